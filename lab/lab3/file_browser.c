@@ -1,58 +1,232 @@
 /*
  * FILE: file_browser.c 
  *
- * Description: A simple, iterative HTTP/1.0 Web server that uses the
+ * Description: A simple HTTP/1.1 Web server that uses the
  * GET method to serve static and dynamic content.
  *
+ * The requests are served by a fixed number of pre-forked worker processes,
+ * one per CPU by default. Every worker is pinned to a CPU and accepts on its
+ * own listening socket, all bound to the same port with SO_REUSEPORT so the
+ * kernel spreads the connections over them. A worker which dies is forked
+ * again by the master process. With 0 workers a child process is forked for
+ * every connection instead, and serves one request on it.
+ *
+ * Every worker is a single threaded event loop built on epoll. The client
+ * connections are nonblocking and persistent (HTTP/1.1 keep-alive): the
+ * received bytes are buffered per connection, so a request may arrive in
+ * pieces and several pipelined requests may arrive at once. The parser is a
+ * state machine which resumes where it stopped when more bytes arrive, and
+ * points into the buffer instead of copying. The requests of a connection
+ * are answered in order, the next one only once the response to the
+ * previous one is written. A response is built in the connection's
+ * write buffer, followed by the body of the file served, and is written
+ * whenever the connection is writable. The file body is sent with
+ * sendfile() straight from the page cache, and a single byte range of it
+ * can be requested with a Range header. Connections idle for IDLE_TIMEOUT
+ * seconds are closed.
+ *
+ * Every worker keeps an LRU cache of the files it serves: the open
+ * descriptor, the status, the pre-rendered headers and, for small files,
+ * the content, so a hit on a small file costs one writev() call. inotify
+ * watches on the directories of the cached files remove the changed ones.
+ * Directory listings are cached too, each sort order and page rendered once,
+ * until the directory changes. A listing can be sorted by name, size or mtime
+ * and split in pages: /dir/?sort=size&order=desc&page=2.
+ * A client which accepts gzip gets the files and listings of a text type
+ * compressed: a .gz file next to the file is sent when it is not older,
+ * otherwise the worker compresses the content once, up to GZIP_MAX_SIZE
+ * bytes, and keeps it with the cached file within the same memory limit.
+ * Sending SIGUSR1 to the master makes every worker print its cache counters.
+ *
+ * Every response is logged once it is written, as one line of fixed fields:
+ *   2016-04-04T12:00:00.123Z 127.0.0.1 "GET /dir/a.txt" 200 2859 153 Chrome
+ * the time of the response (UTC), the client, the request line, the status,
+ * the bytes sent with the headers, the latency in microseconds from the
+ * complete request to the last byte written, and the browser. A worker never
+ * waits for the log: its lines go into a ring in memory shared with the
+ * master, where a writer thread drains the rings of all the workers with one
+ * writev() call every LOG_FLUSH_INTERVAL ms. A worker whose ring is full drops
+ * the line, and the writer reports the number dropped.
+ *
+ * Usage: file_browser <directory> [port] [workers]
+ *        file_browser --bench [-k] <port> <path> [requests]
+ *        file_browser --bench-parser [parses]
+ * The second form is a load generator which requests path from the server
+ * on the local port at increasing concurrency and reports requests/s and
+ * the latency percentiles of every level. Every request uses a new
+ * connection, or with -k every client keeps its connection open. The third
+ * form measures the request parser alone on a few sample requests.
+ *
+ * Build: gcc -O2 -pthread file_browser.c -o file_browser -lz
+ *
  * Date: April 4, 2016
  */
 
+#define _GNU_SOURCE // sched_setaffinity
 #include <arpa/inet.h> // inet_ntoa
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
+#include <stdarg.h>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h> // IOV_MAX
 #include <time.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
 #include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <string.h>
+#include <zlib.h>
 
 #define LISTENQ 1024 // second argument to listen()
 #define MAXLINE 1024 // max length of a line
-#define RIO_BUFSIZE 1024
 #define true 1
 #define false 0
 #define ERROR -1
 #define OK 1
 #define MAX_CLIENTS 9999
-
-typedef struct
-{
-    int rio_fd;                // descriptor for this buf
-    int rio_cnt;               // unread byte in this buf
-    char *rio_bufptr;          // next unread byte in this buf
-    char rio_buf[RIO_BUFSIZE]; // internal buffer
-} rio_t;
+#define DEFAULT_PORT 9999
+#define MAX_WORKERS 256
+#define CONN_BUFSIZE 8192 // max length of the request headers, pipelined requests wait in this buffer
+#define MAX_EVENTS 64     // max number of events handled by one epoll_wait() call
+#define MAX_CONN_FDS 4096 // a worker refuses connections with a larger descriptor
+#define IDLE_TIMEOUT 5    // seconds a keep-alive connection may stay idle
+#define FILE_CHUNK (1 << 20) // max bytes of a file body sent by one sendfile() call
+#define CACHE_ENTRIES 1024   // max number of files in the cache of a worker, each keeps a descriptor open
+#define CACHE_BUCKETS 2048   // hash buckets of the cache
+#define CACHE_MAX_BYTES (64 << 20) // max memory used by the cached headers and contents of a worker
+#define CACHE_SMALL_FILE 65536     // files up to this size are cached with their content
+#define LISTING_CACHE 32           // max number of directories whose listing a worker caches
+#define LISTING_VIEWS 8            // rendered views (sort order and page) of a listing kept
+#define LISTING_MAX_BYTES (32 << 20) // max memory used by the cached listings of a worker
+#define LISTING_PAGE_SIZE 1000     // entries of a page of a listing, when a page is requested
+#define GZIP_MAX_SIZE (1 << 20)    // larger contents are not compressed by a worker, it would stall its other connections
+#define GZIP_LEVEL 6               // zlib compression level of the contents compressed by a worker
+#define LOG_RING_SIZE (1 << 20)    // bytes of the access log ring of a worker
+#define LOG_LINE_MAX 512           // max length of an access log line
+#define LOG_REQUEST_MAX 256        // max length of the request line kept for the log
+#define LOG_FLUSH_INTERVAL 50      // milliseconds between two drains of the log rings by the writer
+// changes which invalidate the cached files and listings of a watched directory
+#define CACHE_WATCH_EVENTS (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | \
+                            IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+#define BENCH_REQUESTS 2000     // requests issued at every concurrency level of the load generator
+#define BENCH_MAX_CONCURRENCY 64 // the concurrency doubles from 1 up to this
+#define BENCH_PARSES 1000000    // times every sample request is parsed by the parser benchmark
+#define BENCH_PARSE_PIECE 16    // bytes added at a time when the parser benchmark feeds a request in pieces
 
 // simplifies calls to bind(), connect(), and accept()
 typedef struct sockaddr SA;
 
+// a string in the read buffer of a connection, not NUL terminated
+typedef struct
+{
+    const char *ptr;
+    size_t len;
+} str_view;
+
 typedef struct
 {
     char filename[512];
+    str_view query; // the part of the url after '?'
     int browser_index;
-    off_t offset; // for support Range
-    size_t end;
+    int range;    // true if the client asked for a byte range of the file
+    off_t offset; // first byte of the range, -1 for the last end bytes of the file
+    size_t end;   // last byte of the range, SIZE_MAX for up to the end of the file
+    int keep_alive; // true if the connection is kept open after the response
+    int gzip;       // true if the client accepts a gzip encoded response
 } http_request;
 
+// states of the request parser, each one names what the next byte belongs to
+typedef enum
+{
+    PARSE_METHOD,      // method, up to a space
+    PARSE_URL,         // request target, up to a space or the end of the line
+    PARSE_VERSION,     // protocol version, up to the end of the line
+    PARSE_LF,          // line feed after a carriage return
+    PARSE_LINE_START,  // first byte of a header line, or of the blank line which ends the headers
+    PARSE_NAME,        // header name, up to the colon
+    PARSE_VALUE_START, // white space before a header value
+    PARSE_VALUE,       // header value, up to the end of the line
+    PARSE_DONE         // the request is complete
+} parse_state;
+
+// incremental HTTP/1.1 request parser
+// it is fed the same buffer again with more bytes appended, and resumes where it stopped;
+// the fields are views into the buffer, nothing is copied
+typedef struct
+{
+    parse_state state;
+    parse_state after_lf; // state entered after the line feed which ends the current line
+    size_t pos;           // bytes of the buffer parsed, the length of the request once complete
+    size_t mark;          // start of the current token
+    size_t value_end;     // end of the current header value, without its trailing white space
+    str_view method, url, version;
+    str_view name;        // name of the current header
+    str_view user_agent, connection, range, accept_encoding;
+} http_parser;
+
+// an open file in the cache of a worker
+typedef struct cache_entry
+{
+    char filename[512];
+    const char *name;        // the file name without its directory, points into filename
+    int wd;                  // inotify watch on the directory of the file, -1 if the entry is not cached
+    int fd;
+    struct stat st;
+    const char *mime_type;
+    char *data;              // pre-rendered headers of a 200 response, followed by the content of a small file
+    size_t header_len;
+    char *content;           // content of the file in data, NULL if the file is sent with sendfile(),
+                             // a rendered directory listing has no file, its fd is -1
+    size_t size;             // bytes of data, counted against CACHE_MAX_BYTES
+    int refs;                // responses written from the entry, it is freed once evicted and unused
+    struct cache_entry *gzip;        // gzip encoded variant, held by the entry, NULL if there is none
+    int gzip_checked;                // true once the variant has been looked for
+    struct cache_entry *hnext;       // next entry in the same hash bucket
+    struct cache_entry *prev, *next; // LRU list, the most recently used entry first
+} cache_entry;
+
+// state of a client connection
+typedef struct
+{
+    int fd;
+    struct sockaddr_in addr;
+    char rbuf[CONN_BUFSIZE]; // received bytes not handled yet, may hold several pipelined requests
+    size_t rlen;
+    http_parser parser;      // state of the parser on the first request in rbuf
+    char *wbuf;              // response bytes not written yet: headers and generated bodies
+    size_t wlen, woff, wcap;
+    cache_entry *entry;      // file whose body follows wbuf, NULL if none
+    size_t hoff;             // next byte of the pre-rendered headers of entry to write
+    off_t file_off;          // next byte of the file body to write
+    off_t file_end;          // end of the file body
+    int corked;              // true while TCP_CORK holds back partial segments of the response
+    int keep_alive;          // false once the connection must be closed after the current response
+    int single;              // true if the connection serves only one request
+    int peer_closed;         // true once the client has shut down its side
+    uint32_t events;         // events the connection is polled for
+    time_t last_active;      // time of the last read or write, for the idle timeout
+    size_t sent;             // bytes of the current response written
+    int log_status;          // status of the current response, logged once it is written, 0 if none
+    int log_browser;         // browser of the current request
+    struct timespec log_start;           // time the current request was complete
+    char log_request[LOG_REQUEST_MAX];   // method and target of the current request
+} http_conn;
+
 typedef struct
 {
     const char *extension;
@@ -62,16 +236,19 @@ typedef struct
 mime_map meme_types[] = {
     {".css", "text/css"},
     {".gif", "image/gif"},
+    {".gz", "application/gzip"},
     {".htm", "text/html"},
     {".html", "text/html"},
     {".jpeg", "image/jpeg"},
     {".jpg", "image/jpeg"},
+    {".json", "application/json"},
     {".ico", "image/x-icon"},
     {".js", "application/javascript"},
     {".pdf", "application/pdf"},
     {".mp4", "video/mp4"},
     {".png", "image/png"},
     {".svg", "image/svg+xml"},
+    {".txt", "text/plain"},
     {".xml", "text/xml"},
     {NULL, NULL},
 };
@@ -86,6 +263,41 @@ int serverSocketFd;
 // working directory
 char *workingDirectory;
 
+// number of pre-forked workers, 0 forks a child for every connection
+int worker_count;
+// listening socket and pid of every worker
+int worker_listenfd[MAX_WORKERS];
+pid_t worker_pid[MAX_WORKERS];
+
+// epoll instance and connections of a worker, indexed by descriptor
+int epfd;
+http_conn *conn_table[MAX_CONN_FDS];
+
+// cache of the open files of a worker, with the inotify instance which invalidates it
+cache_entry *cache_table[CACHE_BUCKETS];
+cache_entry *cache_head, *cache_tail;
+int cache_count;
+size_t cache_bytes;
+int cache_inotify = -1; // -1 disables the cache
+unsigned long cache_hits, cache_misses, cache_evictions, cache_invalidations;
+
+// set by SIGUSR1, the workers print their cache counters
+volatile sig_atomic_t stats_requested;
+
+// access log ring of a worker, in memory shared with the master
+// the worker appends lines at head and the writer thread of the master removes them at tail,
+// each of them publishes its index with a release store, so neither waits for the other
+typedef struct
+{
+    size_t head;           // bytes ever appended, only written by the worker
+    size_t tail;           // bytes ever written out, only written by the writer
+    unsigned long dropped; // lines lost because the ring was full
+    char buf[LOG_RING_SIZE];
+} log_ring;
+
+log_ring *log_rings; // one per worker, NULL in fork mode where every line is written at once
+log_ring *log_own;   // ring of this worker
+
 // Support Browsers
 char const *browsers[5] = {"Safari", "Chrome", "IE", "Firefox", "Others"};
 
@@ -94,14 +306,6 @@ void showErrorAndExit(char *msg)
     perror(msg);
     exit(0);
 }
-// set up an empty read buffer and associates an open file descriptor with that buffer
-void rio_readinitb(rio_t *rp, int fd)
-{
-    rp->rio_fd = fd;
-    rp->rio_cnt = 0;
-    rp->rio_bufptr = rp->rio_buf;
-}
-
 // utility function for writing user buffer into a file descriptor
 ssize_t written(int fd, void *usrbuf, size_t n)
 {
@@ -124,71 +328,6 @@ ssize_t written(int fd, void *usrbuf, size_t n)
     return n;
 }
 
-/*
- *    This is a wrapper for the Unix read() function that
- *    transfers min(n, rio_cnt) bytes from an internal buffer to a user
- *    buffer, where n is the number of bytes requested by the user and
- *    rio_cnt is the number of unread bytes in the internal buffer. On
- *    entry, rio_read() refills the internal buffer via a call to
- *    read() if the internal buffer is empty.
- */
-static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
-{
-    int cnt;
-    while (rp->rio_cnt <= 0)
-    { // refill if buf is empty
-
-        rp->rio_cnt = read(rp->rio_fd, rp->rio_buf,
-                           sizeof(rp->rio_buf));
-        if (rp->rio_cnt < 0)
-        {
-            if (errno != EINTR) // interrupted by sig handler return
-                return -1;
-        }
-        else if (rp->rio_cnt == 0) // EOF
-            return 0;
-        else
-            rp->rio_bufptr = rp->rio_buf; // reset buffer ptr
-    }
-
-    // copy min(n, rp->rio_cnt) bytes from internal buf to user buf
-    cnt = n;
-    if (rp->rio_cnt < n)
-        cnt = rp->rio_cnt;
-    memcpy(usrbuf, rp->rio_bufptr, cnt);
-    rp->rio_bufptr += cnt;
-    rp->rio_cnt -= cnt;
-    return cnt;
-}
-
-// robustly read a text line (buffered)
-ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
-{
-    int n, rc;
-    char c, *bufp = usrbuf;
-
-    for (n = 1; n < maxlen; n++)
-    {
-        if ((rc = rio_read(rp, &c, 1)) == 1)
-        {
-            *bufp++ = c;
-            if (c == '\n')
-                break;
-        }
-        else if (rc == 0)
-        {
-            if (n == 1)
-                return 0; // EOF, no data read
-            else
-                break; // EOF, some data was read
-        }
-        else
-            return -1; // error
-    }
-    *bufp = 0;
-    return n;
-}
-
 // utility function to get the format size
 void format_size(char *buf, struct stat *stat)
 {
@@ -218,46 +357,6 @@ void format_size(char *buf, struct stat *stat)
     }
 }
 
-// pre-process files in the "home" directory and send the list to the client
-void handle_directory_request(int out_fd, int dir_fd, char *filename)
-{
-
-    // send response headers to client e.g., "HTTP/1.1 200 OK\r\n"
-    char buf[MAXLINE];
-    DIR *dir;
-    struct dirent *dir_ptr;
-
-    sprintf(buf, "HTTP/1.1 200 OK\r\n");
-    write(out_fd, buf, strlen(buf));
-
-    sprintf(buf, "\r\n");
-    write(out_fd, buf, strlen(buf));
-
-    // get file directory
-    if ((dir = opendir(filename)) == NULL)
-        showErrorAndExit("Open directory fail!\n");
-
-    // read directory
-    while (dir_ptr = readdir(dir))
-    {
-        if (strcmp(dir_ptr->d_name, ".") == 0 || strcmp(dir_ptr->d_name, "..") == 0)
-            continue;
-
-        // send the file buffers to the client
-        if (dir_ptr->d_type == DT_DIR || dir_ptr->d_type == DT_REG)
-        {
-            if (strcmp(filename, "./") == 0)
-                filename += 2;
-            else
-                filename++;
-
-            sprintf(buf, "<a href=\"%s/%s\">%s</a><br>", filename, dir_ptr->d_name, dir_ptr->d_name);
-            write(out_fd, buf, strlen(buf));
-        }
-    }
-    // send recent browser data to the client
-}
-
 // utility function to get the MIME (Multipurpose Internet Mail Extensions) type
 static const char *get_mime_type(char *filename)
 {
@@ -277,11 +376,31 @@ static const char *get_mime_type(char *filename)
     return default_mime_type;
 }
 
+// return true if a MIME type is text, which is worth compressing
+int is_compressible(const char *mime_type)
+{
+    return strncmp(mime_type, "text/", 5) == 0 || strstr(mime_type, "javascript") || strstr(mime_type, "json") ||
+           strstr(mime_type, "xml");
+}
+
 // open a listening socket descriptor using the specified port number.
-int open_listenfd(int port)
+// with reuseport set, several sockets can listen on the same port and the kernel
+// spreads the incoming connections over them
+int open_listenfd(int port, int reuseport)
 {
+    int optval = 1;
+
     server_port_number = port;
+    // create a socket descriptor
     serverSocketFd = socket(AF_INET, SOCK_STREAM, 0);
+
+    // eliminate "Address already in use" error from bind.
+    setsockopt(serverSocketFd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+    if (reuseport && setsockopt(serverSocketFd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0)
+        showErrorAndExit("SO_REUSEPORT is not supported");
+
+    // Listenfd will be an endpoint for all requests to port
+    // on any IP address for this host
     bzero((char *)&serverAddress, sizeof(serverAddress));
     serverAddress.sin_family = AF_INET;
     serverAddress.sin_addr.s_addr = INADDR_ANY;
@@ -292,254 +411,2417 @@ int open_listenfd(int port)
         sprintf(buffer, "Error in binding to port %d \n", port);
         showErrorAndExit(buffer);
     }
-    listen(serverSocketFd, MAX_CLIENTS);
-    printf("Started listening at port %d for http requests \n", server_port_number);
 
-    // create a socket descriptor
+    // make it a listening socket ready to accept connection requests
+    listen(serverSocketFd, MAX_CLIENTS);
+    return serverSocketFd;
+}
 
-    // eliminate "Address already in use" error from bind.
+// return the value of a hexadecimal digit, -1 if c is none
+int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
 
-    // 6 is TCP's protocol number
-    // enable this, much faster : 4000 req/s -> 17000 req/s
+// decode url: the file name is the working directory followed by the path of the url,
+// with its %XX escapes decoded ("%00" is kept as is, a file name can not hold a NUL)
+// return false if the file name does not fit in max bytes
+int url_decode(str_view src, char *dest, int max)
+{
+    int n, hi, lo;
+    size_t i;
 
-    // Listenfd will be an endpoint for all requests to port
-    // on any IP address for this host
+    if (src.len > 0 && *src.ptr == '/')
+    {
+        src.ptr++;
+        src.len--;
+    }
 
-    // make it a listening socket ready to accept connection requests
+    if ((n = snprintf(dest, max, "%s", workingDirectory)) >= max)
+        return false;
+    for (i = 0; i < src.len; i++)
+    {
+        if (n == max - 1)
+            return false;
+        if (src.ptr[i] == '%' && i + 2 < src.len &&
+            (hi = hex_value(src.ptr[i + 1])) >= 0 && (lo = hex_value(src.ptr[i + 2])) >= 0 && (hi || lo))
+        {
+            dest[n++] = hi * 16 + lo;
+            i += 2;
+        }
+        else
+            dest[n++] = src.ptr[i];
+    }
+    dest[n] = '\0';
+    return true;
 }
 
-// decode url
-void url_decode(char *src, char *dest, int max)
+// hash a file name for the cache table (FNV-1a)
+unsigned int cache_hash(const char *filename)
 {
-    if (*src == '/')
-        src++;
+    unsigned int hash = 2166136261u;
 
-    snprintf(dest, max, "%s%s", workingDirectory, src);
+    while (*filename)
+        hash = (hash ^ (unsigned char)*filename++) * 16777619u;
+    return hash % CACHE_BUCKETS;
 }
 
-// parse request to get url
-void parse_request(int fd, http_request *req)
+void cache_release(cache_entry *entry);
+
+// free an entry which is neither cached nor used by a response
+void cache_free(cache_entry *entry)
 {
+    if (entry->fd >= 0)
+        close(entry->fd);
+    if (entry->gzip)
+        cache_release(entry->gzip);
+    free(entry->data);
+    free(entry);
+}
 
-    // Rio (Robust I/O) Buffered Input Functions
-    rio_t rp;
-    char buf[256], url[128], *token;
-    int i, browser_index;
+// remove an entry from the cache, it is freed once the last response using it is written
+void cache_remove(cache_entry *entry)
+{
+    cache_entry **p = &cache_table[cache_hash(entry->filename)];
 
-    rio_readinitb(&rp, fd);
+    while (*p != entry)
+        p = &(*p)->hnext;
+    *p = entry->hnext;
 
-    // read all
-    rio_readlineb(&rp, buf, sizeof(buf)); // parser request line
-    token = strtok(buf, " ");             // method
-    if (strcmp(token, "GET") == 0)
-    {
-        token = strtok(NULL, " "); // url
-        memcpy(url, token, sizeof(url));
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        cache_head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        cache_tail = entry->prev;
 
-        while (rio_readlineb(&rp, buf, sizeof(buf)) > 0) // parser header line
-        {
-            token = strtok(buf, " ");
-            if (strcmp(token, "User-Agent:") == 0)
-            {
-                while (token = strtok(NULL, " ")) // Detect browser
-                {
-                    i = 0;
-                    while (i < 4)
-                    {
-                        if (strstr(token, browsers[i]))
-                            break;
+    cache_count--;
+    cache_bytes -= entry->size;
+    entry->wd = -1;
+    if (entry->refs == 0)
+        cache_free(entry);
+}
 
-                        i++;
-                    }
+// release an entry used by a response
+void cache_release(cache_entry *entry)
+{
+    if (--entry->refs == 0 && entry->wd < 0)
+        cache_free(entry);
+}
 
-                    if (i < 4)
-                        break;
-                }
+// move an entry to the front of the LRU list
+void cache_touch(cache_entry *entry)
+{
+    if (entry == cache_head)
+        return;
 
-                browser_index = i;
+    entry->prev->next = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        cache_tail = entry->prev;
 
-                break;
-            }
-        }
+    entry->prev = NULL;
+    entry->next = cache_head;
+    cache_head->prev = entry;
+    cache_head = entry;
+}
 
-        // update recent browser data
-        req->browser_index = browser_index;
-        // decode url
-        url_decode(url, req->filename, sizeof(req->filename));
-    }
-    else
+// evict the least recently used entries beyond the limits of the cache, up to keep
+void cache_shrink(cache_entry *keep)
+{
+    while (cache_tail != keep && (cache_count > CACHE_ENTRIES || cache_bytes > CACHE_MAX_BYTES))
     {
-        showErrorAndExit("The server only support GET method\n");
+        cache_remove(cache_tail);
+        cache_evictions++;
     }
 }
 
-// log files
-void log_access(int status, struct sockaddr_in *c_addr, http_request *req)
+// add an entry to the cache, evicting the least recently used entries beyond the limits
+void cache_insert(cache_entry *entry)
 {
-    printf("%s %d %s %s\n", req->filename, status, inet_ntoa(c_addr->sin_addr), browsers[req->browser_index]);
-}
+    unsigned int bucket = cache_hash(entry->filename);
 
-// echo client error e.g. 404
-void client_error(int fd, int status, char *msg, char *longmsg)
-{
-    char buf[256];
-    sprintf(buf, "HTTP/1.1 %d %s\r\n", status, msg);
-    printf("%s\n", buf); // error log
-    written(fd, buf, strlen(buf));
-    sprintf(buf, "\r\n%s", longmsg);
-    written(fd, buf, strlen(buf));
+    entry->hnext = cache_table[bucket];
+    cache_table[bucket] = entry;
+
+    entry->prev = NULL;
+    entry->next = cache_head;
+    if (cache_head)
+        cache_head->prev = entry;
+    else
+        cache_tail = entry;
+    cache_head = entry;
+
+    cache_count++;
+    cache_bytes += entry->size;
+    cache_shrink(entry);
 }
 
-// serve static content
-void serve_static(int out_fd, int in_fd, http_request *req,
-                  size_t total_size)
+// get the file of a request from the cache of the worker, opening it on a miss
+// return the entry of a regular file, released with cache_release() once its response is written,
+// or NULL with *fd the open descriptor of anything else, -1 if it can not be opened, and *st its status
+// without a cache (fork mode, or the directory can not be watched) the entry is used once and freed
+cache_entry *cache_open(const char *filename, int *fd, struct stat *st)
 {
+    cache_entry *entry;
+    const char *dir;
+    char *slash;
 
-    size_t read_size;
-    char buf[MAXLINE];
-    // send response headers to client e.g., "HTTP/1.1 200 OK\r\n"
-    sprintf(buf, "HTTP/1.1 200 OK\r\n");
-    written(out_fd, buf, strlen(buf));
+    if (cache_inotify >= 0)
+    {
+        for (entry = cache_table[cache_hash(filename)]; entry != NULL; entry = entry->hnext)
+        {
+            if (strcmp(entry->filename, filename) == 0)
+            {
+                cache_hits++;
+                cache_touch(entry);
+                entry->refs++;
+                return entry;
+            }
+        }
+        cache_misses++;
+    }
 
-    sprintf(buf, "Content-Type: %s\r\n", get_mime_type(req->filename));
-    written(out_fd, buf, strlen(buf));
+    if ((*fd = open(filename, O_RDONLY, 0)) < 0)
+        return NULL;
+    fstat(*fd, st);
+    if (!S_ISREG(st->st_mode))
+        return NULL;
 
-    sprintf(buf, "Content-Length: %ld\r\n", total_size);
-    written(out_fd, buf, strlen(buf));
+    entry = calloc(1, sizeof(cache_entry));
+    if (entry == NULL)
+        showErrorAndExit("Error in allocating a cache entry");
+    snprintf(entry->filename, sizeof(entry->filename), "%s", filename);
+    slash = strrchr(entry->filename, '/');
+    entry->name = slash ? slash + 1 : entry->filename;
+    entry->fd = *fd;
+    entry->st = *st;
+    entry->mime_type = get_mime_type(entry->filename);
+    entry->refs = 1;
+    entry->wd = -1;
 
-    sprintf(buf, "\r\n");
-    written(out_fd, buf, strlen(buf));
+    // render the headers which follow the status line and the Connection header
+    entry->data = malloc(MAXLINE + (st->st_size <= CACHE_SMALL_FILE ? st->st_size : 0));
+    if (entry->data == NULL)
+        showErrorAndExit("Error in allocating a cache entry");
+    entry->header_len = snprintf(entry->data, MAXLINE,
+                                 "Accept-Ranges: bytes\r\nContent-Type: %s\r\nVary: Accept-Encoding\r\nContent-Length: %lld\r\n\r\n",
+                                 entry->mime_type, (long long)st->st_size);
+    entry->size = entry->header_len;
 
-    // send response body to client
-    rio_t rp;
-    rio_readinitb(&rp, in_fd);
+    // keep the content of a small file, a hit is then written with one writev() call
+    if (st->st_size <= CACHE_SMALL_FILE &&
+        pread(*fd, entry->data + entry->header_len, st->st_size, 0) == st->st_size)
+    {
+        entry->content = entry->data + entry->header_len;
+        entry->size += st->st_size;
+    }
 
-    while ((read_size = rio_read(&rp, buf, MAXLINE)) > 0)
+    // a change to the file is reported by the watch on its directory
+    if (cache_inotify >= 0)
     {
-        written(out_fd, buf, read_size);
+        if (slash == NULL)
+            dir = ".";
+        else if (slash == entry->filename)
+            dir = "/";
+        else
+        {
+            *slash = '\0';
+            dir = entry->filename;
+        }
+        entry->wd = inotify_add_watch(cache_inotify, dir, CACHE_WATCH_EVENTS);
+        if (slash)
+            *slash = '/';
+        if (entry->wd >= 0)
+            cache_insert(entry);
     }
+    return entry;
 }
 
-// handle one HTTP request/response transaction
-void process(int fd, struct sockaddr_in *clientaddr)
+// make the gzip encoded variant of an entry, size bytes long, with its headers rendered and
+// followed by room for its content unless it is sent from fd
+cache_entry *gzip_variant(cache_entry *entry, size_t size, int fd)
 {
-    printf("accept request, fd is %d, pid is %d\n", fd, getpid());
-    http_request req;
-    parse_request(fd, &req);
+    cache_entry *gz = calloc(1, sizeof(cache_entry));
+    size_t room = fd < 0 ? size : 0;
 
-    struct stat sbuf;
-    int status = 200; //server status init as 200
-    int ffd = open(req.filename, O_RDONLY, 0);
-    if (ffd <= 0)
+    if (gz == NULL || (gz->data = malloc(MAXLINE + room)) == NULL)
+        showErrorAndExit("Error in allocating a cache entry");
+    memcpy(gz->filename, entry->filename, sizeof(gz->filename));
+    gz->name = gz->filename + (entry->name - entry->filename);
+    gz->fd = fd;
+    gz->wd = -1;
+    gz->refs = 1; // held by the entry
+    gz->st = entry->st;
+    gz->st.st_size = size;
+    gz->mime_type = entry->mime_type;
+    gz->header_len = snprintf(gz->data, MAXLINE,
+                              "Content-Type: %s\r\nContent-Encoding: gzip\r\nVary: Accept-Encoding\r\nContent-Length: %zu\r\n\r\n",
+                              gz->mime_type, size);
+    if (fd < 0)
+        gz->content = gz->data + gz->header_len;
+    gz->size = gz->header_len + room;
+    return gz;
+}
+
+// return the gzip encoded variant of an entry, looked for on first use and kept with the entry:
+// the file with a .gz suffix next to the file, unless it is older, or else the content compressed
+// by the worker if its type is text and it holds at most GZIP_MAX_SIZE bytes
+// the memory of the variant is added to the size of the entry
+// return NULL if there is no variant, or compressing does not save a tenth of the bytes
+cache_entry *cache_gzip(cache_entry *entry)
+{
+    char gzname[sizeof(entry->filename) + 3], *src = entry->content, *dest;
+    size_t len = entry->st.st_size, bound, n = 0;
+    struct stat st;
+    z_stream zs;
+    int fd;
+
+    if (entry->gzip_checked)
+        return entry->gzip;
+    entry->gzip_checked = true;
+
+    // a precompressed file, sent like the file itself: from memory if it is small
+    if (entry->fd >= 0 && snprintf(gzname, sizeof(gzname), "%s.gz", entry->filename) < (int)sizeof(gzname) &&
+        (fd = open(gzname, O_RDONLY, 0)) >= 0)
     {
-        // detect 404 error and print error log
-        status = 404;
-        client_error(fd, status, "Not Found", "Server has not found that file, maybe remove, change name, or delete.");
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_mtime >= entry->st.st_mtime)
+        {
+            if (st.st_size > CACHE_SMALL_FILE)
+                entry->gzip = gzip_variant(entry, st.st_size, fd);
+            else
+            {
+                entry->gzip = gzip_variant(entry, st.st_size, -1);
+                if (pread(fd, entry->gzip->content, st.st_size, 0) != st.st_size)
+                {
+                    cache_free(entry->gzip);
+                    entry->gzip = NULL;
+                }
+                close(fd);
+            }
+        }
+        else
+            close(fd);
     }
-    else
+
+    if (entry->gzip == NULL && is_compressible(entry->mime_type) && len <= GZIP_MAX_SIZE)
     {
-        // get descriptor status
-        fstat(ffd, &sbuf);
-        if (S_ISREG(sbuf.st_mode))
+        if (src == NULL && (src = malloc(len)) != NULL && pread(entry->fd, src, len, 0) != (ssize_t)len)
         {
-            // server serves static content
-            serve_static(fd, ffd, &req, sbuf.st_size);
+            free(src);
+            src = NULL;
         }
-        else if (S_ISDIR(sbuf.st_mode))
+        memset(&zs, 0, sizeof(zs));
+        // 16 added to the window bits asks for a gzip header and trailer instead of a zlib one
+        if (src && deflateInit2(&zs, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK)
         {
-            // server handle directory request
-            handle_directory_request(fd, ffd, req.filename);
+            bound = deflateBound(&zs, len);
+            if ((dest = malloc(bound)) != NULL)
+            {
+                zs.next_in = (Bytef *)src;
+                zs.avail_in = len;
+                zs.next_out = (Bytef *)dest;
+                zs.avail_out = bound;
+                if (deflate(&zs, Z_FINISH) == Z_STREAM_END && zs.total_out < len - len / 10)
+                    n = zs.total_out;
+            }
+            deflateEnd(&zs);
+            if (n > 0)
+            {
+                entry->gzip = gzip_variant(entry, n, -1);
+                memcpy(entry->gzip->content, dest, n);
+            }
+            free(dest);
         }
-        else
+        if (src != entry->content)
+            free(src);
+    }
+
+    if (entry->gzip)
+    {
+        entry->size += entry->gzip->size;
+        if (entry->wd >= 0)
         {
-            // detect 400 error and print error log
-            status = 400;
-            client_error(fd, status, "Not Found", NULL);
+            cache_bytes += entry->gzip->size;
+            cache_shrink(entry);
         }
-
-        close(ffd);
     }
-
-    // print log/status on the terminal
-    log_access(status, clientaddr, &req);
+    return entry->gzip;
 }
 
-int checkAndUpdateUserInput(int argc, char **argv)
+// append n bytes to the write buffer of a connection
+void conn_append(http_conn *conn, const char *data, size_t n)
 {
-    int result = ERROR;
-    int default_port = 9999;
-    if (argc == 1)
-    {
-        showErrorAndExit("Working directory is required and port number is optional\n");
-        return result;
-    }
-    if (argc == 2)
+    if (conn->wlen + n > conn->wcap)
     {
-        printf("Setting default port number to %d\n", default_port);
-        workingDirectory = argv[1];
-        server_port_number = default_port;
-        result = OK;
-        return result;
+        while (conn->wlen + n > conn->wcap)
+            conn->wcap = conn->wcap ? conn->wcap * 2 : CONN_BUFSIZE;
+        conn->wbuf = realloc(conn->wbuf, conn->wcap);
+        if (conn->wbuf == NULL)
+            showErrorAndExit("Error in allocating a response buffer");
     }
-    if (argc == 3)
+    memcpy(conn->wbuf + conn->wlen, data, n);
+    conn->wlen += n;
+}
+
+// append formatted text to the write buffer of a connection
+void conn_printf(http_conn *conn, const char *format, ...)
+{
+    char buf[2 * MAXLINE];
+    va_list args;
+    int n;
+
+    va_start(args, format);
+    n = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+
+    if (n >= (int)sizeof(buf))
+        n = sizeof(buf) - 1;
+    if (n > 0)
+        conn_append(conn, buf, n);
+}
+
+// set or clear TCP_CORK on a connection
+// while corked, the kernel only sends full segments, so the headers and the start of the
+// file body leave in the same segment
+void conn_cork(http_conn *conn, int cork)
+{
+    if (conn->corked != cork)
     {
-        workingDirectory = argv[1];
-        server_port_number = atoi(argv[2]);
-        result = OK;
-        return result;
+        setsockopt(conn->fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+        conn->corked = cork;
     }
 }
-// main function:
-// get the user input for the file directory and port number
-int main(int argc, char **argv)
+
+// write the pending response of a connection: the write buffer, the pre-rendered headers of the
+// file served, then its body
+// everything held in memory goes out with one writev() call, a body which is not is sent with
+// sendfile(), the kernel copies it from the page cache to the socket
+// return OK once all is written, false if the socket would block, ERROR if the connection failed
+int conn_flush(http_conn *conn)
 {
-    struct sockaddr_in clientAddress;
-    int client = sizeof(clientAddress);
-    int clientSocketFd;
-    int clientPID;
-    int listenfd, connfd;
-    char buf[256];
-    checkAndUpdateUserInput(argc, argv);
-    printf("Server working directory is %s\n", workingDirectory);
-    printf("Server listening port is %d\n", server_port_number);
-    // get the name of the current working directory
-    // user input checking
+    cache_entry *entry = conn->entry;
+    struct iovec iov[3];
+    ssize_t n;
+    size_t chunk, part;
+    int cnt;
+
+    if (entry && entry->content == NULL)
+        conn_cork(conn, true);
 
-    // ignore SIGPIPE signal, so if browser cancels the request, it
-    // won't kill the whole process.
-    signal(SIGPIPE, SIG_IGN);
-    open_listenfd(server_port_number);
     while (1)
     {
-        // permit an incoming connection attempt on a socket.
-        clientSocketFd = accept(serverSocketFd, (struct sockaddr *)&clientAddress, &client);
-        if (clientSocketFd >= 0)
+        cnt = 0;
+        if (conn->woff < conn->wlen)
         {
-            // fork children to handle parallel clients
-            // handle one HTTP request/response transaction
-            clientPID = fork();
-            if (clientPID < 0)
-            {
-                char buffer[256];
-                sprintf(buffer, "Error in binding to port %d \n", clientSocketFd);
-                showErrorAndExit(buffer);
-            }
-            if (clientPID == 0)
-            {
-                close(serverSocketFd);
-                process(clientSocketFd, &clientAddress);
-                exit(0);
-            }
-            else
-            {
-                close(clientSocketFd);
-            }
+            iov[cnt].iov_base = conn->wbuf + conn->woff;
+            iov[cnt++].iov_len = conn->wlen - conn->woff;
         }
-        else
+        if (entry && conn->hoff < entry->header_len)
         {
-            printf("Error in accepting client \n");
+            iov[cnt].iov_base = entry->data + conn->hoff;
+            iov[cnt++].iov_len = entry->header_len - conn->hoff;
         }
-    }
+        if (entry && entry->content && conn->file_off < conn->file_end)
+        {
+            iov[cnt].iov_base = entry->content + conn->file_off;
+            iov[cnt++].iov_len = conn->file_end - conn->file_off;
+        }
+        if (cnt == 0)
+            break;
 
-    return 0;
-}
\ No newline at end of file
+        if ((n = writev(conn->fd, iov, cnt)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? false : ERROR;
+        }
+        conn->last_active = time(NULL);
+        conn->sent += n;
+
+        // consume the bytes written from the parts in order
+        part = conn->wlen - conn->woff;
+        if ((size_t)n < part)
+        {
+            conn->woff += n;
+            continue;
+        }
+        n -= part;
+        conn->woff = conn->wlen = 0;
+        if (entry)
+        {
+            part = entry->header_len - conn->hoff;
+            if ((size_t)n < part)
+            {
+                conn->hoff += n;
+                continue;
+            }
+            conn->hoff = entry->header_len;
+            conn->file_off += n - part;
+        }
+    }
+
+    while (entry && conn->file_off < conn->file_end)
+    {
+        chunk = conn->file_end - conn->file_off < FILE_CHUNK ? conn->file_end - conn->file_off : FILE_CHUNK;
+        if ((n = sendfile(conn->fd, entry->fd, &conn->file_off, chunk)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? false : ERROR;
+        }
+        if (n == 0)
+            return ERROR; // the file was truncated, the promised Content-Length can not be sent
+        conn->last_active = time(NULL);
+        conn->sent += n;
+    }
+
+    if (entry)
+    {
+        cache_release(entry);
+        conn->entry = NULL;
+    }
+    // send the last partial segment now
+    conn_cork(conn, false);
+    return OK;
+}
+
+// reset a parser for the next request
+void http_parser_init(http_parser *parser)
+{
+    memset(parser, 0, sizeof(http_parser));
+    parser->state = PARSE_METHOD;
+}
+
+// create the state of a client connection
+// Nagle's algorithm is turned off, it would hold back the last segment of a response until the
+// client acknowledges the previous one, and the client delays that acknowledgement
+http_conn *conn_create(int fd, struct sockaddr_in *clientaddr)
+{
+    http_conn *conn = calloc(1, sizeof(http_conn));
+    int optval = 1;
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+
+    if (conn == NULL)
+        showErrorAndExit("Error in allocating a connection");
+    conn->fd = fd;
+    conn->addr = *clientaddr;
+    conn->keep_alive = true;
+    conn->last_active = time(NULL);
+    http_parser_init(&conn->parser);
+    return conn;
+}
+
+// close a client connection and free its state
+void conn_close(http_conn *conn)
+{
+    if (conn->entry)
+        cache_release(conn->entry);
+    close(conn->fd);
+    free(conn->wbuf);
+    free(conn);
+}
+
+// classes of the bytes of a request, looked up by the parser for every byte
+#define CHAR_TOKEN 1   // may appear in a method or a header name (an RFC 7230 tchar)
+#define CHAR_VISIBLE 2 // may appear in a request target or a header value, any byte of a UTF-8 sequence too
+#define CHAR_SPACE 4   // white space inside a header value
+const unsigned char char_class[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    4, 3, 2, 3, 3, 3, 3, 3, 2, 2, 3, 3, 2, 3, 3, 2,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2,
+    2, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 2, 2, 2, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 2, 3, 2, 3, 0,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+};
+
+// return true if c belongs to the given classes
+#define char_is(c, classes) (char_class[(unsigned char)(c)] & (classes))
+
+// return true if a view equals str, ignoring case
+int view_equals(str_view view, const char *str)
+{
+    return view.len == strlen(str) && strncasecmp(view.ptr, str, view.len) == 0;
+}
+
+// make a view of the bytes of buf from start to end
+str_view make_view(const char *buf, size_t start, size_t end)
+{
+    str_view view = {buf + start, end - start};
+    return view;
+}
+
+// keep the value of the header just parsed if the server uses it
+void http_parser_header(http_parser *parser, str_view value)
+{
+    if (view_equals(parser->name, "User-Agent"))
+        parser->user_agent = value;
+    else if (view_equals(parser->name, "Connection"))
+        parser->connection = value;
+    else if (view_equals(parser->name, "Range"))
+        parser->range = value;
+    else if (view_equals(parser->name, "Accept-Encoding"))
+        parser->accept_encoding = value;
+}
+
+// parse the request at the start of buf, holding len bytes, from where the last call stopped
+// every state scans its whole token in a tight loop before it looks at the byte which ends it
+// return OK once the request is complete, parser->pos is then its length,
+// false if more bytes are needed, ERROR if the request is malformed
+int http_parse(http_parser *parser, const char *buf, size_t len)
+{
+    size_t i = parser->pos, end;
+    char c;
+
+    while (i < len && parser->state != PARSE_DONE)
+    {
+        switch (parser->state)
+        {
+        case PARSE_METHOD:
+            while (i < len && char_is(buf[i], CHAR_TOKEN))
+                i++;
+            if (i == len)
+                break;
+            if (buf[i] != ' ' || i == parser->mark)
+                return ERROR;
+            parser->method = make_view(buf, parser->mark, i);
+            parser->mark = ++i;
+            parser->state = PARSE_URL;
+            break;
+
+        case PARSE_URL:
+            while (i < len && char_is(buf[i], CHAR_VISIBLE))
+                i++;
+            if (i == len)
+                break;
+            c = buf[i];
+            if ((c != ' ' && c != '\r' && c != '\n') || i == parser->mark)
+                return ERROR;
+            parser->url = make_view(buf, parser->mark, i);
+            parser->mark = ++i;
+            // a request line without a version is an HTTP/0.9 request
+            parser->state = c == ' ' ? PARSE_VERSION : c == '\r' ? PARSE_LF : PARSE_LINE_START;
+            parser->after_lf = PARSE_LINE_START;
+            break;
+
+        case PARSE_VERSION:
+            while (i < len && char_is(buf[i], CHAR_VISIBLE))
+                i++;
+            if (i == len)
+                break;
+            c = buf[i];
+            parser->version = make_view(buf, parser->mark, i);
+            if ((c != '\r' && c != '\n') || parser->version.len != 8 || strncmp(parser->version.ptr, "HTTP/", 5) != 0)
+                return ERROR;
+            i++;
+            parser->state = c == '\r' ? PARSE_LF : PARSE_LINE_START;
+            parser->after_lf = PARSE_LINE_START;
+            break;
+
+        case PARSE_LF:
+            if (buf[i++] != '\n')
+                return ERROR;
+            parser->state = parser->after_lf;
+            break;
+
+        case PARSE_LINE_START:
+            c = buf[i];
+            if (c == '\r')
+            {
+                parser->state = PARSE_LF;
+                parser->after_lf = PARSE_DONE;
+            }
+            else if (c == '\n')
+                parser->state = PARSE_DONE;
+            else if (char_is(c, CHAR_TOKEN)) // a line starting with white space would be an obsolete folded header
+            {
+                parser->mark = i;
+                parser->state = PARSE_NAME;
+            }
+            else
+                return ERROR;
+            i++;
+            break;
+
+        case PARSE_NAME:
+            while (i < len && char_is(buf[i], CHAR_TOKEN))
+                i++;
+            if (i == len)
+                break;
+            if (buf[i] != ':')
+                return ERROR;
+            parser->name = make_view(buf, parser->mark, i);
+            parser->state = PARSE_VALUE_START;
+            i++;
+            break;
+
+        case PARSE_VALUE_START:
+            while (i < len && (buf[i] == ' ' || buf[i] == '\t'))
+                i++;
+            if (i == len)
+                break;
+            parser->mark = parser->value_end = i;
+            parser->state = PARSE_VALUE;
+            break;
+
+        case PARSE_VALUE:
+            // white space inside the value is kept, only the trailing one is dropped
+            end = parser->value_end;
+            while (i < len && char_is(buf[i], CHAR_VISIBLE | CHAR_SPACE))
+            {
+                if (char_is(buf[i], CHAR_VISIBLE))
+                    end = i + 1;
+                i++;
+            }
+            parser->value_end = end;
+            if (i == len)
+                break;
+            c = buf[i];
+            if (c != '\r' && c != '\n')
+                return ERROR;
+            http_parser_header(parser, make_view(buf, parser->mark, end));
+            parser->state = c == '\r' ? PARSE_LF : PARSE_LINE_START;
+            parser->after_lf = PARSE_LINE_START;
+            i++;
+            break;
+
+        case PARSE_DONE:
+            break;
+        }
+    }
+
+    parser->pos = i;
+    return parser->state == PARSE_DONE ? OK : false;
+}
+
+// parse the value of a Range header: "bytes=first-last", "bytes=first-" or "bytes=-suffix"
+// a header with several ranges or a syntax error is ignored, the whole file is sent then
+void parse_range(str_view view, http_request *req)
+{
+    unsigned long long first, last;
+    char value[64], *end, *p;
+
+    if (view.len >= sizeof(value))
+        return;
+    memcpy(value, view.ptr, view.len);
+    value[view.len] = '\0';
+    if (strncmp(value, "bytes=", 6) != 0 || strchr(value, ',') != NULL)
+        return;
+    p = value + 6;
+
+    if (*p == '-') // the last bytes of the file
+    {
+        last = strtoull(p + 1, &end, 10);
+        if (end == p + 1 || *end != '\0')
+            return;
+        req->offset = -1;
+        req->end = last;
+    }
+    else
+    {
+        first = strtoull(p, &end, 10);
+        if (end == p || *end != '-' || (off_t)first < 0)
+            return;
+        p = end + 1;
+        if (*p == '\0')
+            last = SIZE_MAX;
+        else
+        {
+            last = strtoull(p, &end, 10);
+            if (*end != '\0' || last < first)
+                return;
+        }
+        req->offset = first;
+        req->end = last;
+    }
+    req->range = true;
+}
+
+// return the index of the browser named by the first word of a User-Agent value naming one,
+// 4 ("Others") if none does
+int detect_browser(str_view agent)
+{
+    const char *p = agent.ptr, *end = agent.ptr + agent.len, *word;
+
+    while (p < end)
+    {
+        word = p;
+        while (p < end && *p != ' ')
+            p++;
+        for (int i = 0; i < 4; i++)
+        {
+            if (memmem(word, p - word, browsers[i], strlen(browsers[i])))
+                return i;
+        }
+        p++;
+    }
+    return 4;
+}
+
+// return true if the parameters of an item of a list, from p to end, give it a quality of 0 ("q=0", "q=0.000")
+int quality_zero(const char *p, const char *end)
+{
+    char value[8];
+    size_t n;
+
+    for (p++; p + 1 < end; p++)
+    {
+        if ((*p == 'q' || *p == 'Q') && p[1] == '=' && (p[-1] == ';' || p[-1] == ' ' || p[-1] == '\t'))
+        {
+            p += 2;
+            for (n = 0; n < sizeof(value) - 1 && p + n < end && p[n] != ';' && p[n] != ' ' && p[n] != '\t'; n++)
+                value[n] = p[n];
+            value[n] = '\0';
+            return strtod(value, NULL) == 0;
+        }
+    }
+    return false;
+}
+
+// return true if an Accept-Encoding value accepts gzip: it lists "gzip", "x-gzip" or "*"
+// with a quality other than 0, and gzip is not refused by name ("gzip;q=0, *")
+int accepts_gzip(str_view value)
+{
+    const char *p = value.ptr, *end = value.ptr + value.len, *item;
+    int gzip = -1, any = -1;
+    size_t n;
+
+    while (p < end) // the value is a list of codings, each with optional parameters after ';'
+    {
+        while (p < end && (*p == ',' || *p == ' ' || *p == '\t'))
+            p++;
+        item = p;
+        while (p < end && *p != ',')
+            p++;
+        for (n = 0; item + n < p && item[n] != ';' && item[n] != ' ' && item[n] != '\t'; n++)
+            ;
+        if ((n == 4 && strncasecmp(item, "gzip", 4) == 0) || (n == 6 && strncasecmp(item, "x-gzip", 6) == 0))
+            gzip = !quality_zero(item + n, p);
+        else if (n == 1 && *item == '*')
+            any = !quality_zero(item + n, p);
+    }
+    return gzip >= 0 ? gzip : any > 0;
+}
+
+// fill a request from a complete parsed request
+// return ERROR if the method is not GET, false if the url is too long for a file name
+int parse_request(http_parser *parser, http_request *req)
+{
+    str_view url;
+    const char *p, *end;
+    size_t n;
+
+    req->browser_index = detect_browser(parser->user_agent);
+    req->range = false;
+    req->offset = 0;
+    req->end = SIZE_MAX;
+
+    // HTTP/1.1 connections are persistent unless the client asks to close them
+    req->keep_alive = view_equals(parser->version, "HTTP/1.1");
+    p = parser->connection.ptr;
+    end = p + parser->connection.len;
+    while (p < end) // the value is a list of options
+    {
+        while (p < end && (*p == ',' || *p == ' ' || *p == '\t'))
+            p++;
+        for (n = 0; p + n < end && p[n] != ',' && p[n] != ' ' && p[n] != '\t'; n++)
+            ;
+        if (n == 5 && strncasecmp(p, "close", 5) == 0)
+            req->keep_alive = false;
+        else if (n == 10 && strncasecmp(p, "keep-alive", 10) == 0)
+            req->keep_alive = true;
+        p += n;
+    }
+
+    if (parser->method.len != 3 || strncmp(parser->method.ptr, "GET", 3) != 0)
+        return ERROR;
+    if (parser->range.ptr)
+        parse_range(parser->range, req);
+    req->gzip = accepts_gzip(parser->accept_encoding);
+
+    // the query is not part of the file name
+    url = parser->url;
+    req->query.ptr = NULL;
+    req->query.len = 0;
+    if ((p = memchr(url.ptr, '?', url.len)) != NULL)
+    {
+        req->query = make_view(url.ptr, p + 1 - url.ptr, url.len);
+        url.len = p - url.ptr;
+    }
+
+    // decode url
+    return url_decode(url, req->filename, sizeof(req->filename)) ? OK : false;
+}
+
+// append a line to the access log ring of the worker, or drop it if the ring is full
+// in fork mode the line is written at once, one write() keeps it whole
+void log_append(const char *line, size_t n)
+{
+    size_t head, off, part;
+
+    if (log_own == NULL)
+    {
+        written(STDOUT_FILENO, (void *)line, n);
+        return;
+    }
+
+    head = log_own->head;
+    if (LOG_RING_SIZE - (head - __atomic_load_n(&log_own->tail, __ATOMIC_ACQUIRE)) < n)
+    {
+        __atomic_store_n(&log_own->dropped, log_own->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    off = head % LOG_RING_SIZE;
+    part = n < LOG_RING_SIZE - off ? n : LOG_RING_SIZE - off;
+    memcpy(log_own->buf + off, line, part);
+    memcpy(log_own->buf, line + part, n - part);
+    __atomic_store_n(&log_own->head, head + n, __ATOMIC_RELEASE);
+}
+
+// keep the request line of the request parsed at the start of the read buffer for its log line,
+// and start timing it, "-" stands for a request line which could not be parsed
+// a quote in the target is escaped as %22, it would end the field of the log line
+void log_start(http_conn *conn)
+{
+    http_parser *parser = &conn->parser;
+    size_t n = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &conn->log_start);
+    conn->sent = 0;
+    conn->log_browser = 4;
+    if (parser->url.len == 0)
+    {
+        strcpy(conn->log_request, "-");
+        return;
+    }
+    for (size_t i = 0; i < parser->method.len && n < LOG_REQUEST_MAX - 1; i++)
+        conn->log_request[n++] = parser->method.ptr[i];
+    if (n < LOG_REQUEST_MAX - 1)
+        conn->log_request[n++] = ' ';
+    for (size_t i = 0; i < parser->url.len && n < LOG_REQUEST_MAX - 3; i++)
+    {
+        if (parser->url.ptr[i] == '"')
+        {
+            memcpy(conn->log_request + n, "%22", 3);
+            n += 3;
+        }
+        else
+            conn->log_request[n++] = parser->url.ptr[i];
+    }
+    conn->log_request[n] = '\0';
+}
+
+// log the response just written on a connection
+// the date and time are formatted once a second
+void log_access(http_conn *conn)
+{
+    static time_t log_second;
+    static char log_time[32];
+    char line[LOG_LINE_MAX], addr[INET_ADDRSTRLEN];
+    struct timespec now, wall;
+    struct tm tm;
+    long latency;
+    int n;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    latency = (now.tv_sec - conn->log_start.tv_sec) * 1000000L + (now.tv_nsec - conn->log_start.tv_nsec) / 1000;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    if (wall.tv_sec != log_second)
+    {
+        gmtime_r(&wall.tv_sec, &tm);
+        strftime(log_time, sizeof(log_time), "%Y-%m-%dT%H:%M:%S", &tm);
+        log_second = wall.tv_sec;
+    }
+    inet_ntop(AF_INET, &conn->addr.sin_addr, addr, sizeof(addr));
+
+    n = snprintf(line, sizeof(line), "%s.%03ldZ %s \"%s\" %d %zu %ld %s\n", log_time, wall.tv_nsec / 1000000, addr,
+                 conn->log_request, conn->log_status, conn->sent, latency, browsers[conn->log_browser]);
+    if (n >= (int)sizeof(line))
+    {
+        n = sizeof(line) - 1;
+        line[n - 1] = '\n';
+    }
+    log_append(line, n);
+    conn->log_status = 0;
+}
+
+// start a response with its status line and the Connection header
+void start_response(http_conn *conn, int status, const char *msg)
+{
+    conn_printf(conn, "HTTP/1.1 %d %s\r\n", status, msg);
+    conn_printf(conn, "Connection: %s\r\n", conn->keep_alive ? "keep-alive" : "close");
+}
+
+// echo client error e.g. 404
+void client_error(http_conn *conn, int status, char *msg, char *longmsg)
+{
+    if (longmsg == NULL)
+        longmsg = msg;
+
+    start_response(conn, status, msg);
+    conn_printf(conn, "Content-Type: text/plain\r\n");
+    conn_printf(conn, "Content-Length: %zu\r\n\r\n", strlen(longmsg));
+    conn_printf(conn, "%s", longmsg);
+}
+
+// sort keys of a listing
+enum
+{
+    SORT_NAME,
+    SORT_SIZE,
+    SORT_MTIME,
+    SORT_KEYS
+};
+const char *sort_names[SORT_KEYS] = {"name", "size", "mtime"};
+
+// an entry of a directory listing
+typedef struct
+{
+    char *name;
+    int is_dir;
+    int stated;   // false until size and mtime are read, the names are listed without a stat() each
+    off_t size;
+    time_t mtime;
+} listing_item;
+
+// the scanned and the rendered listing of a directory, cached by a worker
+typedef struct
+{
+    char path[512];           // file name of the directory, empty if the slot is free
+    struct timespec mtime;    // the listing is rebuilt once the directory changes
+    ino_t ino;
+    dev_t dev;
+    int wd;                   // inotify watch on the directory, -1 if none
+    int dir_fd;               // the directory, for the stat() of its entries
+    listing_item *items;
+    int count;
+    listing_item **sorted[SORT_KEYS]; // items in the order of every sort key, NULL until needed
+    struct
+    {
+        int key, desc, page;
+        cache_entry *body;    // headers and HTML of the view, sent like a cached file
+    } views[LISTING_VIEWS];
+    int next_view;            // view slot replaced next
+    size_t bytes;             // memory used, counted against LISTING_MAX_BYTES
+    unsigned long last_used;
+} dir_listing;
+
+dir_listing listings[LISTING_CACHE];
+size_t listing_bytes;
+unsigned long listing_clock; // counts the listing requests, for the LRU replacement
+unsigned long listing_hits, listing_misses;
+
+// write a path to a listing with the bytes which are not safe in a url escaped as %XX
+void url_encode(FILE *out, const char *path)
+{
+    for (; *path; path++)
+    {
+        if (char_is(*path, CHAR_TOKEN) && *path != '%' && *path != '&' && *path != '+' && *path != '\'')
+            fputc(*path, out);
+        else if (*path == '/')
+            fputc('/', out);
+        else
+            fprintf(out, "%%%02X", (unsigned char)*path);
+    }
+}
+
+// write a text to a listing with the characters which are special in HTML escaped
+void html_escape(FILE *out, const char *text)
+{
+    for (; *text; text++)
+    {
+        switch (*text)
+        {
+        case '&':
+            fputs("&amp;", out);
+            break;
+        case '<':
+            fputs("&lt;", out);
+            break;
+        case '>':
+            fputs("&gt;", out);
+            break;
+        case '"':
+            fputs("&quot;", out);
+            break;
+        default:
+            fputc(*text, out);
+        }
+    }
+}
+
+// free the items and the views of a listing and mark its slot free
+void listing_free(dir_listing *listing)
+{
+    for (int i = 0; i < LISTING_VIEWS; i++)
+    {
+        if (listing->views[i].body)
+            cache_release(listing->views[i].body);
+    }
+    for (int k = 0; k < SORT_KEYS; k++)
+        free(listing->sorted[k]);
+    for (int i = 0; i < listing->count; i++)
+        free(listing->items[i].name);
+    free(listing->items);
+    if (listing->path[0])
+        close(listing->dir_fd);
+
+    listing_bytes -= listing->bytes;
+    memset(listing, 0, sizeof(dir_listing));
+    listing->wd = -1;
+}
+
+// remove from the cache the listings of the directory watched by wd, all of them if wd is -1
+void listing_invalidate(int wd)
+{
+    for (int i = 0; i < LISTING_CACHE; i++)
+    {
+        if (listings[i].path[0] && (wd < 0 || listings[i].wd == wd))
+        {
+            listing_free(&listings[i]);
+            cache_invalidations++;
+        }
+    }
+}
+
+// compare two listing items for qsort(), the directories first and then by name, size or mtime
+int compare_name(const void *a, const void *b)
+{
+    const listing_item *x = *(listing_item *const *)a, *y = *(listing_item *const *)b;
+    if (x->is_dir != y->is_dir)
+        return y->is_dir - x->is_dir;
+    return strcmp(x->name, y->name);
+}
+
+int compare_size(const void *a, const void *b)
+{
+    const listing_item *x = *(listing_item *const *)a, *y = *(listing_item *const *)b;
+    if (x->is_dir != y->is_dir || x->size == y->size)
+        return compare_name(a, b);
+    return x->size < y->size ? -1 : 1;
+}
+
+int compare_mtime(const void *a, const void *b)
+{
+    const listing_item *x = *(listing_item *const *)a, *y = *(listing_item *const *)b;
+    if (x->is_dir != y->is_dir || x->mtime == y->mtime)
+        return compare_name(a, b);
+    return x->mtime < y->mtime ? -1 : 1;
+}
+
+// read the size and mtime of the items from first to last of a sorted listing, if not read yet
+void listing_stat(dir_listing *listing, listing_item **items, int first, int last)
+{
+    struct stat item_st;
+
+    for (int i = first; i < last; i++)
+    {
+        if (items[i]->stated)
+            continue;
+        if (fstatat(listing->dir_fd, items[i]->name, &item_st, 0) == 0)
+        {
+            items[i]->size = item_st.st_size;
+            items[i]->mtime = item_st.st_mtime;
+        }
+        items[i]->stated = true;
+    }
+}
+
+// read the entries of a directory into a free listing slot
+// the type of an entry comes from readdir(), its size and mtime are read once needed
+// return false if the directory can not be read
+int listing_scan(dir_listing *listing, const char *filename, struct stat *st)
+{
+    DIR *dir;
+    struct dirent *dir_ptr;
+    struct stat item_st;
+    int cap = 0, is_dir;
+
+    // get file directory
+    if ((dir = opendir(filename)) == NULL)
+        return false;
+
+    snprintf(listing->path, sizeof(listing->path), "%s", filename);
+    listing->dir_fd = dup(dirfd(dir));
+    listing->mtime = st->st_mtim;
+    listing->ino = st->st_ino;
+    listing->dev = st->st_dev;
+    listing->wd = cache_inotify >= 0 ? inotify_add_watch(cache_inotify, filename, CACHE_WATCH_EVENTS) : -1;
+
+    // read directory
+    while ((dir_ptr = readdir(dir)))
+    {
+        if (strcmp(dir_ptr->d_name, ".") == 0 || strcmp(dir_ptr->d_name, "..") == 0)
+            continue;
+        // the files and directories are listed, the links are followed
+        if (dir_ptr->d_type == DT_DIR || dir_ptr->d_type == DT_REG)
+            is_dir = dir_ptr->d_type == DT_DIR;
+        else if ((dir_ptr->d_type == DT_LNK || dir_ptr->d_type == DT_UNKNOWN) &&
+                 fstatat(dirfd(dir), dir_ptr->d_name, &item_st, 0) == 0 && (S_ISDIR(item_st.st_mode) || S_ISREG(item_st.st_mode)))
+            is_dir = S_ISDIR(item_st.st_mode);
+        else
+            continue;
+
+        if (listing->count == cap)
+        {
+            cap = cap ? cap * 2 : 64;
+            listing->items = realloc(listing->items, cap * sizeof(listing_item));
+            if (listing->items == NULL)
+                showErrorAndExit("Error in allocating a directory listing");
+        }
+        memset(&listing->items[listing->count], 0, sizeof(listing_item));
+        listing->items[listing->count].name = strdup(dir_ptr->d_name);
+        listing->items[listing->count].is_dir = is_dir;
+        listing->bytes += sizeof(listing_item) + strlen(dir_ptr->d_name) + 1;
+        listing->count++;
+    }
+    closedir(dir);
+
+    listing_bytes += listing->bytes;
+    return true;
+}
+
+// return the items of a listing sorted by the given key, sorted on first use
+listing_item **listing_sorted(dir_listing *listing, int key)
+{
+    int (*compare[SORT_KEYS])(const void *, const void *) = {compare_name, compare_size, compare_mtime};
+
+    if (listing->sorted[key] == NULL)
+    {
+        listing->sorted[key] = malloc((listing->count + 1) * sizeof(listing_item *));
+        if (listing->sorted[key] == NULL)
+            showErrorAndExit("Error in allocating a directory listing");
+        for (int i = 0; i < listing->count; i++)
+            listing->sorted[key][i] = &listing->items[i];
+        if (key != SORT_NAME)
+            listing_stat(listing, listing->sorted[key], 0, listing->count);
+        qsort(listing->sorted[key], listing->count, sizeof(listing_item *), compare[key]);
+        listing->bytes += listing->count * sizeof(listing_item *);
+        listing_bytes += listing->count * sizeof(listing_item *);
+    }
+    return listing->sorted[key];
+}
+
+// write the query of a link to another view of a listing, page 0 is the whole listing
+void listing_link(FILE *out, int key, int desc, int page, const char *text)
+{
+    fprintf(out, "<a href=\"?sort=%s%s", sort_names[key], desc ? "&amp;order=desc" : "");
+    if (page > 0)
+        fprintf(out, "&amp;page=%d", page);
+    else
+        fprintf(out, "&amp;page=all");
+    fprintf(out, "\">%s</a>", text);
+}
+
+// render a view of a listing into an entry holding the response headers and the HTML,
+// page 0 is the whole listing
+cache_entry *listing_render(dir_listing *listing, const char *url_path, int key, int desc, int page)
+{
+    listing_item **items = listing_sorted(listing, key);
+    int pages = (listing->count + LISTING_PAGE_SIZE - 1) / LISTING_PAGE_SIZE;
+    int first = 0, last = listing->count;
+    char size[32], *html = NULL;
+    size_t html_len = 0;
+    cache_entry *entry;
+    FILE *out;
+
+    if (page > 0)
+    {
+        first = (page - 1) * LISTING_PAGE_SIZE;
+        last = first + LISTING_PAGE_SIZE < listing->count ? first + LISTING_PAGE_SIZE : listing->count;
+    }
+    if (desc)
+        listing_stat(listing, items, listing->count - last, listing->count - first);
+    else
+        listing_stat(listing, items, first, last);
+
+    // render the list first, the response needs its length
+    if ((out = open_memstream(&html, &html_len)) == NULL)
+        showErrorAndExit("Error in rendering a directory list");
+
+    fputs("<html><head><meta charset=\"utf-8\"><title>Index of ", out);
+    html_escape(out, url_path);
+    fputs("</title></head><body><h1>Index of ", out);
+    html_escape(out, url_path);
+    fputs("</h1><p>Sort by ", out);
+    for (int k = 0; k < SORT_KEYS; k++)
+    {
+        listing_link(out, k, k == key && !desc, page > 0 ? 1 : 0, sort_names[k]);
+        fputc(' ', out);
+    }
+    fputs("</p>", out);
+    if (page > 0)
+    {
+        fprintf(out, "<p>Page %d of %d ", page, pages);
+        if (page > 1)
+            listing_link(out, key, desc, page - 1, "previous");
+        fputc(' ', out);
+        if (page < pages)
+            listing_link(out, key, desc, page + 1, "next");
+        fputc(' ', out);
+        listing_link(out, key, desc, 0, "all");
+        fputs("</p>", out);
+    }
+
+    for (int i = first; i < last; i++)
+    {
+        listing_item *item = items[desc ? listing->count - 1 - i : i];
+        struct stat item_st;
+
+        item_st.st_mode = item->is_dir ? S_IFDIR : S_IFREG;
+        item_st.st_size = item->size;
+        format_size(size, &item_st);
+
+        // add the file to the list
+        fputs("<a href=\"", out);
+        url_encode(out, url_path);
+        url_encode(out, item->name);
+        fputs(item->is_dir ? "/\">" : "\">", out);
+        html_escape(out, item->name);
+        fprintf(out, "%s</a> %s<br>\n", item->is_dir ? "/" : "", size);
+    }
+    fputs("</body></html>\n", out);
+    fclose(out);
+
+    entry = calloc(1, sizeof(cache_entry));
+    if (entry == NULL)
+        showErrorAndExit("Error in allocating a directory listing");
+    entry->fd = -1;
+    entry->wd = -1;
+    entry->refs = 1; // held by the listing
+    entry->data = malloc(MAXLINE + html_len);
+    if (entry->data == NULL)
+        showErrorAndExit("Error in allocating a directory listing");
+    entry->mime_type = "text/html; charset=utf-8";
+    entry->header_len = snprintf(entry->data, MAXLINE, "Content-Type: %s\r\nVary: Accept-Encoding\r\nContent-Length: %zu\r\n\r\n",
+                                 entry->mime_type, html_len);
+    entry->content = entry->data + entry->header_len;
+    memcpy(entry->content, html, html_len);
+    entry->size = entry->header_len + html_len;
+    entry->st.st_size = html_len;
+    free(html);
+    return entry;
+}
+
+// return the value of the parameter name of a query, an empty view if it is missing
+str_view query_param(str_view query, const char *name)
+{
+    const char *p = query.ptr, *end = query.ptr + query.len, *next;
+    size_t name_len = strlen(name);
+    str_view value = {NULL, 0};
+
+    while (p < end)
+    {
+        if ((next = memchr(p, '&', end - p)) == NULL)
+            next = end;
+        if (next - p > (ssize_t)name_len && strncmp(p, name, name_len) == 0 && p[name_len] == '=')
+        {
+            value.ptr = p + name_len + 1;
+            value.len = next - value.ptr;
+        }
+        p = next + 1;
+    }
+    return value;
+}
+
+// serve the listing of a directory, from the cache of the worker unless the directory changed
+// the query may ask for a sort key ("sort=name", "size" or "mtime"), the reverse order ("order=desc")
+// and a page of LISTING_PAGE_SIZE entries ("page=1" is the first one, "page=all" the whole listing)
+// a directory with more than LISTING_PAGE_SIZE entries is listed from its first page by default
+// return the response status
+int handle_directory_request(http_conn *conn, http_request *req, struct stat *st)
+{
+    dir_listing *listing = NULL, *oldest = &listings[0];
+    int key = SORT_NAME, desc, page = -1, pages;
+    char url_path[sizeof(req->filename) + 2];
+    const char *path = req->filename + strlen(workingDirectory);
+    str_view value;
+    cache_entry *body = NULL;
+
+    // the url of the directory, ending with a slash, to which the names of the entries are appended
+    snprintf(url_path, sizeof(url_path), "/%s%s", path, path[0] && path[strlen(path) - 1] != '/' ? "/" : "");
+
+    value = query_param(req->query, "sort");
+    for (int k = 0; k < SORT_KEYS; k++)
+    {
+        if (value.ptr && value.len == strlen(sort_names[k]) && strncmp(value.ptr, sort_names[k], value.len) == 0)
+            key = k;
+    }
+    value = query_param(req->query, "order");
+    desc = value.len == 4 && strncmp(value.ptr, "desc", 4) == 0;
+    value = query_param(req->query, "page");
+    if (value.len == 3 && strncmp(value.ptr, "all", 3) == 0)
+        page = 0;
+    else if (value.ptr)
+        page = atoi(value.ptr) > 0 ? atoi(value.ptr) : 1;
+
+    // find the listing of the directory, a changed one is scanned again
+    listing_clock++;
+    for (int i = 0; i < LISTING_CACHE; i++)
+    {
+        if (listings[i].path[0] && strcmp(listings[i].path, req->filename) == 0)
+        {
+            if (listings[i].ino == st->st_ino && listings[i].dev == st->st_dev &&
+                listings[i].mtime.tv_sec == st->st_mtim.tv_sec && listings[i].mtime.tv_nsec == st->st_mtim.tv_nsec)
+                listing = &listings[i];
+            else
+                listing_free(&listings[i]);
+        }
+        if (listings[i].path[0] == '\0' || (oldest->path[0] && listings[i].last_used < oldest->last_used))
+            oldest = &listings[i];
+    }
+    if (listing)
+        listing_hits++;
+    else
+    {
+        listing_misses++;
+        listing = oldest;
+        if (listing->path[0])
+            listing_free(listing);
+        if (!listing_scan(listing, req->filename, st))
+        {
+            listing_free(listing);
+            client_error(conn, 403, "Forbidden", "The directory can not be read.");
+            return 403;
+        }
+    }
+    listing->last_used = listing_clock;
+
+    pages = (listing->count + LISTING_PAGE_SIZE - 1) / LISTING_PAGE_SIZE;
+    if (page < 0)
+        page = pages > 1 ? 1 : 0;
+    if (page > pages)
+        page = pages > 0 ? pages : 1;
+
+    for (int i = 0; i < LISTING_VIEWS; i++)
+    {
+        if (listing->views[i].body && listing->views[i].key == key && listing->views[i].desc == desc && listing->views[i].page == page)
+            body = listing->views[i].body;
+    }
+    if (body == NULL)
+    {
+        int slot = listing->next_view;
+        listing->next_view = (slot + 1) % LISTING_VIEWS;
+        if (listing->views[slot].body)
+        {
+            listing->bytes -= listing->views[slot].body->size;
+            listing_bytes -= listing->views[slot].body->size;
+            cache_release(listing->views[slot].body);
+        }
+        body = listing_render(listing, url_path, key, desc, page);
+        listing->views[slot].key = key;
+        listing->views[slot].desc = desc;
+        listing->views[slot].page = page;
+        listing->views[slot].body = body;
+        listing->bytes += body->size;
+        listing_bytes += body->size;
+    }
+
+    // a client accepting gzip gets the view compressed, once for all the clients
+    if (req->gzip)
+    {
+        size_t size = body->size;
+        if (cache_gzip(body))
+        {
+            listing->bytes += body->size - size;
+            listing_bytes += body->size - size;
+            body = body->gzip;
+        }
+    }
+
+    // send the pre-rendered view, like a cached file
+    start_response(conn, 200, "OK");
+    body->refs++;
+    conn->entry = body;
+    conn->hoff = 0;
+    conn->file_off = 0;
+    conn->file_end = body->st.st_size;
+
+    // the other listings make room for this one
+    for (int i = 0; i < LISTING_CACHE && listing_bytes > LISTING_MAX_BYTES; i++)
+    {
+        if (listings[i].path[0] && &listings[i] != listing)
+            listing_free(&listings[i]);
+    }
+    return 200;
+}
+
+// return true if an inotify event on the directory of an entry names its file, or the .gz file next to it
+int cache_event_matches(cache_entry *entry, struct inotify_event *event)
+{
+    size_t n = strlen(entry->name);
+
+    if (entry->wd != event->wd)
+        return false;
+    return event->len == 0 ||
+           (strncmp(entry->name, event->name, n) == 0 && (event->name[n] == '\0' || strcmp(event->name + n, ".gz") == 0));
+}
+
+// remove from the cache the entries and the listings changed according to the pending inotify events
+// any change in a directory invalidates its listing, which also shows the sizes and times of the files
+void cache_invalidate()
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *event;
+    cache_entry *entry, *next;
+    ssize_t n;
+
+    while ((n = read(cache_inotify, buf, sizeof(buf))) > 0)
+    {
+        for (char *p = buf; p < buf + n; p += sizeof(struct inotify_event) + event->len)
+        {
+            event = (struct inotify_event *)p;
+            listing_invalidate(event->mask & IN_Q_OVERFLOW ? -1 : event->wd);
+            for (entry = cache_head; entry != NULL; entry = next)
+            {
+                next = entry->next;
+                // an overflow loses events, the whole cache is dropped then
+                if ((event->mask & IN_Q_OVERFLOW) || cache_event_matches(entry, event))
+                {
+                    cache_remove(entry);
+                    cache_invalidations++;
+                }
+            }
+        }
+    }
+}
+
+// print the cache counters of a worker
+void cache_print_stats(int index)
+{
+    printf("worker %d cache: %lu hits %lu misses %lu evictions %lu invalidations, %d files %zu bytes, "
+           "listings: %lu hits %lu misses %zu bytes\n",
+           index, cache_hits, cache_misses, cache_evictions, cache_invalidations, cache_count, cache_bytes,
+           listing_hits, listing_misses, listing_bytes);
+    fflush(stdout);
+}
+
+// serve static content
+// a satisfiable byte range is answered with 206 Partial Content, the whole file otherwise,
+// gzip encoded if the client accepts it and the file has a gzip variant
+// the response is written by conn_flush(), which releases the entry at the end
+// return the response status
+int serve_static(http_conn *conn, cache_entry *entry, http_request *req)
+{
+    cache_entry *gzip;
+
+    // a range is taken from the file itself, the offsets of the encoded variant mean nothing to the client
+    if (req->gzip && !req->range && (gzip = cache_gzip(entry)) != NULL)
+    {
+        gzip->refs++;
+        cache_release(entry);
+        entry = gzip;
+    }
+
+    size_t total_size = entry->st.st_size;
+    off_t first = 0, last = (off_t)total_size - 1;
+
+    if (req->range)
+    {
+        if (req->offset < 0) // the last req->end bytes
+            first = req->end < total_size ? (off_t)(total_size - req->end) : 0;
+        else
+            first = req->offset;
+        if (req->offset >= 0 && req->end < total_size)
+            last = req->end;
+
+        if (first >= (off_t)total_size || (req->offset < 0 && req->end == 0))
+        {
+            start_response(conn, 416, "Range Not Satisfiable");
+            conn_printf(conn, "Content-Range: bytes */%zu\r\n", total_size);
+            conn_printf(conn, "Content-Length: 0\r\n\r\n");
+            cache_release(entry);
+            return 416;
+        }
+    }
+
+    conn->entry = entry;
+    conn->file_off = first;
+    conn->file_end = last + 1;
+
+    // send response headers to client e.g., "HTTP/1.1 200 OK\r\n"
+    if (!req->range)
+    {
+        // the other headers are pre-rendered in the entry
+        start_response(conn, 200, "OK");
+        conn->hoff = 0;
+        return 200;
+    }
+
+    start_response(conn, 206, "Partial Content");
+    conn_printf(conn, "Content-Range: bytes %lld-%lld/%zu\r\n", (long long)first, (long long)last, total_size);
+    conn_printf(conn, "Accept-Ranges: bytes\r\n");
+    conn_printf(conn, "Content-Type: %s\r\n", entry->mime_type);
+    conn_printf(conn, "Vary: Accept-Encoding\r\n");
+    conn_printf(conn, "Content-Length: %lld\r\n\r\n", (long long)(last - first + 1));
+    conn->hoff = entry->header_len;
+    return 206;
+}
+
+// answer the request parsed at the start of the read buffer of a connection
+// return the response status
+int conn_process(http_conn *conn)
+{
+    http_request req;
+    int result = parse_request(&conn->parser, &req);
+    conn->log_browser = req.browser_index;
+    if (result == ERROR)
+    {
+        conn->keep_alive = false;
+        client_error(conn, 501, "Not Implemented", "The server only support GET method");
+        return 501;
+    }
+    conn->keep_alive = req.keep_alive && !conn->single;
+    if (result == false)
+    {
+        client_error(conn, 414, "URI Too Long", NULL);
+        return 414;
+    }
+
+    struct stat sbuf;
+    int status = 200; //server status init as 200
+    int ffd;
+    cache_entry *entry = cache_open(req.filename, &ffd, &sbuf);
+    if (entry)
+    {
+        // server serves static content
+        status = serve_static(conn, entry, &req);
+    }
+    else if (ffd < 0)
+    {
+        // detect 404 error and print error log
+        status = 404;
+        client_error(conn, status, "Not Found", "Server has not found that file, maybe remove, change name, or delete.");
+    }
+    else
+    {
+        if (S_ISDIR(sbuf.st_mode))
+        {
+            // server handle directory request
+            status = handle_directory_request(conn, &req, &sbuf);
+        }
+        else
+        {
+            // detect 400 error and print error log
+            status = 400;
+            client_error(conn, status, "Not Found", NULL);
+        }
+
+        close(ffd);
+    }
+    return status;
+}
+
+// answer the requests buffered on a connection in order, the next one only once the
+// response to the previous one is written
+// return OK when waiting for more requests, false when waiting to write, ERROR if the connection must be closed
+int conn_handle(http_conn *conn)
+{
+    int result;
+
+    while (1)
+    {
+        if ((result = conn_flush(conn)) != OK)
+            return result;
+        if (conn->log_status)
+            log_access(conn);
+        if (!conn->keep_alive) // the last response is written
+            return ERROR;
+
+        if ((result = http_parse(&conn->parser, conn->rbuf, conn->rlen)) == ERROR)
+        {
+            log_start(conn);
+            conn->log_status = 400;
+            conn->keep_alive = false;
+            client_error(conn, 400, "Bad Request", NULL);
+            continue;
+        }
+        if (result == false)
+        {
+            if (conn->rlen == CONN_BUFSIZE)
+            {
+                log_start(conn);
+                conn->log_status = 431;
+                conn->keep_alive = false;
+                client_error(conn, 431, "Request Header Fields Too Large", NULL);
+                continue;
+            }
+            return conn->peer_closed ? ERROR : OK;
+        }
+
+        log_start(conn);
+        conn->log_status = conn_process(conn);
+        conn->rlen -= conn->parser.pos;
+        memmove(conn->rbuf, conn->rbuf + conn->parser.pos, conn->rlen);
+        http_parser_init(&conn->parser);
+    }
+}
+
+// handle one connection with blocking I/O: serve one HTTP request/response transaction
+void process(int fd, struct sockaddr_in *clientaddr)
+{
+    http_conn *conn = conn_create(fd, clientaddr);
+    ssize_t n;
+
+    conn->single = true;
+    while (conn_handle(conn) == OK)
+    {
+        n = read(fd, conn->rbuf + conn->rlen, CONN_BUFSIZE - conn->rlen);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            conn->peer_closed = true;
+        else
+            conn->rlen += n;
+    }
+    if (conn->log_status) // the response failed
+        log_access(conn);
+    conn_close(conn);
+}
+
+int checkAndUpdateUserInput(int argc, char **argv)
+{
+    int result = ERROR;
+    int default_port = DEFAULT_PORT;
+    if (argc == 1 || argc > 4)
+    {
+        showErrorAndExit("Working directory is required and port number and worker count are optional\n");
+        return result;
+    }
+
+    workingDirectory = argv[1];
+    worker_count = sysconf(_SC_NPROCESSORS_ONLN); // one worker per CPU by default
+    if (argc == 2)
+    {
+        printf("Setting default port number to %d\n", default_port);
+        server_port_number = default_port;
+    }
+    else
+        server_port_number = atoi(argv[2]);
+
+    if (argc == 4)
+        worker_count = atoi(argv[3]);
+    if (worker_count < 0 || worker_count > MAX_WORKERS)
+        showErrorAndExit("Worker count must be between 0 and 256\n");
+
+    result = OK;
+    return result;
+}
+
+// fork a child process for every accepted connection
+// the children are reaped automatically since SIGCHLD is ignored
+void serve_forked()
+{
+    struct sockaddr_in clientAddress;
+    socklen_t client = sizeof(clientAddress);
+    int clientSocketFd;
+    int clientPID;
+
+    signal(SIGCHLD, SIG_IGN);
+    open_listenfd(server_port_number, false);
+    printf("Started listening at port %d for http requests \n", server_port_number);
+    fflush(stdout); // the children must not inherit and print again the buffered output
+    while (1)
+    {
+        // permit an incoming connection attempt on a socket.
+        clientSocketFd = accept(serverSocketFd, (struct sockaddr *)&clientAddress, &client);
+        if (clientSocketFd >= 0)
+        {
+            // fork children to handle parallel clients
+            // handle one HTTP request/response transaction
+            clientPID = fork();
+            if (clientPID < 0)
+            {
+                char buffer[256];
+                sprintf(buffer, "Error in binding to port %d \n", clientSocketFd);
+                showErrorAndExit(buffer);
+            }
+            if (clientPID == 0)
+            {
+                close(serverSocketFd);
+                process(clientSocketFd, &clientAddress);
+                exit(0);
+            }
+            else
+            {
+                close(clientSocketFd);
+            }
+        }
+        else
+        {
+            printf("Error in accepting client \n");
+        }
+    }
+}
+
+// remove a client connection from its worker and close it
+// a response cut short is logged with the bytes sent
+void conn_drop(http_conn *conn)
+{
+    if (conn->log_status)
+        log_access(conn);
+    conn_table[conn->fd] = NULL;
+    conn_close(conn); // closing the descriptor removes it from epoll
+}
+
+// accept all the connections pending on a listening socket and poll them for requests
+void accept_connections(int listenfd)
+{
+    struct sockaddr_in clientAddress;
+    socklen_t client;
+    struct epoll_event ev;
+    int clientSocketFd;
+
+    while (1)
+    {
+        client = sizeof(clientAddress);
+        clientSocketFd = accept4(listenfd, (struct sockaddr *)&clientAddress, &client, SOCK_NONBLOCK);
+        if (clientSocketFd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                printf("Error in accepting client \n");
+            return;
+        }
+        if (clientSocketFd >= MAX_CONN_FDS)
+        {
+            close(clientSocketFd);
+            continue;
+        }
+
+        conn_table[clientSocketFd] = conn_create(clientSocketFd, &clientAddress);
+        conn_table[clientSocketFd]->events = EPOLLIN;
+        ev.events = EPOLLIN;
+        ev.data.fd = clientSocketFd;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, clientSocketFd, &ev) < 0)
+            conn_drop(conn_table[clientSocketFd]);
+    }
+}
+
+// handle the events of a client connection: read the received bytes, answer the complete
+// requests and write their responses
+// the connection is polled for writing while a response is pending and for reading otherwise
+void conn_event(http_conn *conn, uint32_t events)
+{
+    struct epoll_event ev;
+    ssize_t n;
+    int result;
+
+    conn->last_active = time(NULL);
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+    {
+        while (conn->rlen < CONN_BUFSIZE)
+        {
+            n = read(conn->fd, conn->rbuf + conn->rlen, CONN_BUFSIZE - conn->rlen);
+            if (n > 0)
+            {
+                conn->rlen += n;
+                continue;
+            }
+            if (n == 0)
+                conn->peer_closed = true;
+            else if (errno == EINTR)
+                continue;
+            else if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                conn_drop(conn);
+                return;
+            }
+            break;
+        }
+    }
+
+    if ((result = conn_handle(conn)) == ERROR)
+    {
+        conn_drop(conn);
+        return;
+    }
+
+    ev.events = result == OK ? EPOLLIN : EPOLLOUT;
+    if (ev.events != conn->events)
+    {
+        ev.data.fd = conn->fd;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+        conn->events = ev.events;
+    }
+}
+
+// close the connections of the worker idle for IDLE_TIMEOUT seconds
+void close_idle_connections(time_t now)
+{
+    for (int fd = 0; fd < MAX_CONN_FDS; fd++)
+    {
+        if (conn_table[fd] && now - conn_table[fd]->last_active >= IDLE_TIMEOUT)
+            conn_drop(conn_table[fd]);
+    }
+}
+
+// SIGUSR1 handler: ask for the cache counters of the workers
+void request_stats(int sig)
+{
+    (void)sig;
+    stats_requested = true;
+}
+
+// main loop of the worker with the given index
+// the worker is pinned to a CPU and serves all the connections of its own listening socket
+// with one epoll instance, the idle connections are checked once a second
+// the worker caches the files it serves, the inotify instance of the cache is polled with the sockets
+void worker_loop(int index)
+{
+    struct epoll_event ev, events[MAX_EVENTS];
+    int listenfd = worker_listenfd[index];
+    time_t now, last_check = time(NULL);
+    cpu_set_t cpus;
+    int n;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(index % sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+    log_own = &log_rings[index];
+
+    // the listening sockets of the other workers are not used by this one
+    for (int i = 0; i < worker_count; i++)
+    {
+        if (i != index)
+            close(worker_listenfd[i]);
+    }
+
+    fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK);
+    if ((epfd = epoll_create1(0)) < 0)
+        showErrorAndExit("Error in creating epoll instance");
+    ev.events = EPOLLIN;
+    ev.data.fd = listenfd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listenfd, &ev) < 0)
+        showErrorAndExit("Error in polling the listening socket");
+
+    // without inotify the cache could serve stale files, the worker runs without it then
+    if ((cache_inotify = inotify_init1(IN_NONBLOCK)) >= 0)
+    {
+        ev.data.fd = cache_inotify;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, cache_inotify, &ev) < 0)
+        {
+            close(cache_inotify);
+            cache_inotify = -1;
+        }
+    }
+    if (cache_inotify < 0)
+        printf("worker %d runs without a file cache, inotify is not available\n", index);
+
+    while (1)
+    {
+        n = epoll_wait(epfd, events, MAX_EVENTS, 1000);
+        if (n < 0 && errno != EINTR)
+            showErrorAndExit("Error in waiting for events");
+
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.fd == listenfd)
+                accept_connections(listenfd);
+            else if (events[i].data.fd == cache_inotify)
+                cache_invalidate();
+            else if (conn_table[events[i].data.fd])
+                conn_event(conn_table[events[i].data.fd], events[i].events);
+        }
+
+        if (stats_requested)
+        {
+            stats_requested = false;
+            cache_print_stats(index);
+        }
+
+        now = time(NULL);
+        if (now != last_check)
+        {
+            close_idle_connections(now);
+            last_check = now;
+        }
+    }
+}
+
+// fork the worker with the given index
+void start_worker(int index)
+{
+    pid_t pid;
+
+    fflush(stdout); // the worker must not inherit and print again the buffered output of the master
+    pid = fork();
+    if (pid < 0)
+        showErrorAndExit("Error in forking worker");
+    if (pid == 0)
+    {
+        worker_loop(index);
+        exit(0);
+    }
+    worker_pid[index] = pid;
+}
+
+// write out the part of a log ring from tail to head, at most two pieces as it wraps around
+// return the number of iovecs filled
+int log_ring_pieces(log_ring *ring, size_t tail, size_t head, struct iovec *iov)
+{
+    size_t off = tail % LOG_RING_SIZE, n = head - tail;
+    int cnt = 0;
+
+    if (n == 0)
+        return 0;
+    iov[cnt].iov_base = ring->buf + off;
+    iov[cnt].iov_len = n < LOG_RING_SIZE - off ? n : LOG_RING_SIZE - off;
+    n -= iov[cnt++].iov_len;
+    if (n > 0)
+    {
+        iov[cnt].iov_base = ring->buf;
+        iov[cnt++].iov_len = n;
+    }
+    return cnt;
+}
+
+// writer thread of the master: every LOG_FLUSH_INTERVAL ms, write the lines of all the log
+// rings to stdout with one writev() call, straight from the rings, then free their room
+// the lines of a ring stay in order and whole, a worker only publishes complete lines
+void *log_writer(void *arg)
+{
+    struct iovec iov[2 * MAX_WORKERS];
+    size_t heads[MAX_WORKERS];
+    unsigned long dropped, reported[MAX_WORKERS] = {0};
+    struct timespec interval = {0, LOG_FLUSH_INTERVAL * 1000000L};
+    char line[128];
+    int cnt, first;
+    ssize_t n;
+
+    (void)arg;
+    while (1)
+    {
+        nanosleep(&interval, NULL);
+
+        cnt = 0;
+        for (int i = 0; i < worker_count; i++)
+        {
+            heads[i] = __atomic_load_n(&log_rings[i].head, __ATOMIC_ACQUIRE);
+            cnt += log_ring_pieces(&log_rings[i], log_rings[i].tail, heads[i], iov + cnt);
+        }
+
+        // a short write goes on from where it stopped, a failed one loses the lines
+        for (first = 0; first < cnt;)
+        {
+            if ((n = writev(STDOUT_FILENO, iov + first, cnt - first > IOV_MAX ? IOV_MAX : cnt - first)) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            while (first < cnt && (size_t)n >= iov[first].iov_len)
+                n -= iov[first++].iov_len;
+            if (first < cnt)
+            {
+                iov[first].iov_base = (char *)iov[first].iov_base + n;
+                iov[first].iov_len -= n;
+            }
+        }
+
+        for (int i = 0; i < worker_count; i++)
+        {
+            __atomic_store_n(&log_rings[i].tail, heads[i], __ATOMIC_RELEASE);
+            dropped = __atomic_load_n(&log_rings[i].dropped, __ATOMIC_RELAXED);
+            if (dropped != reported[i])
+            {
+                n = snprintf(line, sizeof(line), "worker %d dropped %lu access log lines, its ring was full\n",
+                             i, dropped - reported[i]);
+                written(STDOUT_FILENO, line, n);
+                reported[i] = dropped;
+            }
+        }
+    }
+    return NULL;
+}
+
+// serve the connections with worker_count pre-forked workers
+// the listening sockets are opened by the master, so a worker forked again after a crash
+// takes over the connections already queued on the socket of the dead one
+// SIGUSR1 sent to the master is passed to every worker, which prints its cache counters
+// the log rings are shared by the master and the workers, the writer thread drains them
+void serve_workers()
+{
+    struct sigaction sa;
+    sigset_t mask, old_mask;
+    pthread_t writer;
+    pid_t pid;
+    int status;
+
+    // without SA_RESTART, wait() returns when the signal arrives
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = request_stats;
+    sigaction(SIGUSR1, &sa, NULL);
+
+    for (int i = 0; i < worker_count; i++)
+        worker_listenfd[i] = open_listenfd(server_port_number, true);
+    printf("Started listening at port %d for http requests with %d workers \n", server_port_number, worker_count);
+    fflush(stdout); // the writer thread writes to stdout without the buffer of stdio
+
+    log_rings = mmap(NULL, worker_count * sizeof(log_ring), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (log_rings == MAP_FAILED)
+        showErrorAndExit("Error in allocating the access log rings");
+    // SIGUSR1 must interrupt wait() in the main thread, the writer thread blocks it
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+    if (pthread_create(&writer, NULL, log_writer, NULL) != 0)
+        showErrorAndExit("Error in starting the access log writer");
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    for (int i = 0; i < worker_count; i++)
+        start_worker(i);
+
+    // reap the workers and fork the dead ones again
+    while (1)
+    {
+        if ((pid = wait(&status)) < 0)
+        {
+            if (errno == EINTR)
+            {
+                if (stats_requested)
+                {
+                    stats_requested = false;
+                    for (int i = 0; i < worker_count; i++)
+                        kill(worker_pid[i], SIGUSR1);
+                }
+                continue;
+            }
+            showErrorAndExit("Error in waiting for workers");
+        }
+
+        for (int i = 0; i < worker_count; i++)
+        {
+            if (worker_pid[i] == pid)
+            {
+                printf("worker %d (pid %d) died, forking it again\n", i, pid);
+                start_worker(i);
+            }
+        }
+    }
+}
+
+// shared state of the load generator threads of one concurrency level
+typedef struct
+{
+    int port;
+    const char *path;
+    int keep_alive;    // true if every thread keeps its connection open
+    int total;         // number of requests of this level
+    int next;          // index of the next request to issue
+    int failed;        // number of requests which got no response
+    double *latency;   // latency of every request in microseconds
+    pthread_mutex_t lock;
+} bench_state;
+
+// return the time of a monotonic clock in microseconds
+double bench_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// connect to the server on the local port
+// return the socket descriptor, or ERROR if the connection failed
+int bench_connect(int port)
+{
+    struct sockaddr_in addr;
+    int fd;
+
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+        return ERROR;
+
+    bzero((char *)&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(fd, (SA *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return ERROR;
+    }
+    return fd;
+}
+
+// issue one request on a new connection and read the whole response
+// return the number of bytes received, or ERROR if the request failed
+ssize_t bench_request(int port, const char *path)
+{
+    char buf[16384];
+    ssize_t n, total = 0;
+    int fd;
+
+    if ((fd = bench_connect(port)) < 0)
+        return ERROR;
+
+    n = snprintf(buf, sizeof(buf), "GET %s HTTP/1.0\r\nUser-Agent: file_browser-bench\r\n\r\n", path);
+    if (written(fd, buf, n) < 0)
+    {
+        close(fd);
+        return ERROR;
+    }
+
+    // the server closes the connection after the response
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        total += n;
+    close(fd);
+
+    return n < 0 || total == 0 ? ERROR : total;
+}
+
+// issue one request on the persistent connection *fd, connected first if *fd is -1,
+// and read the response up to its Content-Length
+// the connection is closed and *fd set to -1 if the server closes it
+// return the number of bytes received, or ERROR if the request failed
+ssize_t bench_request_keepalive(int *fd, int port, const char *path)
+{
+    char buf[16384], *end, *header;
+    ssize_t n, total = 0, length = -1;
+    int reused = *fd >= 0;
+
+    if (*fd < 0 && (*fd = bench_connect(port)) < 0)
+        return ERROR;
+
+    n = snprintf(buf, sizeof(buf), "GET %s HTTP/1.1\r\nHost: localhost\r\nUser-Agent: file_browser-bench\r\n\r\n", path);
+    if (written(*fd, buf, n) < 0)
+        goto failed;
+
+    // read the headers
+    while (length < 0)
+    {
+        if ((n = read(*fd, buf + total, sizeof(buf) - 1 - total)) <= 0)
+            goto failed;
+        total += n;
+        buf[total] = '\0';
+        if ((end = strstr(buf, "\r\n\r\n")) == NULL)
+        {
+            if (total == sizeof(buf) - 1)
+                goto failed;
+            continue;
+        }
+        if ((header = strcasestr(buf, "Content-Length:")) == NULL || header > end)
+            goto failed;
+        length = end + 4 - buf + atol(header + 15);
+    }
+    end = strcasestr(buf, "Connection: close");
+
+    // read the rest of the body
+    while (total < length)
+    {
+        if ((n = read(*fd, buf, length - total < (ssize_t)sizeof(buf) ? length - total : (ssize_t)sizeof(buf))) <= 0)
+            goto failed;
+        total += n;
+    }
+
+    if (end)
+    {
+        close(*fd);
+        *fd = -1;
+    }
+    return total;
+
+failed:
+    close(*fd);
+    *fd = -1;
+    // the server may have closed the idle connection just before the request
+    if (reused && total == 0)
+        return bench_request_keepalive(fd, port, path);
+    return ERROR;
+}
+
+// load generator thread: issue requests until all the requests of the level are issued
+void *bench_thread(void *arg)
+{
+    bench_state *state = arg;
+    double start;
+    ssize_t result;
+    int i, fd = -1;
+
+    while (1)
+    {
+        pthread_mutex_lock(&state->lock);
+        i = state->next++;
+        pthread_mutex_unlock(&state->lock);
+        if (i >= state->total)
+            break;
+
+        start = bench_now();
+        if (state->keep_alive)
+            result = bench_request_keepalive(&fd, state->port, state->path);
+        else
+            result = bench_request(state->port, state->path);
+        if (result == ERROR)
+        {
+            pthread_mutex_lock(&state->lock);
+            state->failed++;
+            pthread_mutex_unlock(&state->lock);
+        }
+        state->latency[i] = bench_now() - start;
+    }
+
+    if (fd >= 0)
+        close(fd);
+    return NULL;
+}
+
+// compare two latencies for qsort()
+int bench_compare(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// load generator: file_browser --bench [-k] <port> <path> [requests]
+// requests path at concurrency 1, 2, 4 ... BENCH_MAX_CONCURRENCY and prints requests/s and latency percentiles
+int run_benchmark(int argc, char **argv)
+{
+    pthread_t threads[BENCH_MAX_CONCURRENCY];
+    bench_state state;
+    double start, elapsed;
+
+    // -k keeps the connection of every thread open
+    state.keep_alive = argc > 2 && strcmp(argv[2], "-k") == 0;
+    if (state.keep_alive)
+    {
+        argc--;
+        argv++;
+    }
+    if (argc < 4)
+        showErrorAndExit("Usage: file_browser --bench [-k] <port> <path> [requests]\n");
+
+    state.port = atoi(argv[2]);
+    state.path = argv[3];
+    state.total = argc > 4 ? atoi(argv[4]) : BENCH_REQUESTS;
+    state.latency = malloc(state.total * sizeof(double));
+    pthread_mutex_init(&state.lock, NULL);
+
+    printf("%11s %10s %10s %10s %10s %7s\n", "concurrency", "req/s", "p50 (us)", "p99 (us)", "max (us)", "failed");
+    for (int c = 1; c <= BENCH_MAX_CONCURRENCY; c *= 2)
+    {
+        state.next = 0;
+        state.failed = 0;
+
+        start = bench_now();
+        for (int i = 0; i < c; i++)
+            pthread_create(&threads[i], NULL, bench_thread, &state);
+        for (int i = 0; i < c; i++)
+            pthread_join(threads[i], NULL);
+        elapsed = bench_now() - start;
+
+        qsort(state.latency, state.total, sizeof(double), bench_compare);
+        printf("%11d %10.0f %10.0f %10.0f %10.0f %7d\n", c, state.total / (elapsed / 1e6),
+               state.latency[state.total / 2], state.latency[state.total * 99 / 100],
+               state.latency[state.total - 1], state.failed);
+    }
+
+    free(state.latency);
+    return 0;
+}
+
+// sample requests of the parser benchmark
+const char *bench_parser_requests[][2] = {
+    {"minimal", "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n"},
+    {"curl", "GET /small.txt HTTP/1.1\r\nHost: localhost:9999\r\nUser-Agent: curl/7.88.1\r\nAccept: */*\r\n\r\n"},
+    {"range", "GET /big.bin HTTP/1.1\r\nHost: localhost:9999\r\nRange: bytes=1048576-2097151\r\nConnection: keep-alive\r\n\r\n"},
+    {"browser", "GET /sub/index.html HTTP/1.1\r\nHost: localhost:9999\r\nConnection: keep-alive\r\n"
+                "Cache-Control: max-age=0\r\nUpgrade-Insecure-Requests: 1\r\n"
+                "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+                "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+                "Accept-Encoding: gzip, deflate, br\r\nAccept-Language: en-US,en;q=0.9\r\n"
+                "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark\r\n\r\n"},
+    {NULL, NULL},
+};
+
+// parser benchmark: file_browser --bench-parser [parses]
+// parses every sample request whole, then fed in pieces of BENCH_PARSE_PIECE bytes as partial reads
+// would deliver it, and prints the requests parsed per second
+int run_parser_benchmark(int argc, char **argv)
+{
+    http_parser parser;
+    http_request req;
+    unsigned long check = 0;
+    int parses = argc > 2 ? atoi(argv[2]) : BENCH_PARSES;
+    double start, whole, pieces;
+    size_t len, n;
+
+    workingDirectory = "./";
+    printf("%-8s %6s %14s %14s\n", "request", "bytes", "whole (req/s)", "pieces (req/s)");
+    for (int r = 0; bench_parser_requests[r][0]; r++)
+    {
+        const char *buf = bench_parser_requests[r][1];
+        len = strlen(buf);
+
+        start = bench_now();
+        for (int i = 0; i < parses; i++)
+        {
+            http_parser_init(&parser);
+            if (http_parse(&parser, buf, len) != OK || parse_request(&parser, &req) != OK)
+                showErrorAndExit("Sample request not parsed");
+            check += parser.pos + req.browser_index;
+        }
+        whole = bench_now() - start;
+
+        start = bench_now();
+        for (int i = 0; i < parses; i++)
+        {
+            http_parser_init(&parser);
+            for (n = BENCH_PARSE_PIECE; http_parse(&parser, buf, n < len ? n : len) == false; n += BENCH_PARSE_PIECE)
+                ;
+            if (parser.state != PARSE_DONE || parse_request(&parser, &req) != OK)
+                showErrorAndExit("Sample request not parsed");
+            check += parser.pos + req.browser_index;
+        }
+        pieces = bench_now() - start;
+
+        printf("%-8s %6zu %14.0f %14.0f\n", bench_parser_requests[r][0], len, parses / (whole / 1e6), parses / (pieces / 1e6));
+    }
+
+    // the check sum keeps the compiler from dropping the parses
+    return check == 0;
+}
+
+// main function:
+// get the user input for the file directory, port number and worker count
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return run_benchmark(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--bench-parser") == 0)
+        return run_parser_benchmark(argc, argv);
+
+    checkAndUpdateUserInput(argc, argv);
+    printf("Server working directory is %s\n", workingDirectory);
+    printf("Server listening port is %d\n", server_port_number);
+
+    // ignore SIGPIPE signal, so if browser cancels the request, it
+    // won't kill the whole process.
+    signal(SIGPIPE, SIG_IGN);
+    if (worker_count == 0)
+        serve_forked();
+    else
+        serve_workers();
+
+    return 0;
+}
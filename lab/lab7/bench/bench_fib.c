@@ -0,0 +1,226 @@
+//FILE: bench/bench_fib.c
+//
+//Description: this file benchmarks the lookups in the routing table, a forwarding information base directly indexed by the destination
+//node ID, against the chained hash table of MAX_ROUTINGTABLE_SLOTS slots it replaced (kept below as hashtable_t for the comparison).
+//Both tables hold the routes of a node of a synthetic topology (see benchtopo.h), computed with lsdb_computeroutes().
+//The destinations are looked up in a fixed random order, one at a time, and in bursts with routingtable_getnextnodes(),
+//both on a plain table and on the RCU published table the forwarding path uses.
+//
+//Run make bench, or ./bench/bench_fib [N ...].
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/constants.h"
+#include "../network/lsdb.h"
+#include "../network/routingtable.h"
+#include "benchtopo.h"
+
+//number of slots of the chained hash routing table, MAX_ROUTINGTABLE_SLOTS before the FIB
+#define HASHTABLE_SLOTS 10
+//number of destinations in the random lookup order
+#define BENCH_DESTS 4096
+//number of packets of a burst
+#define BENCH_BURST 32
+//every kind of lookup is repeated until it ran for at least BENCH_MIN_NS
+#define BENCH_MIN_NS 200000000LL
+
+//a routing entry of the chained hash routing table
+typedef struct hashtable_entry {
+  int destNodeID;
+  int nextNodeID;
+  struct hashtable_entry *next;
+} hashtable_entry_t;
+
+//the chained hash routing table, a slot is a linked list of the routing entries whose destination hashes to it
+typedef struct hashtable {
+  hashtable_entry_t *hash[HASHTABLE_SLOTS];
+} hashtable_t;
+
+//This function sets the next hop of destNodeID in the chained hash routing table, the entry is appended to its slot if it is new.
+static void hashtable_setnextnode(hashtable_t *table, int destNodeID, int nextNodeID)
+{
+  hashtable_entry_t **entry = &table->hash[destNodeID % HASHTABLE_SLOTS];
+
+  while (*entry != NULL && (*entry)->destNodeID != destNodeID)
+    entry = &(*entry)->next;
+
+  if (*entry == NULL)
+  {
+    *entry = calloc(1, sizeof(hashtable_entry_t));
+    (*entry)->destNodeID = destNodeID;
+  }
+  (*entry)->nextNodeID = nextNodeID;
+}
+
+//This function looks up destNodeID in the chained hash routing table.
+//Return its next hop, or -1 if there is no route to it.
+static int hashtable_getnextnode(hashtable_t *table, int destNodeID)
+{
+  hashtable_entry_t *entry = table->hash[destNodeID % HASHTABLE_SLOTS];
+
+  while (entry != NULL)
+  {
+    if (entry->destNodeID == destNodeID)
+      return entry->nextNodeID;
+    entry = entry->next;
+  }
+
+  return -1;
+}
+
+//This function frees the chained hash routing table.
+static void hashtable_destroy(hashtable_t *table)
+{
+  hashtable_entry_t *entry, *next;
+
+  for (int i = 0; i < HASHTABLE_SLOTS; i++)
+  {
+    for (entry = table->hash[i]; entry != NULL; entry = next)
+    {
+      next = entry->next;
+      free(entry);
+    }
+  }
+  free(table);
+}
+
+//This function prints the lookup rate of a kind of lookup, given the number of lookups done in the given CPU time.
+static void bench_print(const char *name, long long lookups, long long ns)
+{
+  printf("  %-36s %8.1f M lookups/s %8.1f ns/lookup\n", name, lookups / (ns / 1e3), (double)ns / lookups);
+}
+
+//This function benchmarks the lookups in the routing tables of node 0 of the topology of nodeNum nodes.
+static void bench_run(int nodeNum)
+{
+  benchtopo_t *topo = malloc(sizeof(benchtopo_t));
+  lsdb_t *lsdb = lsdb_create();
+  routingtable_t *fib = calloc(1, sizeof(routingtable_t));
+  hashtable_t *hash = calloc(1, sizeof(hashtable_t));
+  routingtable_rcu_t *rcu;
+  int dests[BENCH_DESTS], nexts[BENCH_BURST];
+  unsigned int flows[BENCH_DESTS];
+  long long start, lookups;
+  int sum = 0, mismatches = 0;
+
+  benchtopo_generate(topo, nodeNum);
+  benchtopo_buildlsdb(topo, lsdb);
+  lsdb_computeroutes(lsdb, 0, fib);
+  for (int dest = 1; dest < nodeNum; dest++)
+    hashtable_setnextnode(hash, dest, routingtable_getnextnode(fib, dest));
+
+  srand(1);
+  for (int i = 0; i < BENCH_DESTS; i++)
+  {
+    dests[i] = 1 + rand() % (nodeNum - 1);
+    flows[i] = rand();
+    if (hashtable_getnextnode(hash, dests[i]) != routingtable_getnextnode(fib, dests[i]))
+      mismatches++;
+  }
+
+  printf("%d nodes, routes of node 0, %s\n", nodeNum, mismatches == 0 ? "both tables give the same next hops" : "NEXT HOP MISMATCH");
+
+  lookups = 0;
+  start = benchtopo_cputime();
+  do
+  {
+    for (int i = 0; i < BENCH_DESTS; i++)
+      sum += hashtable_getnextnode(hash, dests[i]);
+    lookups += BENCH_DESTS;
+  } while (benchtopo_cputime() - start < BENCH_MIN_NS);
+  bench_print("chained hash, one at a time", lookups, benchtopo_cputime() - start);
+
+  lookups = 0;
+  start = benchtopo_cputime();
+  do
+  {
+    for (int i = 0; i < BENCH_DESTS; i++)
+      sum += routingtable_getnextnode(fib, dests[i]);
+    lookups += BENCH_DESTS;
+  } while (benchtopo_cputime() - start < BENCH_MIN_NS);
+  bench_print("FIB, one at a time", lookups, benchtopo_cputime() - start);
+
+  lookups = 0;
+  start = benchtopo_cputime();
+  do
+  {
+    for (int i = 0; i < BENCH_DESTS; i++)
+      sum += routingtable_getflownextnode(fib, dests[i], flows[i]);
+    lookups += BENCH_DESTS;
+  } while (benchtopo_cputime() - start < BENCH_MIN_NS);
+  bench_print("FIB, one flow at a time (ECMP)", lookups, benchtopo_cputime() - start);
+
+  lookups = 0;
+  start = benchtopo_cputime();
+  do
+  {
+    for (int i = 0; i < BENCH_DESTS; i += BENCH_BURST)
+    {
+      routingtable_getnextnodes(fib, dests + i, flows + i, nexts, BENCH_BURST);
+      sum += nexts[0];
+    }
+    lookups += BENCH_DESTS;
+  } while (benchtopo_cputime() - start < BENCH_MIN_NS);
+  bench_print("FIB, bursts of 32 flows", lookups, benchtopo_cputime() - start);
+
+  rcu = routingtable_rcu_create(fib);
+
+  lookups = 0;
+  start = benchtopo_cputime();
+  do
+  {
+    for (int i = 0; i < BENCH_DESTS; i++)
+      sum += routingtable_rcu_getflownextnode(rcu, dests[i], flows[i]);
+    lookups += BENCH_DESTS;
+  } while (benchtopo_cputime() - start < BENCH_MIN_NS);
+  bench_print("RCU FIB, one flow at a time", lookups, benchtopo_cputime() - start);
+
+  lookups = 0;
+  start = benchtopo_cputime();
+  do
+  {
+    for (int i = 0; i < BENCH_DESTS; i += BENCH_BURST)
+    {
+      routingtable_rcu_getnextnodes(rcu, dests + i, flows + i, nexts, BENCH_BURST);
+      sum += nexts[0];
+    }
+    lookups += BENCH_DESTS;
+  } while (benchtopo_cputime() - start < BENCH_MIN_NS);
+  bench_print("RCU FIB, bursts of 32 flows", lookups, benchtopo_cputime() - start);
+
+  //the sum keeps the lookups from being optimized away
+  if (sum == 0)
+    printf("no route found\n");
+
+  routingtable_rcu_destroy(rcu);
+  hashtable_destroy(hash);
+  lsdb_destroy(lsdb);
+  free(topo);
+}
+
+int main(int argc, char *argv[])
+{
+  int nodeNum;
+
+  if (argc > 1)
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      nodeNum = atoi(argv[i]);
+      if (nodeNum < 3 || nodeNum > MAX_NODEID)
+      {
+        printf("the number of nodes must be between 3 and %d\n", MAX_NODEID);
+        return 1;
+      }
+      bench_run(nodeNum);
+    }
+    return 0;
+  }
+
+  bench_run(MAX_NODE_NUM);
+  bench_run(MAX_NODEID);
+  return 0;
+}
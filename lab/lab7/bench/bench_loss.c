@@ -0,0 +1,327 @@
+//FILE: bench/bench_loss.c
+//
+//Description: this file measures the latency of the segments crossing a lossy overlay link, with TCP or UDP links between the ON processes.
+//It is run by bench/loss.sh on two nodes (see bench/netns.sh), as two programs:
+//
+//bench_loss client nodeID: runs on a node with its ON and SNP processes. It sends a segment to the given node every millisecond,
+//BENCH_SEGS segments in all, receives the echoed segments and prints how many came back and their round trip times.
+//
+//bench_loss peer IP tcp|udp loss: plays the whole neighbor with the given IP address instead of its ON and SNP processes and an echo server.
+//It brings up the link in the given mode, sends heartbeats and distance vectors, and sends back every SNP packet to its source.
+//The kernel has no netem here, so the peer emulates the loss of the link with the given probability in both directions:
+//on a UDP link, a lost datagram is dropped. On a TCP link, the kernel would retransmit a lost segment, so a lost packet and every packet
+//behind it are held back BENCH_RTO_US, modelling a fast retransmit recovery (three later segments and a round trip).
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "../common/constants.h"
+#include "../common/pkt.h"
+#include "../common/seg.h"
+#include "../overlay/udplink.h"
+#include "../topology/topology.h"
+#include "benchtopo.h"
+
+//number of segments sent by the client, one every BENCH_GAP_US microseconds
+#define BENCH_SEGS 3000
+#define BENCH_GAP_US 1000
+//SRT ports of the client and of the echo server
+#define BENCH_CLIENT_PORT 87
+#define BENCH_ECHO_PORT 88
+//time a lost packet holds back a TCP link
+#define BENCH_RTO_US 3500
+//max number of packets held back by the peer on a TCP link
+#define BENCH_QUEUE 4096
+
+//the send times and the round trip times of the segments of the client, 0 if not echoed yet
+static long long sentns[BENCH_SEGS], rttns[BENCH_SEGS];
+static int network_conn;
+
+//a packet held back by the peer until its release time
+typedef struct heldpkt {
+  long long release;
+  snp_pkt_t pkt;
+} heldpkt_t;
+
+//This thread receives the echoed segments of the client and records their round trip times.
+static void *bench_clientrecv(void *arg)
+{
+  seg_t seg;
+  int srcNodeID;
+
+  while (snp_recvseg(network_conn, &srcNodeID, &seg) > 0)
+  {
+    if (seg.header.seq_num < BENCH_SEGS && rttns[seg.header.seq_num] == 0)
+      rttns[seg.header.seq_num] = benchtopo_walltime() - sentns[seg.header.seq_num];
+  }
+  return NULL;
+}
+
+//This function compares two round trip times for qsort().
+static int bench_cmp(const void *a, const void *b)
+{
+  long long x = *(long long *)a, y = *(long long *)b;
+  return x < y ? -1 : x > y;
+}
+
+//This function runs the client, it sends the segments to the node destNodeID and prints their round trip times.
+static int bench_client(int destNodeID)
+{
+  struct sockaddr_in addr;
+  pthread_t thread;
+  seg_t seg;
+  long long *sorted = malloc(BENCH_SEGS * sizeof(long long));
+  int n = 0;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(NETWORK_PORT);
+  network_conn = socket(AF_INET, SOCK_STREAM, 0);
+  if (connect(network_conn, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+  {
+    printf("can not connect to the SNP process\n");
+    return 1;
+  }
+  snp_attachshm(network_conn);
+  snp_registerport(network_conn, BENCH_CLIENT_PORT);
+  pthread_create(&thread, NULL, bench_clientrecv, NULL);
+
+  memset(&seg, 0, sizeof(seg_t));
+  seg.header.src_port = BENCH_CLIENT_PORT;
+  seg.header.dest_port = BENCH_ECHO_PORT;
+  seg.header.type = DATA;
+  seg.header.length = 100;
+  for (int i = 0; i < BENCH_SEGS; i++)
+  {
+    seg.header.seq_num = i;
+    sentns[i] = benchtopo_walltime();
+    snp_sendseg(network_conn, destNodeID, &seg);
+    usleep(BENCH_GAP_US);
+  }
+  //the last echoed segments may still be held back by a lossy link
+  sleep(1);
+
+  for (int i = 0; i < BENCH_SEGS; i++)
+  {
+    if (rttns[i] > 0)
+      sorted[n++] = rttns[i];
+  }
+  if (n == 0)
+  {
+    printf("no segment came back\n");
+    return 1;
+  }
+  qsort(sorted, n, sizeof(long long), bench_cmp);
+  printf("delivered %d/%d median %.0f us p99 %.0f us max %.0f us\n", n, BENCH_SEGS, sorted[n / 2] / 1e3, sorted[n * 99 / 100] / 1e3, sorted[n - 1] / 1e3);
+  return 0;
+}
+
+//This function returns 1 with the given probability.
+static int bench_lost(double loss)
+{
+  return rand() < loss * RAND_MAX;
+}
+
+//This function turns the SNP packet pkt into its echo: it goes back to its source, and the ports of its segment are swapped.
+//Swapping the ports keeps the checksum of the segment valid.
+static void bench_echo(snp_pkt_t *pkt, int myNodeID)
+{
+  seg_t *seg = (seg_t *)pkt->data;
+  unsigned int port = seg->header.src_port;
+
+  seg->header.src_port = seg->header.dest_port;
+  seg->header.dest_port = port;
+  pkt->header.dest_nodeID = pkt->header.src_nodeID;
+  pkt->header.src_nodeID = myNodeID;
+  pkt->header.ttl = SNP_INITIAL_TTL;
+}
+
+//This function fills the heartbeat or the distance vector the peer sends every HEARTBEAT_INTERVAL / 2 milliseconds.
+//The distance vector makes the neighbor route to the peer over the link.
+static void bench_control(snp_pkt_t *pkt, int type, int myNodeID, int nbrID)
+{
+  pkt_routeupdate_t *update = (pkt_routeupdate_t *)pkt->data;
+
+  memset(pkt, 0, sizeof(snp_pkt_t));
+  pkt->header.src_nodeID = myNodeID;
+  pkt->header.type = type;
+  if (type == HEARTBEAT)
+  {
+    pkt->header.dest_nodeID = nbrID;
+    return;
+  }
+  pkt->header.dest_nodeID = BROADCAST_NODEID;
+  pkt->header.length = sizeof(pkt_routeupdate_t);
+  update->entryNum = 2;
+  update->entry[0].nodeID = myNodeID;
+  update->entry[0].cost = 0;
+  update->entry[1].nodeID = nbrID;
+  update->entry[1].cost = topology_getCost(myNodeID, nbrID);
+}
+
+//This function sends a packet to the neighbor over the UDP link, unless it is lost.
+static void bench_udpsend(int sock, struct sockaddr_in *nbr, unsigned int *seqNum, snp_pkt_t *pkt, double loss)
+{
+  char buf[UDPLINK_MAX_LEN];
+  size_t len = sizeof(snp_hdr_t) + pkt->header.length;
+
+  ((link_hdr_t *)buf)->seqNum = (*seqNum)++;
+  memcpy(buf + sizeof(link_hdr_t), pkt, len);
+  if (!bench_lost(loss))
+    sendto(sock, buf, sizeof(link_hdr_t) + len, 0, (struct sockaddr *)nbr, sizeof(struct sockaddr_in));
+}
+
+//This function runs the peer on a UDP link.
+static void bench_peerudp(struct sockaddr_in *nbr, int myNodeID, int nbrID, double loss)
+{
+  struct sockaddr_in addr;
+  struct pollfd fds;
+  char buf[UDPLINK_MAX_LEN];
+  snp_pkt_t *pkt = (snp_pkt_t *)(buf + sizeof(link_hdr_t)), control;
+  unsigned int seqNum = 0;
+  long long lastControl = 0;
+  ssize_t len;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(CONNECTION_PORT);
+  topology_getMyNodeIP(&addr.sin_addr.s_addr);
+  fds.fd = socket(AF_INET, SOCK_DGRAM, 0);
+  fds.events = POLLIN;
+  if (bind(fds.fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+  {
+    printf("can not bind the UDP link\n");
+    exit(1);
+  }
+
+  while (1)
+  {
+    if (benchtopo_walltime() - lastControl > HEARTBEAT_INTERVAL * 500000LL)
+    {
+      bench_control(&control, HEARTBEAT, myNodeID, nbrID);
+      bench_udpsend(fds.fd, nbr, &seqNum, &control, 0);
+      bench_control(&control, ROUTE_UPDATE, myNodeID, nbrID);
+      bench_udpsend(fds.fd, nbr, &seqNum, &control, 0);
+      lastControl = benchtopo_walltime();
+    }
+
+    if (poll(&fds, 1, HEARTBEAT_INTERVAL / 4) <= 0)
+      continue;
+    len = recv(fds.fd, buf, sizeof(buf), 0);
+    if (len < (ssize_t)(sizeof(link_hdr_t) + sizeof(snp_hdr_t)) || pkt->header.type != SNP || pkt->header.dest_nodeID != myNodeID ||
+        bench_lost(loss))
+      continue;
+    bench_echo(pkt, myNodeID);
+    bench_udpsend(fds.fd, nbr, &seqNum, pkt, loss);
+  }
+}
+
+//This function runs the peer on a TCP link. The peer has the larger node ID, so it connects to the neighbor.
+static void bench_peertcp(struct sockaddr_in *nbr, int myNodeID, int nbrID, double loss)
+{
+  struct sockaddr_in addr;
+  struct pollfd fds;
+  heldpkt_t *held = malloc(BENCH_QUEUE * sizeof(heldpkt_t));
+  snp_pkt_t control;
+  unsigned int head = 0, tail = 0;
+  long long now, release = 0, lastControl = 0;
+  int one = 1, timeout;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  topology_getMyNodeIP(&addr.sin_addr.s_addr);
+  while (1)
+  {
+    fds.fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (bind(fds.fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 && connect(fds.fd, (struct sockaddr *)nbr, sizeof(struct sockaddr_in)) == 0)
+      break;
+    close(fds.fd);
+    usleep(50000);
+  }
+  setsockopt(fds.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  fds.events = POLLIN;
+
+  while (1)
+  {
+    now = benchtopo_walltime();
+    if (now - lastControl > HEARTBEAT_INTERVAL * 500000LL)
+    {
+      bench_control(&control, HEARTBEAT, myNodeID, nbrID);
+      sendpkt(&control, fds.fd);
+      bench_control(&control, ROUTE_UPDATE, myNodeID, nbrID);
+      sendpkt(&control, fds.fd);
+      lastControl = now;
+    }
+
+    //the echoes go out in order, each once its release time is reached
+    while (head != tail && held[head % BENCH_QUEUE].release <= now)
+      sendpkt(&held[head++ % BENCH_QUEUE].pkt, fds.fd);
+
+    timeout = HEARTBEAT_INTERVAL / 4;
+    if (head != tail && (held[head % BENCH_QUEUE].release - now) / 1000000 < timeout)
+      timeout = (held[head % BENCH_QUEUE].release - now) / 1000000;
+    if (poll(&fds, 1, timeout) <= 0)
+      continue;
+
+    if (recvpkt(&held[tail % BENCH_QUEUE].pkt, fds.fd) < 0)
+    {
+      printf("the neighbor closed the link\n");
+      exit(1);
+    }
+    if (held[tail % BENCH_QUEUE].pkt.header.type != SNP || held[tail % BENCH_QUEUE].pkt.header.dest_nodeID != myNodeID ||
+        tail - head == BENCH_QUEUE)
+      continue;
+
+    //a packet lost on the way in or on the way back stalls the link, so it holds back all the packets behind it as well
+    bench_echo(&held[tail % BENCH_QUEUE].pkt, myNodeID);
+    now = benchtopo_walltime() + BENCH_RTO_US * 1000LL * (bench_lost(loss) + bench_lost(loss));
+    release = now > release ? now : release;
+    held[tail++ % BENCH_QUEUE].release = release;
+  }
+}
+
+//This function runs the peer of the neighbor nbrIP.
+static int bench_peer(char *nbrIP, char *mode, double loss)
+{
+  struct sockaddr_in nbr;
+  int myNodeID = topology_getMyNodeID(), nbrID;
+
+  memset(&nbr, 0, sizeof(nbr));
+  nbr.sin_family = AF_INET;
+  nbr.sin_port = htons(CONNECTION_PORT);
+  if (inet_aton(nbrIP, &nbr.sin_addr) == 0 || topology_getCost(myNodeID, nbrID = topology_getNodeIDfromip(&nbr.sin_addr)) == INFINITE_COST)
+  {
+    printf("%s is not a neighbor of node %d in the topology\n", nbrIP, myNodeID);
+    return 1;
+  }
+
+  srand(myNodeID);
+  printf("peer %d of neighbor %d, %s link, loss %.1f%%\n", myNodeID, nbrID, mode, loss * 100);
+  if (strcmp(mode, "udp") == 0)
+    bench_peerudp(&nbr, myNodeID, nbrID, loss);
+  else
+    bench_peertcp(&nbr, myNodeID, nbrID, loss);
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc == 3 && strcmp(argv[1], "client") == 0)
+    return bench_client(atoi(argv[2]));
+  if (argc == 5 && strcmp(argv[1], "peer") == 0)
+    return bench_peer(argv[2], argv[3], atof(argv[4]));
+
+  printf("usage: %s client nodeID, or %s peer IP tcp|udp loss\n", argv[0], argv[0]);
+  return 1;
+}
@@ -0,0 +1,197 @@
+//FILE: bench/bench_lsdb.c
+//
+//Description: this file benchmarks the link state routing engine against the distance vector engine on synthetic topologies.
+//A topology of N nodes (node IDs 0 to N-1, up to MAX_NODEID) is a ring with random chords, every node has at most MAX_NODE_NUM neighbors,
+//so its LSA fits in a pkt_lsa_t. The link state side installs the LSAs of all the nodes with lsdb_update() and runs lsdb_computeroutes()
+//from every node. The distance vector side replays the relaxation of dv_recompute() at every node in synchronous rounds,
+//one round per ROUTEUPDATE_INTERVAL, until no distance vector changes. Both sides must end with the same route costs.
+//
+//Run make bench, or ./bench/bench_lsdb [N ...].
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/constants.h"
+#include "../common/pkt.h"
+#include "../network/lsdb.h"
+#include "../network/routingtable.h"
+#include "benchtopo.h"
+
+//every route computation is repeated until it ran for at least BENCH_MIN_NS
+#define BENCH_MIN_NS 200000000LL
+
+//This function runs one round of the distance vector engine: every node recomputes its distance vector from the vectors
+//its neighbors sent in the previous round, as dv_recompute() does, and writes its routing table.
+//Return the number of nodes whose distance vector changed.
+static int dv_round(benchtopo_t *topo, unsigned int (*dv)[MAX_NODEID], unsigned int (*newdv)[MAX_NODEID], routingtable_t *tables)
+{
+  int changed = 0;
+
+  for (int u = 0; u < topo->nodeNum; u++)
+  {
+    int nodeChanged = 0;
+
+    for (int dest = 0; dest < topo->nodeNum; dest++)
+    {
+      unsigned int best = INFINITE_COST;
+      int nextID[MAX_ECMP_PATHS], nextNum = 0;
+
+      if (dest == u)
+      {
+        newdv[u][dest] = 0;
+        continue;
+      }
+
+      for (int j = 0; j < topo->nbrNum[u]; j++)
+      {
+        int v = topo->nbr[u][j];
+        unsigned int cost = topo->cost[u][v] + (v == dest ? 0 : dv[v][dest]);
+
+        if (cost >= INFINITE_COST || cost > best)
+          continue;
+
+        if (cost < best)
+        {
+          best = cost;
+          nextNum = 0;
+        }
+        if (nextNum < MAX_ECMP_PATHS)
+          nextID[nextNum++] = v;
+      }
+
+      if (dv[u][dest] != best)
+        nodeChanged = 1;
+      newdv[u][dest] = best;
+
+      routingtable_setnextnode(&tables[u], dest, nextNum > 0 ? nextID[0] : -1);
+      for (int k = 1; k < nextNum; k++)
+        routingtable_addnextnode(&tables[u], dest, nextID[k]);
+    }
+    changed += nodeChanged;
+  }
+
+  return changed;
+}
+
+//This function returns the cost of the path from src to dest following the first next hops of the routing tables of every node,
+//or INFINITE_COST if the path is broken or loops.
+static unsigned int path_cost(benchtopo_t *topo, routingtable_t *tables, int src, int dest)
+{
+  unsigned int cost = 0;
+  int hops = 0;
+
+  while (src != dest)
+  {
+    int next = routingtable_getnextnode(&tables[src], dest);
+
+    if (next == -1 || ++hops > topo->nodeNum)
+      return INFINITE_COST;
+    cost += topo->cost[src][next];
+    src = next;
+  }
+
+  return cost;
+}
+
+//This function benchmarks both engines on the topology of nodeNum nodes and prints one line of results.
+static void bench_run(int nodeNum)
+{
+  benchtopo_t *topo = malloc(sizeof(benchtopo_t));
+  lsdb_t *lsdb = lsdb_create();
+  routingtable_t *lstables = calloc(nodeNum, sizeof(routingtable_t));
+  routingtable_t *dvtables = calloc(nodeNum, sizeof(routingtable_t));
+  unsigned int (*dv)[MAX_NODEID] = malloc(sizeof(unsigned int[MAX_NODEID][MAX_NODEID]));
+  unsigned int (*newdv)[MAX_NODEID] = malloc(sizeof(unsigned int[MAX_NODEID][MAX_NODEID]));
+  unsigned int (*tmp)[MAX_NODEID];
+  long long start, lsns, dvns;
+  int runs, rounds, mismatches = 0;
+
+  benchtopo_generate(topo, nodeNum);
+  benchtopo_buildlsdb(topo, lsdb);
+
+  //link state: every node runs Dijkstra once over the full LSDB
+  runs = 0;
+  start = benchtopo_cputime();
+  do
+  {
+    for (int u = 0; u < nodeNum; u++)
+      lsdb_computeroutes(lsdb, u, &lstables[u]);
+    runs++;
+  } while (benchtopo_cputime() - start < BENCH_MIN_NS);
+  lsns = (benchtopo_cputime() - start) / runs;
+
+  //distance vector: rounds from the initial vectors (only the direct links known) until no vector changes
+  runs = 0;
+  start = benchtopo_cputime();
+  do
+  {
+    for (int u = 0; u < nodeNum; u++)
+    {
+      for (int dest = 0; dest < nodeNum; dest++)
+        dv[u][dest] = u == dest ? 0 : INFINITE_COST;
+    }
+    rounds = 0;
+    while (dv_round(topo, dv, newdv, dvtables) > 0)
+    {
+      tmp = dv;
+      dv = newdv;
+      newdv = tmp;
+      rounds++;
+    }
+    runs++;
+  } while (benchtopo_cputime() - start < BENCH_MIN_NS);
+  dvns = (benchtopo_cputime() - start) / runs;
+
+  for (int u = 0; u < nodeNum; u++)
+  {
+    for (int dest = 0; dest < nodeNum; dest++)
+    {
+      if (path_cost(topo, lstables, u, dest) != dv[u][dest] || path_cost(topo, dvtables, u, dest) != dv[u][dest])
+        mismatches++;
+    }
+  }
+
+  //a LSA is sent once over every link in each direction except back to the neighbor it came from,
+  //a distance vector is sent to every neighbor every round
+  printf("%5d %6d | %10.1f %12.1f %10d | %6d %7d %12.1f %10d | %s\n", nodeNum, topo->linkNum,
+         lsns / 1000.0 / nodeNum, lsns / 1000.0, nodeNum * (2 * topo->linkNum - (nodeNum - 1)),
+         rounds, rounds * ROUTEUPDATE_INTERVAL, dvns / 1000.0, rounds * 2 * topo->linkNum,
+         mismatches == 0 ? "same costs" : "COST MISMATCH");
+
+  free(dv);
+  free(newdv);
+  free(lstables);
+  free(dvtables);
+  lsdb_destroy(lsdb);
+  free(topo);
+}
+
+int main(int argc, char *argv[])
+{
+  int sizes[] = {10, 32, 64, 128, 256};
+  int nodeNum;
+
+  printf("link state (Dijkstra from every node) vs distance vector (synchronous rounds) on a ring with random chords, degree <= %d\n", MAX_NODE_NUM);
+  printf("nodes  links | us/node    us all nodes  LSAs sent  | rounds conv(s)  us all nodes DVs sent   | check\n");
+
+  if (argc > 1)
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      nodeNum = atoi(argv[i]);
+      if (nodeNum < 3 || nodeNum > MAX_NODEID)
+      {
+        printf("the number of nodes must be between 3 and %d\n", MAX_NODEID);
+        return 1;
+      }
+      bench_run(nodeNum);
+    }
+    return 0;
+  }
+
+  for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    bench_run(sizes[i]);
+  return 0;
+}
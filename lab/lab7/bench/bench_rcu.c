@@ -0,0 +1,197 @@
+//FILE: bench/bench_rcu.c
+//
+//Description: this file benchmarks the forwarding path during a storm of route updates.
+//BENCH_READERS threads look up next hops for rotating destinations and flows, as pkthandler and waitTransport() do for every forwarded packet,
+//while a writer thread recomputes the routes of a node of a synthetic topology of MAX_NODEID nodes (see benchtopo.h) with
+//lsdb_computeroutes() over and over, with a changed link cost every time.
+//The routing table is either published RCU-style (routingtable_rcu_t, the readers never wait for the writer), or protected by
+//a mutex held by the writer during the whole computation, as routingtable_mutex was before. With the mutex, the lookups which find it
+//held by the writer and the time they wait for it are counted.
+//
+//Run make bench, or ./bench/bench_rcu [seconds].
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "../common/constants.h"
+#include "../network/lsdb.h"
+#include "../network/routingtable.h"
+#include "benchtopo.h"
+
+//number of forwarding threads
+#define BENCH_READERS 2
+
+//the shared state of a run
+typedef struct benchrun {
+  int useRcu;                //1 for the RCU published table, 0 for the mutex protected table
+  int storm;                 //1 if the writer recomputes the routes during the run
+  int stop;                  //set to 1 at the end of the run
+  int nodeNum;               //number of nodes of the topology
+  lsdb_t *lsdb;              //link state database the writer computes the routes from
+  routingtable_rcu_t *rcu;   //the RCU published table
+  routingtable_t *table;     //the mutex protected table
+  pthread_mutex_t mutex;     //protects table
+  unsigned long lookups[BENCH_READERS];
+  unsigned long blocked[BENCH_READERS];   //number of lookups which waited for the writer to release the mutex
+  long long blockedns[BENCH_READERS];     //time spent waiting for the writer in nanoseconds
+  unsigned long updates;
+} benchrun_t;
+
+//this is the argument of a reader thread
+typedef struct benchreader {
+  benchrun_t *run;
+  int id;
+} benchreader_t;
+
+//This thread looks up next hops until the run stops, and counts them.
+static void *bench_reader(void *arg)
+{
+  benchreader_t *reader = (benchreader_t *)arg;
+  benchrun_t *run = reader->run;
+  unsigned long n = 0, blocked = 0;
+  long long start, blockedns = 0;
+  int dest, nextNodeID, noroute = 0;
+
+  while (!__atomic_load_n(&run->stop, __ATOMIC_RELAXED))
+  {
+    dest = 1 + n % (run->nodeNum - 1);
+    if (run->useRcu)
+      nextNodeID = routingtable_rcu_getflownextnode(run->rcu, dest, n);
+    else
+    {
+      if (pthread_mutex_trylock(&run->mutex) != 0)
+      {
+        //the packet waits until the writer is done with the routing table
+        start = benchtopo_walltime();
+        pthread_mutex_lock(&run->mutex);
+        blockedns += benchtopo_walltime() - start;
+        blocked++;
+      }
+      nextNodeID = routingtable_getflownextnode(run->table, dest, n);
+      pthread_mutex_unlock(&run->mutex);
+    }
+    noroute += nextNodeID == -1;
+    n++;
+  }
+
+  if (noroute > 0)
+    printf("reader %d: %d lookups found no route\n", reader->id, noroute);
+  run->lookups[reader->id] = n;
+  run->blocked[reader->id] = blocked;
+  run->blockedns[reader->id] = blockedns;
+  return NULL;
+}
+
+//This thread recomputes the routes of node 0 until the run stops, every time after changing the cost of one of its links.
+static void *bench_writer(void *arg)
+{
+  benchrun_t *run = (benchrun_t *)arg;
+  lsdb_entry_t *lsa = &run->lsdb->lsa[0];
+  unsigned int cost = lsa->entry[0].cost;
+  routingtable_t *table;
+  unsigned long n = 0;
+
+  while (!__atomic_load_n(&run->stop, __ATOMIC_RELAXED))
+  {
+    lsa->entry[0].cost = n % 2 == 0 ? cost + BENCHTOPO_MAX_COST : cost;
+    if (run->useRcu)
+    {
+      table = routingtable_rcu_update_begin(run->rcu);
+      lsdb_computeroutes(run->lsdb, 0, table);
+      routingtable_rcu_publish(run->rcu, table);
+    }
+    else
+    {
+      pthread_mutex_lock(&run->mutex);
+      lsdb_computeroutes(run->lsdb, 0, run->table);
+      pthread_mutex_unlock(&run->mutex);
+    }
+    n++;
+  }
+
+  lsa->entry[0].cost = cost;
+  run->updates = n;
+  return NULL;
+}
+
+//This function runs the readers, and the writer if storm is 1, for the given number of seconds and prints one line of results.
+static void bench_run(benchtopo_t *topo, lsdb_t *lsdb, int useRcu, int storm, double seconds)
+{
+  benchrun_t run;
+  benchreader_t readers[BENCH_READERS];
+  pthread_t readerThreads[BENCH_READERS], writerThread;
+  routingtable_t *table = calloc(1, sizeof(routingtable_t));
+  unsigned long lookups = 0, blocked = 0;
+  long long start, elapsed, blockedns = 0;
+
+  memset(&run, 0, sizeof(benchrun_t));
+  run.useRcu = useRcu;
+  run.storm = storm;
+  run.nodeNum = topo->nodeNum;
+  run.lsdb = lsdb;
+  lsdb_computeroutes(lsdb, 0, table);
+  if (useRcu)
+    run.rcu = routingtable_rcu_create(table);
+  else
+    run.table = table;
+  pthread_mutex_init(&run.mutex, NULL);
+
+  start = benchtopo_walltime();
+  for (int i = 0; i < BENCH_READERS; i++)
+  {
+    readers[i].run = &run;
+    readers[i].id = i;
+    pthread_create(&readerThreads[i], NULL, bench_reader, &readers[i]);
+  }
+  if (storm)
+    pthread_create(&writerThread, NULL, bench_writer, &run);
+
+  while (benchtopo_walltime() - start < seconds * 1e9)
+    sched_yield();
+  __atomic_store_n(&run.stop, 1, __ATOMIC_RELAXED);
+
+  for (int i = 0; i < BENCH_READERS; i++)
+  {
+    pthread_join(readerThreads[i], NULL);
+    lookups += run.lookups[i];
+    blocked += run.blocked[i];
+    blockedns += run.blockedns[i];
+  }
+  if (storm)
+    pthread_join(writerThread, NULL);
+  elapsed = benchtopo_walltime() - start;
+
+  printf("%-6s %-12s | %12.0f | %12.0f %12.1f | %10.0f\n", useRcu ? "rcu" : "mutex", storm ? "update storm" : "no updates",
+         lookups / (elapsed / 1e9), blocked / (elapsed / 1e9), blockedns / 1e6 / (elapsed / 1e9), run.updates / (elapsed / 1e9));
+
+  if (useRcu)
+    routingtable_rcu_destroy(run.rcu);
+  else
+    routingtable_destroy(run.table);
+  pthread_mutex_destroy(&run.mutex);
+}
+
+int main(int argc, char *argv[])
+{
+  benchtopo_t *topo = malloc(sizeof(benchtopo_t));
+  lsdb_t *lsdb = lsdb_create();
+  double seconds = argc > 1 ? atof(argv[1]) : 1;
+
+  benchtopo_generate(topo, MAX_NODEID);
+  benchtopo_buildlsdb(topo, lsdb);
+
+  printf("%d forwarding threads, writer recomputing the routes of a %d node topology, %.1f s per run\n", BENCH_READERS, MAX_NODEID, seconds);
+  printf("table  writer       | lookups/s    | blocked/s    blocked ms/s | updates/s\n");
+  bench_run(topo, lsdb, 0, 0, seconds);
+  bench_run(topo, lsdb, 0, 1, seconds);
+  bench_run(topo, lsdb, 1, 0, seconds);
+  bench_run(topo, lsdb, 1, 1, seconds);
+
+  lsdb_destroy(lsdb);
+  free(topo);
+  return 0;
+}
@@ -0,0 +1,285 @@
+//FILE: bench/bench_shmring.c
+//
+//Description: this file benchmarks the local hop between the SNP process and the ON process, over the shared memory channel
+//(see common/shmring.h) against the loopback TCP connection it replaces when the SNP process is started with shm.
+//The benchmark forks, the parent plays the SNP process and the child plays the ON process. Every packet is a full snp_pkt_t of
+//1504 bytes with its next hop, sent with overlay_sendpkt() and received with getpktToSend() on TCP, and written in place into
+//a ring slot on the channel. The ring consumer sleeps on its doorbell when the ring is empty, as the ON and SNP processes do.
+//The round trip is measured by a ping-pong of one packet, the child sends every packet back with forwardpktToSNP().
+//The one way rate is measured by BENCH_PKTS packets sent back to back, the child answers the last one only.
+//The hop between a SRT process and the SNP process is measured in a single process, as the cost of moving one sendseg_arg_t
+//from the sender to the receiver: send() and getsegToSend() on a loopback TCP connection, against a copy into a ring slot
+//with shmring_reserve() and shmring_commit() and the shmring_peek() and shmring_release() of the receiver, as snp_sendseg() and
+//the SNP process do.
+//
+//Run make bench, or ./bench/bench_shmring [round trips].
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "../common/constants.h"
+#include "../common/pkt.h"
+#include "../common/seg.h"
+#include "../common/shmring.h"
+#include "benchtopo.h"
+
+//number of packets of the one way run
+#define BENCH_PKTS 200000
+//number of segments of the SRT to SNP hop measurement
+#define BENCH_SEGS 1000000
+//next hop of the packets of the one way run but the last one, the child answers the packet whose next hop is not BENCH_NOREPLY
+#define BENCH_NOREPLY 1
+#define BENCH_REPLY 2
+
+//This function fills a full size data packet.
+static void bench_fillpkt(snp_pkt_t *pkt)
+{
+  memset(pkt, 0, sizeof(snp_pkt_t));
+  pkt->header.src_nodeID = 1;
+  pkt->header.dest_nodeID = 2;
+  pkt->header.type = SNP;
+  pkt->header.length = MAX_PKT_LEN;
+  memset(pkt->data, 'x', MAX_PKT_LEN);
+}
+
+//This function opens a loopback TCP connection with TCP_NODELAY set at both ends, as between the SNP and ON processes.
+//Return 1 and set the two ends on success, -1 on failure.
+static int bench_tcppair(int *snp_conn, int *on_conn)
+{
+  struct sockaddr_in addr;
+  socklen_t addrlen = sizeof(addr);
+  int listenfd, one = 1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  listenfd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenfd < 0 || bind(listenfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenfd, 1) < 0 ||
+      getsockname(listenfd, (struct sockaddr *)&addr, &addrlen) < 0)
+    return -1;
+
+  *snp_conn = socket(AF_INET, SOCK_STREAM, 0);
+  if (connect(*snp_conn, (struct sockaddr *)&addr, sizeof(addr)) < 0 || (*on_conn = accept(listenfd, NULL, NULL)) < 0)
+    return -1;
+  close(listenfd);
+
+  setsockopt(*snp_conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  setsockopt(*on_conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return 1;
+}
+
+//This function writes a packet and its next hop into the next slot of the ring, it yields the CPU while the ring is full.
+static void bench_ringsend(shmring_t *ring, int doorbell, int nextNodeID, snp_pkt_t *pkt)
+{
+  sendpkt_arg_t *slot;
+
+  while ((slot = shmring_reserve(ring)) == NULL)
+    sched_yield();
+  slot->nextNodeID = nextNodeID;
+  memcpy(&slot->pkt, pkt, sizeof(snp_hdr_t) + pkt->header.length);
+  shmring_commit(ring, doorbell);
+}
+
+//This function reads the next packet of the ring into pkt, it sleeps on the doorbell while the ring is empty.
+//Return the next hop of the packet, -1 if conn is closed.
+static int bench_ringrecv(shmring_t *ring, int doorbell, int conn, snp_pkt_t *pkt)
+{
+  sendpkt_arg_t *slot;
+  int nextNodeID;
+
+  if (shmring_wait(ring, doorbell, conn) < 0)
+    return -1;
+  slot = shmring_peek(ring);
+  nextNodeID = slot->nextNodeID;
+  memcpy(pkt, &slot->pkt, sizeof(snp_hdr_t) + slot->pkt.header.length);
+  shmring_release(ring);
+  return nextNodeID;
+}
+
+//This function runs the ON process side of the benchmark in the child: it sends back the packets which ask for a reply,
+//until the connection is closed.
+static void bench_child(shmchannel_t *ch, int conn, int useRing)
+{
+  snp_pkt_t *pkt = malloc(sizeof(snp_pkt_t));
+  int nextNodeID;
+
+  while (1)
+  {
+    if (useRing)
+      nextNodeID = bench_ringrecv(ch->toserver, ch->toserver_fd, conn, pkt);
+    else if (getpktToSend(pkt, &nextNodeID, conn) < 0)
+      nextNodeID = -1;
+
+    if (nextNodeID < 0)
+      break;
+    if (nextNodeID == BENCH_NOREPLY)
+      continue;
+
+    if (useRing)
+      bench_ringsend(ch->toclient, ch->toclient_fd, 0, pkt);
+    else
+      forwardpktToSNP(pkt, conn);
+  }
+  free(pkt);
+}
+
+//This function sends a packet from the parent and receives the answer of the child.
+static void bench_roundtrip(shmchannel_t *ch, int conn, int useRing, int nextNodeID, snp_pkt_t *pkt)
+{
+  if (useRing)
+  {
+    bench_ringsend(ch->toserver, ch->toserver_fd, nextNodeID, pkt);
+    bench_ringrecv(ch->toclient, ch->toclient_fd, conn, pkt);
+  }
+  else
+  {
+    overlay_sendpkt(nextNodeID, pkt, conn);
+    overlay_recvpkt(pkt, conn);
+  }
+}
+
+//This function runs the round trip and the one way run over the ring or the TCP connection and prints one line of results.
+static void bench_run(int useRing, int roundtrips)
+{
+  shmchannel_t *ch = NULL;
+  snp_pkt_t *pkt = malloc(sizeof(snp_pkt_t));
+  int snp_conn, on_conn;
+  long long start, rttns, onewayns;
+  pid_t pid;
+
+  if (bench_tcppair(&snp_conn, &on_conn) < 0)
+  {
+    printf("can not open a loopback TCP connection\n");
+    exit(1);
+  }
+  //the channel is mapped before the fork, so the child shares it as the ON process does once it attached it
+  if (useRing && (ch = shmchannel_create()) == NULL)
+  {
+    printf("can not create a shared memory channel\n");
+    exit(1);
+  }
+
+  //the child must not print the buffered output again
+  fflush(stdout);
+  pid = fork();
+  if (pid == 0)
+  {
+    close(snp_conn);
+    bench_child(ch, on_conn, useRing);
+    exit(0);
+  }
+  close(on_conn);
+  bench_fillpkt(pkt);
+
+  //warm up
+  for (int i = 0; i < roundtrips / 10; i++)
+    bench_roundtrip(ch, snp_conn, useRing, BENCH_REPLY, pkt);
+
+  start = benchtopo_walltime();
+  for (int i = 0; i < roundtrips; i++)
+    bench_roundtrip(ch, snp_conn, useRing, BENCH_REPLY, pkt);
+  rttns = benchtopo_walltime() - start;
+
+  start = benchtopo_walltime();
+  for (int i = 0; i < BENCH_PKTS - 1; i++)
+  {
+    if (useRing)
+      bench_ringsend(ch->toserver, ch->toserver_fd, BENCH_NOREPLY, pkt);
+    else
+      overlay_sendpkt(BENCH_NOREPLY, pkt, snp_conn);
+  }
+  bench_roundtrip(ch, snp_conn, useRing, BENCH_REPLY, pkt);
+  onewayns = benchtopo_walltime() - start;
+
+  printf("%-14s | %8.1f us | %10.0f\n", useRing ? "shm ring" : "loopback TCP", rttns / 1e3 / roundtrips, BENCH_PKTS / (onewayns / 1e9));
+
+  close(snp_conn);
+  waitpid(pid, NULL, 0);
+  if (ch != NULL)
+    shmchannel_destroy(ch);
+  free(pkt);
+}
+
+//This function measures the cost of moving one segment from a SRT process to the SNP process over TCP and over the ring,
+//and prints one line for each.
+static void bench_seghop()
+{
+  shmchannel_t *ch = shmchannel_create();
+  sendseg_arg_t seg_arg, *slot;
+  seg_t *seg = malloc(sizeof(seg_t));
+  int srt_conn, snp_conn, nodeID, sum = 0;
+  long long start;
+
+  if (ch == NULL || bench_tcppair(&srt_conn, &snp_conn) < 0)
+  {
+    printf("can not open the channels\n");
+    exit(1);
+  }
+  memset(&seg_arg, 0, sizeof(sendseg_arg_t));
+  seg_arg.nodeID = 2;
+  seg_arg.seg.header.type = DATA;
+  seg_arg.seg.header.length = MAX_SEG_LEN;
+
+  start = benchtopo_walltime();
+  for (int i = 0; i < BENCH_SEGS; i++)
+  {
+    seg_arg.seg.header.seq_num = i;
+    send(srt_conn, &seg_arg, sizeof(sendseg_arg_t), 0);
+    getsegToSend(snp_conn, &nodeID, seg);
+    sum += seg->header.seq_num;
+  }
+  printf("%-14s | %8.0f ns\n", "loopback TCP", (benchtopo_walltime() - start) / (double)BENCH_SEGS);
+
+  start = benchtopo_walltime();
+  for (int i = 0; i < BENCH_SEGS; i++)
+  {
+    seg_arg.seg.header.seq_num = i;
+    slot = shmring_reserve(ch->toserver);
+    memcpy(slot, &seg_arg, sizeof(sendseg_arg_t));
+    shmring_commit(ch->toserver, ch->toserver_fd);
+    slot = shmring_peek(ch->toserver);
+    sum += slot->seg.header.seq_num;
+    shmring_release(ch->toserver);
+  }
+  printf("%-14s | %8.0f ns\n", "shm ring", (benchtopo_walltime() - start) / (double)BENCH_SEGS);
+
+  //the sum keeps the reads from being optimized away
+  if (sum == 0)
+    printf("no segment received\n");
+
+  close(srt_conn);
+  close(snp_conn);
+  shmchannel_destroy(ch);
+  free(seg);
+}
+
+int main(int argc, char *argv[])
+{
+  int roundtrips = argc > 1 ? atoi(argv[1]) : 20000;
+
+  if (roundtrips <= 0)
+  {
+    printf("the number of round trips must be positive\n");
+    return 1;
+  }
+
+  printf("SNP to ON hop, %d byte sendpkt_arg_t, %d round trips, %d packets one way\n", (int)sizeof(sendpkt_arg_t), roundtrips, BENCH_PKTS);
+  printf("channel        | round trip  | packets/s one way\n");
+  bench_run(0, roundtrips);
+  bench_run(1, roundtrips);
+
+  printf("SRT to SNP hop, %d byte sendseg_arg_t, %d segments\n", (int)sizeof(sendseg_arg_t), BENCH_SEGS);
+  printf("channel        | per segment\n");
+  bench_seghop();
+  return 0;
+}
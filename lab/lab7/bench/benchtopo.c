@@ -0,0 +1,86 @@
+//FILE: bench/benchtopo.c
+//
+//Description: this file implements the synthetic topologies the routing benchmarks run on.
+//
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/pkt.h"
+#include "benchtopo.h"
+
+//This function adds a link between u and v with the given cost to the topology.
+//Return 1 if the link is added, -1 if it exists already or one of the nodes has MAX_NODE_NUM neighbors.
+static int benchtopo_addlink(benchtopo_t *topo, int u, int v, unsigned int cost)
+{
+  if (u == v || topo->cost[u][v] != INFINITE_COST || topo->nbrNum[u] == MAX_NODE_NUM || topo->nbrNum[v] == MAX_NODE_NUM)
+    return -1;
+
+  topo->cost[u][v] = topo->cost[v][u] = cost;
+  topo->nbr[u][topo->nbrNum[u]++] = v;
+  topo->nbr[v][topo->nbrNum[v]++] = u;
+  topo->linkNum++;
+  return 1;
+}
+
+//This function generates a connected topology of nodeNum nodes: a ring with random chords and random link costs.
+//The same nodeNum always gives the same topology.
+void benchtopo_generate(benchtopo_t *topo, int nodeNum)
+{
+  int tries;
+
+  memset(topo, 0, sizeof(benchtopo_t));
+  topo->nodeNum = nodeNum;
+  for (int u = 0; u < MAX_NODEID; u++)
+  {
+    for (int v = 0; v < MAX_NODEID; v++)
+      topo->cost[u][v] = INFINITE_COST;
+  }
+
+  srand(nodeNum);
+  for (int u = 0; u < nodeNum; u++)
+    benchtopo_addlink(topo, u, (u + 1) % nodeNum, 1 + rand() % BENCHTOPO_MAX_COST);
+
+  for (tries = 0; topo->linkNum < nodeNum * BENCHTOPO_DEGREE / 2 && tries < 100 * nodeNum; tries++)
+    benchtopo_addlink(topo, rand() % nodeNum, rand() % nodeNum, 1 + rand() % BENCHTOPO_MAX_COST);
+}
+
+//This function installs in lsdb the LSAs of all the nodes of the topology, as every node holds them once they are flooded.
+void benchtopo_buildlsdb(benchtopo_t *topo, lsdb_t *lsdb)
+{
+  pkt_lsa_t lsa;
+
+  for (int u = 0; u < topo->nodeNum; u++)
+  {
+    memset(&lsa, 0, sizeof(pkt_lsa_t));
+    lsa.nodeID = u;
+    lsa.seqNum = 1;
+    lsa.entryNum = topo->nbrNum[u];
+    for (int i = 0; i < topo->nbrNum[u]; i++)
+    {
+      lsa.entry[i].nodeID = topo->nbr[u][i];
+      lsa.entry[i].cost = topo->cost[u][topo->nbr[u][i]];
+    }
+    lsdb_update(lsdb, &lsa);
+  }
+}
+
+//This function returns the CPU time used by the process in nanoseconds.
+long long benchtopo_cputime()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//This function returns the time of the monotonic clock in nanoseconds.
+long long benchtopo_walltime()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
@@ -0,0 +1,41 @@
+//FILE: bench/benchtopo.h
+//
+//Description: this file defines the synthetic topologies the routing benchmarks run on.
+//A topology of N nodes (node IDs 0 to N-1, up to MAX_NODEID) is a ring with random chords and random link costs,
+//every node has at most MAX_NODE_NUM neighbors, so its LSA fits in a pkt_lsa_t.
+//
+
+#ifndef BENCHTOPO_H
+#define BENCHTOPO_H
+
+#include "../common/constants.h"
+#include "../network/lsdb.h"
+
+//number of links a node tries to have, the ring gives every node 2 of them
+#define BENCHTOPO_DEGREE 4
+//largest link cost of the synthetic topologies
+#define BENCHTOPO_MAX_COST 10
+
+//a synthetic topology: cost[u][v] is the cost of the link between u and v, INFINITE_COST if there is none
+typedef struct benchtopo {
+	int nodeNum;				//number of nodes, their IDs are 0 to nodeNum-1
+	int linkNum;				//number of links
+	int nbrNum[MAX_NODEID];			//number of neighbors of every node
+	int nbr[MAX_NODEID][MAX_NODE_NUM];	//neighbors of every node
+	unsigned int cost[MAX_NODEID][MAX_NODEID];
+} benchtopo_t;
+
+//This function generates a connected topology of nodeNum nodes: a ring with random chords and random link costs.
+//The same nodeNum always gives the same topology.
+void benchtopo_generate(benchtopo_t* topo, int nodeNum);
+
+//This function installs in lsdb the LSAs of all the nodes of the topology, as every node holds them once they are flooded.
+void benchtopo_buildlsdb(benchtopo_t* topo, lsdb_t* lsdb);
+
+//This function returns the CPU time used by the process in nanoseconds.
+long long benchtopo_cputime();
+
+//This function returns the time of the monotonic clock in nanoseconds.
+long long benchtopo_walltime();
+
+#endif
@@ -0,0 +1,42 @@
+#!/bin/bash
+#FILE: bench/loss.sh
+#
+#Description: this script measures the latency of the segments crossing a lossy overlay link, with TCP and with UDP links.
+#Node 1 runs its ON and SNP processes and bench_loss client, node 2 is played by bench_loss peer which emulates the loss
+#and echoes the segments (see bench/bench_loss.c). For every loss rate and link mode it prints the segments echoed and their
+#round trip times, and with UDP links the datagrams node 1 counted as lost.
+#A CPU left idle between two segments adds its wakeup latency to every hop (about 1 ms on a virtual machine), so a busy loop
+#at the lowest priority keeps the CPU awake during the measurement.
+#
+#usage: sudo ./bench/loss.sh [loss ...]	(from the lab7 directory after make and make bench, 0 0.01 0.05 by default)
+#
+
+LOSSES=${*:-0 0.01 0.05}
+
+. bench/netns.sh
+netns_ring 2
+
+for loss in $LOSSES; do
+	for mode in tcp udp; do
+		OVARGS=
+		[ $mode = udp ] && OVARGS=udp
+		netns_exec 1 $LAB7/overlay/overlay $OVARGS
+		netns_exec 2 $LAB7/bench/bench_loss peer 10.77.0.1 $mode $loss
+		netns_wait 1 overlay "waiting for connection from SNP process" 10
+		netns_exec 1 $LAB7/network/network
+		netns_wait 1 network "waiting for connection from SRT process" 30 || echo "node 1: not ready after 30 s"
+		#the route to node 2 comes with the first distance vector of the peer
+		sleep 0.5
+		nice -n 19 sh -c "while :; do :; done" &
+		busy=$!
+		#the client runs in the foreground, so nothing polls its log during the measurement
+		result=$(cd $NETNS_RUN/node && SRT_LOSS_RATE=0 ip netns exec lab7n1 $LAB7/bench/bench_loss client 2 | tail -1)
+		kill $busy
+		netns_kill 1 USR1 overlay
+		sleep 0.2
+		echo "$mode links, loss $loss: $result$(grep -h -o "neighbor 2 link:.*" $NETNS_RUN/node1.overlay.log | sed 's/^/, /')"
+		netns_kill 1
+		netns_kill 2
+		sleep 0.5
+	done
+done
@@ -0,0 +1,79 @@
+#!/bin/bash
+#FILE: bench/netns.sh
+#
+#Description: this file is sourced by the benchmark scripts which run several nodes on one host.
+#A node ID is the last octet of the node's IP address and the ports are fixed, so every node runs in its own network namespace
+#lab7n<i>, with the address 10.77.0.<i> on its loopback interface. Every link of the topology is a veth pair between the two
+#namespaces, with a host route to the neighbor. The processes run in a scratch directory whose ../topology/topology.dat
+#lists the links of the topology. The scripts must be run as root from the lab7 directory after make.
+#
+
+LAB7=$(pwd)
+NETNS_RUN=$(mktemp -d /tmp/lab7bench.XXXXXX)
+NETNS_NODES=0
+
+#netns_node i: creates the namespace of node i
+netns_node() {
+	ip netns add lab7n$1 || exit 1
+	ip -n lab7n$1 link set lo up
+	ip -n lab7n$1 addr add 10.77.0.$1/32 dev lo
+	NETNS_NODES=$(( NETNS_NODES > $1 ? NETNS_NODES : $1 ))
+}
+
+#netns_link i j cost: creates the link between the nodes i and j
+netns_link() {
+	ip link add l7l$1x$2 type veth peer name l7l$2x$1 || exit 1
+	ip link set l7l$1x$2 netns lab7n$1
+	ip link set l7l$2x$1 netns lab7n$2
+	ip -n lab7n$1 link set l7l$1x$2 up
+	ip -n lab7n$2 link set l7l$2x$1 up
+	ip -n lab7n$1 route add 10.77.0.$2/32 dev l7l$1x$2 src 10.77.0.$1
+	ip -n lab7n$2 route add 10.77.0.$1/32 dev l7l$2x$1 src 10.77.0.$2
+	echo "10.77.0.$1 10.77.0.$2 $3" >> $NETNS_RUN/topology/topology.dat
+}
+
+#netns_ring n: creates the nodes 1 to n and links them in a ring, with random link costs from 1 to 5
+netns_ring() {
+	mkdir -p $NETNS_RUN/topology $NETNS_RUN/node
+	: > $NETNS_RUN/topology/topology.dat
+	for i in $(seq 1 $1); do netns_node $i; done
+	for i in $(seq 1 $1); do
+		j=$(( i % $1 + 1 ))
+		[ $1 -eq 2 ] && [ $i -eq 2 ] && break
+		netns_link $i $j $(( RANDOM % 5 + 1 ))
+	done
+}
+
+#netns_exec i command...: runs a command in the namespace of node i from the scratch directory, its output goes to node<i>.<name>.log
+netns_exec() {
+	local node=$1 log=$NETNS_RUN/node$1.$(basename $2).log
+	shift
+	(cd $NETNS_RUN/node && ip netns exec lab7n$node stdbuf -oL "$@" > $log 2>&1 &) 2>/dev/null
+}
+
+#netns_wait i name pattern seconds: waits until the log of the command name on node i contains the pattern, return 1 on timeout
+netns_wait() {
+	for t in $(seq 1 $(( $4 * 20 ))); do
+		grep -q "$3" $NETNS_RUN/node$1.$2.log 2>/dev/null && return 0
+		sleep 0.05
+	done
+	return 1
+}
+
+#netns_kill i [signal [name]]: sends the signal, KILL by default, to the processes of node i, or only to those called name
+#(pkill run in the namespace would see the processes of all the nodes)
+netns_kill() {
+	for p in $(ip netns pids lab7n$1 2>/dev/null); do
+		[ -z "$3" ] || [ "$(cat /proc/$p/comm 2>/dev/null)" = "$3" ] && kill -${2:-KILL} $p 2>/dev/null
+	done
+}
+
+#netns_cleanup: kills the processes of all the nodes and removes the namespaces and the scratch directory
+netns_cleanup() {
+	for i in $(seq 1 $NETNS_NODES); do
+		netns_kill $i
+		ip netns del lab7n$i 2>/dev/null
+	done
+	rm -rf $NETNS_RUN
+}
+trap netns_cleanup EXIT
@@ -0,0 +1,40 @@
+#!/bin/bash
+#FILE: bench/startup.sh
+#
+#Description: this script measures how long a local overlay takes to become usable.
+#It starts the ON and SNP processes of n nodes linked in a ring (see bench/netns.sh) all at once, and waits until every SNP process
+#serves SRT processes. For every node it prints the time the ON process took to bring up the links to all its neighbors and the
+#time the SNP process took to have routes to all the nodes, as they print them, then the time until the last node was ready.
+#
+#usage: sudo ./bench/startup.sh [n] [ls] [udp]	(from the lab7 directory after make, n from 2 to 10, 4 by default)
+#ls runs the SNP processes in link state mode, udp runs the ON processes with UDP links.
+#
+
+NODES=4
+NETARGS=
+OVARGS=
+for arg in "$@"; do
+	case $arg in
+	ls) NETARGS=ls ;;
+	udp) OVARGS=udp ;;
+	*) NODES=$arg ;;
+	esac
+done
+
+. bench/netns.sh
+netns_ring $NODES
+
+start=$(date +%s%N)
+for i in $(seq 1 $NODES); do netns_exec $i $LAB7/overlay/overlay $OVARGS; done
+for i in $(seq 1 $NODES); do netns_exec $i $LAB7/network/network $NETARGS; done
+
+for i in $(seq 1 $NODES); do
+	netns_wait $i network "waiting for connection from SRT process" 60 || echo "node $i: not ready after 60 s"
+done
+end=$(date +%s%N)
+
+echo "$NODES nodes in a ring, ${NETARGS:-dv} routing, ${OVARGS:-tcp} links"
+for i in $(seq 1 $NODES); do
+	echo "node $i: $(grep -h -o "links to all.*" $NETNS_RUN/node$i.overlay.log), $(grep -h -o "routes to all.*" $NETNS_RUN/node$i.network.log)"
+done
+echo "all the nodes ready $(( (end - start) / 1000000 )) ms after the start"
@@ -0,0 +1,223 @@
+//FILE: client/app_file_client.c
+//
+//Description: this is the file transfer client application code. The client first connects to the local SNP process. Then it initializes the SRT client by calling srt_client_init(). It creates a socket and connects to the file transfer server by calling srt_client_sock() and srt_client_connect(). Then it streams the files given on the command line over the connection, see common/filexfer.h. Every file is mapped by windows of FILEXFER_MAP_SIZE bytes which are sent one at a time, so a file of any size is never read into memory whole. An interrupted transfer is resumed with -C offset before the file name, the file is then sent from that offset and the server keeps the data it already has before it. The client prints the throughput of every file and of the whole transfer. Finally the client disconnects from the server, closes the socket and disconnects from the local SNP process.
+
+//Date: May 6, 2008
+
+//Input: servername [-C offset] file [[-C offset] file ...]
+
+//Output: SRT client states, throughput of the transfer
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../common/constants.h"
+#include "../common/filexfer.h"
+#include "../topology/topology.h"
+#include "srt_client.h"
+#ifdef EMBEDDED_STACK
+#include "../stack/stack.h"
+#endif
+
+//After connecting to the local SNP process, wait STARTDELAY for server to start.
+#define STARTDELAY 1
+
+//This function connects to the local SNP process on port NETWORK_PORT. If TCP connection fails, return -1. The TCP socket desciptor returned will be used by SRT to send segments.
+int connectToNetwork() {
+	struct sockaddr_in servaddr;
+
+	servaddr.sin_family = AF_INET;
+	servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+	servaddr.sin_port = htons(NETWORK_PORT);
+
+	int network_conn = socket(AF_INET,SOCK_STREAM,0);
+	if(network_conn<0)
+		return -1;
+	if(connect(network_conn, (struct sockaddr*)&servaddr, sizeof(servaddr))!=0)
+		return -1;
+
+	//succefully connected
+	return network_conn;
+}
+
+//This function disconnects from the local SNP process by closing the local TCP connection to the local SNP process.
+void disconnectToNetwork(int network_conn) {
+	close(network_conn);
+}
+
+//This function returns the time in seconds from an arbitrary starting point.
+double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+//This function sends the file at path from offset to its end: the header, the name without the directory, and the data.
+//The data is mapped by windows of FILEXFER_MAP_SIZE bytes, the bytes sent are added to total.
+//Return 1 if the file is sent, 0 if it is skipped before anything is sent, -1 if the connection fails.
+int sendFile(int sockfd, const char* path, unsigned long long offset, unsigned long long* total) {
+	int fd = open(path,O_RDONLY);
+	if(fd<0) {
+		printf("can not open %s, skipped\n",path);
+		return 0;
+	}
+	struct stat st;
+	if(fstat(fd,&st)<0 || !S_ISREG(st.st_mode)) {
+		printf("%s is not a regular file, skipped\n",path);
+		close(fd);
+		return 0;
+	}
+	unsigned long long fileSize = st.st_size;
+	if(offset>fileSize) {
+		printf("offset %llu is beyond the end of %s, skipped\n",offset,path);
+		close(fd);
+		return 0;
+	}
+	const char* name = strrchr(path,'/');
+	name = name!=NULL?name+1:path;
+	if(strlen(name)==0 || strlen(name)>FILEXFER_MAX_NAME) {
+		printf("bad file name %s, skipped\n",path);
+		close(fd);
+		return 0;
+	}
+
+	filexfer_hdr_t hdr;
+	memset(&hdr,0,sizeof(hdr));
+	hdr.magic = FILEXFER_MAGIC;
+	hdr.nameLen = strlen(name);
+	hdr.fileSize = fileSize;
+	hdr.offset = offset;
+	if(srt_client_send(sockfd,&hdr,sizeof(hdr))<0 || srt_client_send(sockfd,(void*)name,hdr.nameLen)<0) {
+		close(fd);
+		return -1;
+	}
+
+	double start = now();
+	unsigned long long pos = offset;
+	while(pos<fileSize) {
+		//the windows are aligned to FILEXFER_MAP_SIZE, a multiple of the page size, the bytes of the first window before offset are not sent
+		unsigned long long mapStart = pos-pos%FILEXFER_MAP_SIZE;
+		size_t mapLen = fileSize-mapStart<FILEXFER_MAP_SIZE?fileSize-mapStart:FILEXFER_MAP_SIZE;
+		char* map = mmap(NULL,mapLen,PROT_READ,MAP_SHARED,fd,mapStart);
+		if(map==MAP_FAILED) {
+			printf("can not map %s at offset %llu\n",path,mapStart);
+			close(fd);
+			return -1;
+		}
+		madvise(map,mapLen,MADV_SEQUENTIAL);
+
+		//srt_client_send() copies the data into the send buffer, the window can be unmapped right after
+		int sent = srt_client_send(sockfd,map+(pos-mapStart),mapLen-(pos-mapStart));
+		munmap(map,mapLen);
+		if(sent<0) {
+			printf("%s interrupted after offset %llu\n",path,pos);
+			close(fd);
+			return -1;
+		}
+		*total += mapStart+mapLen-pos;
+		pos = mapStart+mapLen;
+	}
+	close(fd);
+
+	double elapsed = now()-start;
+	printf("sent %s: %llu bytes from offset %llu in %.2f s, %.2f MB/s\n",name,fileSize-offset,offset,elapsed,elapsed>0?(fileSize-offset)/elapsed/1e6:0);
+	return 1;
+}
+
+int main(int argc, char* argv[]) {
+	if(argc<3) {
+		printf("usage: %s servername [-C offset] file [[-C offset] file ...]\n",argv[0]);
+		exit(1);
+	}
+
+	//random seed for loss rate
+	srand(time(NULL));
+
+#ifdef EMBEDDED_STACK
+	//run the ON and SNP layers in this process, connectToNetwork() then connects to the SNP layer
+	if(stack_start()<0) {
+		printf("fail to start the embedded stack\n");
+		exit(1);
+	}
+#endif
+
+	//connect to SNP process and get the TCP socket descriptor
+	int network_conn = connectToNetwork();
+	if(network_conn<0) {
+		printf("fail to connect to the local SNP process\n");
+		exit(1);
+	}
+
+	//initialize srt client
+	srt_client_init(network_conn);
+	sleep(STARTDELAY);
+
+	int svr_nodeID = topology_getNodeIDfromname(argv[1]);
+	if(svr_nodeID == -1) {
+		printf("host name error!\n");
+		exit(1);
+	} else {
+		printf("connecting to node %d\n",svr_nodeID);
+	}
+
+	//create a srt client sock on port FILEXFER_CLIENTPORT and connect to srt server port FILEXFER_SVRPORT
+	int sockfd = srt_client_sock(FILEXFER_CLIENTPORT);
+	if(sockfd<0) {
+		printf("fail to create srt client sock");
+		exit(1);
+	}
+	if(srt_client_connect(sockfd,svr_nodeID,FILEXFER_SVRPORT)<0) {
+		printf("fail to connect to srt server\n");
+		exit(1);
+	}
+	printf("client connected to server, client port:%d, server port %d\n",FILEXFER_CLIENTPORT,FILEXFER_SVRPORT);
+
+	//send the files, an offset applies to the next file only
+	double start = now();
+	unsigned long long total = 0;
+	unsigned long long offset = 0;
+	int ok = 1;
+	for(int i=2;i<argc && ok;i++) {
+		if(strcmp(argv[i],"-C")==0 && i+1<argc) {
+			offset = strtoull(argv[++i],NULL,10);
+			continue;
+		}
+		ok = sendFile(sockfd,argv[i],offset,&total)>=0;
+		offset = 0;
+	}
+
+	//an empty header ends the transfer
+	filexfer_hdr_t end;
+	memset(&end,0,sizeof(end));
+	end.magic = FILEXFER_MAGIC;
+	if(ok)
+		srt_client_send(sockfd,&end,sizeof(end));
+
+	//srt_client_disconnect() returns once the server acknowledged all the data
+	if(srt_client_disconnect(sockfd)<0) {
+		printf("fail to disconnect from srt server\n");
+		exit(1);
+	}
+	double elapsed = now()-start;
+	printf("%s: %llu bytes in %.2f s, %.2f MB/s\n",ok?"transfer finished":"transfer failed",total,elapsed,elapsed>0?total/elapsed/1e6:0);
+
+	if(srt_client_close(sockfd)<0) {
+		printf("fail to close srt client\n");
+		exit(1);
+	}
+
+	//disconnect from the SNP process
+	disconnectToNetwork(network_conn);
+	return ok?0:1;
+}
@@ -21,6 +21,9 @@
 #include "../common/constants.h"
 #include "../topology/topology.h"
 #include "srt_client.h"
+#ifdef EMBEDDED_STACK
+#include "../stack/stack.h"
+#endif
 
 //One connection is created using client port CLIENTPORT1 and server port SVRPORT1. 
 #define CLIENTPORT1 87
@@ -59,6 +62,14 @@ int main() {
 	//random seed for loss rate
 	srand(time(NULL));
 
+#ifdef EMBEDDED_STACK
+	//run the ON and SNP layers in this process, connectToNetwork() then connects to the SNP layer
+	if(stack_start()<0) {
+		printf("fail to start the embedded stack\n");
+		exit(1);
+	}
+#endif
+
 	//connect to SNP process and get the TCP socket descriptor	
 	int network_conn = connectToNetwork();
 	if(network_conn<0) {
@@ -3,26 +3,30 @@
 //Description: this file contains the SRT client interface implementation
 //
 //Date: April 18,2008
+#define _GNU_SOURCE
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/select.h>
 #include <assert.h>
 #include <strings.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <time.h>
+#include <errno.h>
 #include <pthread.h>
 #include "../topology/topology.h"
 #include "srt_client.h"
 #include "../common/seg.h"
 
-//declare tcbtable as global variable
-client_tcb_t *tcbtable[MAX_TRANSPORT_CONNECTIONS];
+//declare tcbtable as global variable, static so the SRT server can be linked into the same process
+static client_tcb_t *tcbtable[MAX_TRANSPORT_CONNECTIONS];
 //declare the TCP connection to the SNP process as global variable
-int network_conn;
+static int network_conn;
 
 /*********************************************************************/
 //
@@ -32,7 +36,7 @@ int network_conn;
 
 //get the sock tcb indexed by sockfd
 //return 0 if no tcb found
-client_tcb_t *tcbtable_gettcb(int sockfd)
+static client_tcb_t *tcbtable_gettcb(int sockfd)
 {
   if (tcbtable[sockfd] != NULL)
     return tcbtable[sockfd];
@@ -42,7 +46,7 @@ client_tcb_t *tcbtable_gettcb(int sockfd)
 
 //get the sock tcb from the given client port number
 //return 0 if no tcb found
-client_tcb_t *tcbtable_gettcbFromPort(unsigned int clientPort)
+static client_tcb_t *tcbtable_gettcbFromPort(unsigned int clientPort)
 {
   int i;
   for (i = 0; i < MAX_TRANSPORT_CONNECTIONS; i++)
@@ -59,7 +63,7 @@ client_tcb_t *tcbtable_gettcbFromPort(unsigned int clientPort)
 //assign the client port with the given port number
 //return the index of the new tcb
 //return -1 if the all tcbs in tcbtable are used or the given port number is used
-int tcbtable_newtcb(unsigned int port)
+static int tcbtable_newtcb(unsigned int port)
 {
   int i;
 
@@ -91,22 +95,30 @@ int tcbtable_newtcb(unsigned int port)
 
 // This function initializes the TCB table marking all entries NULL. It also initializes
 // a global variable for the TCP socket descriptor ``conn'' used as input parameter
-// for snp_sendseg and snp_recvseg. Finally, the function starts the seghandler thread to
+// for snp_sendseg and snp_recvseg, and offers a shared memory channel to the SNP process on it
+// with snp_attachshm. Finally, the function starts the seghandler thread to
 // handle the incoming segments. There is only one seghandler for the client side which
 // handles call connections for the client.
 void srt_client_init(int conn)
 {
   //initialize global variables
-  int i;
+  int i, one = 1;
   for (i = 0; i < MAX_TRANSPORT_CONNECTIONS; i++)
   {
     tcbtable[i] = NULL;
   }
   network_conn = conn;
 
+  //without a shared memory channel, a segment must not wait on conn for the acknowledgement of the previous one
+  setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  //segments go through a shared memory channel if the SNP process attaches one, otherwise over conn
+  if (snp_attachshm(conn) == 1)
+    printf("shared memory channel to SNP process attached\n");
+
   //create the seghandler
   pthread_t seghandler_thread;
-  pthread_create(&seghandler_thread, NULL, seghandler, (void *)0);
+  pthread_create(&seghandler_thread, NULL, srt_client_seghandler, (void *)0);
 }
 
 // This function looks up the client TCB table to find the first NULL entry, and creates
@@ -133,12 +145,22 @@ int srt_client_sock(unsigned int client_port)
   my_clienttcb->sendBufunSent = 0;
   my_clienttcb->sendBufTail = 0;
   my_clienttcb->unAck_segNum = 0;
+  my_clienttcb->bufSegNum = 0;
+  my_clienttcb->timerRunning = 0;
   //create the mutex for send buffer
   pthread_mutex_t *sendBuf_mutex;
   sendBuf_mutex = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t));
   assert(sendBuf_mutex != NULL);
   pthread_mutex_init(sendBuf_mutex, NULL);
   my_clienttcb->bufMutex = sendBuf_mutex;
+  pthread_cond_t *sendBuf_cond;
+  sendBuf_cond = (pthread_cond_t *)malloc(sizeof(pthread_cond_t));
+  assert(sendBuf_cond != NULL);
+  pthread_cond_init(sendBuf_cond, NULL);
+  my_clienttcb->bufCond = sendBuf_cond;
+
+  //let the SNP process forward the segments for this port to this process
+  snp_registerport(network_conn, client_port);
 
   return sockfd;
 }
@@ -212,6 +234,8 @@ int srt_client_connect(int sockfd, int nodeID, unsigned int server_port)
 // should be started to poll the send buffer every SENDBUF_POLLING_INTERVAL time
 // to check if a timeout event should occur. If the function completes successfully,
 // it returns 1. Otherwise, it returns -1.
+// While the send buffer holds SENDBUF_MAX_SEGS segments, the function waits for the
+// server to acknowledge some of them, so data of any size can be sent in pieces.
 int srt_client_send(int sockfd, void *data, unsigned int length)
 {
   //get tcb indexed by sockfd
@@ -221,7 +245,7 @@ int srt_client_send(int sockfd, void *data, unsigned int length)
     return -1;
 
   int segNum;
-  int i;
+  int i, full;
   switch (clienttcb->state)
   {
   case CLOSED:
@@ -236,6 +260,17 @@ int srt_client_send(int sockfd, void *data, unsigned int length)
 
     for (i = 0; i < segNum; i++)
     {
+      //the send buffer is full, send what the window allows and wait for the acks
+      pthread_mutex_lock(clienttcb->bufMutex);
+      full = clienttcb->bufSegNum >= SENDBUF_MAX_SEGS;
+      pthread_mutex_unlock(clienttcb->bufMutex);
+      if (full)
+      {
+        sendBuf_send(clienttcb);
+        if (sendBuf_wait(clienttcb, SENDBUF_MAX_SEGS) < 0)
+          return -1;
+      }
+
       segBuf_t *newBuf = (segBuf_t *)malloc(sizeof(segBuf_t));
       assert(newBuf != NULL);
       bzero(newBuf, sizeof(segBuf_t));
@@ -263,6 +298,8 @@ int srt_client_send(int sockfd, void *data, unsigned int length)
 
 // This function is used to disconnect from the server. It takes the socket ID as
 // an input parameter. The socket ID is used to find the TCB entry in the TCB table.
+// The data still in the send buffer is delivered first, unless the server stops
+// acknowledging it for SENDBUF_IDLE_TIMEOUT.
 // This function sends a FIN segment to the server. After the FIN segment is sent
 // the state should transition to FINWAIT and a timer started. If the
 // state == CLOSED after the timeout the FINACK was successfully received. Else,
@@ -286,6 +323,10 @@ int srt_client_disconnect(int sockfd)
   case SYNSENT:
     return -1;
   case CONNECTED:
+    //wait until the server acknowledged all the data, a FIN would make it drop the rest
+    if (sendBuf_wait(clienttcb, 1) < 0)
+      printf("CLIENT: SEND BUFFER NOT ACKNOWLEDGED, DATA LOST\n");
+
     //send fin
     bzero(&fin, sizeof(fin));
     fin.header.type = FIN;
@@ -318,7 +359,12 @@ int srt_client_disconnect(int sockfd)
         retry--;
       }
     }
+    //the server is gone, drop what it did not acknowledge so the socket starts afresh on its next connection
     clienttcb->state = CLOSED;
+    clienttcb->svr_nodeID = -1;
+    clienttcb->svr_portNum = 0;
+    clienttcb->next_seqNum = 0;
+    sendBuf_clear(clienttcb);
     return -1;
   case FINWAIT:
     return -1;
@@ -341,6 +387,8 @@ int srt_client_close(int sockfd)
   switch (clienttcb->state)
   {
   case CLOSED:
+    pthread_cond_destroy(clienttcb->bufCond);
+    free(clienttcb->bufCond);
     free(clienttcb->bufMutex);
     free(tcbtable[sockfd]);
     tcbtable[sockfd] = NULL;
@@ -361,7 +409,7 @@ int srt_client_close(int sockfd)
 // snp_recvseg() fails then the connection to the SNP process is closed and the thread is terminated. Depending
 // on the state of the connection when a segment is received  (based on the incoming segment) various
 // actions are taken. See the client FSM for more details.
-void *seghandler(void *arg)
+void *srt_client_seghandler(void *arg)
 {
   seg_t segBuf;
   int src_nodeID;
@@ -459,6 +507,7 @@ void sendBuf_addSeg(client_tcb_t *clienttcb, segBuf_t *newSegBuf)
     if (clienttcb->sendBufunSent == 0)
       clienttcb->sendBufunSent = newSegBuf;
   }
+  clienttcb->bufSegNum++;
   pthread_mutex_unlock(clienttcb->bufMutex);
 }
 
@@ -473,12 +522,14 @@ void sendBuf_send(client_tcb_t *clienttcb)
     snp_sendseg(network_conn, clienttcb->svr_nodeID, (seg_t *)clienttcb->sendBufunSent);
     struct timeval currentTime;
     gettimeofday(&currentTime, NULL);
-    clienttcb->sendBufunSent->sentTime = currentTime.tv_sec * 1000 + currentTime.tv_usec;
-    //segBuf_timer should be started after sending out the first Data segment
-    if (clienttcb->unAck_segNum == 0)
+    clienttcb->sendBufunSent->sentTime = currentTime.tv_sec * 1000000 + currentTime.tv_usec;
+    //segBuf_timer should be started after sending out the first Data segment, one timer polls the whole buffer
+    if (!clienttcb->timerRunning)
     {
       pthread_t timer;
+      clienttcb->timerRunning = 1;
       pthread_create(&timer, NULL, sendBuf_timer, (void *)clienttcb);
+      pthread_detach(timer);
     }
     clienttcb->unAck_segNum++;
 
@@ -526,7 +577,9 @@ void sendBuf_recvAck(client_tcb_t *clienttcb, unsigned int ack_seqnum)
     bufPtr = bufPtr->next;
     free(temp);
     clienttcb->unAck_segNum--;
+    clienttcb->bufSegNum--;
   }
+  pthread_cond_broadcast(clienttcb->bufCond);
   pthread_mutex_unlock(clienttcb->bufMutex);
 }
 
@@ -548,9 +601,46 @@ void sendBuf_clear(client_tcb_t *clienttcb)
   clienttcb->sendBufHead = 0;
   clienttcb->sendBufTail = 0;
   clienttcb->unAck_segNum = 0;
+  clienttcb->bufSegNum = 0;
+  pthread_cond_broadcast(clienttcb->bufCond);
   pthread_mutex_unlock(clienttcb->bufMutex);
 }
 
+//wait until the send buffer holds less than maxSegs segments
+//return 1 if it does, -1 if the connection is no longer CONNECTED
+//or no segment is acknowledged for SENDBUF_IDLE_TIMEOUT seconds
+int sendBuf_wait(client_tcb_t *clienttcb, unsigned int maxSegs)
+{
+  struct timespec deadline;
+  unsigned int lastSegNum;
+  int result = 1;
+
+  //sendBuf_recvAck() and sendBuf_clear() signal every change of bufSegNum, the deadline moves on each acknowledgement
+  pthread_mutex_lock(clienttcb->bufMutex);
+  lastSegNum = clienttcb->bufSegNum;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += SENDBUF_IDLE_TIMEOUT;
+
+  while (clienttcb->bufSegNum >= maxSegs)
+  {
+    if (clienttcb->state != CONNECTED ||
+        pthread_cond_timedwait(clienttcb->bufCond, clienttcb->bufMutex, &deadline) == ETIMEDOUT)
+    {
+      result = -1;
+      break;
+    }
+
+    if (clienttcb->bufSegNum < lastSegNum)
+    {
+      lastSegNum = clienttcb->bufSegNum;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += SENDBUF_IDLE_TIMEOUT;
+    }
+  }
+  pthread_mutex_unlock(clienttcb->bufMutex);
+  return result;
+}
+
 //thread that continuously polls send buffer to trigger timeout events
 //if the first sent-but-unAcked segment times out, call sendBuf_timeout()
 void *sendBuf_timer(void *clienttcb)
@@ -562,13 +652,22 @@ void *sendBuf_timer(void *clienttcb)
 
     struct timeval currentTime;
     gettimeofday(&currentTime, NULL);
+    unsigned int now = currentTime.tv_sec * 1000000 + currentTime.tv_usec;
 
     //if unAck_segNum is 0, means no segments left in the send buffer, exit
+    //the check is done under the mutex, so sendBuf_send() starts a new timer for the next segment
+    pthread_mutex_lock(my_clienttcb->bufMutex);
     if (my_clienttcb->unAck_segNum == 0)
     {
+      my_clienttcb->timerRunning = 0;
+      pthread_mutex_unlock(my_clienttcb->bufMutex);
       pthread_exit(NULL);
     }
-    else if (my_clienttcb->sendBufHead->sentTime > 0 && my_clienttcb->sendBufHead->sentTime < currentTime.tv_sec * 1000000 + currentTime.tv_usec - DATA_TIMEOUT)
+    //sentTime holds the low 32 bits of the time in microseconds, the difference survives the wrap around
+    int timeout = my_clienttcb->sendBufHead->sentTime > 0 && now - my_clienttcb->sendBufHead->sentTime > DATA_TIMEOUT;
+    pthread_mutex_unlock(my_clienttcb->bufMutex);
+
+    if (timeout)
     {
       sendBuf_timeout(my_clienttcb);
     }
@@ -37,10 +37,13 @@ typedef struct client_tcb {
 	unsigned int state;     	//state of client
 	unsigned int next_seqNum;       //next sequence number to be used by new segment 
 	pthread_mutex_t* bufMutex;      //send buffer mutex
+	pthread_cond_t* bufCond;        //signaled when segments leave the send buffer
 	segBuf_t* sendBufHead;          //head of send buffer
 	segBuf_t* sendBufunSent;        //first unsent segment in send buffer
 	segBuf_t* sendBufTail;          //tail of send buffer
 	unsigned int unAck_segNum;      //number of sent-but-not-Acked segments
+	unsigned int bufSegNum;         //number of segments in send buffer
+	int timerRunning;               //1 while a sendBuf_timer thread polls the send buffer
 } client_tcb_t;
 
 
@@ -106,6 +109,8 @@ int srt_client_send(int sockfd, void* data, unsigned int length);
 // should be started to poll the send buffer every SENDBUF_POLLING_INTERVAL time
 // to check if a timeout event should occur. If the function completes successfully, 
 // it returns 1. Otherwise, it returns -1.
+// While the send buffer holds SENDBUF_MAX_SEGS segments, the function waits for the
+// server to acknowledge some of them, so data of any size can be sent in pieces.
 // 
 //
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
@@ -115,6 +120,8 @@ int srt_client_disconnect(int sockfd);
 
 // This function is used to disconnect from the server. It takes the socket ID as 
 // an input parameter. The socket ID is used to find the TCB entry in the TCB table.  
+// The data still in the send buffer is delivered first, unless the server stops
+// acknowledging it for SENDBUF_IDLE_TIMEOUT.
 // This function sends a FIN segment to the server. After the FIN segment is sent
 // the state should transition to FINWAIT and a timer started. If the 
 // state == CLOSED after the timeout the FINACK was successfully received. Else,
@@ -134,7 +141,7 @@ int srt_client_close(int sockfd);
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
 
-void *seghandler(void* arg);
+void *srt_client_seghandler(void* arg);
 
 // This is a thread  started by srt_client_init(). It handles all the incoming 
 // segments from the server. The design of seghanlder is an infinite loop that calls snp_recvseg(). If
@@ -176,6 +183,12 @@ void sendBuf_recvAck(client_tcb_t* clienttcb, unsigned int seqnum);
 void sendBuf_clear(client_tcb_t* clienttcb);
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 
+//wait until the send buffer holds less than maxSegs segments
+//return 1 if it does, -1 if the connection is no longer CONNECTED
+//or no segment is acknowledged for SENDBUF_IDLE_TIMEOUT seconds
+int sendBuf_wait(client_tcb_t* clienttcb, unsigned int maxSegs);
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
 //thread that continuously polls send buffer to trigger timeout events
 //if the first sent-but-unAcked segment times out, call sendBuf_timeout()
 void* sendBuf_timer(void* clienttcb);
@@ -31,6 +31,10 @@
 #define CLOSEWAIT_TIMEOUT 5
 //sendBuf_timer thread's polling interval in nanoseconds
 #define SENDBUF_POLLING_INTERVAL 500000000
+//srt_client_send() waits while the send buffer holds this many segments, so a large file is not buffered whole
+#define SENDBUF_MAX_SEGS 4096
+//srt_client_send() and srt_client_disconnect() give up waiting for the send buffer to drain when no segment is acknowledged for this time in seconds
+#define SENDBUF_IDLE_TIMEOUT 10
 //srt client polls the receive buffer with this time interval in order
 //to check if requested data is available in srt_srv_recv() function
 //in seconds
@@ -59,19 +63,60 @@
 //max packet data length
 #define MAX_PKT_LEN 1488
 
+//max number of frames queued to a neighbor or to the SNP process by the ON process
+//when the queue is full, new frames are dropped
+#define OVERLAY_QUEUE_LIMIT 256
+
+//tick of the ON process timer in milliseconds, reconnections and heartbeats are driven by this timer
+#define OVERLAY_TICK 100
+//a heartbeat is sent to a neighbor when nothing else has been sent to it for HEARTBEAT_INTERVAL milliseconds
+#define HEARTBEAT_INTERVAL 200
+//a neighbor link is considered down when nothing has been received from the neighbor for LINK_TIMEOUT milliseconds
+#define LINK_TIMEOUT 800
+//the delay before reconnecting to a neighbor starts at RECONNECT_MIN_DELAY milliseconds
+//and doubles after every failed attempt up to RECONNECT_MAX_DELAY milliseconds
+#define RECONNECT_MIN_DELAY 100
+#define RECONNECT_MAX_DELAY 8000
+
+//RED drop policy of the ON process queues
+//below RED_MIN_THRESHOLD frames (average queue length) no frame is dropped, above RED_MAX_THRESHOLD all new frames are dropped
+//in between, frames are dropped with a probability growing linearly up to RED_MAX_PROBABILITY
+#define RED_MIN_THRESHOLD 64
+#define RED_MAX_THRESHOLD 192
+#define RED_MAX_PROBABILITY 0.1
+//weight of the current queue length in the average queue length
+#define RED_WEIGHT 0.02
+
 /*******************************************************************/
 //network layer parameters
 /*******************************************************************/
 //max node number support by the overlay
 #define MAX_NODE_NUM 10
 
-//max routing table slots
-#define MAX_ROUTINGTABLE_SLOTS 10
+//node IDs are the last octet of the node's IP address, so every node ID is smaller than MAX_NODEID
+//the routing table has one entry for each possible node ID
+#define MAX_NODEID 256
 
 //infinite link cost value
 //if two nodes are unconnected, they will have link cost INFINITE_COST
 #define INFINITE_COST 999
 
+//initial TTL of the SNP packets sent by a SNP process
+//a loop free path visits every node at most once, so a packet which has taken MAX_NODE_NUM hops is looping and is dropped
+#define SNP_INITIAL_TTL MAX_NODE_NUM
+
+//one in TTL_LOG_SAMPLE packets dropped because their TTL expired is logged, 0 disables the log
+#define TTL_LOG_SAMPLE 100
+
+//max number of equal cost next hops kept for a destination in the routing table
+#define MAX_ECMP_PATHS 4
+
+//max number of SRT ports that can be registered at a SNP process by all the connected SRT processes
+#define MAX_TRANSPORT_PORTS 64
+
+//max number of events handled by one epoll_wait() call of the SNP process
+#define NETWORK_MAX_EVENTS 16
+
 //network layer process opens this port, and waits for connection from transport layer process,
 //you should change this to a random value to avoid conflictions with other students
 #define NETWORK_PORT 4022
@@ -79,6 +124,26 @@
 //this is the broadcasting nodeID address
 #define BROADCAST_NODEID 9999
 
+//a sendpkt_arg_t with this nextNodeID carries the shared memory channel offered by the SNP process to the ON process
+//a sendseg_arg_t with this nodeID carries the shared memory channel offered by a SRT process to the SNP process,
+//the SNP process acknowledges the attached channel with it, and the SRT process confirms the acknowledged channel with it as the first slot of its ring
+#define SHM_ATTACH_NODEID -2
+
+//ON process listens on this abstract unix socket for the shared memory channel offered by the SNP process,
+//file descriptors can not be passed over the TCP connection between them
+#define OVERLAY_SHM_NAME "snp_on_channel"
+
+//SNP process listens on this abstract unix socket for the shared memory channels offered by the SRT processes
+#define NETWORK_SHM_NAME "srt_snp_channel"
+
+//time in milliseconds a SRT process waits for the SNP process to acknowledge its shared memory channel before it keeps using TCP
+#define SHM_ATTACH_TIMEOUT 1000
+
+//number of slots of each ring of a shared memory channel
+//it must be a power of 2
+#define SHMRING_SLOTS 256
+
 //route update broadcasting interval in seconds
+//in link state mode this is also the interval at which a node refreshes its own LSA
 #define ROUTEUPDATE_INTERVAL 5
 #endif
@@ -0,0 +1,31 @@
+//FILE: common/filexfer.h
+
+//Description: this file defines the records of the SRT file transfer service, see client/app_file_client.c and server/app_file_server.c.
+//The client sends any number of files over one SRT connection. Every file is sent as a filexfer_hdr_t, the file name,
+//and the file data from the offset given in the header to the end of the file. A header with an empty name ends the transfer.
+
+#ifndef FILEXFER_H
+#define FILEXFER_H
+
+//One SRT connection is created using client port FILEXFER_CLIENTPORT and server port FILEXFER_SVRPORT.
+#define FILEXFER_CLIENTPORT 89
+#define FILEXFER_SVRPORT 90
+
+//every header starts with FILEXFER_MAGIC, anything else means the receiver lost track of the records
+#define FILEXFER_MAGIC 0x53525446
+//max length of a file name, names are sent without a directory
+#define FILEXFER_MAX_NAME 255
+//the sender maps the file by windows of FILEXFER_MAP_SIZE bytes and sends each window with one srt_client_send()
+#define FILEXFER_MAP_SIZE (1 << 20)
+//the receiver receives and writes the file by pieces of FILEXFER_CHUNK bytes, it must not exceed RECEIVE_BUF_SIZE
+#define FILEXFER_CHUNK 65536
+
+//the header sent before every file
+typedef struct filexfer_hdr {
+	unsigned int magic;		//FILEXFER_MAGIC
+	unsigned int nameLen;		//length of the file name following the header, 0 ends the transfer
+	unsigned long long fileSize;	//size of the whole file
+	unsigned long long offset;	//the data following the name starts at this offset, the receiver keeps what it has before it
+} filexfer_hdr_t;
+
+#endif
@@ -7,8 +7,7 @@ enum PKTSTATE
 {
   PKTSTART1,
   PKTSTART2,
-  PKTRECV,
-  PKTSTOP1
+  PKTRECV
 };
 
 // When sending the packet over the TCP connection between the SNP
@@ -16,11 +15,9 @@ enum PKTSTATE
 // Send !& packet !# over the TCP connection.
 // Return 1 if packet is sent successfully, otherwise return -1.
 int send_pkt_with_delimiter(int overlay_conn, void *buff, size_t len);
-// To receive the packet, this function uses a simple finite state machine(FSM)
-// PKTSTART1 -- starting point
-// PKTSTART2 -- '!' received, expecting '&' to receive data
-// PKTRECV -- '&' received, start receiving data
-// PKTSTOP1 -- '!' received, expecting '#' to finish receiving data
+// To receive the packet, this function synchronizes on the '!&' delimiter, reads
+// exactly the length of the data and checks that '!#' follows it, so a '!#'
+// inside the data does not end the frame early.
 // Return 1 if a packet is received successfully, otherwise return -1.
 int recv_pkt_without_delimiter(int overlay_conn, void *buff, size_t len);
 
@@ -50,11 +47,9 @@ int overlay_sendpkt(int nextNodeID, snp_pkt_t *pkt, int overlay_conn)
 // descriptior between the SNP process and the ON process. The packet is sent over
 // the TCP connection between the SNP process and the ON process, and delimiters
 // !& and !# are used.
-// To receive the packet, this function uses a simple finite state machine(FSM)
-// PKTSTART1 -- starting point
-// PKTSTART2 -- '!' received, expecting '&' to receive data
-// PKTRECV -- '&' received, start receiving data
-// PKTSTOP1 -- '!' received, expecting '#' to finish receiving data
+// To receive the packet, this function synchronizes on the '!&' delimiter, reads
+// exactly the length of the data and checks that '!#' follows it, so a '!#'
+// inside the data does not end the frame early.
 // Return 1 if a packet is received successfully, otherwise return -1.
 int overlay_recvpkt(snp_pkt_t *pkt, int overlay_conn)
 {
@@ -66,11 +61,9 @@ int overlay_recvpkt(snp_pkt_t *pkt, int overlay_conn)
 // The parameter network_conn is the TCP connection's socket descriptior between the
 // SNP process and the ON process. The sendpkt_arg_t structure is sent over the TCP
 // connection between the SNP process and the ON process, and delimiters !& and !# are used.
-// To receive the packet, this function uses a simple finite state machine(FSM)
-// PKTSTART1 -- starting point
-// PKTSTART2 -- '!' received, expecting '&' to receive data
-// PKTRECV -- '&' received, start receiving data
-// PKTSTOP1 -- '!' received, expecting '#' to finish receiving data
+// To receive the packet, this function synchronizes on the '!&' delimiter, reads
+// exactly the length of the data and checks that '!#' follows it, so a '!#'
+// inside the data does not end the frame early.
 // Return 1 if a sendpkt_arg_t structure is received successfully, otherwise return -1.
 int getpktToSend(snp_pkt_t *pkt, int *nextNode, int network_conn)
 {
@@ -116,11 +109,9 @@ int sendpkt(snp_pkt_t *pkt, int conn)
 // Parameter conn is the TCP connection's socket descritpor to a neighbor.
 // The packet is sent over the TCP connection  between the ON process and the neighbor,
 // and delimiters !& and !# are used.
-// To receive the packet, this function uses a simple finite state machine(FSM)
-// PKTSTART1 -- starting point
-// PKTSTART2 -- '!' received, expecting '&' to receive data
-// PKTRECV -- '&' received, start receiving data
-// PKTSTOP1 -- '!' received, expecting '#' to finish receiving data
+// To receive the packet, this function synchronizes on the '!&' delimiter, reads
+// exactly the length of the data and checks that '!#' follows it, so a '!#'
+// inside the data does not end the frame early.
 // Return 1 if the packet is received successfully, otherwise return -1.
 int recvpkt(snp_pkt_t *pkt, int conn)
 {
@@ -129,86 +120,93 @@ int recvpkt(snp_pkt_t *pkt, int conn)
 
 int send_pkt_with_delimiter(int overlay_conn, void *buff, size_t len)
 {
-  char bufstart[2];
-  char bufend[2];
+  char buf[len + 4];
 
-  bufstart[0] = '!';
-  bufstart[1] = '&';
-  bufend[0] = '!';
-  bufend[1] = '#';
+  //the whole frame is sent by one send() call, so the frames of different threads sharing the connection are not interleaved
+  buf[0] = '!';
+  buf[1] = '&';
+  memcpy(buf + 2, buff, len);
+  buf[len + 2] = '!';
+  buf[len + 3] = '#';
 
-  if (send(overlay_conn, bufstart, 2, 0) < 0)
+  if (send(overlay_conn, buf, len + 4, MSG_NOSIGNAL) < 0)
   {
     return -1;
   }
 
-  if (send(overlay_conn, buff, len, 0) < 0)
-  {
-    return -1;
-  }
+  return 1;
+}
 
-  if (send(overlay_conn, bufend, 2, 0) < 0)
+// recv_all() receives exactly len bytes from conn.
+// Return 1 if the bytes are received, otherwise return -1.
+static int recv_all(int conn, char *buf, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0)
   {
-    return -1;
+    n = recv(conn, buf, len, 0);
+    if (n <= 0)
+      return -1;
+    buf += n;
+    len -= n;
   }
-
   return 1;
 }
 
+// The frame is read in two steps, the same way the ON process parses its read buffers:
+// PKTSTART1 -- starting point
+// PKTSTART2 -- '!' received, expecting '&' to receive data
+// PKTRECV -- '&' received, the len bytes of data and the '!#' after them are read at once
+// If '!#' does not follow the data, the bytes read are searched for the next '!&'.
 int recv_pkt_without_delimiter(int overlay_conn, void *data, size_t len)
 {
   char buf[len + 2];
   char c;
-  int idx = 0;
+  size_t have = 0;
+  size_t i;
   int state = PKTSTART1;
 
-  while (recv(overlay_conn, &c, 1, 0) > 0)
+  while (1)
   {
-    if (state == PKTSTART1)
-    {
-      if (c == '!')
-        state = PKTSTART2;
-    }
-    else if (state == PKTSTART2)
+    while (state != PKTRECV)
     {
-      if (c == '&')
+      if (recv(overlay_conn, &c, 1, 0) <= 0)
+        return -1;
+      if (state == PKTSTART1)
+      {
+        if (c == '!')
+          state = PKTSTART2;
+      }
+      else if (c == '&')
         state = PKTRECV;
-      else
+      else if (c != '!')
         state = PKTSTART1;
     }
-    else if (state == PKTRECV)
+
+    if (recv_all(overlay_conn, buf + have, len + 2 - have) < 0)
+      return -1;
+
+    if (buf[len] == '!' && buf[len + 1] == '#')
     {
-      if (c == '!')
-      {
-        buf[idx] = c;
-        idx++;
-        state = PKTSTOP1;
-      }
-      else
-      {
-        buf[idx] = c;
-        idx++;
-      }
+      memcpy(data, buf, len);
+      return 1;
     }
-    else if (state == PKTSTOP1)
+
+    //not a frame, restart from the next '!&' already read, if any
+    state = PKTSTART1;
+    have = 0;
+    for (i = 0; i + 1 < len + 2; i++)
     {
-      if (c == '#')
-      {
-        memcpy(data, buf, len);
-        return 1;
-      }
-      else if (c == '!')
-      {
-        buf[idx] = c;
-        idx++;
-      }
-      else
+      if (buf[i] == '!' && buf[i + 1] == '&')
       {
-        buf[idx] = c;
-        idx++;
+        have = len - i;
+        memmove(buf, buf + i + 2, have);
         state = PKTRECV;
+        break;
       }
     }
+    if (state == PKTSTART1 && buf[len + 1] == '!')
+      state = PKTSTART2;
   }
-  return -1;
 }
@@ -10,6 +10,11 @@
 //packet type definition, used for type field in packet header
 #define ROUTE_UPDATE 1
 #define SNP 2
+#define LINK_STATE 3
+#define HEARTBEAT 4 //exchanged between neighboring ON processes to detect dead links, never forwarded to the SNP process
+#define LINK_UP 5   //sent by the ON process to the SNP process when the link to the neighbor src_nodeID is up
+#define LINK_DOWN 6 //sent by the ON process to the SNP process when the link to the neighbor src_nodeID is down
+#define SHM_ATTACHED 7 //sent by the ON process over TCP when it has attached the shared memory channel, all the later packets use the channel
 
 //SNP packet format definition
 typedef struct snpheader
@@ -18,6 +23,8 @@ typedef struct snpheader
   int dest_nodeID;           //destination node ID
   unsigned short int length; //length of the data in the packet
   unsigned short int type;   //type of the packet
+  unsigned short int ttl;    //number of hops the packet can still take, decremented by every node forwarding it
+                             //only SNP packets are forwarded along the routing tables, so only they use it
 } snp_hdr_t;
 
 typedef struct packet
@@ -43,6 +50,17 @@ typedef struct pktrt
   routeupdate_entry_t entry[MAX_NODE_NUM];
 } pkt_routeupdate_t;
 
+//link state advertisement definition
+//for a link state packet, the LSA will be stored in the data field of a packet
+//the LSA lists the direct link costs from the originating node to all its neighbors
+typedef struct pktlsa
+{
+  unsigned int nodeID;   //node ID of the node originating this LSA
+  unsigned int seqNum;   //sequence number, a LSA with a larger seqNum replaces the older one
+  unsigned int entryNum; //number of neighbor entries contained in this LSA
+  routeupdate_entry_t entry[MAX_NODE_NUM];
+} pkt_lsa_t;
+
 // sendpkt_arg_t data structure is used in the overlay_sendpkt() function.
 // overlay_sendpkt() is called by the SNP process to request
 // the ON process to send a packet out to the overlay network.
@@ -76,11 +94,9 @@ int overlay_sendpkt(int nextNodeID, snp_pkt_t *pkt, int overlay_conn);
 // descriptior between the SNP process and the ON process. The packet is sent over
 // the TCP connection between the SNP process and the ON process, and delimiters
 // !& and !# are used.
-// To receive the packet, this function uses a simple finite state machine(FSM)
-// PKTSTART1 -- starting point
-// PKTSTART2 -- '!' received, expecting '&' to receive data
-// PKTRECV -- '&' received, start receiving data
-// PKTSTOP1 -- '!' received, expecting '#' to finish receiving data
+// To receive the packet, this function synchronizes on the '!&' delimiter, reads
+// exactly the length of the data and checks that '!#' follows it, so a '!#'
+// inside the data does not end the frame early.
 // Return 1 if a packet is received successfully, otherwise return -1.
 int overlay_recvpkt(snp_pkt_t *pkt, int overlay_conn);
 
@@ -89,11 +105,9 @@ int overlay_recvpkt(snp_pkt_t *pkt, int overlay_conn);
 // The parameter network_conn is the TCP connection's socket descriptior between the
 // SNP process and the ON process. The sendpkt_arg_t structure is sent over the TCP
 // connection between the SNP process and the ON process, and delimiters !& and !# are used.
-// To receive the packet, this function uses a simple finite state machine(FSM)
-// PKTSTART1 -- starting point
-// PKTSTART2 -- '!' received, expecting '&' to receive data
-// PKTRECV -- '&' received, start receiving data
-// PKTSTOP1 -- '!' received, expecting '#' to finish receiving data
+// To receive the packet, this function synchronizes on the '!&' delimiter, reads
+// exactly the length of the data and checks that '!#' follows it, so a '!#'
+// inside the data does not end the frame early.
 // Return 1 if a sendpkt_arg_t structure is received successfully, otherwise return -1.
 int getpktToSend(snp_pkt_t *pkt, int *nextNode, int network_conn);
 
@@ -121,11 +135,9 @@ int sendpkt(snp_pkt_t *pkt, int conn);
 // Parameter conn is the TCP connection's socket descritpor to a neighbor.
 // The packet is sent over the TCP connection  between the ON process and the neighbor,
 // and delimiters !& and !# are used.
-// To receive the packet, this function uses a simple finite state machine(FSM)
-// PKTSTART1 -- starting point
-// PKTSTART2 -- '!' received, expecting '&' to receive data
-// PKTRECV -- '&' received, start receiving data
-// PKTSTOP1 -- '!' received, expecting '#' to finish receiving data
+// To receive the packet, this function synchronizes on the '!&' delimiter, reads
+// exactly the length of the data and checks that '!#' follows it, so a '!#'
+// inside the data does not end the frame early.
 // Return 1 if the packet is received successfully, otherwise return -1.
 int recvpkt(snp_pkt_t *pkt, int conn);
 
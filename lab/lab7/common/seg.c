@@ -1,33 +1,149 @@
 
+#define _GNU_SOURCE
 #include "seg.h"
+#include "shmring.h"
 #include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <poll.h>
+#include <pthread.h>
+
+//shared memory channel to the SNP process attached by snp_attachshm(), NULL while the segments go over the TCP connection
+static shmchannel_t *seg_shm = NULL;
+//TCP connection to the SNP process the channel belongs to
+static int seg_shm_conn = -1;
+//serializes the SRT threads producing into the ring to the SNP process
+static pthread_mutex_t seg_shm_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+//SRT process uses this function to offer a shared memory channel to the SNP process right after connecting to it, before any segment is sent.
+//The channel is passed over the unix socket NETWORK_SHM_NAME with the address of the SRT process's end of network_conn,
+//from which the SNP process finds the TCP connection of this SRT process. The SNP process acknowledges the channel over network_conn,
+//and the SRT process confirms it through the ring. The SNP process only delivers into the ring after the confirmation, and detaches the channel
+//if the SRT process sends over network_conn instead, so a channel this function gave up on is never used.
+//Afterwards snp_sendseg() and snp_recvseg() on network_conn use the channel.
+//A process has at most one channel: a process linking both the SRT client and server connects to the SNP process twice, the second connection keeps using TCP.
+//Return 1 if the channel is attached, otherwise return -1 and the segments keep going over network_conn.
+int snp_attachshm(int network_conn)
+{
+  sendseg_arg_t offer, ack, *slot;
+  struct sockaddr_in addr;
+  socklen_t addrlen = sizeof(struct sockaddr_in);
+  struct pollfd pfd;
+  shmchannel_t *ch;
+
+  if (seg_shm != NULL)
+    return -1;
+
+  if (getsockname(network_conn, (struct sockaddr *)&addr, &addrlen) == -1 || (ch = shmchannel_create()) == NULL)
+    return -1;
+
+  memset(&offer, 0, sizeof(sendseg_arg_t));
+  offer.nodeID = SHM_ATTACH_NODEID;
+  memcpy(offer.seg.data, &addr, sizeof(struct sockaddr_in));
+
+  pfd.fd = network_conn;
+  pfd.events = POLLIN;
+  if (shmchannel_offer(NETWORK_SHM_NAME, ch, &offer, sizeof(sendseg_arg_t)) == -1 ||
+      poll(&pfd, 1, SHM_ATTACH_TIMEOUT) != 1 ||
+      recv(network_conn, &ack, sizeof(sendseg_arg_t), MSG_WAITALL) != sizeof(sendseg_arg_t) ||
+      ack.nodeID != SHM_ATTACH_NODEID)
+  {
+    shmchannel_destroy(ch);
+    return -1;
+  }
+
+  //the SNP process delivers into the ring once it reads the confirmation, until then a late acknowledgement could have been missed
+  slot = shmring_reserve(ch->toserver);
+  memset(slot, 0, sizeof(sendseg_arg_t));
+  slot->nodeID = SHM_ATTACH_NODEID;
+  shmring_commit(ch->toserver, ch->toserver_fd);
+
+  seg_shm_conn = network_conn;
+  seg_shm = ch;
+  return 1;
+}
 
 //SRT process uses this function to send a segment and its destination node ID in a sendseg_arg_t structure to SNP process to send out.
 //Parameter network_conn is the TCP descriptor of the connection between the SRT process and the SNP process.
+//If a shared memory channel is attached to network_conn, the sendseg_arg_t is written in place into the ring to the SNP process, and is lost if the ring is full.
+//The checksum of the segment is set before it is sent.
 //Return 1 if a sendseg_arg_t is succefully sent, otherwise return -1.
 int snp_sendseg(int network_conn, int dest_nodeID, seg_t *segPtr)
 {
-  sendseg_arg_t seg_arg;
+  sendseg_arg_t seg_arg, *slot;
+
+  segPtr->header.checksum = 0;
+  segPtr->header.checksum = checksum(segPtr);
+
+  if (seg_shm != NULL && network_conn == seg_shm_conn)
+  {
+    //several SRT threads send segments, but a ring has a single producer
+    pthread_mutex_lock(&seg_shm_mutex);
+    if ((slot = shmring_reserve(seg_shm->toserver)) == NULL)
+    {
+      //the ring is full, the segment is lost as on a congested link and SRT retransmits it
+      pthread_mutex_unlock(&seg_shm_mutex);
+      return -1;
+    }
+    slot->nodeID = dest_nodeID;
+    memcpy(&slot->seg, segPtr, sizeof(seg_t));
+    shmring_commit(seg_shm->toserver, seg_shm->toserver_fd);
+    pthread_mutex_unlock(&seg_shm_mutex);
+    return 1;
+  }
+
   seg_arg.nodeID = dest_nodeID;
   memcpy(&seg_arg.seg, segPtr, sizeof(seg_t));
 
   return send(network_conn, &seg_arg, sizeof(sendseg_arg_t), 0) > 0 ? 1 : -1;
 }
 
+//SRT process uses this function to register a SRT port at the SNP process.
+//Many SRT processes can be connected to the same SNP process, the SNP process dispatches the incoming segments by their destination ports.
+//Parameter network_conn is the TCP descriptor of the connection between the SRT process and the SNP process.
+//Return 1 if the registration is succefully sent, otherwise return -1.
+int snp_registerport(int network_conn, unsigned int port)
+{
+  seg_t seg;
+  memset(&seg, 0, sizeof(seg_t));
+  seg.header.src_port = port;
+
+  return snp_sendseg(network_conn, PORT_REGISTER_NODEID, &seg);
+}
+
 //SRT process uses this function to receive a  sendseg_arg_t structure which contains a segment and its src node ID from the SNP process.
 //Parameter network_conn is the TCP descriptor of the connection between the SRT process and the SNP process.
 //When a segment is received, use seglost to determine if the segment should be discarded, also check the checksum.
+//If a shared memory channel is attached to network_conn, the sendseg_arg_t is read from the ring to the SRT process.
 //Return 1 if a sendseg_arg_t is succefully received, otherwise return -1.
 int snp_recvseg(int network_conn, int *src_nodeID, seg_t *segPtr)
 {
-  sendseg_arg_t seg_arg;
-  while (recv(network_conn, &seg_arg, sizeof(sendseg_arg_t), 0) > 0)
+  sendseg_arg_t seg_arg, *slot;
+
+  if (seg_shm != NULL && network_conn == seg_shm_conn)
   {
-    if (seglost(&seg_arg.seg) == 1)
+    //the SNP process sends nothing more over network_conn, so an event on it means the SNP process is gone
+    while (shmring_wait(seg_shm->toclient, seg_shm->toclient_fd, network_conn) == 1)
+    {
+      slot = shmring_peek(seg_shm->toclient);
+      memcpy(segPtr, &slot->seg, sizeof(seg_t));
+      *src_nodeID = slot->nodeID;
+      shmring_release(seg_shm->toclient);
+
+      if (seglost(segPtr) == 0 && checkchecksum(segPtr) == 1)
+        return 1;
+    }
+    return -1;
+  }
+
+  //a short read would leave the next sendseg_arg_t misaligned, so only a complete one is accepted
+  while (recv(network_conn, &seg_arg, sizeof(sendseg_arg_t), MSG_WAITALL) == sizeof(sendseg_arg_t))
+  {
+    //an acknowledgement of a shared memory channel which came after snp_attachshm() gave up is not a segment
+    if (seg_arg.nodeID == SHM_ATTACH_NODEID || seglost(&seg_arg.seg) == 1 || checkchecksum(&seg_arg.seg) == -1)
       continue;
 
     memcpy(segPtr, &seg_arg.seg, sizeof(seg_t));
@@ -44,7 +160,7 @@ int snp_recvseg(int network_conn, int *src_nodeID, seg_t *segPtr)
 int getsegToSend(int tran_conn, int *dest_nodeID, seg_t *segPtr)
 {
   sendseg_arg_t seg_arg;
-  if (recv(tran_conn, &seg_arg, sizeof(sendseg_arg_t), 0) == -1)
+  if (recv(tran_conn, &seg_arg, sizeof(sendseg_arg_t), MSG_WAITALL) != sizeof(sendseg_arg_t))
     return -1;
 
   *dest_nodeID = seg_arg.nodeID;
@@ -59,7 +175,7 @@ int forwardsegToSRT(int tran_conn, int src_nodeID, seg_t *segPtr)
 {
   sendseg_arg_t seg_arg;
   seg_arg.nodeID = src_nodeID;
-  memcpy(&seg_arg.seg, segPtr, sizeof(sendseg_arg_t));
+  memcpy(&seg_arg.seg, segPtr, sizeof(seg_t));
   return send(tran_conn, &seg_arg, sizeof(sendseg_arg_t), 0) > 0 ? 1 : -1;
 }
 
@@ -69,10 +185,18 @@ int forwardsegToSRT(int tran_conn, int src_nodeID, seg_t *segPtr)
 // If the segment is not lost, return 0.
 // Even the segment is not lost, the packet has PKT_LOST_RATE/2 probability to have invalid checksum
 // We flip  a random bit in the segment to create invalid checksum
+// The SRT_LOSS_RATE environment variable overrides PKT_LOSS_RATE, e.g. 0 for throughput measurements
 int seglost(seg_t *segPtr)
 {
+  static double lossRate = -1;
+  if (lossRate < 0)
+  {
+    char *env = getenv("SRT_LOSS_RATE");
+    lossRate = env != NULL ? atof(env) : PKT_LOSS_RATE;
+  }
+
   int random = rand() % 100;
-  if (random < PKT_LOSS_RATE * 100)
+  if (random < lossRate * 100)
   {
     //50% probability of losing a segment
     if (rand() % 2 == 0)
@@ -138,7 +262,6 @@ unsigned short checksum(seg_t *segment)
 //return -1 if the checksum is invalid
 int checkchecksum(seg_t *segment)
 {
-  register long checksum_result = checksum(segment);
-  // calculate the return value 1 or -1
-  return (~checksum_result) == 0 ? 1 : -1;
+  //the 1s complement sum over a valid segment, its checksum included, is 0xFFFF, so checksum() returns 0
+  return checksum(segment) == 0 ? 1 : -1;
 }
@@ -51,14 +51,37 @@ typedef struct sendsegargument {
 	seg_t seg;		//a segment 
 } sendseg_arg_t;
 
+//A sendseg_arg_t sent by a SRT process with this node ID is not a segment to send.
+//It registers seg.header.src_port at the SNP process, so that the segments destined to that port are forwarded to this SRT process.
+#define PORT_REGISTER_NODEID -1
+
+//SRT process uses this function to offer a shared memory channel to the SNP process right after connecting to it, before any segment is sent.
+//The channel is passed over the unix socket NETWORK_SHM_NAME with the address of the SRT process's end of network_conn,
+//from which the SNP process finds the TCP connection of this SRT process. The SNP process acknowledges the channel over network_conn,
+//and the SRT process confirms it through the ring. The SNP process only delivers into the ring after the confirmation, and detaches the channel
+//if the SRT process sends over network_conn instead, so a channel this function gave up on is never used.
+//Afterwards snp_sendseg() and snp_recvseg() on network_conn use the channel.
+//A process has at most one channel: a process linking both the SRT client and server connects to the SNP process twice, the second connection keeps using TCP.
+//Return 1 if the channel is attached, otherwise return -1 and the segments keep going over network_conn.
+int snp_attachshm(int network_conn);
+
+//SRT process uses this function to register a SRT port at the SNP process.
+//Many SRT processes can be connected to the same SNP process, the SNP process dispatches the incoming segments by their destination ports.
+//Parameter network_conn is the TCP descriptor of the connection between the SRT process and the SNP process.
+//Return 1 if the registration is succefully sent, otherwise return -1.
+int snp_registerport(int network_conn, unsigned int port);
+
 //SRT process uses this function to send a segment and its destination node ID in a sendseg_arg_t structure to SNP process to send out. 
 //Parameter network_conn is the TCP descriptor of the connection between the SRT process and the SNP process. 
+//If a shared memory channel is attached to network_conn, the sendseg_arg_t is written in place into the ring to the SNP process, and is lost if the ring is full.
+//The checksum of the segment is set before it is sent.
 //Return 1 if a sendseg_arg_t is succefully sent, otherwise return -1.
 int snp_sendseg(int network_conn, int dest_nodeID, seg_t* segPtr);
 
 //SRT process uses this function to receive a  sendseg_arg_t structure which contains a segment and its src node ID from the SNP process. 
 //Parameter network_conn is the TCP descriptor of the connection between the SRT process and the SNP process. 
 //When a segment is received, use seglost to determine if the segment should be discarded, also check the checksum.  
+//If a shared memory channel is attached to network_conn, the sendseg_arg_t is read from the ring to the SRT process.
 //Return 1 if a sendseg_arg_t is succefully received, otherwise return -1.
 int snp_recvseg(int network_conn, int* src_nodeID, seg_t* segPtr);
 
@@ -78,6 +101,7 @@ int forwardsegToSRT(int tran_conn, int src_nodeID, seg_t* segPtr);
 // If the segment is not lost, return 0. 
 // Even the segment is not lost, the packet has PKT_LOST_RATE/2 probability to have invalid checksum
 // We flip  a random bit in the segment to create invalid checksum
+// The SRT_LOSS_RATE environment variable overrides PKT_LOSS_RATE, e.g. 0 for throughput measurements
 int seglost(seg_t* segPtr); 
 //
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
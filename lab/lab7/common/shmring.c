@@ -0,0 +1,316 @@
+//FILE: common/shmring.c
+//
+//Description: this file implements the shared memory channel between two processes on the same host.
+//
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+
+#include "shmring.h"
+
+//This function creates a new channel with two empty rings and their doorbells.
+//It is called by the client. The created channel is returned, NULL is returned on failure.
+shmchannel_t *shmchannel_create()
+{
+  int memfd, toclient_fd, toserver_fd;
+
+  if ((memfd = memfd_create("shmchannel", MFD_CLOEXEC)) == -1)
+    return NULL;
+
+  if (ftruncate(memfd, 2 * sizeof(shmring_t)) == -1)
+  {
+    close(memfd);
+    return NULL;
+  }
+
+  toclient_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  toserver_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  //a new memfd is zero filled, so both rings start empty
+  return shmchannel_attach(memfd, toclient_fd, toserver_fd);
+}
+
+//This function maps the channel created by the client, given the memfd and the doorbells received from it.
+//It is called by the server. The channel owns the descriptors afterwards.
+//The mapped channel is returned, NULL is returned on failure (the descriptors are closed).
+shmchannel_t *shmchannel_attach(int memfd, int toclient_fd, int toserver_fd)
+{
+  shmchannel_t *ch;
+  void *map;
+
+  if (memfd == -1 || toclient_fd == -1 || toserver_fd == -1 ||
+      (map = mmap(NULL, 2 * sizeof(shmring_t), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0)) == MAP_FAILED)
+  {
+    close(memfd);
+    close(toclient_fd);
+    close(toserver_fd);
+    return NULL;
+  }
+
+  ch = malloc(sizeof(shmchannel_t));
+  ch->memfd = memfd;
+  ch->toclient_fd = toclient_fd;
+  ch->toserver_fd = toserver_fd;
+  ch->toclient = (shmring_t *)map;
+  ch->toserver = (shmring_t *)map + 1;
+
+  return ch;
+}
+
+//This function unmaps a channel, closes its descriptors and frees it.
+void shmchannel_destroy(shmchannel_t *ch)
+{
+  munmap(ch->toclient, 2 * sizeof(shmring_t));
+  close(ch->memfd);
+  close(ch->toclient_fd);
+  close(ch->toserver_fd);
+  free(ch);
+}
+
+//This function fills the abstract address of the unix socket name, its length is returned.
+static socklen_t shmchannel_addr(struct sockaddr_un *addr, const char *name)
+{
+  memset(addr, 0, sizeof(struct sockaddr_un));
+  addr->sun_family = AF_UNIX;
+  //an abstract address starts with a zero byte and leaves no file behind
+  memcpy(addr->sun_path + 1, name, strlen(name));
+
+  return offsetof(struct sockaddr_un, sun_path) + 1 + strlen(name);
+}
+
+//This function opens the nonblocking abstract unix socket name on which a server receives the offered channels.
+//The listening socket descriptor is returned if success, otherwise return -1.
+int shmchannel_listen(const char *name)
+{
+  struct sockaddr_un addr;
+  socklen_t addrlen = shmchannel_addr(&addr, name);
+  int sfd;
+
+  if ((sfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1)
+    return -1;
+
+  if (bind(sfd, (struct sockaddr *)&addr, addrlen) == -1 || listen(sfd, 10) == -1)
+  {
+    close(sfd);
+    return -1;
+  }
+
+  return sfd;
+}
+
+//This function offers a channel to the server listening on the abstract unix socket name.
+//It sends "!& data !#" with the memfd and the doorbells of the channel attached (SCM_RIGHTS).
+//Return 1 on success, -1 on failure.
+int shmchannel_offer(const char *name, shmchannel_t *ch, void *data, size_t len)
+{
+  struct sockaddr_un addr;
+  socklen_t addrlen = shmchannel_addr(&addr, name);
+  int conn;
+  char buf[len + 4];
+  int fds[3] = {ch->memfd, ch->toclient_fd, ch->toserver_fd};
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(fds))];
+  } control;
+  struct iovec iov;
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+
+  buf[0] = '!';
+  buf[1] = '&';
+  memcpy(buf + 2, data, len);
+  buf[len + 2] = '!';
+  buf[len + 3] = '#';
+
+  iov.iov_base = buf;
+  iov.iov_len = len + 4;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  if ((conn = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
+    return -1;
+
+  if (connect(conn, (struct sockaddr *)&addr, addrlen) == -1 || sendmsg(conn, &msg, MSG_NOSIGNAL) != len + 4)
+  {
+    close(conn);
+    return -1;
+  }
+
+  close(conn);
+  return 1;
+}
+
+//This function accepts a connection on the listening socket listenfd, over which a client offers a channel.
+//The connection is nonblocking, the offer is received with shmchannel_recvoffer() when the connection is readable.
+//The connection is returned, -1 is returned if no connection is pending.
+int shmchannel_accept(int listenfd)
+{
+  return accept4(listenfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+}
+
+//This function receives the channel offered on the connection conn returned by shmchannel_accept(), and len bytes of data with it.
+//It never blocks, so it is called by an event loop when conn is readable.
+//Return 1 and set *ch to the mapped channel if the offer is received, 0 if it has not arrived yet,
+//-1 if the offer is not valid or the connection is closed. The caller closes conn unless 0 is returned.
+int shmchannel_recvoffer(int conn, void *data, size_t len, shmchannel_t **ch)
+{
+  char buf[len + 4];
+  int fds[3] = {-1, -1, -1};
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(fds))];
+  } control;
+  struct iovec iov;
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  ssize_t n;
+
+  iov.iov_base = buf;
+  iov.iov_len = len + 4;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  //the offer is a single sendmsg() much smaller than the socket buffer, so it arrives whole with its descriptors
+  n = recvmsg(conn, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+  if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    return 0;
+
+  cmsg = CMSG_FIRSTHDR(&msg);
+  if (n > 0 && cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+    memcpy(fds, CMSG_DATA(cmsg), cmsg->cmsg_len == CMSG_LEN(sizeof(fds)) ? sizeof(fds) : 0);
+
+  if (n != len + 4 || buf[0] != '!' || buf[1] != '&' || buf[len + 2] != '!' || buf[len + 3] != '#')
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      if (fds[i] != -1)
+        close(fds[i]);
+    }
+    return -1;
+  }
+
+  memcpy(data, buf + 2, len);
+  *ch = shmchannel_attach(fds[0], fds[1], fds[2]);
+  return *ch != NULL ? 1 : -1;
+}
+
+//This function returns the next free slot of the ring to be written in place by the producer, or NULL if the ring is full.
+void *shmring_reserve(shmring_t *ring)
+{
+  unsigned int tail = ring->tail;
+
+  if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == SHMRING_SLOTS)
+    return NULL;
+
+  return ring->slot[tail % SHMRING_SLOTS];
+}
+
+//This function publishes the slot returned by shmring_reserve() to the consumer.
+//The doorbell is rung if the consumer is waiting for it.
+void shmring_commit(shmring_t *ring, int doorbell)
+{
+  uint64_t one = 1;
+
+  __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+
+  //pairs with the fence in shmring_arm(): either the consumer sees the new tail or the producer sees waiting
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&ring->waiting, __ATOMIC_RELAXED))
+  {
+    if (write(doorbell, &one, sizeof(one)) == -1)
+      return;
+  }
+}
+
+//This function returns the next slot to be read in place by the consumer, or NULL if the ring is empty.
+void *shmring_peek(shmring_t *ring)
+{
+  unsigned int head = ring->head;
+
+  if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+    return NULL;
+
+  return ring->slot[head % SHMRING_SLOTS];
+}
+
+//This function gives the slot returned by shmring_peek() back to the producer.
+void shmring_release(shmring_t *ring)
+{
+  __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+//This function tells the producer that the consumer is going to sleep on the doorbell.
+//Return 1 if the ring is still empty and the consumer can sleep, return 0 if slots arrived meanwhile and must be consumed first.
+int shmring_arm(shmring_t *ring)
+{
+  __atomic_store_n(&ring->waiting, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(&ring->tail, __ATOMIC_RELAXED) != ring->head)
+  {
+    __atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+    return 0;
+  }
+
+  return 1;
+}
+
+//This function tells the producer that the consumer is awake, and clears the doorbell.
+void shmring_disarm(shmring_t *ring, int doorbell)
+{
+  uint64_t count;
+
+  __atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+  if (read(doorbell, &count, sizeof(count)) == -1)
+    return;
+}
+
+//This function blocks the consumer until the ring is not empty.
+//While waiting, the connection conn is watched as well, since the ring has no other way to tell that the producer is gone.
+//Return 1 when the ring is not empty, -1 if conn is closed or receives anything.
+int shmring_wait(shmring_t *ring, int doorbell, int conn)
+{
+  struct pollfd fds[2];
+
+  while (shmring_peek(ring) == NULL)
+  {
+    if (shmring_arm(ring))
+    {
+      fds[0].fd = doorbell;
+      fds[0].events = POLLIN;
+      fds[1].fd = conn;
+      fds[1].events = POLLIN;
+      fds[1].revents = 0;
+
+      if (poll(fds, 2, -1) == -1 && errno != EINTR)
+        return -1;
+      shmring_disarm(ring, doorbell);
+
+      if (fds[1].revents)
+        return -1;
+    }
+  }
+
+  return 1;
+}
@@ -0,0 +1,101 @@
+//FILE: common/shmring.h
+//
+//Description: this file defines the shared memory channel between two processes on the same host,
+//used between the SNP process and the ON process, and between a SRT process and the SNP process.
+//A channel is a pair of single producer single consumer rings of fixed size slots in one memfd mapping, one ring for each direction.
+//Packets and segments are written in place into the slots, so they are not copied through the kernel.
+//Each ring has an eventfd doorbell. The producer rings it only when the consumer is waiting for it, so a busy consumer drains the ring without any system call.
+//The client (the SNP process towards the ON process, a SRT process towards the SNP process) creates the channel
+//and passes the memfd and the doorbells to the server over a unix socket, since file descriptors can not be passed over their TCP connection.
+//The TCP connection stays open as the control connection.
+//
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stddef.h>
+#include "constants.h"
+#include "pkt.h"
+
+//size of a slot, big enough for a snp_pkt_t, a sendpkt_arg_t and a sendseg_arg_t
+#define SHMRING_SLOT_SIZE sizeof(sendpkt_arg_t)
+
+//a single producer single consumer ring in shared memory
+//head, tail and waiting are on their own cache lines, so the producer and the consumer do not share a line they both write
+typedef struct shmring {
+	unsigned int head;		//number of slots consumed, written by the consumer only
+	char pad1[60];
+	unsigned int tail;		//number of slots produced, written by the producer only
+	char pad2[60];
+	int waiting;			//1 while the consumer sleeps on the doorbell, written by the consumer only
+	char pad3[60];
+	char slot[SHMRING_SLOTS][SHMRING_SLOT_SIZE];
+} shmring_t;
+
+//shmchannel_t is the local view of a channel mapped by its client or its server
+typedef struct shmchannel {
+	int memfd;			//memfd holding the two rings
+	int toclient_fd;		//eventfd doorbell of the ring from the server to the client
+	int toserver_fd;		//eventfd doorbell of the ring from the client to the server
+	shmring_t* toclient;		//ring from the server to the client: snp_pkt_ts from the ON process, sendseg_arg_ts from the SNP process
+	shmring_t* toserver;		//ring from the client to the server: sendpkt_arg_ts to the ON process, sendseg_arg_ts to the SNP process
+} shmchannel_t;
+
+//This function creates a new channel with two empty rings and their doorbells.
+//It is called by the client. The created channel is returned, NULL is returned on failure.
+shmchannel_t* shmchannel_create();
+
+//This function maps the channel created by the client, given the memfd and the doorbells received from it.
+//It is called by the server. The channel owns the descriptors afterwards.
+//The mapped channel is returned, NULL is returned on failure (the descriptors are closed).
+shmchannel_t* shmchannel_attach(int memfd, int toclient_fd, int toserver_fd);
+
+//This function unmaps a channel, closes its descriptors and frees it.
+void shmchannel_destroy(shmchannel_t* ch);
+
+//This function opens the nonblocking abstract unix socket name on which a server receives the offered channels.
+//The listening socket descriptor is returned if success, otherwise return -1.
+int shmchannel_listen(const char* name);
+
+//This function offers a channel to the server listening on the abstract unix socket name.
+//It sends "!& data !#" with the memfd and the doorbells of the channel attached (SCM_RIGHTS).
+//Return 1 on success, -1 on failure.
+int shmchannel_offer(const char* name, shmchannel_t* ch, void* data, size_t len);
+
+//This function accepts a connection on the listening socket listenfd, over which a client offers a channel.
+//The connection is nonblocking, the offer is received with shmchannel_recvoffer() when the connection is readable.
+//The connection is returned, -1 is returned if no connection is pending.
+int shmchannel_accept(int listenfd);
+
+//This function receives the channel offered on the connection conn returned by shmchannel_accept(), and len bytes of data with it.
+//It never blocks, so it is called by an event loop when conn is readable.
+//Return 1 and set *ch to the mapped channel if the offer is received, 0 if it has not arrived yet,
+//-1 if the offer is not valid or the connection is closed. The caller closes conn unless 0 is returned.
+int shmchannel_recvoffer(int conn, void* data, size_t len, shmchannel_t** ch);
+
+//This function returns the next free slot of the ring to be written in place by the producer, or NULL if the ring is full.
+void* shmring_reserve(shmring_t* ring);
+
+//This function publishes the slot returned by shmring_reserve() to the consumer.
+//The doorbell is rung if the consumer is waiting for it.
+void shmring_commit(shmring_t* ring, int doorbell);
+
+//This function returns the next slot to be read in place by the consumer, or NULL if the ring is empty.
+void* shmring_peek(shmring_t* ring);
+
+//This function gives the slot returned by shmring_peek() back to the producer.
+void shmring_release(shmring_t* ring);
+
+//This function tells the producer that the consumer is going to sleep on the doorbell.
+//Return 1 if the ring is still empty and the consumer can sleep, return 0 if slots arrived meanwhile and must be consumed first.
+int shmring_arm(shmring_t* ring);
+
+//This function tells the producer that the consumer is awake, and clears the doorbell.
+void shmring_disarm(shmring_t* ring, int doorbell);
+
+//This function blocks the consumer until the ring is not empty.
+//While waiting, the connection conn is watched as well, since the ring has no other way to tell that the producer is gone.
+//Return 1 when the ring is not empty, -1 if conn is closed or receives anything.
+int shmring_wait(shmring_t* ring, int doorbell, int conn);
+
+#endif
@@ -0,0 +1,330 @@
+//FILE: gateway/app_agent.c
+//
+//Description: this is the node agent of the HTTP gateway, see gateway/gateway.h. It runs on a node which serves files with lab3's file_browser, and
+//forwards the HTTP requests the gateways send over the SRT overlay to the local file_browser. The agent first connects to the local SNP process twice,
+//once for the SRT server side and once for the SRT client side, and initializes both. It then waits for channels on AGENT_SLOTS SRT server sockets.
+//When a gateway connects to a slot and says hello, the agent connects back to the gateway for the responses. Every request received on the
+//channel is served by a thread of its own: it connects to the file_browser, sends the request, and sends the response back by frames of up to
+//GATEWAY_CHUNK bytes as it is read. When the gateway disconnects, the requests in progress are stopped and the slot waits for the next gateway.
+//A gateway which sends no frame, not even a KEEPALIVE, for AGENT_IDLE_TIMEOUT seconds is given up the same way, so a killed gateway does not hold its slot.
+
+//Date: May 6, 2008
+
+//Input: [port], the port of the local file_browser
+
+//Output: SRT states, the gateways connecting and disconnecting
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../common/constants.h"
+#include "../topology/topology.h"
+#include "../client/srt_client.h"
+#include "../server/srt_server.h"
+#include "gateway.h"
+#ifdef EMBEDDED_STACK
+#include "../stack/stack.h"
+#endif
+
+//the port of the local file_browser when none is given, file_browser's default port
+#define AGENT_BACKEND_PORT 9999
+
+//a request in progress
+typedef struct agent_stream {
+	unsigned int streamID;		//stream of the request
+	int fd;				//connection to the file_browser, -1 if the entry is free
+} agent_stream_t;
+
+//a slot which serves one channel at a time
+typedef struct agent_slot {
+	int index;			//slot number
+	int reqSock;			//SRT server socket receiving the requests
+	int respSock;			//SRT client socket sending the responses
+	pthread_mutex_t sendMutex;	//the frames of the streams are sent on respSock one at a time
+	pthread_mutex_t mutex;		//protects streams, active, connected and lastFrame
+	pthread_cond_t idle;		//signaled when a stream ends
+	int active;			//number of requests in progress
+	int connected;			//1 while a gateway holds the slot
+	time_t lastFrame;		//when the last frame of the gateway was received
+	agent_stream_t streams[GATEWAY_MAX_STREAMS];
+} agent_slot_t;
+
+//a request handed to its thread
+typedef struct agent_work {
+	agent_slot_t* slot;
+	agent_stream_t* stream;
+	unsigned int length;
+	char request[GATEWAY_MAX_REQUEST];
+} agent_work_t;
+
+//the port of the local file_browser
+static int backendPort = AGENT_BACKEND_PORT;
+
+//This function connects to the local SNP process on port NETWORK_PORT. If the TCP connection fails, return -1. The TCP socket desciptor returned will be used by SRT to send segments.
+int connectToNetwork() {
+	struct sockaddr_in servaddr;
+
+	servaddr.sin_family = AF_INET;
+	servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+	servaddr.sin_port = htons(NETWORK_PORT);
+
+	int network_conn = socket(AF_INET,SOCK_STREAM,0);
+	if(network_conn<0)
+		return -1;
+	if(connect(network_conn, (struct sockaddr*)&servaddr, sizeof(servaddr))!=0)
+		return -1;
+
+	//succefully connected
+	return network_conn;
+}
+
+//This function sends a frame with the given payload on the response connection of the slot.
+//Return 1 if the frame is sent, -1 if the connection failed.
+int sendFrame(agent_slot_t* slot, unsigned int type, unsigned int streamID, const void* data, unsigned int length) {
+	gateway_hdr_t hdr;
+	int ok;
+
+	hdr.type = type;
+	hdr.streamID = streamID;
+	hdr.length = length;
+	pthread_mutex_lock(&slot->sendMutex);
+	ok = srt_client_send(slot->respSock,&hdr,sizeof(hdr))>0 && (length==0 || srt_client_send(slot->respSock,(void*)data,length)>0);
+	pthread_mutex_unlock(&slot->sendMutex);
+	return ok?1:-1;
+}
+
+//This function sends a complete error response of the given status on the stream.
+void sendError(agent_slot_t* slot, unsigned int streamID, const char* status) {
+	char response[256];
+	int len = snprintf(response,sizeof(response),"HTTP/1.1 %s\r\nContent-Type: text/plain\r\nContent-Length: %d\r\nConnection: close\r\n\r\n%s\n",status,(int)strlen(status)+1,status);
+	sendFrame(slot,GATEWAY_DATA,streamID,response,len);
+}
+
+//This function writes the whole buffer to the socket fd.
+//Return 1 if it is written, -1 if the connection failed.
+int written(int fd, const char* buf, unsigned int len) {
+	while(len>0) {
+		int n = send(fd,buf,len,MSG_NOSIGNAL);
+		if(n<=0)
+			return -1;
+		buf += n;
+		len -= n;
+	}
+	return 1;
+}
+
+//This is the thread serving one request: it sends the request to the file_browser and the response back to the gateway as it is read.
+void* agent_serve(void* arg) {
+	agent_work_t* work = (agent_work_t*)arg;
+	agent_slot_t* slot = work->slot;
+	agent_stream_t* stream = work->stream;
+	char buf[GATEWAY_CHUNK];
+	struct sockaddr_in addr;
+	int n;
+
+	memset(&addr,0,sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(backendPort);
+
+	if(connect(stream->fd,(struct sockaddr*)&addr,sizeof(addr))<0 || written(stream->fd,work->request,work->length)<0)
+		sendError(slot,stream->streamID,"502 Bad Gateway");
+	else {
+		//the request asks the file_browser to close the connection, so the response ends with the connection
+		while((n = recv(stream->fd,buf,sizeof(buf),0))>0)
+			if(sendFrame(slot,GATEWAY_DATA,stream->streamID,buf,n)<0)
+				break;
+	}
+	sendFrame(slot,GATEWAY_END,stream->streamID,NULL,0);
+
+	pthread_mutex_lock(&slot->mutex);
+	close(stream->fd);
+	stream->fd = -1;
+	slot->active--;
+	pthread_cond_signal(&slot->idle);
+	pthread_mutex_unlock(&slot->mutex);
+	free(work);
+	return NULL;
+}
+
+//This function starts a thread for a request received on the slot.
+void agent_start(agent_slot_t* slot, unsigned int streamID, const char* request, unsigned int length) {
+	agent_stream_t* stream = NULL;
+	agent_work_t* work;
+	pthread_t thread;
+	int fd;
+
+	if((fd = socket(AF_INET,SOCK_STREAM,0))<0) {
+		sendError(slot,streamID,"503 Service Unavailable");
+		sendFrame(slot,GATEWAY_END,streamID,NULL,0);
+		return;
+	}
+
+	pthread_mutex_lock(&slot->mutex);
+	for(int i=0;i<GATEWAY_MAX_STREAMS && stream==NULL;i++)
+		if(slot->streams[i].fd<0)
+			stream = &slot->streams[i];
+	if(stream!=NULL) {
+		stream->streamID = streamID;
+		stream->fd = fd;
+		slot->active++;
+	}
+	pthread_mutex_unlock(&slot->mutex);
+
+	if(stream==NULL) {
+		close(fd);
+		sendError(slot,streamID,"503 Service Unavailable");
+		sendFrame(slot,GATEWAY_END,streamID,NULL,0);
+		return;
+	}
+
+	work = (agent_work_t*)malloc(sizeof(agent_work_t));
+	work->slot = slot;
+	work->stream = stream;
+	work->length = length;
+	memcpy(work->request,request,length);
+	pthread_create(&thread,NULL,agent_serve,work);
+	pthread_detach(thread);
+}
+
+//This function stops the request of the given stream, or all the requests of the slot if all is set, by shutting down their connections to the file_browser.
+void agent_stop(agent_slot_t* slot, unsigned int streamID, int all) {
+	pthread_mutex_lock(&slot->mutex);
+	for(int i=0;i<GATEWAY_MAX_STREAMS;i++)
+		if(slot->streams[i].fd>=0 && (all || slot->streams[i].streamID==streamID))
+			shutdown(slot->streams[i].fd,SHUT_RDWR);
+	pthread_mutex_unlock(&slot->mutex);
+}
+
+//This function records that a frame of the gateway was received on the slot, or that a gateway holds the slot from now on if connected is set, or no longer holds it otherwise.
+void agent_seen(agent_slot_t* slot, int connected) {
+	pthread_mutex_lock(&slot->mutex);
+	slot->connected = connected;
+	slot->lastFrame = time(NULL);
+	pthread_mutex_unlock(&slot->mutex);
+}
+
+//This is the thread of a slot: it waits for a gateway, connects back to it and receives its requests until it disconnects.
+void* agent_slot(void* arg) {
+	agent_slot_t* slot = (agent_slot_t*)arg;
+	char buf[GATEWAY_MAX_REQUEST];
+	gateway_hdr_t hdr;
+	gateway_hello_t hello;
+
+	while(1) {
+		//srt_server_accept() fails until the previous channel leaves CLOSEWAIT
+		while(srt_server_accept(slot->reqSock)<0)
+			sleep(1);
+		agent_seen(slot,1);
+
+		if(srt_server_recv(slot->reqSock,&hdr,sizeof(hdr))<0 || hdr.type!=GATEWAY_HELLO || hdr.length!=sizeof(hello) ||
+		   srt_server_recv(slot->reqSock,&hello,sizeof(hello))<0) {
+			printf("slot %d: bad hello from the gateway\n",slot->index);
+		} else if(srt_client_connect(slot->respSock,hello.nodeID,hello.port)<0) {
+			printf("slot %d: can not connect back to the gateway on node %d\n",slot->index,hello.nodeID);
+		} else {
+			printf("slot %d: gateway on node %d connected\n",slot->index,hello.nodeID);
+			while(srt_server_recv(slot->reqSock,&hdr,sizeof(hdr))>0) {
+				if(hdr.length>GATEWAY_MAX_REQUEST || (hdr.length>0 && srt_server_recv(slot->reqSock,buf,hdr.length)<0))
+					break;
+				agent_seen(slot,1);
+				if(hdr.type==GATEWAY_REQUEST)
+					agent_start(slot,hdr.streamID,buf,hdr.length);
+				else if(hdr.type==GATEWAY_ABORT)
+					agent_stop(slot,hdr.streamID,0);
+			}
+
+			//the gateway is gone, stop its requests before closing the response connection
+			agent_stop(slot,0,1);
+			pthread_mutex_lock(&slot->mutex);
+			while(slot->active>0)
+				pthread_cond_wait(&slot->idle,&slot->mutex);
+			pthread_mutex_unlock(&slot->mutex);
+			srt_client_disconnect(slot->respSock);
+			printf("slot %d: gateway on node %d disconnected\n",slot->index,hello.nodeID);
+		}
+
+		//drop whatever the gateway still sends until it disconnects
+		while(srt_server_recv(slot->reqSock,buf,1)>0);
+		agent_seen(slot,0);
+	}
+}
+
+//This function gives up the channel of every slot whose gateway sent no frame for AGENT_IDLE_TIMEOUT seconds.
+//The slot's srt_server_recv() then fails and the slot is freed as if the gateway disconnected.
+void agent_watch(agent_slot_t** slots) {
+	for(int k=0;k<AGENT_SLOTS;k++) {
+		pthread_mutex_lock(&slots[k]->mutex);
+		if(slots[k]->connected && time(NULL)-slots[k]->lastFrame>=AGENT_IDLE_TIMEOUT && srt_server_abort(slots[k]->reqSock)>0) {
+			printf("slot %d: no frame from the gateway for %d seconds, giving it up\n",k,AGENT_IDLE_TIMEOUT);
+			slots[k]->connected = 0;
+		}
+		pthread_mutex_unlock(&slots[k]->mutex);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	agent_slot_t* slots[AGENT_SLOTS];
+	pthread_t thread;
+
+	if(argc>1)
+		backendPort = atoi(argv[1]);
+
+	//random seed for segment loss
+	srand(time(NULL));
+	signal(SIGPIPE,SIG_IGN);
+
+#ifdef EMBEDDED_STACK
+	//run the ON and SNP layers in this process, connectToNetwork() then connects to the SNP layer
+	if(stack_start()<0) {
+		printf("fail to start the embedded stack\n");
+		exit(1);
+	}
+#endif
+
+	//the SRT client and server each use a connection of their own to the SNP process
+	int client_conn = connectToNetwork();
+	int server_conn = connectToNetwork();
+	if(client_conn<0 || server_conn<0) {
+		printf("fail to connect to the local SNP process\n");
+		exit(1);
+	}
+	srt_client_init(client_conn);
+	srt_server_init(server_conn);
+
+	for(int k=0;k<AGENT_SLOTS;k++) {
+		agent_slot_t* slot = (agent_slot_t*)calloc(1,sizeof(agent_slot_t));
+		slot->index = k;
+		slot->reqSock = srt_server_sock(AGENT_PORT_BASE+k);
+		slot->respSock = srt_client_sock(AGENT_PORT_BASE+AGENT_SLOTS+k);
+		if(slot->reqSock<0 || slot->respSock<0) {
+			printf("can't create srt sockets of slot %d\n",k);
+			exit(1);
+		}
+		pthread_mutex_init(&slot->sendMutex,NULL);
+		pthread_mutex_init(&slot->mutex,NULL);
+		pthread_cond_init(&slot->idle,NULL);
+		for(int i=0;i<GATEWAY_MAX_STREAMS;i++)
+			slot->streams[i].fd = -1;
+		slots[k] = slot;
+		pthread_create(&thread,NULL,agent_slot,slot);
+	}
+	printf("agent on node %d forwards to the file_browser on port %d\n",topology_getMyNodeID(),backendPort);
+
+	//the slots run until the agent is killed, the main thread frees the slots of the gateways which went silent
+	while(1) {
+		sleep(1);
+		agent_watch(slots);
+	}
+	return 0;
+}
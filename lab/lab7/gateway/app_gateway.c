@@ -0,0 +1,582 @@
+//FILE: gateway/app_gateway.c
+//
+//Description: this is the HTTP gateway, see gateway/gateway.h. It serves the files of the file_browsers running on other nodes of the overlay:
+//every TCP port given on the command line fronts the file_browser of one node, and the paths are passed through unchanged, so the links
+//of the directory listings keep working. The gateway first connects to the local SNP process twice, once for the SRT client side and once
+//for the SRT server side, and initializes both. It then sets up a pool of GATEWAY_POOL_SIZE channels to the agent of every node, each by a
+//thread which connects to a free slot of the agent, says hello, and accepts the agent's connection back. The thread then receives the response
+//frames of the channel and queues them to their streams, it never writes to a HTTP client itself. Every HTTP client is served by a thread of
+//its own: it reads the request head, sends it on the channel of the node with the fewest requests in progress, and writes the response to the
+//client as its pieces are queued. A client which does not keep up is dropped when GATEWAY_STREAM_BUFFER bytes are waiting for it, and a response
+//which makes no progress for GATEWAY_IO_TIMEOUT seconds is given up, without holding up the other streams. A HTTP client gets one
+//response per connection. A channel which fails is set up again. A KEEPALIVE frame is sent on every channel every GATEWAY_KEEPALIVE_INTERVAL
+//seconds, so an agent frees the slot of a gateway which is killed. SIGINT or SIGTERM disconnects the channels, so the agents free their slots.
+
+//Date: May 6, 2008
+
+//Input: port nodename [port nodename ...]
+
+//Output: SRT states, the channels going up and down
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../common/constants.h"
+#include "../topology/topology.h"
+#include "../client/srt_client.h"
+#include "../server/srt_server.h"
+#include "gateway.h"
+#ifdef EMBEDDED_STACK
+#include "../stack/stack.h"
+#endif
+
+//a piece of a response waiting to be written to the HTTP client
+typedef struct gateway_piece {
+	struct gateway_piece* next;
+	unsigned int length;
+	char data[GATEWAY_CHUNK];
+} gateway_piece_t;
+
+//a request in progress on a channel
+typedef struct gateway_stream {
+	unsigned int streamID;		//stream of the request, 0 if the entry is free
+	int done;			//no more piece will be queued: the response is complete, or will not be
+	int aborted;			//the client did not keep up, the pieces are dropped and the agent is told to stop
+	gateway_piece_t* head;		//first piece to write to the client
+	gateway_piece_t* tail;		//last piece to write to the client
+	unsigned int buffered;		//bytes in the pieces
+	pthread_cond_t cond;		//signaled when a piece is queued or the stream is done
+} gateway_stream_t;
+
+//a channel to the agent of a node
+typedef struct gateway_channel {
+	int nodeID;			//node of the agent
+	int index;			//channel number, gives the SRT ports
+	int reqSock;			//SRT client socket sending the requests
+	int respSock;			//SRT server socket receiving the responses
+	int up;				//1 while the channel can take requests
+	pthread_mutex_t sendMutex;	//the frames of the streams are sent on reqSock one at a time
+	pthread_mutex_t mutex;		//protects up, the streams and active
+	pthread_cond_t cond;		//signaled when a stream ends, or the channel goes up or down
+	unsigned int nextStreamID;	//ID of the next stream
+	int active;			//number of requests in progress
+	gateway_stream_t streams[GATEWAY_MAX_STREAMS];
+} gateway_channel_t;
+
+//a TCP port fronting the file_browser of a node
+typedef struct gateway_route {
+	int port;			//HTTP port
+	int nodeID;			//node served on the port
+	int sock;			//listening socket
+	gateway_channel_t* channels[GATEWAY_POOL_SIZE];
+} gateway_route_t;
+
+//a HTTP client handed to its thread
+typedef struct gateway_client {
+	gateway_route_t* route;
+	int fd;
+} gateway_client_t;
+
+//all the channels, to disconnect them on exit
+static gateway_channel_t* channels[MAX_TRANSPORT_CONNECTIONS];
+static int channelNum = 0;
+
+//This function connects to the local SNP process on port NETWORK_PORT. If TCP connection fails, return -1. The TCP socket desciptor returned will be used by SRT to send segments.
+int connectToNetwork() {
+	struct sockaddr_in servaddr;
+
+	servaddr.sin_family = AF_INET;
+	servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+	servaddr.sin_port = htons(NETWORK_PORT);
+
+	int network_conn = socket(AF_INET,SOCK_STREAM,0);
+	if(network_conn<0)
+		return -1;
+	if(connect(network_conn, (struct sockaddr*)&servaddr, sizeof(servaddr))!=0)
+		return -1;
+
+	//succefully connected
+	return network_conn;
+}
+
+//This function sends a frame with the given payload on the request connection of the channel.
+//Return 1 if the frame is sent, -1 if the connection failed.
+int sendFrame(gateway_channel_t* ch, unsigned int type, unsigned int streamID, const void* data, unsigned int length) {
+	gateway_hdr_t hdr;
+	int ok;
+
+	hdr.type = type;
+	hdr.streamID = streamID;
+	hdr.length = length;
+	pthread_mutex_lock(&ch->sendMutex);
+	ok = srt_client_send(ch->reqSock,&hdr,sizeof(hdr))>0 && (length==0 || srt_client_send(ch->reqSock,(void*)data,length)>0);
+	pthread_mutex_unlock(&ch->sendMutex);
+	return ok?1:-1;
+}
+
+//This function writes the whole buffer to the socket fd.
+//Return 1 if it is written, -1 if the connection failed or timed out.
+int written(int fd, const char* buf, unsigned int len) {
+	while(len>0) {
+		int n = send(fd,buf,len,MSG_NOSIGNAL);
+		if(n<=0)
+			return -1;
+		buf += n;
+		len -= n;
+	}
+	return 1;
+}
+
+//This function sends a complete error response of the given status to the HTTP client.
+void sendError(int fd, const char* status) {
+	char response[256];
+	int len = snprintf(response,sizeof(response),"HTTP/1.1 %s\r\nContent-Type: text/plain\r\nContent-Length: %d\r\nConnection: close\r\n\r\n%s\n",status,(int)strlen(status)+1,status);
+	written(fd,response,len);
+}
+
+//This function returns the stream of the channel with the given ID, NULL if the stream has ended. The channel's mutex is held.
+gateway_stream_t* findStream(gateway_channel_t* ch, unsigned int streamID) {
+	for(int i=0;i<GATEWAY_MAX_STREAMS;i++)
+		if(ch->streams[i].streamID==streamID)
+			return &ch->streams[i];
+	return NULL;
+}
+
+//This function frees the pieces of the stream which are not written. The channel's mutex is held.
+void dropPieces(gateway_stream_t* stream) {
+	while(stream->head!=NULL) {
+		gateway_piece_t* piece = stream->head;
+		stream->head = piece->next;
+		free(piece);
+	}
+	stream->tail = NULL;
+	stream->buffered = 0;
+}
+
+//This function queues a DATA frame to its stream, the client thread of the stream writes it to the HTTP client.
+//The channel thread never waits for a client: a client with GATEWAY_STREAM_BUFFER bytes already waiting is dropped, and the agent told to stop.
+void deliver(gateway_channel_t* ch, unsigned int streamID, const char* data, unsigned int length) {
+	gateway_stream_t* stream;
+	gateway_piece_t* piece = (gateway_piece_t*)malloc(sizeof(gateway_piece_t));
+	int drop = 0;
+
+	piece->next = NULL;
+	piece->length = length;
+	memcpy(piece->data,data,length);
+
+	pthread_mutex_lock(&ch->mutex);
+	stream = findStream(ch,streamID);
+	if(stream==NULL || stream->done) {
+		pthread_mutex_unlock(&ch->mutex);
+		free(piece);
+		return;
+	}
+	if(stream->buffered+length>GATEWAY_STREAM_BUFFER) {
+		stream->done = 1;
+		stream->aborted = 1;
+		dropPieces(stream);
+		free(piece);
+		drop = 1;
+	} else {
+		if(stream->tail!=NULL)
+			stream->tail->next = piece;
+		else
+			stream->head = piece;
+		stream->tail = piece;
+		stream->buffered += length;
+	}
+	pthread_cond_signal(&stream->cond);
+	pthread_mutex_unlock(&ch->mutex);
+
+	if(drop)
+		sendFrame(ch,GATEWAY_ABORT,streamID,NULL,0);
+}
+
+//This function sets up the channel: it connects to a free slot of the agent, says hello, and accepts the agent's connection back.
+//Return 1 if the channel is up, -1 if it can not be set up now.
+int channel_setup(gateway_channel_t* ch) {
+	gateway_hello_t hello;
+	int k;
+
+	//the channels start at different slots, so the channels of the pool do not race for the same one
+	for(k=0;k<AGENT_SLOTS;k++)
+		if(srt_client_connect(ch->reqSock,ch->nodeID,AGENT_PORT_BASE+(ch->index+k)%AGENT_SLOTS)>0)
+			break;
+	if(k==AGENT_SLOTS)
+		return -1;
+
+	hello.nodeID = topology_getMyNodeID();
+	hello.port = GATEWAY_PORT_BASE+2*ch->index+1;
+	if(sendFrame(ch,GATEWAY_HELLO,0,&hello,sizeof(hello))<0) {
+		srt_client_disconnect(ch->reqSock);
+		return -1;
+	}
+
+	//srt_server_accept() fails until the previous channel leaves CLOSEWAIT
+	while(srt_server_accept(ch->respSock)<0)
+		sleep(1);
+	return 1;
+}
+
+//This is the thread of a channel: it sets the channel up, receives the response frames and delivers them until the channel fails, and starts over.
+void* channel_run(void* arg) {
+	gateway_channel_t* ch = (gateway_channel_t*)arg;
+	char buf[GATEWAY_CHUNK];
+	gateway_hdr_t hdr;
+
+	while(1) {
+		if(channel_setup(ch)<0) {
+			sleep(GATEWAY_RETRY_INTERVAL);
+			continue;
+		}
+		printf("channel %d to node %d is up\n",ch->index,ch->nodeID);
+		pthread_mutex_lock(&ch->mutex);
+		ch->up = 1;
+		pthread_cond_broadcast(&ch->cond);
+		pthread_mutex_unlock(&ch->mutex);
+
+		while(srt_server_recv(ch->respSock,&hdr,sizeof(hdr))>0) {
+			if(hdr.length>GATEWAY_CHUNK || (hdr.length>0 && srt_server_recv(ch->respSock,buf,hdr.length)<0))
+				break;
+			if(hdr.type==GATEWAY_DATA)
+				deliver(ch,hdr.streamID,buf,hdr.length);
+			else if(hdr.type==GATEWAY_END) {
+				pthread_mutex_lock(&ch->mutex);
+				gateway_stream_t* stream = findStream(ch,hdr.streamID);
+				if(stream!=NULL) {
+					stream->done = 1;
+					pthread_cond_signal(&stream->cond);
+				}
+				pthread_mutex_unlock(&ch->mutex);
+			}
+		}
+
+		//the agent is gone, the responses in progress will not complete
+		printf("channel %d to node %d is down\n",ch->index,ch->nodeID);
+		pthread_mutex_lock(&ch->mutex);
+		ch->up = 0;
+		for(int i=0;i<GATEWAY_MAX_STREAMS;i++) {
+			ch->streams[i].done = 1;
+			pthread_cond_signal(&ch->streams[i].cond);
+		}
+		pthread_cond_broadcast(&ch->cond);
+		pthread_mutex_unlock(&ch->mutex);
+		srt_client_disconnect(ch->reqSock);
+		while(srt_server_recv(ch->respSock,buf,1)>0);
+	}
+}
+
+//This function reads the request head from the HTTP client into buf, and rewrites it so the file_browser closes the connection after the response.
+//Return the length of the rewritten head, -1 if the client sent no complete head.
+int readRequest(int fd, char* buf, int size) {
+	char head[GATEWAY_MAX_REQUEST+1];
+	int len = 0, n, out = 0;
+	char* end = NULL;
+
+	while(end==NULL && len<GATEWAY_MAX_REQUEST) {
+		if((n = recv(fd,head+len,GATEWAY_MAX_REQUEST-len,0))<=0)
+			return -1;
+		len += n;
+		head[len] = 0;
+		end = strstr(head,"\r\n\r\n");
+	}
+	if(end==NULL)
+		return -1;
+
+	//copy the lines but the ones about the connection, which the gateway owns
+	for(char* line=head;line<end+2;) {
+		char* eol = strstr(line,"\r\n")+2;
+		if(strncasecmp(line,"Connection:",11)!=0 && strncasecmp(line,"Keep-Alive:",11)!=0) {
+			if(out+(eol-line)>size)
+				return -1;
+			memcpy(buf+out,line,eol-line);
+			out += eol-line;
+		}
+		line = eol;
+	}
+	if(out+21>size)
+		return -1;
+	memcpy(buf+out,"Connection: close\r\n\r\n",21);
+	return out+21;
+}
+
+//This function sets the deadline GATEWAY_IO_TIMEOUT seconds from now.
+void setDeadline(struct timespec* deadline) {
+	clock_gettime(CLOCK_REALTIME,deadline);
+	deadline->tv_sec += GATEWAY_IO_TIMEOUT;
+}
+
+//This is the thread serving a HTTP client: it forwards the request on a channel of the node and writes the pieces of the response queued to its stream.
+void* gateway_serve(void* arg) {
+	gateway_client_t* client = (gateway_client_t*)arg;
+	gateway_route_t* route = client->route;
+	gateway_channel_t* ch = NULL;
+	gateway_stream_t* stream = NULL;
+	struct timeval timeout = {GATEWAY_IO_TIMEOUT,0};
+	char request[GATEWAY_MAX_REQUEST];
+	int len, fd = client->fd;
+
+	free(client);
+	setsockopt(fd,SOL_SOCKET,SO_RCVTIMEO,&timeout,sizeof(timeout));
+	setsockopt(fd,SOL_SOCKET,SO_SNDTIMEO,&timeout,sizeof(timeout));
+
+	if((len = readRequest(fd,request,sizeof(request)))<0) {
+		sendError(fd,"400 Bad Request");
+		close(fd);
+		return NULL;
+	}
+
+	//take the channel with the fewest requests in progress, wait if they are all full
+	while(1) {
+		int least = 0;
+		ch = NULL;
+		//the channels are compared on a snapshot, the chosen one is checked again under its mutex
+		for(int i=0;i<GATEWAY_POOL_SIZE;i++) {
+			gateway_channel_t* c = route->channels[i];
+			pthread_mutex_lock(&c->mutex);
+			int up = c->up, active = c->active;
+			pthread_mutex_unlock(&c->mutex);
+			if(up && (ch==NULL || active<least)) {
+				ch = c;
+				least = active;
+			}
+		}
+		if(ch==NULL) {
+			sendError(fd,"502 Bad Gateway");
+			close(fd);
+			return NULL;
+		}
+		pthread_mutex_lock(&ch->mutex);
+		if(ch->up && ch->active<GATEWAY_MAX_STREAMS)
+			break;
+		if(ch->up)
+			pthread_cond_wait(&ch->cond,&ch->mutex);
+		pthread_mutex_unlock(&ch->mutex);
+	}
+
+	//register the stream before the request is sent, the response may come right away
+	stream = findStream(ch,0);
+	if(++ch->nextStreamID==0)
+		ch->nextStreamID = 1;
+	stream->streamID = ch->nextStreamID;
+	stream->done = 0;
+	stream->aborted = 0;
+	ch->active++;
+	unsigned int streamID = stream->streamID;
+	pthread_mutex_unlock(&ch->mutex);
+
+	int ok = sendFrame(ch,GATEWAY_REQUEST,streamID,request,len)>0;
+	int timedOut = 0;
+	unsigned long long sent = 0;
+	struct timespec deadline;
+
+	//write the pieces as they are queued, a response which makes no progress for GATEWAY_IO_TIMEOUT is given up
+	pthread_mutex_lock(&ch->mutex);
+	if(!ok)
+		stream->done = 1;
+	setDeadline(&deadline);
+	while(1) {
+		if(stream->head!=NULL) {
+			gateway_piece_t* piece = stream->head;
+			stream->head = piece->next;
+			if(stream->head==NULL)
+				stream->tail = NULL;
+			stream->buffered -= piece->length;
+			pthread_mutex_unlock(&ch->mutex);
+
+			int wrote = written(fd,piece->data,piece->length)>0;
+			if(wrote)
+				sent += piece->length;
+			free(piece);
+
+			pthread_mutex_lock(&ch->mutex);
+			if(!wrote) {
+				stream->done = 1;
+				ok = 0;
+				break;
+			}
+			setDeadline(&deadline);
+		} else if(stream->done)
+			break;
+		else if(pthread_cond_timedwait(&stream->cond,&ch->mutex,&deadline)==ETIMEDOUT && stream->head==NULL && !stream->done) {
+			stream->done = 1;
+			ok = 0;
+			timedOut = 1;
+			break;
+		}
+	}
+	//deliver() already told the agent to stop a stream it aborted
+	if(stream->aborted)
+		ok = 1;
+	dropPieces(stream);
+	stream->streamID = 0;
+	ch->active--;
+	pthread_cond_broadcast(&ch->cond);
+	pthread_mutex_unlock(&ch->mutex);
+
+	if(!ok)
+		sendFrame(ch,GATEWAY_ABORT,streamID,NULL,0);
+	if(sent==0)
+		sendError(fd,timedOut?"504 Gateway Timeout":"502 Bad Gateway");
+	close(fd);
+	return NULL;
+}
+
+//This is the thread accepting the HTTP clients of a port.
+void* gateway_listen(void* arg) {
+	gateway_route_t* route = (gateway_route_t*)arg;
+	pthread_t thread;
+
+	while(1) {
+		int fd = accept(route->sock,NULL,NULL);
+		if(fd<0)
+			continue;
+		gateway_client_t* client = (gateway_client_t*)malloc(sizeof(gateway_client_t));
+		client->route = route;
+		client->fd = fd;
+		if(pthread_create(&thread,NULL,gateway_serve,client)!=0) {
+			close(fd);
+			free(client);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+}
+
+//This is the thread sending a KEEPALIVE frame on every channel which is up every GATEWAY_KEEPALIVE_INTERVAL seconds, so the agents keep the slots of idle channels.
+void* gateway_keepalive(void* arg) {
+	while(1) {
+		sleep(GATEWAY_KEEPALIVE_INTERVAL);
+		for(int i=0;i<channelNum;i++) {
+			pthread_mutex_lock(&channels[i]->mutex);
+			int up = channels[i]->up;
+			pthread_mutex_unlock(&channels[i]->mutex);
+			if(up)
+				sendFrame(channels[i],GATEWAY_KEEPALIVE,0,NULL,0);
+		}
+	}
+}
+
+//This function opens the listening TCP socket of a port.
+//Return the socket, -1 if the port can not be used.
+int listenPort(int port) {
+	struct sockaddr_in addr;
+	int on = 1;
+	int sock = socket(AF_INET,SOCK_STREAM,0);
+	if(sock<0)
+		return -1;
+	setsockopt(sock,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on));
+
+	memset(&addr,0,sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if(bind(sock,(struct sockaddr*)&addr,sizeof(addr))<0 || listen(sock,SOMAXCONN)<0) {
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+int main(int argc, char* argv[]) {
+	int routeNum = (argc-1)/2;
+	pthread_t thread;
+	sigset_t signals;
+	int sig;
+
+	//every channel takes a SRT client and a SRT server connection
+	if(argc<3 || argc%2==0 || routeNum*GATEWAY_POOL_SIZE>MAX_TRANSPORT_CONNECTIONS) {
+		printf("usage: %s port nodename [port nodename ...], at most %d nodes\n",argv[0],MAX_TRANSPORT_CONNECTIONS/GATEWAY_POOL_SIZE);
+		exit(1);
+	}
+
+	//random seed for segment loss
+	srand(time(NULL));
+
+	//the threads leave SIGINT and SIGTERM to the main thread, which disconnects the channels
+	sigemptyset(&signals);
+	sigaddset(&signals,SIGINT);
+	sigaddset(&signals,SIGTERM);
+	pthread_sigmask(SIG_BLOCK,&signals,NULL);
+	signal(SIGPIPE,SIG_IGN);
+
+#ifdef EMBEDDED_STACK
+	//run the ON and SNP layers in this process, connectToNetwork() then connects to the SNP layer
+	if(stack_start()<0) {
+		printf("fail to start the embedded stack\n");
+		exit(1);
+	}
+#endif
+
+	//the SRT client and server each use a connection of their own to the SNP process
+	int client_conn = connectToNetwork();
+	int server_conn = connectToNetwork();
+	if(client_conn<0 || server_conn<0) {
+		printf("fail to connect to the local SNP process\n");
+		exit(1);
+	}
+	srt_client_init(client_conn);
+	srt_server_init(server_conn);
+
+	for(int r=0;r<routeNum;r++) {
+		gateway_route_t* route = (gateway_route_t*)calloc(1,sizeof(gateway_route_t));
+		route->port = atoi(argv[1+2*r]);
+		route->nodeID = topology_getNodeIDfromname(argv[2+2*r]);
+		if(route->nodeID==-1) {
+			printf("host name error: %s\n",argv[2+2*r]);
+			exit(1);
+		}
+		if((route->sock = listenPort(route->port))<0) {
+			printf("can't listen on port %d\n",route->port);
+			exit(1);
+		}
+
+		for(int i=0;i<GATEWAY_POOL_SIZE;i++) {
+			gateway_channel_t* ch = (gateway_channel_t*)calloc(1,sizeof(gateway_channel_t));
+			ch->nodeID = route->nodeID;
+			ch->index = channelNum;
+			ch->reqSock = srt_client_sock(GATEWAY_PORT_BASE+2*ch->index);
+			ch->respSock = srt_server_sock(GATEWAY_PORT_BASE+2*ch->index+1);
+			if(ch->reqSock<0 || ch->respSock<0) {
+				printf("can't create srt sockets of channel %d\n",ch->index);
+				exit(1);
+			}
+			pthread_mutex_init(&ch->sendMutex,NULL);
+			pthread_mutex_init(&ch->mutex,NULL);
+			pthread_cond_init(&ch->cond,NULL);
+			for(int k=0;k<GATEWAY_MAX_STREAMS;k++)
+				pthread_cond_init(&ch->streams[k].cond,NULL);
+			route->channels[i] = ch;
+			channels[channelNum++] = ch;
+			pthread_create(&thread,NULL,channel_run,ch);
+		}
+
+		pthread_create(&thread,NULL,gateway_listen,route);
+		printf("port %d serves node %d\n",route->port,route->nodeID);
+	}
+	pthread_create(&thread,NULL,gateway_keepalive,NULL);
+
+	//disconnect the channels on exit, so the agents free their slots
+	sigwait(&signals,&sig);
+	for(int i=0;i<channelNum;i++) {
+		pthread_mutex_lock(&channels[i]->mutex);
+		int up = channels[i]->up;
+		pthread_mutex_unlock(&channels[i]->mutex);
+		if(up)
+			srt_client_disconnect(channels[i]->reqSock);
+	}
+	return 0;
+}
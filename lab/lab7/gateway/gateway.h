@@ -0,0 +1,68 @@
+//FILE: gateway/gateway.h
+//
+//Description: this file defines the protocol between the HTTP gateway (gateway/app_gateway.c) and the node agents (gateway/app_agent.c).
+//The gateway keeps a pool of GATEWAY_POOL_SIZE channels to the agent of every remote node it serves. A channel is a pair of SRT
+//connections, since the data of a SRT connection only flows from the client to the server: the gateway sends the requests over
+//the first one, the agent sends the responses back over the second one. Many requests are multiplexed on a channel at the same time,
+//every frame carries the stream ID of the request it belongs to, and the frames of the responses are interleaved by pieces of
+//GATEWAY_CHUNK bytes so a large file does not hold up the other streams.
+//
+
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+//number of channels from the gateway to every agent
+#define GATEWAY_POOL_SIZE 2
+//the gateway uses SRT ports GATEWAY_PORT_BASE+2*i (requests, client side) and GATEWAY_PORT_BASE+2*i+1 (responses, server side) for its channel i
+#define GATEWAY_PORT_BASE 100
+//the agent accepts up to AGENT_SLOTS channels, channel k on SRT port AGENT_PORT_BASE+k for the requests, the responses are sent from port AGENT_PORT_BASE+AGENT_SLOTS+k
+//a gateway takes the first free slot, so several gateways can share an agent
+#define AGENT_SLOTS 4
+#define AGENT_PORT_BASE 120
+
+//max number of requests in progress on a channel
+#define GATEWAY_MAX_STREAMS 64
+//max length of a HTTP request head
+#define GATEWAY_MAX_REQUEST 8192
+//max length of a response frame
+#define GATEWAY_CHUNK 8192
+//a HTTP client which does not send its request or take the response for GATEWAY_IO_TIMEOUT seconds is dropped,
+//and so is a response which makes no progress for GATEWAY_IO_TIMEOUT seconds
+#define GATEWAY_IO_TIMEOUT 10
+//max number of response bytes waiting for a HTTP client, a client which does not keep up with its response is dropped
+#define GATEWAY_STREAM_BUFFER (4*1024*1024)
+//the gateway retries to set up a channel every GATEWAY_RETRY_INTERVAL seconds until the agent answers
+#define GATEWAY_RETRY_INTERVAL 5
+//the gateway sends a KEEPALIVE frame on every channel which is up every GATEWAY_KEEPALIVE_INTERVAL seconds
+#define GATEWAY_KEEPALIVE_INTERVAL 5
+//an agent frees the slot of a gateway it receives no frame from for AGENT_IDLE_TIMEOUT seconds, e.g. a gateway killed with -9
+#define AGENT_IDLE_TIMEOUT (3*GATEWAY_KEEPALIVE_INTERVAL)
+
+//frame types
+//HELLO: first frame of a channel, from the gateway, the payload is a gateway_hello_t
+#define GATEWAY_HELLO 1
+//REQUEST: from the gateway, the payload is the HTTP request head, a new stream starts
+#define GATEWAY_REQUEST 2
+//DATA: from the agent, the payload is the next piece of the HTTP response of the stream
+#define GATEWAY_DATA 3
+//END: from the agent, the response of the stream is complete
+#define GATEWAY_END 4
+//ABORT: from the gateway, the HTTP client of the stream is gone and the agent stops sending the response
+#define GATEWAY_ABORT 5
+//KEEPALIVE: from the gateway, no payload, tells the agent the gateway is still there when it sends no request
+#define GATEWAY_KEEPALIVE 6
+
+//frame header, followed by length bytes of payload
+typedef struct gateway_hdr {
+	unsigned int type;		//GATEWAY_HELLO, GATEWAY_REQUEST, GATEWAY_DATA, GATEWAY_END, GATEWAY_ABORT or GATEWAY_KEEPALIVE
+	unsigned int streamID;		//stream the frame belongs to
+	unsigned int length;		//payload length
+} gateway_hdr_t;
+
+//payload of GATEWAY_HELLO, where the agent connects to send the responses
+typedef struct gateway_hello {
+	int nodeID;			//node of the gateway
+	unsigned int port;		//SRT port of the gateway's server side of the channel
+} gateway_hello_t;
+
+#endif
@@ -33,9 +33,9 @@ dv_t *dvtable_create()
     entry->nodeID = source_id;
     entry->dvEntry = malloc(sizeof(dv_entry_t) * node_num);
 
-    for (int j = 0; i < node_num; j++)
+    for (int j = 0; j < node_num; j++)
     {
-      int dest_id = node_id_array[i];
+      int dest_id = node_id_array[j];
       entry->dvEntry[j].nodeID = dest_id;
       entry->dvEntry[j].cost = i == nb_num ? topology_getCost(source_id, dest_id) : INFINITE_COST;
     }
@@ -51,7 +51,7 @@ dv_t *dvtable_create()
 //It frees all the dynamically allocated memory for the dvtable.
 void dvtable_destroy(dv_t *dvtable)
 {
-  for (int i = 0; i < topology_getNbrNum(); i++)
+  for (int i = 0; i <= topology_getNbrNum(); i++)
     free(dvtable[i].dvEntry);
 
   free(dvtable);
@@ -71,7 +71,7 @@ int dvtable_setcost(dv_t *dvtable, int fromNodeID, int toNodeID, unsigned int co
   {
     dv_t *entry = &dvtable[i];
 
-    for (int j = 0; i < node_num; j++)
+    for (int j = 0; j < node_num; j++)
     {
       if (entry->nodeID == fromNodeID && entry->dvEntry[j].nodeID == toNodeID)
       {
@@ -97,7 +97,7 @@ unsigned int dvtable_getcost(dv_t *dvtable, int fromNodeID, int toNodeID)
   {
     dv_t *entry = &dvtable[i];
 
-    for (int j = 0; i < node_num; j++)
+    for (int j = 0; j < node_num; j++)
       if (entry->nodeID == fromNodeID && entry->dvEntry[j].nodeID == toNodeID)
         return entry->dvEntry[j].cost;
   }
@@ -116,7 +116,7 @@ void dvtable_print(dv_t *dvtable)
   {
     dv_t *entry = &dvtable[i];
 
-    for (int j = 0; i < node_num; j++)
+    for (int j = 0; j < node_num; j++)
       printf("distance vector table: %d --- %d : %u\n", entry->nodeID, entry->dvEntry[j].nodeID, entry->dvEntry[j].cost);
   }
 }
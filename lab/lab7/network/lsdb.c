@@ -0,0 +1,264 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../common/constants.h"
+#include "../topology/topology.h"
+#include "lsdb.h"
+
+//binary min heap of node IDs keyed by their current path cost
+//pos[] keeps the heap index of each node so that the cost of a queued node can be decreased in place
+typedef struct nodeheap
+{
+  int node[MAX_NODEID];
+  int pos[MAX_NODEID];
+  int size;
+} nodeheap_t;
+
+static void heap_swap(nodeheap_t *h, int i, int j)
+{
+  int tmp = h->node[i];
+  h->node[i] = h->node[j];
+  h->node[j] = tmp;
+  h->pos[h->node[i]] = i;
+  h->pos[h->node[j]] = j;
+}
+
+static void heap_siftup(nodeheap_t *h, unsigned int *cost, int i)
+{
+  while (i > 0 && cost[h->node[(i - 1) / 2]] > cost[h->node[i]])
+  {
+    heap_swap(h, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static void heap_siftdown(nodeheap_t *h, unsigned int *cost, int i)
+{
+  int smallest;
+
+  while (1)
+  {
+    smallest = i;
+    if (2 * i + 1 < h->size && cost[h->node[2 * i + 1]] < cost[h->node[smallest]])
+      smallest = 2 * i + 1;
+    if (2 * i + 2 < h->size && cost[h->node[2 * i + 2]] < cost[h->node[smallest]])
+      smallest = 2 * i + 2;
+    if (smallest == i)
+      return;
+
+    heap_swap(h, i, smallest);
+    i = smallest;
+  }
+}
+
+//insert the node into the heap, or move it up if it is already queued with a larger cost
+static void heap_push(nodeheap_t *h, unsigned int *cost, int nodeID)
+{
+  if (h->pos[nodeID] == -1)
+  {
+    h->node[h->size] = nodeID;
+    h->pos[nodeID] = h->size;
+    h->size++;
+  }
+  heap_siftup(h, cost, h->pos[nodeID]);
+}
+
+static int heap_pop(nodeheap_t *h, unsigned int *cost)
+{
+  int nodeID = h->node[0];
+
+  heap_swap(h, 0, h->size - 1);
+  h->size--;
+  h->pos[nodeID] = -1;
+  heap_siftdown(h, cost, 0);
+
+  return nodeID;
+}
+
+//This function creates an empty link state database dynamically.
+//The dynamically created link state database is returned.
+lsdb_t *lsdb_create()
+{
+  lsdb_t *lsdb;
+
+  lsdb = malloc(sizeof(lsdb_t));
+  memset(lsdb, 0, sizeof(lsdb_t));
+
+  return lsdb;
+}
+
+//This function destroys a link state database.
+//It frees all the dynamically allocated memory for the link state database.
+void lsdb_destroy(lsdb_t *lsdb)
+{
+  free(lsdb);
+}
+
+//This function builds the LSA of this node from the neighbor cost table.
+//The given sequence number is stored in the LSA.
+void lsdb_buildlsa(nbr_cost_entry_t *nct, unsigned int seqNum, pkt_lsa_t *lsa)
+{
+  int nb_num = topology_getNbrNum();
+
+  memset(lsa, 0, sizeof(pkt_lsa_t));
+  lsa->nodeID = topology_getMyNodeID();
+  lsa->seqNum = seqNum;
+  lsa->entryNum = nb_num < MAX_NODE_NUM ? nb_num : MAX_NODE_NUM;
+
+  for (int i = 0; i < lsa->entryNum; i++)
+  {
+    lsa->entry[i].nodeID = nct[i].nodeID;
+    lsa->entry[i].cost = nct[i].cost;
+  }
+}
+
+//This function installs the given LSA in the link state database.
+//If the LSA is newer than the stored one (or no LSA is stored for that node), it is installed and 1 is returned.
+//Otherwise the LSA is a duplicate or stale copy, it is ignored and -1 is returned.
+int lsdb_update(lsdb_t *lsdb, pkt_lsa_t *lsa)
+{
+  lsdb_entry_t *entry;
+
+  if (lsa->nodeID >= MAX_NODEID || lsa->entryNum > MAX_NODE_NUM)
+    return -1;
+
+  entry = &lsdb->lsa[lsa->nodeID];
+
+  //sequence numbers are compared with serial number arithmetic so that a wrapped counter is still newer
+  if (entry->valid && (int)(lsa->seqNum - entry->seqNum) <= 0)
+    return -1;
+
+  entry->valid = 1;
+  entry->seqNum = lsa->seqNum;
+  entry->entryNum = lsa->entryNum;
+  memcpy(entry->entry, lsa->entry, lsa->entryNum * sizeof(routeupdate_entry_t));
+
+  return 1;
+}
+
+//This function copies the LSA stored for the given node into lsa.
+//Return 1 if a LSA is stored for that node, otherwise return -1.
+int lsdb_getlsa(lsdb_t *lsdb, int nodeID, pkt_lsa_t *lsa)
+{
+  lsdb_entry_t *entry;
+
+  if (nodeID < 0 || nodeID >= MAX_NODEID || !lsdb->lsa[nodeID].valid)
+    return -1;
+
+  entry = &lsdb->lsa[nodeID];
+  memset(lsa, 0, sizeof(pkt_lsa_t));
+  lsa->nodeID = nodeID;
+  lsa->seqNum = entry->seqNum;
+  lsa->entryNum = entry->entryNum;
+  memcpy(lsa->entry, entry->entry, entry->entryNum * sizeof(routeupdate_entry_t));
+
+  return 1;
+}
+
+//This function merges the first hop set from into the first hop set to.
+//At most MAX_ECMP_PATHS first hops are kept.
+static void firsthop_merge(int *to, int *toNum, const int *from, int fromNum)
+{
+  for (int i = 0; i < fromNum; i++)
+  {
+    int j;
+
+    for (j = 0; j < *toNum; j++)
+    {
+      if (to[j] == from[i])
+        break;
+    }
+
+    if (j == *toNum && *toNum < MAX_ECMP_PATHS)
+      to[(*toNum)++] = from[i];
+  }
+}
+
+//This function runs Dijkstra's algorithm over the link state database from the given source node.
+//A binary heap keyed by path cost is used, so the computation takes O((N+E)logN) time.
+//Every destination keeps the set of first hops of all its equal cost shortest paths (up to MAX_ECMP_PATHS).
+//For every reachable destination, these first hops are written into the routing table, the routes to unreachable destinations are removed.
+void lsdb_computeroutes(lsdb_t *lsdb, int srcNodeID, routingtable_t *routingtable)
+{
+  unsigned int cost[MAX_NODEID];
+  int firsthop[MAX_NODEID][MAX_ECMP_PATHS];
+  int firsthopNum[MAX_NODEID];
+  nodeheap_t heap;
+
+  if (srcNodeID < 0 || srcNodeID >= MAX_NODEID)
+    return;
+
+  for (int i = 0; i < MAX_NODEID; i++)
+  {
+    cost[i] = INFINITE_COST;
+    firsthopNum[i] = 0;
+    heap.pos[i] = -1;
+  }
+  heap.size = 0;
+
+  cost[srcNodeID] = 0;
+  heap_push(&heap, cost, srcNodeID);
+
+  while (heap.size > 0)
+  {
+    int u = heap_pop(&heap, cost);
+    lsdb_entry_t *entry = &lsdb->lsa[u];
+
+    if (!entry->valid)
+      continue;
+
+    for (int i = 0; i < entry->entryNum; i++)
+    {
+      int v = entry->entry[i].nodeID;
+      unsigned int newcost;
+
+      if (v >= MAX_NODEID || v == srcNodeID || entry->entry[i].cost >= INFINITE_COST)
+        continue;
+
+      newcost = cost[u] + entry->entry[i].cost;
+      if (newcost > cost[v])
+        continue;
+
+      if (newcost < cost[v])
+      {
+        cost[v] = newcost;
+        firsthopNum[v] = 0;
+        heap_push(&heap, cost, v);
+      }
+
+      //an equal cost path adds its first hops to the ones already found
+      if (u == srcNodeID)
+        firsthop_merge(firsthop[v], &firsthopNum[v], &v, 1);
+      else
+        firsthop_merge(firsthop[v], &firsthopNum[v], firsthop[u], firsthopNum[u]);
+    }
+  }
+
+  for (int i = 0; i < MAX_NODEID; i++)
+  {
+    if (i == srcNodeID)
+      continue;
+
+    routingtable_setnextnode(routingtable, i, firsthopNum[i] > 0 ? firsthop[i][0] : -1);
+    for (int j = 1; j < firsthopNum[i]; j++)
+      routingtable_addnextnode(routingtable, i, firsthop[i][j]);
+  }
+}
+
+//This function prints out the contents of a link state database.
+void lsdb_print(lsdb_t *lsdb)
+{
+  for (int i = 0; i < MAX_NODEID; i++)
+  {
+    lsdb_entry_t *entry = &lsdb->lsa[i];
+
+    if (!entry->valid)
+      continue;
+
+    for (int j = 0; j < entry->entryNum; j++)
+      printf("link state database: %d(seq %u) --- %u : %u\n", i, entry->seqNum, entry->entry[j].nodeID, entry->entry[j].cost);
+  }
+}
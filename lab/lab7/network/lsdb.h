@@ -0,0 +1,59 @@
+//FILE: network/lsdb.h
+//
+//Description: this file defines the data structures and functions for the link state database.
+//The link state database keeps the latest LSA received from every node in the overlay.
+//It is used by the link state routing mode to compute the shortest paths with Dijkstra's algorithm.
+//
+
+#ifndef LSDB_H
+#define LSDB_H
+
+#include "../common/pkt.h"
+#include "nbrcosttable.h"
+#include "routingtable.h"
+
+//lsdb_entry_t structure definition
+//an entry holds the latest LSA originated by one node
+typedef struct lsdbentry {
+	int valid;		//1 if a LSA has been received from this node, otherwise 0
+	unsigned int seqNum;	//sequence number of the stored LSA
+	unsigned int entryNum;	//number of neighbor entries in the stored LSA
+	routeupdate_entry_t entry[MAX_NODE_NUM];	//direct link costs from this node to its neighbors
+} lsdb_entry_t;
+
+//A link state database is indexed directly by the originating node ID.
+typedef struct linkstatedatabase {
+	lsdb_entry_t lsa[MAX_NODEID];
+} lsdb_t;
+
+//This function creates an empty link state database dynamically.
+//The dynamically created link state database is returned.
+lsdb_t* lsdb_create();
+
+//This function destroys a link state database.
+//It frees all the dynamically allocated memory for the link state database.
+void lsdb_destroy(lsdb_t* lsdb);
+
+//This function builds the LSA of this node from the neighbor cost table.
+//The given sequence number is stored in the LSA.
+void lsdb_buildlsa(nbr_cost_entry_t* nct, unsigned int seqNum, pkt_lsa_t* lsa);
+
+//This function installs the given LSA in the link state database.
+//If the LSA is newer than the stored one (or no LSA is stored for that node), it is installed and 1 is returned.
+//Otherwise the LSA is a duplicate or stale copy, it is ignored and -1 is returned.
+int lsdb_update(lsdb_t* lsdb, pkt_lsa_t* lsa);
+
+//This function copies the LSA stored for the given node into lsa.
+//Return 1 if a LSA is stored for that node, otherwise return -1.
+int lsdb_getlsa(lsdb_t* lsdb, int nodeID, pkt_lsa_t* lsa);
+
+//This function runs Dijkstra's algorithm over the link state database from the given source node.
+//A binary heap keyed by path cost is used, so the computation takes O((N+E)logN) time.
+//Every destination keeps the set of first hops of all its equal cost shortest paths (up to MAX_ECMP_PATHS).
+//For every reachable destination, these first hops are written into the routing table, the routes to unreachable destinations are removed.
+void lsdb_computeroutes(lsdb_t* lsdb, int srcNodeID, routingtable_t* routingtable);
+
+//This function prints out the contents of a link state database.
+void lsdb_print(lsdb_t* lsdb);
+
+#endif
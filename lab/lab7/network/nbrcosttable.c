@@ -62,6 +62,26 @@ unsigned int nbrcosttable_getcost(nbr_cost_entry_t *nct, int nodeID)
   return INFINITE_COST;
 }
 
+//This function is used to set the direct link cost to a neighbor.
+//A link which is down has the cost INFINITE_COST.
+//If the neighbor is found in the table and the cost is set, return 1, otherwise return -1.
+int nbrcosttable_setcost(nbr_cost_entry_t *nct, int nodeID, unsigned int cost)
+{
+  int nb_num;
+  nb_num = topology_getNbrNum();
+
+  for (int i = 0; i < nb_num; i++)
+  {
+    if (nct[i].nodeID == nodeID)
+    {
+      nct[i].cost = cost;
+      return 1;
+    }
+  }
+
+  return -1;
+}
+
 //This function prints out the contents of a neighbor cost table.
 void nbrcosttable_print(nbr_cost_entry_t *nct)
 {
@@ -28,6 +28,11 @@ void nbrcosttable_destroy(nbr_cost_entry_t* nct);
 //INFINITE_COST is returned if the node is not found in the table.
 unsigned int nbrcosttable_getcost(nbr_cost_entry_t* nct, int nodeID);
 
+//This function is used to set the direct link cost to a neighbor.
+//A link which is down has the cost INFINITE_COST.
+//If the neighbor is found in the table and the cost is set, return 1, otherwise return -1.
+int nbrcosttable_setcost(nbr_cost_entry_t* nct, int nodeID, unsigned int cost);
+
 //This function prints out the contents of a neighbor cost table.
 void nbrcosttable_print(nbr_cost_entry_t* nct); 
 
@@ -9,6 +9,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <string.h>
 #include <strings.h>
 #include <arpa/inet.h>
@@ -18,6 +19,11 @@
 #include <sys/utsname.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sched.h>
 
 #include "../common/constants.h"
 #include "../common/pkt.h"
@@ -27,20 +33,74 @@
 #include "nbrcosttable.h"
 #include "dvtable.h"
 #include "routingtable.h"
+#include "lsdb.h"
+#include "porttable.h"
+#include "../common/shmring.h"
 
-//network layer waits this time for establishing the routing paths
-#define NETWORK_WAITTIME 60
+//network layer waits at most this time (in seconds) for the routes to all the nodes before serving the SRT processes
+//it only expires when some node of the overlay is unreachable, otherwise the SRT processes are served as soon as the routes converge
+#define NETWORK_CONVERGE_TIMEOUT 30
+
+//max file descriptor of the connections of the SRT processes and of their doorbells, a SRT process connected on a larger one is refused
+#define NETWORK_MAX_FDS 1024
+
+//types of the file descriptors served by waitTransport()
+#define TRANSPORT_NONE 0 //not a descriptor of a SRT process
+#define TRANSPORT_CONN 1 //TCP connection of a SRT process
+#define TRANSPORT_RING 2 //doorbell of the ring from a SRT process to the SNP process
+#define TRANSPORT_OFFER 3 //unix connection over which a SRT process offers a shared memory channel
+
+//size of the read buffer of the connection of a SRT process, in sendseg_arg_ts
+#define TRANSPORT_RBUF_SEGS 16
+//size of the write queue of the connection of a SRT process, in sendseg_arg_ts
+//a segment to a SRT process which does not keep up is dropped beyond it, as on a congested link, and SRT retransmits it
+#define TRANSPORT_WBUF_SEGS 64
+
+//routing modes, selected by the command line argument of the SNP process
+#define ROUTING_DV 0 //distance vector routing, the default
+#define ROUTING_LS 1 //link state routing, started with "./network ls"
 
 /**************************************************************/
 //delare global variables
 /**************************************************************/
 int overlay_conn;                    //connection to the overlay
-int transport_conn;                  //connection to the transport
+porttable_t *porttable;              //SRT ports registered by the connected SRT processes
+pthread_mutex_t *porttable_mutex;    //porttable mutex
 nbr_cost_entry_t *nct;               //neighbor cost table
 dv_t *dv;                            //distance vector table
 pthread_mutex_t *dv_mutex;           //dvtable mutex
-routingtable_t *routingtable;        //routing table
-pthread_mutex_t *routingtable_mutex; //routingtable mutex
+routingtable_rcu_t *routingtable;    //routing table, published to the forwarding path without locks
+int routing_mode;                    //ROUTING_DV or ROUTING_LS
+int use_shm;                         //1 if the SNP process offers a shared memory channel to the ON process, set by "./network shm"
+lsdb_t *lsdb;                        //link state database, only used in link state mode
+pthread_mutex_t *lsdb_mutex;         //lsdb mutex
+unsigned int lsa_seqNum;             //sequence number of the last LSA originated by this node, protected by lsdb_mutex
+int converged;                       //1 once this node has routes to all the nodes of the overlay
+int serving;                         //1 once waitTransport() accepts SRT processes, -1 if it failed, protected by converge_mutex
+pthread_mutex_t *converge_mutex;     //converged mutex
+pthread_cond_t *converge_cond;       //signaled when converged or serving is set
+struct timespec start_time;          //time the SNP process started, used to report the convergence time
+shmchannel_t *overlay_shm;           //shared memory channel to the ON process, NULL while the packets go over overlay_conn
+shmchannel_t *offered_shm;           //shared memory channel offered to the ON process and not acknowledged yet
+pthread_mutex_t *shm_mutex;          //serializes the threads producing into the ring to the ON process
+unsigned long ttl_expired;           //number of packets dropped because their TTL expired, only written by pkthandler
+int transport_epfd;                  //epoll instance of waitTransport(), pkthandler polls a connection for writability in it
+
+//a descriptor served by waitTransport(), indexed by the descriptor
+typedef struct transportentry
+{
+  int type;          //TRANSPORT_NONE, TRANSPORT_CONN, TRANSPORT_RING or TRANSPORT_OFFER
+  int conn;          //for a doorbell, the connection of the SRT process owning the channel
+  shmchannel_t *shm; //for a connection, the shared memory channel attached by its SRT process, NULL if it uses TCP, protected by porttable_mutex
+  int shm_confirmed; //for a connection, 1 once the SRT process confirmed its channel through the ring, the segments are delivered over TCP until then, protected by porttable_mutex
+  char *rbuf;        //for a connection, the bytes received and not parsed into sendseg_arg_ts yet, only used by waitTransport()
+  int rlen;          //for a connection, number of bytes in rbuf
+  char *wbuf;        //for a connection, the sendseg_arg_ts queued to the SRT process, the bytes from wstart to wend are not sent yet, protected by porttable_mutex
+  int wstart;        //for a connection, first byte of wbuf not sent yet
+  int wend;          //for a connection, end of the bytes queued in wbuf
+  int pollout;       //for a connection, 1 while it is polled for writability because wbuf is not empty, protected by porttable_mutex
+} transport_entry_t;
+transport_entry_t transport[NETWORK_MAX_FDS];
 
 /**************************************************************/
 //implementation network layer functions
@@ -48,9 +108,12 @@ pthread_mutex_t *routingtable_mutex; //routingtable mutex
 
 //This function is used to for the SNP process to connect to the local ON process on port OVERLAY_PORT.
 //TCP descriptor is returned if success, otherwise return -1.
+//The caller retries with an exponential backoff, so the SNP process can be started before the ON process.
+//Nagle's algorithm is disabled on the connection: a packet held back until the previous one is acknowledged would wait for the delayed ACK
+//of the ON process, or for the next packet in the other direction.
 int connectToOverlay()
 {
-  int sfd;
+  int sfd, one = 1;
   struct sockaddr_in addr;
   sfd = socket(AF_INET, SOCK_STREAM, 0);
 
@@ -67,17 +130,305 @@ int connectToOverlay()
 
   if (connect(sfd, (struct sockaddr *)&addr, sizeof(struct sockaddr_in)) == 0)
   {
+    setsockopt(sfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
     return sfd;
   }
 
+  close(sfd);
   return -1;
 }
 
-//This thread sends out route update packets every ROUTEUPDATE_INTERVAL time
-//The route update packet contains this node's distance vector.
+//This function checks whether this node has a route to every node of the overlay.
+//The first time it has, the time since the SNP process started is printed and the main thread waiting in network_waitconverged() is woken up.
+void network_checkconverged()
+{
+  int myID = topology_getMyNodeID();
+  int node_num = topology_getNodeNum();
+  int *node_id_array;
+  struct timespec now;
+
+  pthread_mutex_lock(converge_mutex);
+  if (converged)
+  {
+    pthread_mutex_unlock(converge_mutex);
+    return;
+  }
+
+  node_id_array = topology_getNodeArray();
+  for (int i = 0; i < node_num; i++)
+  {
+    if (node_id_array[i] != myID && routingtable_rcu_getnextnode(routingtable, node_id_array[i]) == -1)
+    {
+      free(node_id_array);
+      pthread_mutex_unlock(converge_mutex);
+      return;
+    }
+  }
+  free(node_id_array);
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  printf("network layer: routes to all %d nodes established in %ld ms\n", node_num,
+         (now.tv_sec - start_time.tv_sec) * 1000 + (now.tv_nsec - start_time.tv_nsec) / 1000000);
+  converged = 1;
+  pthread_cond_broadcast(converge_cond);
+  pthread_mutex_unlock(converge_mutex);
+}
+
+//This function blocks until this node has routes to all the nodes of the overlay, or until timeout seconds have passed.
+//Return 1 if the routes converged, otherwise return -1.
+int network_waitconverged(int timeout)
+{
+  struct timespec deadline;
+  int result;
+
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeout;
+
+  pthread_mutex_lock(converge_mutex);
+  while (!converged)
+  {
+    if (pthread_cond_timedwait(converge_cond, converge_mutex, &deadline) == ETIMEDOUT)
+      break;
+  }
+  result = converged ? 1 : -1;
+  pthread_mutex_unlock(converge_mutex);
+
+  return result;
+}
+
+//This function recomputes the routing table from the link state database with Dijkstra's algorithm
+//and publishes the new routing table to the forwarding path.
+//The caller must hold lsdb_mutex.
+void lsdb_recompute()
+{
+  routingtable_t *newtable = routingtable_rcu_update_begin(routingtable);
+  lsdb_computeroutes(lsdb, topology_getMyNodeID(), newtable);
+  routingtable_rcu_publish(routingtable, newtable);
+  network_checkconverged();
+}
+
+//This function offers a shared memory channel to the ON process.
+//The channel is used once the ON process acknowledges it with a SHM_ATTACHED packet, until then overlay_conn is used.
+//Return 1 if the channel is offered, otherwise return -1.
+int network_offershm()
+{
+  sendpkt_arg_t offer;
+
+  if ((offered_shm = shmchannel_create()) == NULL)
+    return -1;
+
+  memset(&offer, 0, sizeof(sendpkt_arg_t));
+  offer.nextNodeID = SHM_ATTACH_NODEID;
+  if (shmchannel_offer(OVERLAY_SHM_NAME, offered_shm, &offer, sizeof(sendpkt_arg_t)) == -1)
+  {
+    shmchannel_destroy(offered_shm);
+    offered_shm = NULL;
+    return -1;
+  }
+
+  return 1;
+}
+
+//This function sends a packet to the ON process, which sends it to the next hop nextNodeID.
+//If the ON process attached the shared memory channel, the sendpkt_arg_t is written in place into the ring to the ON process,
+//otherwise overlay_sendpkt() is used.
+//Return 1 if the packet is handed to the ON process, otherwise return -1.
+int network_sendpkt(int nextNodeID, snp_pkt_t *pkt)
+{
+  shmchannel_t *ch = __atomic_load_n(&overlay_shm, __ATOMIC_ACQUIRE);
+  sendpkt_arg_t *slot;
+
+  if (ch == NULL)
+    return overlay_sendpkt(nextNodeID, pkt, overlay_conn);
+
+  //several threads send packets, but a ring has a single producer
+  pthread_mutex_lock(shm_mutex);
+  while ((slot = shmring_reserve(ch->toserver)) == NULL)
+  {
+    //the ring is full, the ON process drains it without blocking, so wait for it
+    if (overlay_conn == -1)
+    {
+      pthread_mutex_unlock(shm_mutex);
+      return -1;
+    }
+    sched_yield();
+  }
+  slot->nextNodeID = nextNodeID;
+  memcpy(&slot->pkt, pkt, sizeof(snp_pkt_t));
+  shmring_commit(ch->toserver, ch->toserver_fd);
+  pthread_mutex_unlock(shm_mutex);
+
+  return 1;
+}
+
+//This function receives a packet from the ON process.
+//Until the ON process acknowledges the offered shared memory channel, packets are received from overlay_conn with overlay_recvpkt(),
+//afterwards they are read from the ring to the SNP process.
+//Return 1 if a packet is received, -1 if the ON process is gone.
+int network_recvpkt(snp_pkt_t *pkt)
+{
+  while (overlay_shm == NULL)
+  {
+    if (overlay_recvpkt(pkt, overlay_conn) == -1)
+      return -1;
+
+    if (pkt->header.type != SHM_ATTACHED)
+      return 1;
+
+    if (offered_shm != NULL)
+    {
+      __atomic_store_n(&overlay_shm, offered_shm, __ATOMIC_RELEASE);
+      printf("network layer: shared memory channel to ON process attached\n");
+    }
+  }
+
+  if (shmring_wait(overlay_shm->toclient, overlay_shm->toclient_fd, overlay_conn) == -1)
+    return -1;
+
+  memcpy(pkt, shmring_peek(overlay_shm->toclient), sizeof(snp_pkt_t));
+  shmring_release(overlay_shm->toclient);
+
+  return 1;
+}
+
+//This function forwards a SNP packet destined to another node to the next hop of its flow.
+//The TTL of the packet is decremented first. A packet whose TTL reaches 0 is looping during a routing transient, so it is dropped
+//instead of burning the bandwidth of the links. The dropped packets are counted, and one in TTL_LOG_SAMPLE of them is logged.
+void network_forwardpkt(snp_pkt_t *pkt)
+{
+  seg_t *seg = (seg_t *)pkt->data;
+  unsigned int flowHash;
+  int nextID;
+
+  if (pkt->header.ttl <= 1)
+  {
+    ttl_expired++;
+    if (TTL_LOG_SAMPLE > 0 && (ttl_expired - 1) % TTL_LOG_SAMPLE == 0)
+      printf("network layer: packet from %d to %d dropped, TTL expired (%lu packets dropped)\n",
+             pkt->header.src_nodeID, pkt->header.dest_nodeID, ttl_expired);
+    return;
+  }
+  pkt->header.ttl--;
+
+  flowHash = routingtable_flowhash(pkt->header.src_nodeID, pkt->header.dest_nodeID, seg->header.src_port, seg->header.dest_port);
+  nextID = routingtable_rcu_getflownextnode(routingtable, pkt->header.dest_nodeID, flowHash);
+  network_sendpkt(nextID, pkt);
+}
+
+//This function delivers the segment of a packet destined to this node to the SRT process which registered the segment's destination port.
+//If the SRT process attached a shared memory channel and confirmed it, the sendseg_arg_t is written in place into its ring, and is lost if the ring is full.
+//Otherwise it is queued to the connection with network_queueseg(), which never blocks, and is lost if the queue is full.
+//A packet whose length does not fit a segment is dropped.
+void network_deliverseg(snp_pkt_t *pkt)
+{
+  seg_t *seg = (seg_t *)pkt->data;
+  sendseg_arg_t *slot;
+  shmchannel_t *ch;
+  int conn;
+
+  if (pkt->header.length > sizeof(seg_t))
+  {
+    printf("network layer: packet from %d with bad length %u dropped\n", pkt->header.src_nodeID, pkt->header.length);
+    return;
+  }
+
+  pthread_mutex_lock(porttable_mutex);
+  conn = porttable_getconn(porttable, seg->header.dest_port);
+  if (conn == -1)
+  {
+    pthread_mutex_unlock(porttable_mutex);
+    printf("network layer: no SRT process on port %u, segment dropped\n", seg->header.dest_port);
+    return;
+  }
+
+  //the channel is only destroyed under porttable_mutex, and pkthandler is its only producer
+  ch = transport[conn].shm;
+  if (ch != NULL && transport[conn].shm_confirmed)
+  {
+    if ((slot = shmring_reserve(ch->toclient)) != NULL)
+    {
+      slot->nodeID = pkt->header.src_nodeID;
+      memcpy(&slot->seg, seg, pkt->header.length);
+      shmring_commit(ch->toclient, ch->toclient_fd);
+    }
+    pthread_mutex_unlock(porttable_mutex);
+    return;
+  }
+  network_queueseg(conn, pkt->header.src_nodeID, seg);
+  pthread_mutex_unlock(porttable_mutex);
+}
+
+//This function recomputes this node's distance vector and the routing table with the Bellman-Ford equation,
+//from the direct link costs in the neighbor cost table and the distance vectors received from the neighbors.
+//All the equal cost next hops of a destination (up to MAX_ECMP_PATHS) are kept.
+//The new routing table is published to the forwarding path if any route changed.
+//Return 1 if this node's distance vector changed, otherwise return 0.
+//The caller must hold dv_mutex.
+int dv_recompute()
+{
+  int myID = topology_getMyNodeID();
+  int nb_num = topology_getNbrNum();
+  int node_num = topology_getNodeNum();
+  int *node_id_array = topology_getNodeArray();
+  routingtable_t *newtable = routingtable_rcu_update_begin(routingtable);
+  int changed = 0;
+
+  for (int i = 0; i < node_num; i++)
+  {
+    int destID = node_id_array[i];
+    unsigned int best = INFINITE_COST;
+    int nextID[MAX_ECMP_PATHS], nextNum = 0;
+
+    if (destID == myID)
+      continue;
+
+    for (int j = 0; j < nb_num; j++)
+    {
+      unsigned int cost;
+
+      if (nct[j].cost >= INFINITE_COST)
+        continue;
+
+      cost = nct[j].cost + (nct[j].nodeID == destID ? 0 : dvtable_getcost(dv, nct[j].nodeID, destID));
+      if (cost >= INFINITE_COST || cost > best)
+        continue;
+
+      if (cost < best)
+      {
+        best = cost;
+        nextNum = 0;
+      }
+      if (nextNum < MAX_ECMP_PATHS)
+        nextID[nextNum++] = nct[j].nodeID;
+    }
+
+    if (dvtable_getcost(dv, myID, destID) != best)
+    {
+      dvtable_setcost(dv, myID, destID, best);
+      changed = 1;
+    }
+
+    routingtable_setnextnode(newtable, destID, nextNum > 0 ? nextID[0] : -1);
+    for (int k = 1; k < nextNum; k++)
+      routingtable_addnextnode(newtable, destID, nextID[k]);
+  }
+
+  //forwarding keeps using the published table until the updated copy is swapped in
+  if (memcmp(newtable, routingtable_rcu_dereference(routingtable), sizeof(routingtable_t)) != 0)
+    routingtable_rcu_publish(routingtable, newtable);
+  else
+    routingtable_rcu_abort(routingtable, newtable);
+  network_checkconverged();
+
+  free(node_id_array);
+  return changed;
+}
+
+//This function broadcasts a route update packet containing this node's distance vector to all the neighbors.
 //Broadcasting is done by set the dest_nodeID in packet header as BROADCAST_NODEID
-//and use overlay_sendpkt() to send the packet out using BROADCAST_NODEID address.
-void *routeupdate_daemon(void *arg)
+//and use network_sendpkt() to send the packet out using BROADCAST_NODEID address.
+//Return 1 if the packet is sent to the ON process, otherwise return -1.
+int routeupdate_send()
 {
   snp_pkt_t pkt;
   pkt_routeupdate_t route_update;
@@ -91,82 +442,223 @@ void *routeupdate_daemon(void *arg)
   memset(route_update.entry, 0, MAX_NODE_NUM * sizeof(routeupdate_entry_t));
   node_id_array = topology_getNodeArray();
 
-  do
+  // set pkt_routeupdate_t, the distance vector is retrieved from the source node’s distance vector table.
+  pthread_mutex_lock(dv_mutex);
+  for (int i = 0; i < route_update.entryNum; i++)
+  {
+    routeupdate_entry_t *rt_entry = &route_update.entry[i];
+    rt_entry->nodeID = node_id_array[i];
+    rt_entry->cost = dvtable_getcost(dv, pkt.header.src_nodeID, rt_entry->nodeID);
+  }
+  memcpy(pkt.data, &route_update, sizeof(pkt_routeupdate_t));
+  pthread_mutex_unlock(dv_mutex);
+
+  free(node_id_array);
+  return network_sendpkt(BROADCAST_NODEID, &pkt);
+}
+
+//This function rebuilds this node's LSA from the neighbor cost table with a new sequence number,
+//installs it in its own link state database, recomputes the routing table and floods the LSA to all the neighbors using BROADCAST_NODEID.
+//Return 1 if the packet is sent to the ON process, otherwise return -1.
+int lsa_originate()
+{
+  snp_pkt_t pkt;
+  pkt_lsa_t lsa;
+
+  pkt.header.src_nodeID = topology_getMyNodeID();
+  pkt.header.dest_nodeID = BROADCAST_NODEID;
+  pkt.header.length = sizeof(pkt_lsa_t);
+  pkt.header.type = LINK_STATE;
+
+  pthread_mutex_lock(lsdb_mutex);
+  lsdb_buildlsa(nct, ++lsa_seqNum, &lsa);
+  lsdb_update(lsdb, &lsa);
+  lsdb_recompute();
+  pthread_mutex_unlock(lsdb_mutex);
+
+  memcpy(pkt.data, &lsa, sizeof(pkt_lsa_t));
+  return network_sendpkt(BROADCAST_NODEID, &pkt);
+}
+
+//This function sends every LSA stored in the link state database to the given neighbor only.
+//LSAs flooded while that neighbor's SNP process was not connected to its ON process are lost for it,
+//so they are resent when the neighbor shows up instead of waiting for the next ROUTEUPDATE_INTERVAL.
+//The neighbor installs and floods further the LSAs which are newer than its own copies.
+void lsdb_sync(int nbrID)
+{
+  int node_num = topology_getNodeNum();
+  int *node_id_array = topology_getNodeArray();
+  snp_pkt_t pkt;
+  pkt_lsa_t lsa;
+
+  pkt.header.src_nodeID = topology_getMyNodeID();
+  pkt.header.dest_nodeID = BROADCAST_NODEID;
+  pkt.header.length = sizeof(pkt_lsa_t);
+  pkt.header.type = LINK_STATE;
+
+  for (int i = 0; i < node_num; i++)
   {
-    // set pkt_routeupdate_t, the distance vector is retrieved from the source node’s distance vector table.
-    pthread_mutex_lock(dv_mutex);
-    for (int i = 0; i < route_update.entryNum; i++)
+    pthread_mutex_lock(lsdb_mutex);
+    int stored = lsdb_getlsa(lsdb, node_id_array[i], &lsa);
+    pthread_mutex_unlock(lsdb_mutex);
+    if (stored == 1 && node_id_array[i] != nbrID)
     {
-      routeupdate_entry_t *rt_entry = &route_update.entry[i];
-      rt_entry->nodeID = node_id_array[i];
-      rt_entry->cost = dvtable_getcost(dv, pkt.header.src_nodeID, rt_entry->nodeID);
+      memcpy(pkt.data, &lsa, sizeof(pkt_lsa_t));
+      network_sendpkt(nbrID, &pkt);
     }
-    memcpy(pkt.data, &route_update, sizeof(pkt_routeupdate_t));
-    pthread_mutex_unlock(dv_mutex);
+  }
+  free(node_id_array);
+}
 
-    if (overlay_sendpkt(BROADCAST_NODEID, &pkt, overlay_conn) == -1)
+//This function handles a link up or link down event of the link to the given neighbor reported by the ON process.
+//The direct link cost to the neighbor is restored from the topology when the link is up, and set to INFINITE_COST when it is down.
+//In distance vector mode, the distance vector of a neighbor whose link is down is discarded, the routes are recomputed
+//and a route update is sent right away if this node's distance vector changed.
+//In link state mode, a new LSA is originated right away, and the link state database is sent to a neighbor whose link is up.
+void network_linkevent(int nbrID, int up)
+{
+  int myID = topology_getMyNodeID();
+
+  printf("network layer: link to neighbor %d is %s\n", nbrID, up ? "up" : "down");
+
+  if (routing_mode == ROUTING_LS)
+  {
+    pthread_mutex_lock(lsdb_mutex);
+    nbrcosttable_setcost(nct, nbrID, up ? topology_getCost(myID, nbrID) : INFINITE_COST);
+    pthread_mutex_unlock(lsdb_mutex);
+    lsa_originate();
+    if (up)
+      lsdb_sync(nbrID);
+    return;
+  }
+
+  pthread_mutex_lock(dv_mutex);
+  nbrcosttable_setcost(nct, nbrID, up ? topology_getCost(myID, nbrID) : INFINITE_COST);
+  if (!up)
+  {
+    int node_num = topology_getNodeNum();
+    int *node_id_array = topology_getNodeArray();
+
+    for (int i = 0; i < node_num; i++)
+      dvtable_setcost(dv, nbrID, node_id_array[i], INFINITE_COST);
+    free(node_id_array);
+  }
+  int changed = dv_recompute();
+  pthread_mutex_unlock(dv_mutex);
+
+  if (changed)
+    routeupdate_send();
+}
+
+//This thread sends out route update packets every ROUTEUPDATE_INTERVAL time
+//The route update packet contains this node's distance vector.
+//In link state mode, this node's LSA is broadcast instead, and it is flooded further by the receiving nodes.
+void *routeupdate_daemon(void *arg)
+{
+  int result;
+
+  do
+  {
+    if (routing_mode == ROUTING_LS)
+      result = lsa_originate();
+    else
+      result = routeupdate_send();
+
+    if (result == -1)
       break;
   } while (sleep(ROUTEUPDATE_INTERVAL) == 0);
 
-  free(node_id_array);
   close(overlay_conn);
   overlay_conn = -1;
   pthread_exit(NULL);
 }
 
 //This thread handles incoming packets from the ON process.
-//It receives packets from the ON process by calling overlay_recvpkt().
-//If the packet is a SNP packet and the destination node is this node, forward the packet to the SRT process.
+//It receives packets from the ON process by calling network_recvpkt().
+//If the packet is a SNP packet and the destination node is this node, forward the packet to the SRT process which registered the segment's destination port.
 //If the packet is a SNP packet and the destination node is not this node, forward the packet to the next hop according to the routing table.
-//If this packet is an Route Update packet, update the distance vector table and the routing table.
+//When there are several equal cost next hops, the flow of the packet (source/destination nodes and SRT ports) selects one of them.
+//If this packet is an Route Update packet, update the distance vector table and the routing table, and send a route update right away if this node's distance vector changed.
+//If this packet is a Link State packet carrying a new LSA, install it, recompute the routing table and flood it to the neighbors.
+//The first LSA of a neighbor whose link is up is answered with the whole link state database, as that neighbor's SNP process just started.
+//An older LSA is answered with the stored copy, and a copy of this node's LSA from before a restart makes this node originate a newer one.
+//If this packet is a link up or link down event from the ON process, update the routes through that neighbor.
 void *pkthandler(void *arg)
 {
   snp_pkt_t pkt;
   int myID = topology_getMyNodeID();
 
-  while (overlay_recvpkt(&pkt, overlay_conn) > 0)
+  while (network_recvpkt(&pkt) > 0)
   {
     if (pkt.header.type == SNP && pkt.header.dest_nodeID == myID)
-    {
-      seg_t seg;
-      memcpy(&seg, pkt.data, pkt.header.length);
-      forwardsegToSRT(transport_conn, pkt.header.src_nodeID, &seg);
-    }
+      network_deliverseg(&pkt);
     else if (pkt.header.type == SNP && pkt.header.dest_nodeID != myID)
-    {
-      pthread_mutex_lock(routingtable_mutex);
-      int nextID = routingtable_getnextnode(routingtable, pkt.header.dest_nodeID);
-      pthread_mutex_unlock(routingtable_mutex);
-      overlay_sendpkt(nextID, &pkt, overlay_conn);
-    }
+      network_forwardpkt(&pkt);
     else if (pkt.header.type == ROUTE_UPDATE)
     {
       // update the distance vector table and the routing table.
-      pthread_mutex_lock(dv_mutex);
-      pthread_mutex_lock(routingtable_mutex);
-
       pkt_routeupdate_t route_update;
+      int changed;
       memcpy(&route_update, pkt.data, pkt.header.length);
 
+      pthread_mutex_lock(dv_mutex);
       for (int i = 0; i < route_update.entryNum; i++)
       {
         routeupdate_entry_t *rt_update_entry = &route_update.entry[i];
-        int my_cost, fw_to_nb_cost;
-
         dvtable_setcost(dv, pkt.header.src_nodeID, rt_update_entry->nodeID, rt_update_entry->cost);
-        my_cost = dvtable_getcost(dv, myID, rt_update_entry->nodeID);
-        fw_to_nb_cost = nbrcosttable_getcost(nct, pkt.header.src_nodeID) + rt_update_entry->cost;
-
-        if (my_cost > fw_to_nb_cost)
-        {
-          dvtable_setcost(dv, myID, rt_update_entry->nodeID, fw_to_nb_cost);
-          routingtable_setnextnode(routingtable, rt_update_entry->nodeID, pkt.header.src_nodeID);
-        }
       }
-
+      changed = dv_recompute();
       pthread_mutex_unlock(dv_mutex);
-      pthread_mutex_unlock(routingtable_mutex);
+
+      //a triggered update spreads the change without waiting for the next ROUTEUPDATE_INTERVAL
+      if (changed)
+        routeupdate_send();
     }
+    else if (pkt.header.type == LINK_STATE && routing_mode == ROUTING_LS)
+    {
+      pkt_lsa_t lsa;
+      pkt_lsa_t stored;
+      memcpy(&lsa, pkt.data, sizeof(pkt_lsa_t));
+
+      pthread_mutex_lock(lsdb_mutex);
+      //no LSA is stored yet for a neighbor whose link is up: its SNP process connected after the link came up on this side,
+      //so no link event will make this node send it the link state database
+      int newnbr = lsa.nodeID != myID && lsdb_getlsa(lsdb, lsa.nodeID, &stored) == -1 &&
+                   nbrcosttable_getcost(nct, lsa.nodeID) != INFINITE_COST;
+      if (lsa.nodeID == myID)
+      {
+        //a LSA of this node which is not the current one was originated before this SNP process restarted,
+        //the counter is moved past it and a fresh LSA is originated so the other nodes replace the old links
+        int stale = (int)(lsa.seqNum - lsa_seqNum) > 0;
+        if (lsa.seqNum == lsa_seqNum && lsdb_getlsa(lsdb, myID, &stored) == 1)
+          stale = lsa.entryNum != stored.entryNum || memcmp(lsa.entry, stored.entry, lsa.entryNum * sizeof(routeupdate_entry_t)) != 0;
+        if (stale)
+          lsa_seqNum = lsa.seqNum;
+        pthread_mutex_unlock(lsdb_mutex);
+        if (stale)
+          lsa_originate();
+      }
+      else if (lsdb_update(lsdb, &lsa) == 1)
+      {
+        lsdb_recompute();
+        pthread_mutex_unlock(lsdb_mutex);
+        //only a newer LSA is flooded further, duplicates stop here
+        network_sendpkt(BROADCAST_NODEID, &pkt);
+        if (newnbr)
+          lsdb_sync(lsa.nodeID);
+      }
+      else if (lsdb_getlsa(lsdb, lsa.nodeID, &stored) == 1 && (int)(stored.seqNum - lsa.seqNum) > 0)
+      {
+        pthread_mutex_unlock(lsdb_mutex);
+        //an older LSA comes from a node which restarted its counter, the stored copy is sent back so that node moves past it
+        memcpy(pkt.data, &stored, sizeof(pkt_lsa_t));
+        network_sendpkt(BROADCAST_NODEID, &pkt);
+      }
+      else
+        pthread_mutex_unlock(lsdb_mutex);
+    }
+    else if (pkt.header.type == LINK_UP || pkt.header.type == LINK_DOWN)
+      network_linkevent(pkt.header.src_nodeID, pkt.header.type == LINK_UP);
   }
   close(overlay_conn);
   overlay_conn = -1;
@@ -178,25 +670,355 @@ void *pkthandler(void *arg)
 //It is called when the SNP process receives a signal SIGINT.
 void network_stop()
 {
-  close(transport_conn);
+  printf("network layer: %lu packets dropped because their TTL expired\n", ttl_expired);
   close(overlay_conn);
+  if (offered_shm != NULL)
+    shmchannel_destroy(offered_shm);
+  pthread_mutex_destroy(shm_mutex);
+  free(shm_mutex);
+  porttable_destroy(porttable);
+  pthread_mutex_destroy(porttable_mutex);
+  free(porttable_mutex);
   nbrcosttable_destroy(nct);
   dvtable_destroy(dv);
   pthread_mutex_destroy(dv_mutex);
   free(dv_mutex);
-  routingtable_destroy(routingtable);
-  pthread_mutex_destroy(routingtable_mutex);
-  free(routingtable_mutex);
+  routingtable_rcu_destroy(routingtable);
+  lsdb_destroy(lsdb);
+  pthread_mutex_destroy(lsdb_mutex);
+  free(lsdb_mutex);
+  pthread_mutex_destroy(converge_mutex);
+  free(converge_mutex);
+  pthread_cond_destroy(converge_cond);
+  free(converge_cond);
   exit(0);
 }
 
-//This function opens a port on NETWORK_PORT and waits for the TCP connection from local SRT process.
-//After the local SRT process is connected, this function keeps receiving sendseg_arg_ts which contains the segments and their destination node addresses from the SRT process. The received segments are then encapsulated into packets (one segment in one packet), and sent to the next hop using overlay_sendpkt. The next hop is retrieved from routing table.
-//When a local SRT process is disconnected, this function waits for the next SRT process to connect.
+//This function records whether waitTransport() accepts SRT processes (1) or failed to (-1), and wakes up network_waitserving().
+void network_setserving(int state)
+{
+  pthread_mutex_lock(converge_mutex);
+  serving = state;
+  pthread_cond_broadcast(converge_cond);
+  pthread_mutex_unlock(converge_mutex);
+}
+
+//This function waits until waitTransport() accepts SRT processes.
+//Return 1 when the SRT processes can connect, -1 if waitTransport() failed.
+int network_waitserving()
+{
+  int result;
+
+  pthread_mutex_lock(converge_mutex);
+  while (serving == 0)
+    pthread_cond_wait(converge_cond, converge_mutex);
+  result = serving;
+  pthread_mutex_unlock(converge_mutex);
+
+  return result;
+}
+
+//This function sends a segment received from the SRT process connected on conn, the segment is in pkt->data and its destination node in pkt->header.dest_nodeID.
+//The source port of the segment is registered for the SRT process, a segment with PORT_REGISTER_NODEID is only a registration.
+//Otherwise the packet is sent to the next hop of its flow with network_sendpkt().
+void network_sendseg(int conn, snp_pkt_t *pkt)
+{
+  seg_t *seg = (seg_t *)pkt->data;
+  unsigned int flowHash;
+  int nextID;
+
+  //a SRT process owns the source ports of its segments, so they are registered as well
+  pthread_mutex_lock(porttable_mutex);
+  porttable_register(porttable, seg->header.src_port, conn);
+  pthread_mutex_unlock(porttable_mutex);
+
+  if (pkt->header.dest_nodeID == PORT_REGISTER_NODEID)
+    return;
+
+  //the packets of a flow are hashed onto the same equal cost next hop to keep them in order
+  flowHash = routingtable_flowhash(pkt->header.src_nodeID, pkt->header.dest_nodeID, seg->header.src_port, seg->header.dest_port);
+  nextID = routingtable_rcu_getflownextnode(routingtable, pkt->header.dest_nodeID, flowHash);
+  network_sendpkt(nextID, pkt);
+}
+
+//This function polls the connection conn of a SRT process for writability while its write queue is not empty, and stops when it is empty.
+//The caller holds porttable_mutex.
+void network_pollout(int conn)
+{
+  struct epoll_event ev;
+  int pollout = transport[conn].wstart < transport[conn].wend;
+
+  if (pollout == transport[conn].pollout)
+    return;
+
+  transport[conn].pollout = pollout;
+  ev.events = pollout ? EPOLLIN | EPOLLOUT : EPOLLIN;
+  ev.data.fd = conn;
+  epoll_ctl(transport_epfd, EPOLL_CTL_MOD, conn, &ev);
+}
+
+//This function sends the write queue of the nonblocking connection conn of a SRT process until it is empty or the connection would block.
+//The rest is sent when waitTransport() finds the connection writable. A broken connection drops the queue, waitTransport() closes it when reading fails.
+//The caller holds porttable_mutex.
+void network_flushtransport(int conn)
+{
+  transport_entry_t *t = &transport[conn];
+  ssize_t n;
+
+  while (t->wstart < t->wend)
+  {
+    n = send(conn, t->wbuf + t->wstart, t->wend - t->wstart, MSG_NOSIGNAL);
+    if (n > 0)
+      t->wstart += n;
+    else if (n == -1 && errno == EINTR)
+      continue;
+    else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    else
+      t->wstart = t->wend;
+  }
+
+  if (t->wstart == t->wend)
+    t->wstart = t->wend = 0;
+  network_pollout(conn);
+}
+
+//This function queues a sendseg_arg_t with the segment seg and the node ID nodeID to the SRT process connected on conn, and sends as much of the write queue as the connection takes.
+//It never blocks, so pkthandler does not wait for a slow SRT process.
+//Return 1 if the sendseg_arg_t is queued, -1 if the write queue is full and it is dropped.
+//The caller holds porttable_mutex.
+int network_queueseg(int conn, int nodeID, seg_t *seg)
+{
+  transport_entry_t *t = &transport[conn];
+  sendseg_arg_t *arg;
+
+  if (t->wend + sizeof(sendseg_arg_t) > TRANSPORT_WBUF_SEGS * sizeof(sendseg_arg_t))
+  {
+    //make room at the end of the queue by moving the bytes not sent yet to its front
+    if (t->wstart == 0)
+      return -1;
+    memmove(t->wbuf, t->wbuf + t->wstart, t->wend - t->wstart);
+    t->wend -= t->wstart;
+    t->wstart = 0;
+  }
+
+  arg = (sendseg_arg_t *)(t->wbuf + t->wend);
+  arg->nodeID = nodeID;
+  memcpy(&arg->seg, seg, sizeof(seg_t));
+  t->wend += sizeof(sendseg_arg_t);
+
+  network_flushtransport(conn);
+  return 1;
+}
+
+//This function receives the bytes available on the nonblocking connection conn of a SRT process into its read buffer,
+//and sends every complete sendseg_arg_t with network_sendseg(). A sendseg_arg_t received in part waits in the read buffer for the rest.
+//A sendseg_arg_t over TCP from a SRT process whose channel is not confirmed means it gave up on the channel, which is detached.
+//Return 1 if the connection is still open, -1 if the SRT process disconnected or the connection is broken.
+int network_readtransport(int conn, snp_pkt_t *pkt)
+{
+  transport_entry_t *t = &transport[conn];
+  sendseg_arg_t *arg;
+  ssize_t n;
+  int parsed;
+
+  while (1)
+  {
+    n = recv(conn, t->rbuf + t->rlen, TRANSPORT_RBUF_SEGS * sizeof(sendseg_arg_t) - t->rlen, 0);
+    if (n == 0)
+      return -1;
+    if (n == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK ? 1 : -1;
+    }
+    t->rlen += n;
+
+    for (parsed = 0; t->rlen - parsed >= sizeof(sendseg_arg_t); parsed += sizeof(sendseg_arg_t))
+    {
+      arg = (sendseg_arg_t *)(t->rbuf + parsed);
+      //a SRT process sends over TCP after offering a channel only if it gave up waiting for the acknowledgement
+      if (t->shm != NULL && !t->shm_confirmed)
+      {
+        network_detachshm(transport_epfd, conn);
+        printf("network layer: SRT process on %d keeps using TCP, its shared memory channel is detached\n", conn);
+      }
+      pkt->header.dest_nodeID = arg->nodeID;
+      memcpy(pkt->data, &arg->seg, sizeof(seg_t));
+      network_sendseg(conn, pkt);
+    }
+    memmove(t->rbuf, t->rbuf + parsed, t->rlen - parsed);
+    t->rlen -= parsed;
+  }
+}
+
+//This function accepts the unix connection over which a SRT process offers a shared memory channel on the unix socket shm_sfd.
+//The connection is added to the epoll instance epfd, the offer is received by network_recvshm() once it is readable.
+void network_acceptshm(int epfd, int shm_sfd)
+{
+  struct epoll_event ev;
+  int offerconn;
+
+  if ((offerconn = shmchannel_accept(shm_sfd)) == -1)
+    return;
+
+  if (offerconn >= NETWORK_MAX_FDS)
+  {
+    close(offerconn);
+    return;
+  }
+
+  transport[offerconn].type = TRANSPORT_OFFER;
+  ev.events = EPOLLIN;
+  ev.data.fd = offerconn;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, offerconn, &ev);
+}
+
+//This function receives the shared memory channel offered by a SRT process on the unix connection offerconn.
+//The offer carries the address of the SRT process's end of its TCP connection, the channel is attached to the connected SRT process with this address.
+//The doorbell of the ring from the SRT process is added to the epoll instance epfd, and the channel is acknowledged over the TCP connection.
+//The segments to the SRT process keep going over TCP until it confirms the channel through the ring, see network_handleshm().
+void network_recvshm(int epfd, int offerconn)
+{
+  struct sockaddr_in offered, peer;
+  socklen_t addrlen;
+  struct epoll_event ev;
+  sendseg_arg_t offer;
+  seg_t ack;
+  shmchannel_t *ch;
+  int conn, result;
+
+  if ((result = shmchannel_recvoffer(offerconn, &offer, sizeof(sendseg_arg_t), &ch)) == 0)
+    return;
+
+  epoll_ctl(epfd, EPOLL_CTL_DEL, offerconn, NULL);
+  transport[offerconn].type = TRANSPORT_NONE;
+  close(offerconn);
+  if (result == -1)
+    return;
+  memcpy(&offered, offer.seg.data, sizeof(struct sockaddr_in));
+
+  for (conn = 0; conn < NETWORK_MAX_FDS; conn++)
+  {
+    addrlen = sizeof(struct sockaddr_in);
+    if (transport[conn].type == TRANSPORT_CONN && transport[conn].shm == NULL &&
+        getpeername(conn, (struct sockaddr *)&peer, &addrlen) == 0 &&
+        peer.sin_addr.s_addr == offered.sin_addr.s_addr && peer.sin_port == offered.sin_port)
+      break;
+  }
+
+  if (offer.nodeID != SHM_ATTACH_NODEID || conn == NETWORK_MAX_FDS || ch->toserver_fd >= NETWORK_MAX_FDS)
+  {
+    printf("network layer: shared memory channel from SRT process not attached\n");
+    shmchannel_destroy(ch);
+    return;
+  }
+
+  pthread_mutex_lock(porttable_mutex);
+  transport[conn].shm = ch;
+  transport[conn].shm_confirmed = 0;
+  pthread_mutex_unlock(porttable_mutex);
+  transport[ch->toserver_fd].type = TRANSPORT_RING;
+  transport[ch->toserver_fd].conn = conn;
+
+  ev.events = EPOLLIN;
+  ev.data.fd = ch->toserver_fd;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, ch->toserver_fd, &ev);
+  shmring_arm(ch->toserver);
+
+  memset(&ack, 0, sizeof(seg_t));
+  pthread_mutex_lock(porttable_mutex);
+  network_queueseg(conn, SHM_ATTACH_NODEID, &ack);
+  pthread_mutex_unlock(porttable_mutex);
+  printf("network layer: shared memory channel from SRT process on %d attached, waiting for its confirmation\n", conn);
+}
+
+//This function handles the doorbell doorbell of the ring from a SRT process.
+//The first sendseg_arg_t in the ring is the confirmation of the channel by the SRT process, the segments to it are delivered into the ring afterwards.
+//All the other sendseg_arg_ts in the ring are sent with network_sendseg().
+void network_handleshm(int doorbell, snp_pkt_t *pkt)
+{
+  int conn = transport[doorbell].conn;
+  shmring_t *ring = transport[conn].shm->toserver;
+  sendseg_arg_t *slot;
+
+  shmring_disarm(ring, doorbell);
+  do
+  {
+    while ((slot = shmring_peek(ring)) != NULL)
+    {
+      if (slot->nodeID == SHM_ATTACH_NODEID)
+      {
+        shmring_release(ring);
+        pthread_mutex_lock(porttable_mutex);
+        transport[conn].shm_confirmed = 1;
+        pthread_mutex_unlock(porttable_mutex);
+        printf("network layer: shared memory channel from SRT process on %d confirmed\n", conn);
+        continue;
+      }
+      pkt->header.dest_nodeID = slot->nodeID;
+      memcpy(pkt->data, &slot->seg, sizeof(seg_t));
+      shmring_release(ring);
+      network_sendseg(conn, pkt);
+    }
+  } while (!shmring_arm(ring));
+}
+
+//This function detaches the shared memory channel of the connection conn of a SRT process, its doorbell is removed from the epoll instance epfd.
+void network_detachshm(int epfd, int conn)
+{
+  shmchannel_t *ch;
+
+  pthread_mutex_lock(porttable_mutex);
+  ch = transport[conn].shm;
+  transport[conn].shm = NULL;
+  transport[conn].shm_confirmed = 0;
+  pthread_mutex_unlock(porttable_mutex);
+
+  if (ch != NULL)
+  {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, ch->toserver_fd, NULL);
+    transport[ch->toserver_fd].type = TRANSPORT_NONE;
+    shmchannel_destroy(ch);
+  }
+}
+
+//This function closes the connection conn of a SRT process which disconnected.
+//Its ports are removed from the port table, its shared memory channel is detached, and its buffers are freed.
+//pkthandler only uses the connection under porttable_mutex after finding it in the port table, so it is done with it afterwards.
+void network_closetransport(int epfd, int conn)
+{
+  epoll_ctl(epfd, EPOLL_CTL_DEL, conn, NULL);
+  network_detachshm(epfd, conn);
+  pthread_mutex_lock(porttable_mutex);
+  porttable_removeconn(porttable, conn);
+  free(transport[conn].wbuf);
+  transport[conn].wbuf = NULL;
+  transport[conn].wstart = transport[conn].wend = 0;
+  transport[conn].pollout = 0;
+  pthread_mutex_unlock(porttable_mutex);
+  free(transport[conn].rbuf);
+  transport[conn].rbuf = NULL;
+  transport[conn].type = TRANSPORT_NONE;
+  close(conn);
+  printf("network layer: SRT process disconnected on %d\n", conn);
+}
+
+//This function opens a port on NETWORK_PORT and serves all the local SRT processes connected to it.
+//Many SRT processes can be connected at the same time, an epoll loop accepts new connections and receives sendseg_arg_ts from all the connected SRT processes.
+//A sendseg_arg_t with PORT_REGISTER_NODEID registers a SRT port of the sending SRT process in the port table.
+//Other sendseg_arg_ts contain the segments and their destination node addresses. The received segments are encapsulated into packets (one segment in one packet), and sent to the next hop using network_sendpkt. The next hop is retrieved from routing table.
+//A SRT process can attach a shared memory channel with snp_attachshm() right after connecting, its segments are then received from the ring of the channel.
+//When a local SRT process is disconnected, its ports are removed from the port table.
 void waitTransport()
 {
   struct sockaddr_in addr;
-  int sfd = socket(AF_INET, SOCK_STREAM, 0);
+  struct epoll_event ev, events[NETWORK_MAX_EVENTS];
+  snp_pkt_t pkt;
+  int sfd, shm_sfd, epfd, nfds, conn, one = 1;
+
+  sfd = socket(AF_INET, SOCK_STREAM, 0);
 
   if (sfd == -1)
   {
@@ -213,6 +1035,7 @@ void waitTransport()
   {
     printf("bind address to socket failed!\n");
     close(sfd);
+    network_setserving(-1);
     return;
   }
 
@@ -220,62 +1043,183 @@ void waitTransport()
   {
     printf("Failed to listen on server socket.\n");
     close(sfd);
+    network_setserving(-1);
     return;
   }
 
-  while ((transport_conn = accept(sfd, NULL, NULL)) > 0)
+  if ((epfd = epoll_create1(0)) == -1)
   {
-    snp_pkt_t pkt;
-    int nextID;
+    printf("create epoll instance failed!\n");
+    close(sfd);
+    network_setserving(-1);
+    return;
+  }
+  transport_epfd = epfd;
 
-    pkt.header.src_nodeID = topology_getMyNodeID();
-    pkt.header.length = sizeof(seg_t);
-    pkt.header.type = SNP;
+  ev.events = EPOLLIN;
+  ev.data.fd = sfd;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev);
+
+  //the shared memory channels are optional, the SRT processes keep using TCP without them
+  if ((shm_sfd = shmchannel_listen(NETWORK_SHM_NAME)) == -1)
+    printf("network layer: can't listen for shared memory channels\n");
+  else
+  {
+    ev.data.fd = shm_sfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, shm_sfd, &ev);
+  }
+  network_setserving(1);
+
+  pkt.header.src_nodeID = topology_getMyNodeID();
+  pkt.header.length = sizeof(seg_t);
+  pkt.header.type = SNP;
+  pkt.header.ttl = SNP_INITIAL_TTL;
 
-    while (getsegToSend(transport_conn, &pkt.header.dest_nodeID, (seg_t *)&pkt.data))
+  while (1)
+  {
+    if ((nfds = epoll_wait(epfd, events, NETWORK_MAX_EVENTS, -1)) == -1)
     {
-      pthread_mutex_lock(routingtable_mutex);
-      nextID = routingtable_getnextnode(routingtable, pkt.header.dest_nodeID);
-      pthread_mutex_unlock(routingtable_mutex);
-      overlay_sendpkt(nextID, &pkt, overlay_conn);
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    for (int i = 0; i < nfds; i++)
+    {
+      conn = events[i].data.fd;
+
+      if (conn == sfd)
+      {
+        if ((conn = accept(sfd, NULL, NULL)) < 0)
+          continue;
+
+        if (conn >= NETWORK_MAX_FDS)
+        {
+          printf("network layer: too many SRT processes, connection refused\n");
+          close(conn);
+          continue;
+        }
+
+        //the connection never blocks the loop, the sendseg_arg_ts are buffered in both directions and sent without Nagle's delay
+        fcntl(conn, F_SETFL, fcntl(conn, F_GETFL, 0) | O_NONBLOCK);
+        setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        transport[conn].rbuf = (char *)malloc(TRANSPORT_RBUF_SEGS * sizeof(sendseg_arg_t));
+        transport[conn].rlen = 0;
+        pthread_mutex_lock(porttable_mutex);
+        transport[conn].type = TRANSPORT_CONN;
+        transport[conn].shm = NULL;
+        transport[conn].shm_confirmed = 0;
+        transport[conn].wbuf = (char *)malloc(TRANSPORT_WBUF_SEGS * sizeof(sendseg_arg_t));
+        transport[conn].wstart = transport[conn].wend = 0;
+        transport[conn].pollout = 0;
+        pthread_mutex_unlock(porttable_mutex);
+        ev.events = EPOLLIN;
+        ev.data.fd = conn;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, conn, &ev);
+        printf("network layer: SRT process connected on %d\n", conn);
+      }
+      else if (conn == shm_sfd)
+        network_acceptshm(epfd, shm_sfd);
+      else if (transport[conn].type == TRANSPORT_OFFER)
+        network_recvshm(epfd, conn);
+      else if (transport[conn].type == TRANSPORT_RING)
+        network_handleshm(conn, &pkt);
+      else if (transport[conn].type == TRANSPORT_CONN)
+      {
+        if (events[i].events & EPOLLOUT)
+        {
+          pthread_mutex_lock(porttable_mutex);
+          network_flushtransport(conn);
+          pthread_mutex_unlock(porttable_mutex);
+        }
+        if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && network_readtransport(conn, &pkt) == -1)
+          network_closetransport(epfd, conn);
+      }
     }
-    close(transport_conn);
-    transport_conn = -1;
   }
 
+  if (shm_sfd != -1)
+    close(shm_sfd);
+  close(epfd);
   close(sfd);
 }
 
-int main(int argc, char *argv[])
+//This function initializes the SNP process: it creates the tables, connects to the local ON process, offers it the shared memory channel if "shm" is in argv,
+//and starts the pkthandler and routeupdate_daemon threads. "ls" in argv selects link state routing.
+//It exits the process if the ON process can not be reached.
+void network_init(int argc, char *argv[])
 {
   printf("network layer is starting, pls wait...\n");
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
 
   //initialize global variables
   nct = nbrcosttable_create();
   dv = dvtable_create();
   dv_mutex = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t));
   pthread_mutex_init(dv_mutex, NULL);
-  routingtable = routingtable_create();
-  routingtable_mutex = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t));
-  pthread_mutex_init(routingtable_mutex, NULL);
+  routingtable = routingtable_rcu_create(routingtable_create());
+  lsdb = lsdb_create();
+  lsdb_mutex = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(lsdb_mutex, NULL);
+  routing_mode = ROUTING_DV;
+  use_shm = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "ls") == 0)
+      routing_mode = ROUTING_LS;
+    else if (strcmp(argv[i], "shm") == 0)
+      use_shm = 1;
+  }
+  printf("network layer uses %s routing\n", routing_mode == ROUTING_LS ? "link state" : "distance vector");
+  overlay_shm = NULL;
+  offered_shm = NULL;
+  shm_mutex = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(shm_mutex, NULL);
   overlay_conn = -1;
-  transport_conn = -1;
+  porttable = porttable_create();
+  porttable_mutex = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(porttable_mutex, NULL);
+  converged = 0;
+  serving = 0;
+  ttl_expired = 0;
+  converge_mutex = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(converge_mutex, NULL);
+  converge_cond = (pthread_cond_t *)malloc(sizeof(pthread_cond_t));
+  pthread_cond_init(converge_cond, NULL);
+
+  //all the links are down until the ON process reports them up, so no route is used before its links are established
+  int nb_num = topology_getNbrNum();
+  for (int i = 0; i < nb_num; i++)
+    nbrcosttable_setcost(nct, nct[i].nodeID, INFINITE_COST);
+  pthread_mutex_lock(dv_mutex);
+  dv_recompute();
+  pthread_mutex_unlock(dv_mutex);
 
   nbrcosttable_print(nct);
   dvtable_print(dv);
-  routingtable_print(routingtable);
+  routingtable_print(routingtable_rcu_dereference(routingtable));
 
   //register a signal handler which is used to terminate the process
   signal(SIGINT, network_stop);
 
-  //connect to local ON process
-  overlay_conn = connectToOverlay();
+  //connect to local ON process, which may still be starting
+  for (int delay = RECONNECT_MIN_DELAY, waited = 0; (overlay_conn = connectToOverlay()) < 0 && waited < NETWORK_CONVERGE_TIMEOUT * 1000; waited += delay)
+  {
+    struct timespec ts = {delay / 1000, (delay % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+    if (delay < RECONNECT_MAX_DELAY)
+      delay *= 2;
+  }
   if (overlay_conn < 0)
   {
     printf("can't connect to overlay process\n");
     exit(1);
   }
 
+  //offer the shared memory channel, the packets go over overlay_conn if the ON process does not acknowledge it
+  if (use_shm && network_offershm() == -1)
+    printf("network layer: can't create shared memory channel, using the TCP connection\n");
+
   //start a thread that handles incoming packets from ON process
   pthread_t pkt_handler_thread;
   pthread_create(&pkt_handler_thread, NULL, pkthandler, (void *)0);
@@ -285,11 +1229,25 @@ int main(int argc, char *argv[])
   pthread_create(&routeupdate_thread, NULL, routeupdate_daemon, (void *)0);
 
   printf("network layer is started...\n");
+}
+
+//This function waits until the routes converge, at most NETWORK_CONVERGE_TIMEOUT seconds, and then serves the SRT processes with waitTransport().
+void network_run()
+{
   printf("waiting for routes to be established\n");
-  sleep(NETWORK_WAITTIME);
-  routingtable_print(routingtable);
+  if (network_waitconverged(NETWORK_CONVERGE_TIMEOUT) == -1)
+    printf("network layer: some nodes are still unreachable after %d seconds\n", NETWORK_CONVERGE_TIMEOUT);
+  routingtable_print(routingtable_rcu_dereference(routingtable));
 
   //wait connection from SRT process
   printf("waiting for connection from SRT process\n");
   waitTransport();
 }
+
+#ifndef EMBEDDED_STACK
+int main(int argc, char *argv[])
+{
+  network_init(argc, argv);
+  network_run();
+}
+#endif
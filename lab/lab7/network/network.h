@@ -10,19 +10,86 @@
 
 //This function is used to for the SNP process to connect to the local ON process on port OVERLAY_PORT.
 //TCP descriptor is returned if success, otherwise return -1.
+//The caller retries with an exponential backoff, so the SNP process can be started before the ON process.
 int connectToOverlay();
 
-//This thread sends out route update packets every ROUTEUPDATE_INTERVAL time
-//The route update packet contains this node's distance vector. 
+//This function offers a shared memory channel to the ON process.
+//The channel is used once the ON process acknowledges it with a SHM_ATTACHED packet, until then overlay_conn is used.
+//Return 1 if the channel is offered, otherwise return -1.
+int network_offershm();
+
+//This function sends a packet to the ON process, which sends it to the next hop nextNodeID.
+//If the ON process attached the shared memory channel, the sendpkt_arg_t is written in place into the ring to the ON process,
+//otherwise overlay_sendpkt() is used.
+//Return 1 if the packet is handed to the ON process, otherwise return -1.
+int network_sendpkt(int nextNodeID, snp_pkt_t* pkt);
+
+//This function receives a packet from the ON process.
+//Until the ON process acknowledges the offered shared memory channel, packets are received from overlay_conn with overlay_recvpkt(),
+//afterwards they are read from the ring to the SNP process.
+//Return 1 if a packet is received, -1 if the ON process is gone.
+int network_recvpkt(snp_pkt_t* pkt);
+
+//This function recomputes this node's distance vector and the routing table with the Bellman-Ford equation,
+//from the direct link costs in the neighbor cost table and the distance vectors received from the neighbors.
+//All the equal cost next hops of a destination (up to MAX_ECMP_PATHS) are kept.
+//The new routing table is published to the forwarding path if any route changed.
+//Return 1 if this node's distance vector changed, otherwise return 0.
+//The caller must hold dv_mutex.
+int dv_recompute();
+
+//This function broadcasts a route update packet containing this node's distance vector to all the neighbors.
 //Broadcasting is done by set the dest_nodeID in packet header as BROADCAST_NODEID
 //and use overlay_sendpkt() to send the packet out using BROADCAST_NODEID address.
+//Return 1 if the packet is sent to the ON process, otherwise return -1.
+int routeupdate_send();
+
+//This function checks whether this node has a route to every node of the overlay.
+//The first time it has, the time since the SNP process started is printed and the main thread waiting in network_waitconverged() is woken up.
+void network_checkconverged();
+
+//This function blocks until this node has routes to all the nodes of the overlay, or until timeout seconds have passed.
+//Return 1 if the routes converged, otherwise return -1.
+int network_waitconverged(int timeout);
+
+//This function recomputes the routing table from the link state database with Dijkstra's algorithm
+//and publishes the new routing table to the forwarding path.
+//The caller must hold lsdb_mutex.
+void lsdb_recompute();
+
+//This function rebuilds this node's LSA from the neighbor cost table with a new sequence number,
+//installs it in its own link state database, recomputes the routing table and floods the LSA to all the neighbors using BROADCAST_NODEID.
+//Return 1 if the packet is sent to the ON process, otherwise return -1.
+int lsa_originate();
+
+//This function sends every LSA stored in the link state database to the given neighbor only.
+//LSAs flooded while that neighbor's SNP process was not connected to its ON process are lost for it,
+//so they are resent when the neighbor shows up instead of waiting for the next ROUTEUPDATE_INTERVAL.
+//The neighbor installs and floods further the LSAs which are newer than its own copies.
+void lsdb_sync(int nbrID);
+
+//This function handles a link up or link down event of the link to the given neighbor reported by the ON process.
+//The direct link cost to the neighbor is restored from the topology when the link is up, and set to INFINITE_COST when it is down.
+//In distance vector mode, the distance vector of a neighbor whose link is down is discarded, the routes are recomputed
+//and a route update is sent right away if this node's distance vector changed.
+//In link state mode, a new LSA is originated right away, and the link state database is sent to a neighbor whose link is up.
+void network_linkevent(int nbrID, int up);
+
+//This thread sends out route update packets every ROUTEUPDATE_INTERVAL time
+//The route update packet contains this node's distance vector.
+//In link state mode, this node's LSA is broadcast instead, and it is flooded further by the receiving nodes.
 void* routeupdate_daemon(void* arg);
 
 //This thread handles incoming packets from the ON process.
 //It receives packets from the ON process by calling overlay_recvpkt().
-//If the packet is a SNP packet and the destination node is this node, forward the packet to the SRT process.
+//If the packet is a SNP packet and the destination node is this node, forward the packet to the SRT process which registered the segment's destination port.
 //If the packet is a SNP packet and the destination node is not this node, forward the packet to the next hop according to the routing table.
-//If this packet is an Route Update packet, update the distance vector table and the routing table. 
+//When there are several equal cost next hops, the flow of the packet (source/destination nodes and SRT ports) selects one of them.
+//If this packet is an Route Update packet, update the distance vector table and the routing table, and send a route update right away if this node's distance vector changed.
+//If this packet is a Link State packet carrying a new LSA, install it, recompute the routing table and flood it to the neighbors.
+//The first LSA of a neighbor whose link is up is answered with the whole link state database, as that neighbor's SNP process just started.
+//An older LSA is answered with the stored copy, and a copy of this node's LSA from before a restart makes this node originate a newer one.
+//If this packet is a link up or link down event from the ON process, update the routes through that neighbor.
 void* pkthandler(void* arg); 
 
 //This function stops the SNP process. 
@@ -30,8 +97,88 @@ void* pkthandler(void* arg);
 //Tt is called when the SNP process receives a signal SIGINT.
 void network_stop();
 
-//This function opens a port on NETWORK_PORT and waits for the TCP connection from local SRT process.
-//After the local SRT process is connected, this function keeps receiving sendseg_arg_ts which contains the segments and their destination node addresses from the SRT process. The received segments are then encapsulated into packets (one segment in one packet), and sent to the next hop using overlay_sendpkt. The next hop is retrieved from routing table.
-//When a local SRT process is disconnected, this function waits for the next SRT process to connect.
+//This function records whether waitTransport() accepts SRT processes (1) or failed to (-1), and wakes up network_waitserving().
+void network_setserving(int state);
+
+//This function waits until waitTransport() accepts SRT processes.
+//Return 1 when the SRT processes can connect, -1 if waitTransport() failed.
+int network_waitserving();
+
+//This function forwards a SNP packet destined to another node to the next hop of its flow.
+//The TTL of the packet is decremented first. A packet whose TTL reaches 0 is looping during a routing transient, so it is dropped
+//instead of burning the bandwidth of the links. The dropped packets are counted, and one in TTL_LOG_SAMPLE of them is logged.
+void network_forwardpkt(snp_pkt_t* pkt);
+
+//This function delivers the segment of a packet destined to this node to the SRT process which registered the segment's destination port.
+//If the SRT process attached a shared memory channel and confirmed it, the sendseg_arg_t is written in place into its ring, and is lost if the ring is full.
+//Otherwise it is queued to the connection with network_queueseg(), which never blocks, and is lost if the queue is full.
+//A packet whose length does not fit a segment is dropped.
+void network_deliverseg(snp_pkt_t* pkt);
+
+//This function sends a segment received from the SRT process connected on conn, the segment is in pkt->data and its destination node in pkt->header.dest_nodeID.
+//The source port of the segment is registered for the SRT process, a segment with PORT_REGISTER_NODEID is only a registration.
+//Otherwise the packet is sent to the next hop of its flow with network_sendpkt().
+void network_sendseg(int conn, snp_pkt_t* pkt);
+
+//This function polls the connection conn of a SRT process for writability while its write queue is not empty, and stops when it is empty.
+//The caller holds porttable_mutex.
+void network_pollout(int conn);
+
+//This function sends the write queue of the nonblocking connection conn of a SRT process until it is empty or the connection would block.
+//The rest is sent when waitTransport() finds the connection writable. A broken connection drops the queue, waitTransport() closes it when reading fails.
+//The caller holds porttable_mutex.
+void network_flushtransport(int conn);
+
+//This function queues a sendseg_arg_t with the segment seg and the node ID nodeID to the SRT process connected on conn, and sends as much of the write queue as the connection takes.
+//It never blocks, so pkthandler does not wait for a slow SRT process.
+//Return 1 if the sendseg_arg_t is queued, -1 if the write queue is full and it is dropped.
+//The caller holds porttable_mutex.
+int network_queueseg(int conn, int nodeID, seg_t* seg);
+
+//This function receives the bytes available on the nonblocking connection conn of a SRT process into its read buffer,
+//and sends every complete sendseg_arg_t with network_sendseg(). A sendseg_arg_t received in part waits in the read buffer for the rest.
+//A sendseg_arg_t over TCP from a SRT process whose channel is not confirmed means it gave up on the channel, which is detached.
+//Return 1 if the connection is still open, -1 if the SRT process disconnected or the connection is broken.
+int network_readtransport(int conn, snp_pkt_t* pkt);
+
+//This function accepts the unix connection over which a SRT process offers a shared memory channel on the unix socket shm_sfd.
+//The connection is added to the epoll instance epfd, the offer is received by network_recvshm() once it is readable.
+void network_acceptshm(int epfd, int shm_sfd);
+
+//This function receives the shared memory channel offered by a SRT process on the unix connection offerconn.
+//The offer carries the address of the SRT process's end of its TCP connection, the channel is attached to the connected SRT process with this address.
+//The doorbell of the ring from the SRT process is added to the epoll instance epfd, and the channel is acknowledged over the TCP connection.
+//The segments to the SRT process keep going over TCP until it confirms the channel through the ring, see network_handleshm().
+void network_recvshm(int epfd, int offerconn);
+
+//This function handles the doorbell doorbell of the ring from a SRT process.
+//The first sendseg_arg_t in the ring is the confirmation of the channel by the SRT process, the segments to it are delivered into the ring afterwards.
+//All the other sendseg_arg_ts in the ring are sent with network_sendseg().
+void network_handleshm(int doorbell, snp_pkt_t* pkt);
+
+//This function detaches the shared memory channel of the connection conn of a SRT process, its doorbell is removed from the epoll instance epfd.
+void network_detachshm(int epfd, int conn);
+
+//This function closes the connection conn of a SRT process which disconnected.
+//Its ports are removed from the port table, its shared memory channel is detached, and its buffers are freed.
+//pkthandler only uses the connection under porttable_mutex after finding it in the port table, so it is done with it afterwards.
+void network_closetransport(int epfd, int conn);
+
+//This function opens a port on NETWORK_PORT and serves all the local SRT processes connected to it.
+//Many SRT processes can be connected at the same time, an epoll loop accepts new connections and receives sendseg_arg_ts from all the connected SRT processes.
+//The connections are nonblocking and buffered in both directions, so a slow SRT process blocks neither the loop nor pkthandler.
+//A sendseg_arg_t with PORT_REGISTER_NODEID registers a SRT port of the sending SRT process in the port table.
+//Other sendseg_arg_ts contain the segments and their destination node addresses. The received segments are encapsulated into packets (one segment in one packet), and sent to the next hop using network_sendpkt. The next hop is retrieved from routing table.
+//A SRT process can attach a shared memory channel with snp_attachshm() right after connecting, its segments are then received from the ring of the channel.
+//When a local SRT process is disconnected, its ports are removed from the port table.
 void waitTranport();
+
+//This function initializes the SNP process: it creates the tables, connects to the local ON process, offers it the shared memory channel if "shm" is in argv,
+//and starts the pkthandler and routeupdate_daemon threads. "ls" in argv selects link state routing.
+//It exits the process if the ON process can not be reached.
+void network_init(int argc, char *argv[]);
+
+//This function waits until the routes converge, at most NETWORK_CONVERGE_TIMEOUT seconds, and then serves the SRT processes with waitTransport().
+void network_run();
+
 #endif
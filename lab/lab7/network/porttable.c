@@ -0,0 +1,97 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/constants.h"
+#include "porttable.h"
+
+//This function creates a port table dynamically with all the entries unused.
+//The dynamically created port table is returned.
+porttable_t *porttable_create()
+{
+  porttable_t *porttable;
+
+  porttable = malloc(sizeof(porttable_t));
+  for (int i = 0; i < MAX_TRANSPORT_PORTS; i++)
+  {
+    porttable->entry[i].port = 0;
+    porttable->entry[i].conn = -1;
+  }
+
+  return porttable;
+}
+
+//This function destroys a port table.
+//It closes all the registered connections and frees all the dynamically allocated memory for the port table.
+void porttable_destroy(porttable_t *porttable)
+{
+  for (int i = 0; i < MAX_TRANSPORT_PORTS; i++)
+  {
+    int conn = porttable->entry[i].conn;
+
+    if (conn != -1)
+    {
+      close(conn);
+      porttable_removeconn(porttable, conn);
+    }
+  }
+
+  free(porttable);
+}
+
+//This function registers the given port for the SRT process connected by conn.
+//If the port is already registered, its connection is replaced.
+//Return 1 if the port is registered, return -1 if the port table is full.
+int porttable_register(porttable_t *porttable, unsigned int port, int conn)
+{
+  port_entry_t *freeEntry = NULL;
+
+  for (int i = 0; i < MAX_TRANSPORT_PORTS; i++)
+  {
+    port_entry_t *entry = &porttable->entry[i];
+
+    if (entry->conn != -1 && entry->port == port)
+    {
+      if (entry->conn != conn)
+        printf("port table: port %u moved from connection %d to %d\n", port, entry->conn, conn);
+      entry->conn = conn;
+      return 1;
+    }
+
+    if (entry->conn == -1 && freeEntry == NULL)
+      freeEntry = entry;
+  }
+
+  if (freeEntry == NULL)
+    return -1;
+
+  freeEntry->port = port;
+  freeEntry->conn = conn;
+  return 1;
+}
+
+//This function returns the connection to the SRT process that registered the given port.
+//If the port is not registered, return -1.
+int porttable_getconn(porttable_t *porttable, unsigned int port)
+{
+  for (int i = 0; i < MAX_TRANSPORT_PORTS; i++)
+  {
+    if (porttable->entry[i].conn != -1 && porttable->entry[i].port == port)
+      return porttable->entry[i].conn;
+  }
+
+  return -1;
+}
+
+//This function removes all the ports registered by the SRT process connected by conn.
+//It is called when the SRT process disconnects.
+void porttable_removeconn(porttable_t *porttable, int conn)
+{
+  for (int i = 0; i < MAX_TRANSPORT_PORTS; i++)
+  {
+    if (porttable->entry[i].conn == conn)
+      porttable->entry[i].conn = -1;
+  }
+}
@@ -0,0 +1,46 @@
+//FILE: network/porttable.h
+//
+//Description: this file defines the data structures and functions for the transport port table.
+//A SNP process serves many SRT processes at the same time. Each SRT process registers its SRT ports
+//at the SNP process, and the port table maps every registered port to the TCP connection of its SRT process.
+//Incoming segments are dispatched to the SRT process by their destination port.
+//
+
+#ifndef PORTTABLE_H
+#define PORTTABLE_H
+
+#include "../common/constants.h"
+
+//port table entry definition
+typedef struct porttableentry {
+	unsigned int port;	//SRT port number
+	int conn;		//TCP connection's socket descriptor to the SRT process owning the port, -1 if the entry is unused
+} port_entry_t;
+
+//A port table contains MAX_TRANSPORT_PORTS entries.
+typedef struct porttable {
+	port_entry_t entry[MAX_TRANSPORT_PORTS];
+} porttable_t;
+
+//This function creates a port table dynamically with all the entries unused.
+//The dynamically created port table is returned.
+porttable_t* porttable_create();
+
+//This function destroys a port table.
+//It closes all the registered connections and frees all the dynamically allocated memory for the port table.
+void porttable_destroy(porttable_t* porttable);
+
+//This function registers the given port for the SRT process connected by conn.
+//If the port is already registered, its connection is replaced.
+//Return 1 if the port is registered, return -1 if the port table is full.
+int porttable_register(porttable_t* porttable, unsigned int port, int conn);
+
+//This function returns the connection to the SRT process that registered the given port.
+//If the port is not registered, return -1.
+int porttable_getconn(porttable_t* porttable, unsigned int port);
+
+//This function removes all the ports registered by the SRT process connected by conn.
+//It is called when the SRT process disconnects.
+void porttable_removeconn(porttable_t* porttable, int conn);
+
+#endif
@@ -4,21 +4,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <sched.h>
 
 #include "../common/constants.h"
 #include "../topology/topology.h"
 #include "routingtable.h"
 
-//This is the hash function used the by the routing table
-//It takes the hash key - destination node ID as input,
-//and returns the hash value - slot number for this destination node ID.
-int makehash(int node)
-{
-  return node % MAX_ROUTINGTABLE_SLOTS;
-}
-
 //This function creates a routing table dynamically.
-//All the entries in the table are initialized to NULL pointers.
+//All the entries in the table are initialized to have no next hop.
 //Then for all the neighbors with a direct link, create a routing entry using the neighbor itself as the next hop node, and insert this routing entry into the routing table.
 //The dynamically created routing table structure is returned.
 routingtable_t *routingtable_create()
@@ -44,94 +37,251 @@ routingtable_t *routingtable_create()
 //All dynamically allocated data structures for this routing table are freed.
 void routingtable_destroy(routingtable_t *routingtable)
 {
-  routingtable_entry_t *entry, *entry_tmp;
-
-  for (int i = 0; i < MAX_ROUTINGTABLE_SLOTS; i++)
-  {
-    entry = routingtable->hash[i];
-    while (entry)
-    {
-      entry_tmp = entry;
-      entry = entry->next;
-      free(entry_tmp);
-    }
-  }
-
   free(routingtable);
 }
 
 //This function updates the routing table using the given destination node ID and next hop's node ID.
-//If the routing entry for the given destination already exists, update the existing routing entry.
-//If the routing entry of the given destination is not there, add one with the given next node ID.
-//Each slot in routing table contains a linked list of routing entries due to conflicting hash keys (differnt hash keys (destination node ID here) may have same hash values (slot entry number here)).
-//To add an routing entry to the hash table:
-//First use the hash function makehash() to get the slot number in which this routing entry should be stored.
-//Then append the routing entry to the linked list in that slot.
+//The routing entry of the given destination is overwritten with the given next node ID as its only next hop.
+//If nextNodeID is -1, the route to the destination is removed.
+//Destination node IDs outside of [0, MAX_NODEID) are ignored.
 void routingtable_setnextnode(routingtable_t *routingtable, int destNodeID, int nextNodeID)
 {
-  int i = makehash(destNodeID);
-  routingtable_entry_t *entry = routingtable->hash[i];
+  routingtable_entry_t *entry;
 
-  if (entry == NULL)
-  {
-    entry = malloc(sizeof(routingtable_entry_t));
-    routingtable->hash[i] = entry;
-    memset(entry, 0, sizeof(routingtable_entry_t));
-  }
-  else
+  if (destNodeID < 0 || destNodeID >= MAX_NODEID)
+    return;
+
+  entry = &routingtable->entry[destNodeID];
+  entry->nextNodeNum = nextNodeID == -1 ? 0 : 1;
+  entry->nextNodeID[0] = nextNodeID;
+}
+
+//This function adds the given next hop to the next hops of the given destination.
+//It is used when a path with the same cost as the existing ones is found.
+//Return 1 if the next hop is in the routing entry afterwards, return -1 if the routing entry already has MAX_ECMP_PATHS next hops.
+int routingtable_addnextnode(routingtable_t *routingtable, int destNodeID, int nextNodeID)
+{
+  routingtable_entry_t *entry;
+
+  if (destNodeID < 0 || destNodeID >= MAX_NODEID || nextNodeID == -1)
+    return -1;
+
+  entry = &routingtable->entry[destNodeID];
+  for (int i = 0; i < entry->nextNodeNum; i++)
   {
-    while (entry)
-    {
-      if (entry->destNodeID == destNodeID)
-        break;
-      else if (entry->next == NULL)
-      {
-        entry->next = malloc(sizeof(routingtable_entry_t));
-        entry = entry->next;
-        memset(entry, 0, sizeof(routingtable_entry_t));
-        break;
-      }
-
-      entry = entry->next;
-    }
+    if (entry->nextNodeID[i] == nextNodeID)
+      return 1;
   }
-  entry->destNodeID = destNodeID;
-  entry->nextNodeID = nextNodeID;
+
+  if (entry->nextNodeNum == MAX_ECMP_PATHS)
+    return -1;
+
+  entry->nextNodeID[entry->nextNodeNum++] = nextNodeID;
+  return 1;
+}
+
+//This function returns the flow hash of a flow, identified by its source and destination nodes and SRT ports.
+unsigned int routingtable_flowhash(int srcNodeID, int destNodeID, unsigned int srcPort, unsigned int destPort)
+{
+  unsigned int hash = 2166136261u;
+
+  //FNV-1a over the flow identifiers, mixes well enough to spread a few flows over a few paths
+  hash = (hash ^ (unsigned int)srcNodeID) * 16777619u;
+  hash = (hash ^ (unsigned int)destNodeID) * 16777619u;
+  hash = (hash ^ srcPort) * 16777619u;
+  hash = (hash ^ destPort) * 16777619u;
+
+  return hash ^ (hash >> 16);
 }
 
 //This function looks up the destNodeID in the routing table.
-//Since routing table is a hash table, this opeartion has O(1) time complexity.
-//To find a routing entry for a destination node, you should first use the hash function makehash() to get the slot number and then go through the linked list in that slot to search the routing entry.
-//If the destNodeID is found, return the nextNodeID for this destination node.
-//If the destNodeID is not found, return -1.
+//Since routing table is indexed by destination node ID, this opeartion is a single array access.
+//If a route to destNodeID exists, return the first nextNodeID for this destination node.
+//Otherwise, return -1.
 int routingtable_getnextnode(routingtable_t *routingtable, int destNodeID)
 {
-  int i = makehash(destNodeID);
-  routingtable_entry_t *entry = routingtable->hash[i];
+  routingtable_entry_t *entry;
 
-  while (entry)
-  {
-    if (entry->destNodeID == destNodeID)
-      return entry->nextNodeID;
+  //the unsigned compare rejects negative IDs and BROADCAST_NODEID with one branch
+  if ((unsigned int)destNodeID >= MAX_NODEID)
+    return -1;
 
-    entry = entry->next;
-  }
+  entry = &routingtable->entry[destNodeID];
+  return entry->nextNodeNum > 0 ? entry->nextNodeID[0] : -1;
+}
+
+//This function looks up the destNodeID for the flow with the given flow hash.
+//The flow hash selects one of the equal cost next hops, so all the packets of a flow take the same path.
+//If no route to destNodeID exists, return -1.
+int routingtable_getflownextnode(routingtable_t *routingtable, int destNodeID, unsigned int flowHash)
+{
+  routingtable_entry_t *entry;
+
+  if ((unsigned int)destNodeID >= MAX_NODEID)
+    return -1;
 
-  return -1;
+  entry = &routingtable->entry[destNodeID];
+  if (entry->nextNodeNum == 0)
+    return -1;
+
+  return entry->nextNodeID[flowHash % entry->nextNodeNum];
+}
+
+//This function looks up a burst of num destination node IDs in the routing table.
+//The next hop of destNodeIDs[i] for the flow hash flowHashes[i] is stored in nextNodeIDs[i], -1 if there is no route.
+//If flowHashes is NULL, the first next hop of every destination is used.
+void routingtable_getnextnodes(routingtable_t *routingtable, const int *destNodeIDs, const unsigned int *flowHashes, int *nextNodeIDs, int num)
+{
+  for (int i = 0; i < num; i++)
+    nextNodeIDs[i] = routingtable_getflownextnode(routingtable, destNodeIDs[i], flowHashes ? flowHashes[i] : 0);
 }
 
 //This function prints out the contents of the routing table
 void routingtable_print(routingtable_t *routingtable)
 {
-  routingtable_entry_t *entry;
+  for (int i = 0; i < MAX_NODEID; i++)
+  {
+    routingtable_entry_t *entry = &routingtable->entry[i];
+
+    for (int j = 0; j < entry->nextNodeNum; j++)
+      printf("routing table: %d --- %d\n", i, entry->nextNodeID[j]);
+  }
+}
+
+//This function creates a copy of the given routing table dynamically.
+//The dynamically created routing table structure is returned.
+routingtable_t *routingtable_copy(routingtable_t *routingtable)
+{
+  routingtable_t *rt_table;
+
+  rt_table = malloc(sizeof(routingtable_t));
+  memcpy(rt_table, routingtable, sizeof(routingtable_t));
+
+  return rt_table;
+}
+
+//This function creates a routingtable_rcu_t dynamically, which publishes the given routing table.
+//The dynamically created routingtable_rcu_t structure is returned.
+routingtable_rcu_t *routingtable_rcu_create(routingtable_t *routingtable)
+{
+  routingtable_rcu_t *rcu;
+
+  rcu = malloc(sizeof(routingtable_rcu_t));
+  memset(rcu, 0, sizeof(routingtable_rcu_t));
+  rcu->current = routingtable;
+  pthread_mutex_init(&rcu->update_mutex, NULL);
+
+  return rcu;
+}
+
+//This function destroys a routingtable_rcu_t and the routing table it publishes.
+//No reader or writer may be active when it is called.
+void routingtable_rcu_destroy(routingtable_rcu_t *rcu)
+{
+  routingtable_destroy(rcu->current);
+  pthread_mutex_destroy(&rcu->update_mutex);
+  free(rcu);
+}
 
-  for (int i = 0; i < MAX_ROUTINGTABLE_SLOTS; i++)
+//This function enters a read side critical section.
+//The returned token must be passed to routingtable_rcu_read_unlock().
+int routingtable_rcu_read_lock(routingtable_rcu_t *rcu)
+{
+  unsigned int epoch;
+
+  //register under the current epoch parity, retry if a writer flipped the epoch in between,
+  //otherwise the writer could miss this reader while waiting for the grace period
+  while (1)
   {
-    entry = routingtable->hash[i];
-    while (entry)
-    {
-      printf("routing table: %d --- %d", entry->destNodeID, entry->nextNodeID);
-      entry = entry->next;
-    }
+    epoch = __atomic_load_n(&rcu->epoch, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&rcu->readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&rcu->epoch, __ATOMIC_SEQ_CST) == epoch)
+      return epoch & 1;
+    __atomic_sub_fetch(&rcu->readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
   }
 }
+
+//This function returns the published routing table.
+//The routing table must only be used inside a read side critical section and must not be modified.
+routingtable_t *routingtable_rcu_dereference(routingtable_rcu_t *rcu)
+{
+  return __atomic_load_n(&rcu->current, __ATOMIC_ACQUIRE);
+}
+
+//This function leaves a read side critical section.
+void routingtable_rcu_read_unlock(routingtable_rcu_t *rcu, int token)
+{
+  __atomic_sub_fetch(&rcu->readers[token], 1, __ATOMIC_RELEASE);
+}
+
+//This function looks up the destNodeID in the published routing table without blocking.
+//If the destNodeID is found, return the nextNodeID for this destination node, otherwise return -1.
+int routingtable_rcu_getnextnode(routingtable_rcu_t *rcu, int destNodeID)
+{
+  int token, nextNodeID;
+
+  token = routingtable_rcu_read_lock(rcu);
+  nextNodeID = routingtable_getnextnode(routingtable_rcu_dereference(rcu), destNodeID);
+  routingtable_rcu_read_unlock(rcu, token);
+
+  return nextNodeID;
+}
+
+//This function looks up the destNodeID for the flow with the given flow hash in the published routing table without blocking.
+//If no route to destNodeID exists, return -1.
+int routingtable_rcu_getflownextnode(routingtable_rcu_t *rcu, int destNodeID, unsigned int flowHash)
+{
+  int token, nextNodeID;
+
+  token = routingtable_rcu_read_lock(rcu);
+  nextNodeID = routingtable_getflownextnode(routingtable_rcu_dereference(rcu), destNodeID, flowHash);
+  routingtable_rcu_read_unlock(rcu, token);
+
+  return nextNodeID;
+}
+
+//This function looks up a burst of num destination node IDs in the published routing table without blocking.
+//All the lookups of the burst see the same routing table.
+void routingtable_rcu_getnextnodes(routingtable_rcu_t *rcu, const int *destNodeIDs, const unsigned int *flowHashes, int *nextNodeIDs, int num)
+{
+  int token;
+
+  token = routingtable_rcu_read_lock(rcu);
+  routingtable_getnextnodes(routingtable_rcu_dereference(rcu), destNodeIDs, flowHashes, nextNodeIDs, num);
+  routingtable_rcu_read_unlock(rcu, token);
+}
+
+//This function starts a control plane update.
+//It blocks other writers and returns a private copy of the published routing table to be updated.
+//The update must be finished with either routingtable_rcu_publish() or routingtable_rcu_abort().
+routingtable_t *routingtable_rcu_update_begin(routingtable_rcu_t *rcu)
+{
+  pthread_mutex_lock(&rcu->update_mutex);
+  return routingtable_copy(rcu->current);
+}
+
+//This function publishes the updated routing table returned by routingtable_rcu_update_begin().
+//It waits for a grace period, frees the previously published table and lets the next writer in.
+void routingtable_rcu_publish(routingtable_rcu_t *rcu, routingtable_t *routingtable)
+{
+  routingtable_t *old;
+  unsigned int epoch;
+
+  old = __atomic_exchange_n(&rcu->current, routingtable, __ATOMIC_SEQ_CST);
+
+  //new readers register under the new parity and can only see the new table,
+  //so the old table is unreachable once the readers of the old parity are gone
+  epoch = __atomic_add_fetch(&rcu->epoch, 1, __ATOMIC_SEQ_CST) - 1;
+  while (__atomic_load_n(&rcu->readers[epoch & 1], __ATOMIC_SEQ_CST) != 0)
+    sched_yield();
+
+  routingtable_destroy(old);
+  pthread_mutex_unlock(&rcu->update_mutex);
+}
+
+//This function discards the routing table returned by routingtable_rcu_update_begin() without publishing it.
+void routingtable_rcu_abort(routingtable_rcu_t *rcu, routingtable_t *routingtable)
+{
+  routingtable_destroy(routingtable);
+  pthread_mutex_unlock(&rcu->update_mutex);
+}
@@ -1,7 +1,7 @@
 //FILE: network/routingtable.h
 //
 //Description: this file defines the data structures and functions for routing table. 
-//A routing table is a hash table containing MAX_RT_ENTRY slot entries.  
+//A routing table is a forwarding information base directly indexed by the destination node ID.  
 //
 //Date: April 29,2008
 
@@ -10,31 +10,38 @@
 #ifndef ROUTINGTABLE_H
 #define ROUTINGTABLE_H
 
-//routingtable_entry_t is the routing entry contained in the routing table.
+#include <pthread.h>
+#include "../common/constants.h"
+
+//routingtable_entry_t is the set of equal cost next hops for a destination.
+//The packets of a flow are always hashed onto the same next hop, so the packets of a flow stay in order.
 typedef struct routingtable_entry {
-	int destNodeID;		//destination node ID
-	int nextNodeID;		//next node ID to which the packet should be forwarded
-	struct routingtable_entry* next;	//pointer to the next routingtable_entry_t in the same routing table slot
+	int nextNodeNum;			//number of next hops, 0 means there is no route to the destination
+	int nextNodeID[MAX_ECMP_PATHS];		//next node IDs to which the packets should be forwarded
 } routingtable_entry_t;
 
-//A routing table is a hash table containing MAX_ROUTINGTABLE_SLOTS slots. Each slot is a linked list of routing entries.
+//A routing table is a dense array of routing entries indexed by the destination node ID.
+//Node IDs are the last octet of the node's IP address, so MAX_NODEID entries cover all of them
+//and a lookup is a single array access with no pointer chasing.
 typedef struct routingtable {
-	routingtable_entry_t* hash[MAX_ROUTINGTABLE_SLOTS];
+	routingtable_entry_t entry[MAX_NODEID];
 } routingtable_t;
 
-//This is the hash function used the by the routing table
-//It takes the hash key - destination node ID as input, 
-//and returns the hash value - slot number for this destination node ID.
-//
-//You can copy makehash() implementation below directly to routingtable.c:
-//int makehash(int node) {
-//	return node%MAX_ROUTINGTABLE_SLOTS;
-//}
-//
-int makehash(int node); 
+//routingtable_rcu_t publishes an immutable routing table to the forwarding path.
+//Readers look up the published table without taking any lock. The control plane copies the published table,
+//updates the copy and publishes it by atomically swapping the pointer. The old table is freed only after all
+//readers that could still see it have left their read side critical sections (a grace period).
+//Readers are counted per epoch parity, a writer flips the epoch and waits for the old parity's count to drain,
+//so new readers never delay the reclamation of the old table.
+typedef struct routingtable_rcu {
+	routingtable_t* current;	//the published routing table, never modified after it is published
+	unsigned int epoch;		//grace period counter, its parity selects the reader counter
+	int readers[2];			//number of readers inside a read side critical section for each epoch parity
+	pthread_mutex_t update_mutex;	//serializes the control plane updates
+} routingtable_rcu_t;
 
 //This function creates a routing table dynamically.
-//All the entries in the table are initialized to NULL pointers.
+//All the entries in the table are initialized to have no next hop.
 //Then for all the neighbors with a direct link, create a routing entry using the neighbor itself as the next hop node, and insert this routing entry into the routing table. 
 //The dynamically created routing table structure is returned.
 routingtable_t* routingtable_create();
@@ -44,22 +51,83 @@ routingtable_t* routingtable_create();
 void routingtable_destroy(routingtable_t* routingtable);
 
 //This function updates the routing table using the given destination node ID and next hop's node ID.
-//If the routing entry for the given destination already exists, update the existing routing entry.
-//If the routing entry of the given destination is not there, add one with the given next node ID.
-//Each slot in routing table contains a linked list of routing entries due to conflicting hash keys (differnt hash keys (destination node ID here) may have same hash values (slot entry number here)).
-//To add an routing entry to the hash table:
-//First use the hash function makehash() to get the slot number in which this routing entry should be stored. 
-//Then append the routing entry to the linked list in that slot.
+//The routing entry of the given destination is overwritten with the given next node ID as its only next hop.
+//If nextNodeID is -1, the route to the destination is removed.
+//Destination node IDs outside of [0, MAX_NODEID) are ignored.
 void routingtable_setnextnode(routingtable_t* routingtable, int destNodeID, int nextNodeID);
 
+//This function adds the given next hop to the next hops of the given destination.
+//It is used when a path with the same cost as the existing ones is found.
+//Return 1 if the next hop is in the routing entry afterwards, return -1 if the routing entry already has MAX_ECMP_PATHS next hops.
+int routingtable_addnextnode(routingtable_t* routingtable, int destNodeID, int nextNodeID);
+
+//This function returns the flow hash of a flow, identified by its source and destination nodes and SRT ports.
+unsigned int routingtable_flowhash(int srcNodeID, int destNodeID, unsigned int srcPort, unsigned int destPort);
+
 //This function looks up the destNodeID in the routing table.
-//Since routing table is a hash table, this opeartion has O(1) time complexity.
-//To find a routing entry for a destination node, you should first use the hash function makehash() to get the slot number and then go through the linked list in that slot to search the routing entry.
-//If the destNodeID is found, return the nextNodeID for this destination node.
-//If the destNodeID is not found, return -1.
+//Since routing table is indexed by destination node ID, this opeartion is a single array access.
+//If a route to destNodeID exists, return the first nextNodeID for this destination node.
+//Otherwise, return -1.
 int routingtable_getnextnode(routingtable_t* routingtable, int destNodeID);
 
+//This function looks up the destNodeID for the flow with the given flow hash.
+//The flow hash selects one of the equal cost next hops, so all the packets of a flow take the same path.
+//If no route to destNodeID exists, return -1.
+int routingtable_getflownextnode(routingtable_t* routingtable, int destNodeID, unsigned int flowHash);
+
+//This function looks up a burst of num destination node IDs in the routing table.
+//The next hop of destNodeIDs[i] for the flow hash flowHashes[i] is stored in nextNodeIDs[i], -1 if there is no route.
+//If flowHashes is NULL, the first next hop of every destination is used.
+void routingtable_getnextnodes(routingtable_t* routingtable, const int* destNodeIDs, const unsigned int* flowHashes, int* nextNodeIDs, int num);
+
 //This function prints out the contents of the routing table
 void routingtable_print(routingtable_t* routingtable);
 
+//This function creates a copy of the given routing table dynamically.
+//The dynamically created routing table structure is returned.
+routingtable_t* routingtable_copy(routingtable_t* routingtable);
+
+//This function creates a routingtable_rcu_t dynamically, which publishes the given routing table.
+//The dynamically created routingtable_rcu_t structure is returned.
+routingtable_rcu_t* routingtable_rcu_create(routingtable_t* routingtable);
+
+//This function destroys a routingtable_rcu_t and the routing table it publishes.
+//No reader or writer may be active when it is called.
+void routingtable_rcu_destroy(routingtable_rcu_t* rcu);
+
+//This function enters a read side critical section.
+//The returned token must be passed to routingtable_rcu_read_unlock().
+int routingtable_rcu_read_lock(routingtable_rcu_t* rcu);
+
+//This function returns the published routing table.
+//The routing table must only be used inside a read side critical section and must not be modified.
+routingtable_t* routingtable_rcu_dereference(routingtable_rcu_t* rcu);
+
+//This function leaves a read side critical section.
+void routingtable_rcu_read_unlock(routingtable_rcu_t* rcu, int token);
+
+//This function looks up the destNodeID in the published routing table without blocking.
+//If the destNodeID is found, return the nextNodeID for this destination node, otherwise return -1.
+int routingtable_rcu_getnextnode(routingtable_rcu_t* rcu, int destNodeID);
+
+//This function looks up the destNodeID for the flow with the given flow hash in the published routing table without blocking.
+//If no route to destNodeID exists, return -1.
+int routingtable_rcu_getflownextnode(routingtable_rcu_t* rcu, int destNodeID, unsigned int flowHash);
+
+//This function looks up a burst of num destination node IDs in the published routing table without blocking.
+//All the lookups of the burst see the same routing table.
+void routingtable_rcu_getnextnodes(routingtable_rcu_t* rcu, const int* destNodeIDs, const unsigned int* flowHashes, int* nextNodeIDs, int num);
+
+//This function starts a control plane update.
+//It blocks other writers and returns a private copy of the published routing table to be updated.
+//The update must be finished with either routingtable_rcu_publish() or routingtable_rcu_abort().
+routingtable_t* routingtable_rcu_update_begin(routingtable_rcu_t* rcu);
+
+//This function publishes the updated routing table returned by routingtable_rcu_update_begin().
+//It waits for a grace period, frees the previously published table and lets the next writer in.
+void routingtable_rcu_publish(routingtable_rcu_t* rcu, routingtable_t* routingtable);
+
+//This function discards the routing table returned by routingtable_rcu_update_begin() without publishing it.
+void routingtable_rcu_abort(routingtable_rcu_t* rcu, routingtable_t* routingtable);
+
 #endif
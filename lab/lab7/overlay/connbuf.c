@@ -0,0 +1,334 @@
+//FILE: overlay/connbuf.c
+//
+//Description: this file implements the per connection buffers used by the ON process event loop.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "connbuf.h"
+
+//This function initializes an empty connbuf with the given write queue limit and drop policy.
+//All the queue metrics are reset.
+void connbuf_init(connbuf_t *cb, int qlimit, int policy)
+{
+  cb->rstart = 0;
+  cb->rend = 0;
+  cb->whead = NULL;
+  cb->wtail = NULL;
+  cb->woff = 0;
+  cb->wqlen = 0;
+  cb->pollout = 0;
+  cb->qlimit = qlimit;
+  cb->policy = policy;
+  cb->avgqlen = 0;
+  cb->maxqlen = 0;
+  cb->queued = 0;
+  cb->dropped = 0;
+  cb->sent = 0;
+}
+
+//This function drops all the received bytes and frees all the queued frames of a connbuf.
+//The write queue limit, the drop policy and the queue metrics are kept.
+void connbuf_clear(connbuf_t *cb)
+{
+  wqentry_t *entry;
+
+  while (cb->whead)
+  {
+    entry = cb->whead;
+    cb->whead = entry->next;
+    frame_release(entry->frame);
+    free(entry);
+  }
+
+  cb->rstart = 0;
+  cb->rend = 0;
+  cb->wtail = NULL;
+  cb->woff = 0;
+  cb->wqlen = 0;
+  cb->pollout = 0;
+  cb->avgqlen = 0;
+}
+
+//This function applies the drop policy of the write queue to a new frame.
+//Return 1 if the frame should be dropped, otherwise return 0.
+static int connbuf_shoulddrop(connbuf_t *cb)
+{
+  double p;
+
+  if (cb->wqlen >= cb->qlimit)
+    return 1;
+
+  if (cb->policy != QUEUE_RED)
+    return 0;
+
+  cb->avgqlen = (1 - RED_WEIGHT) * cb->avgqlen + RED_WEIGHT * cb->wqlen;
+
+  if (cb->avgqlen < RED_MIN_THRESHOLD)
+    return 0;
+  if (cb->avgqlen >= RED_MAX_THRESHOLD)
+    return 1;
+
+  p = RED_MAX_PROBABILITY * (cb->avgqlen - RED_MIN_THRESHOLD) / (RED_MAX_THRESHOLD - RED_MIN_THRESHOLD);
+  return rand() < p * RAND_MAX;
+}
+
+//This function reads all the bytes available on the nonblocking connection conn into the read buffer.
+//Return the number of bytes read (0 if no byte is available or the read buffer is full).
+//Return -1 if the connection is closed by the peer or broken.
+int connbuf_read(int conn, connbuf_t *cb)
+{
+  ssize_t n;
+  int total = 0;
+
+  //move the unparsed bytes to the front to make room for new ones
+  if (cb->rstart > 0)
+  {
+    memmove(cb->rbuf, cb->rbuf + cb->rstart, cb->rend - cb->rstart);
+    cb->rend -= cb->rstart;
+    cb->rstart = 0;
+  }
+
+  while (cb->rend < CONNBUF_SIZE)
+  {
+    n = recv(conn, cb->rbuf + cb->rend, CONNBUF_SIZE - cb->rend, 0);
+
+    if (n > 0)
+    {
+      cb->rend += n;
+      total += n;
+    }
+    else if (n == 0)
+      return -1;
+    else if (errno == EINTR)
+      continue;
+    else if (errno == EAGAIN || errno == EWOULDBLOCK)
+      break;
+    else
+      return -1;
+  }
+
+  return total;
+}
+
+//This function parses the next complete frame carrying len bytes of data from the read buffer.
+//The frame is expected as !& data !#. Bytes which are not part of a valid frame are skipped.
+//Return 1 and copy the data into data if a frame is parsed, return 0 if no complete frame is buffered.
+int connbuf_nextframe(connbuf_t *cb, void *data, size_t len)
+{
+  char *p;
+
+  while (cb->rend - cb->rstart >= 2)
+  {
+    p = cb->rbuf + cb->rstart;
+
+    if (p[0] != '!' || p[1] != '&')
+    {
+      cb->rstart++;
+      continue;
+    }
+
+    if (cb->rend - cb->rstart < len + 4)
+      return 0;
+
+    //the data has a fixed length, so a "!#" inside the data can not end the frame early
+    if (p[len + 2] != '!' || p[len + 3] != '#')
+    {
+      cb->rstart++;
+      continue;
+    }
+
+    memcpy(data, p + 2, len);
+    cb->rstart += len + 4;
+    return 1;
+  }
+
+  return 0;
+}
+
+//This function encodes len bytes of data into a "!& data !#" frame.
+//The frame is returned with a reference count of 1 held by the caller, which must release it with frame_release().
+frame_t *frame_encode(void *data, size_t len)
+{
+  frame_t *frame;
+
+  frame = malloc(sizeof(frame_t));
+  frame->refcnt = 1;
+  frame->len = len + 4;
+  frame->data[0] = '!';
+  frame->data[1] = '&';
+  memcpy(frame->data + 2, data, len);
+  frame->data[len + 2] = '!';
+  frame->data[len + 3] = '#';
+
+  return frame;
+}
+
+//This function drops a reference to a frame. The frame is freed when its last reference is dropped.
+void frame_release(frame_t *frame)
+{
+  if (--frame->refcnt == 0)
+    free(frame);
+}
+
+//This function appends an encoded frame to the write queue and takes a reference to it.
+static void connbuf_append(connbuf_t *cb, frame_t *frame)
+{
+  wqentry_t *entry;
+
+  entry = malloc(sizeof(wqentry_t));
+  entry->next = NULL;
+  entry->frame = frame;
+  frame->refcnt++;
+
+  if (cb->wtail)
+    cb->wtail->next = entry;
+  else
+    cb->whead = entry;
+  cb->wtail = entry;
+  cb->wqlen++;
+  cb->queued++;
+  if (cb->wqlen > cb->maxqlen)
+    cb->maxqlen = cb->wqlen;
+}
+
+//This function appends an encoded frame to the write queue, the write queue takes its own reference to the frame.
+//The drop policy of the write queue decides whether the frame is queued.
+//Return 1 if the frame is queued, -1 if it is dropped.
+int connbuf_queueshared(connbuf_t *cb, frame_t *frame)
+{
+  if (connbuf_shoulddrop(cb))
+  {
+    cb->dropped++;
+    return -1;
+  }
+
+  connbuf_append(cb, frame);
+  return 1;
+}
+
+//This function encodes len bytes of data into a "!& data !#" frame and appends it to the write queue.
+//The drop policy of the write queue decides whether the frame is queued.
+//Return 1 if the frame is queued, -1 if it is dropped.
+int connbuf_queueframe(connbuf_t *cb, void *data, size_t len)
+{
+  frame_t *frame;
+  int result;
+
+  frame = frame_encode(data, len);
+  result = connbuf_queueshared(cb, frame);
+  frame_release(frame);
+
+  return result;
+}
+
+//This function encodes len bytes of data into a "!& data !#" frame and appends it to the write queue whatever its length.
+//It is used for the control frames which are never sent again, the drop policy does not apply to them.
+void connbuf_queuecontrol(connbuf_t *cb, void *data, size_t len)
+{
+  frame_t *frame;
+
+  frame = frame_encode(data, len);
+  connbuf_append(cb, frame);
+  frame_release(frame);
+}
+
+//This function removes the first frame from the write queue and counts it as sent.
+void connbuf_popframe(connbuf_t *cb)
+{
+  wqentry_t *entry = cb->whead;
+
+  cb->whead = entry->next;
+  if (cb->whead == NULL)
+    cb->wtail = NULL;
+  cb->woff = 0;
+  cb->wqlen--;
+  cb->sent++;
+  frame_release(entry->frame);
+  free(entry);
+}
+
+//This function writes the queued frames to the nonblocking connection conn until the queue is empty or the connection would block.
+//Up to CONNBUF_IOV_MAX frames are written by each writev() call.
+//Return 1 if the write queue is empty, 0 if frames are still pending, -1 if the connection is broken.
+int connbuf_flush(int conn, connbuf_t *cb)
+{
+  struct iovec iov[CONNBUF_IOV_MAX];
+  struct msghdr msg;
+  wqentry_t *entry;
+  size_t left;
+  ssize_t n;
+  int iovcnt;
+
+  while (cb->whead != NULL)
+  {
+    iovcnt = 0;
+    for (entry = cb->whead; entry != NULL && iovcnt < CONNBUF_IOV_MAX; entry = entry->next)
+    {
+      iov[iovcnt].iov_base = entry->frame->data;
+      iov[iovcnt].iov_len = entry->frame->len;
+      iovcnt++;
+    }
+    iov[0].iov_base = (char *)iov[0].iov_base + cb->woff;
+    iov[0].iov_len -= cb->woff;
+
+    //sendmsg() is writev() with MSG_NOSIGNAL, a broken connection returns EPIPE instead of raising SIGPIPE
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+    n = sendmsg(conn, &msg, MSG_NOSIGNAL);
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return 0;
+      return -1;
+    }
+
+    //dequeue the frames written completely, and remember how much of the next one is written
+    left = n;
+    while (left > 0)
+    {
+      entry = cb->whead;
+      if (left < entry->frame->len - cb->woff)
+      {
+        cb->woff += left;
+        break;
+      }
+
+      left -= entry->frame->len - cb->woff;
+      connbuf_popframe(cb);
+    }
+  }
+
+  return 1;
+}
+
+//This function prints out the queue metrics of a connbuf.
+void connbuf_printstats(connbuf_t *cb, const char *name)
+{
+  printf("queue %s: depth %d max %d avg %.1f queued %lu sent %lu dropped %lu\n",
+         name, cb->wqlen, cb->maxqlen, cb->avgqlen, cb->queued, cb->sent, cb->dropped);
+}
+
+//This function sets the connection conn to nonblocking mode.
+//Return 1 on success, -1 on failure.
+int connbuf_setnonblocking(int conn)
+{
+  int flags = fcntl(conn, F_GETFL, 0);
+
+  if (flags == -1 || fcntl(conn, F_SETFL, flags | O_NONBLOCK) == -1)
+    return -1;
+
+  return 1;
+}
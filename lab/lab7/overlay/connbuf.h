@@ -0,0 +1,115 @@
+//FILE: overlay/connbuf.h
+//
+//Description: this file defines the per connection buffers used by the ON process event loop.
+//Every nonblocking TCP connection of the ON process has a read buffer, from which complete "!& data !#" frames are parsed,
+//and a write queue of encoded frames, which is flushed whenever the connection is writable.
+//An encoded frame is reference counted, so a broadcast packet is encoded once and the same frame is queued to all the neighbors.
+//
+
+#ifndef CONNBUF_H
+#define CONNBUF_H
+
+#include <stddef.h>
+#include "../common/constants.h"
+#include "../common/pkt.h"
+
+//size of a frame carrying the biggest structure exchanged by the ON process (a sendpkt_arg_t) including the delimiters
+#define FRAME_MAX_LEN (sizeof(sendpkt_arg_t) + 4)
+
+//size of the read buffer of a connection
+#define CONNBUF_SIZE (4 * FRAME_MAX_LEN)
+
+//max number of queued frames written by one writev() call
+#define CONNBUF_IOV_MAX 16
+
+//drop policies of a write queue
+#define QUEUE_TAILDROP 0 //a new frame is dropped only when the queue is full
+#define QUEUE_RED 1      //random early detection, new frames are dropped with a probability growing with the average queue length
+
+//an encoded frame shared by all the write queues it is queued to
+typedef struct frame {
+	int refcnt;		//number of write queues holding the frame, plus one while the encoder holds it
+	size_t len;		//length of the encoded frame
+	char data[FRAME_MAX_LEN];	//"!&" data "!#"
+} frame_t;
+
+//an entry of a write queue
+typedef struct wqentry {
+	struct wqentry* next;	//next entry in the write queue
+	frame_t* frame;		//frame to write
+} wqentry_t;
+
+//connbuf_t keeps the read buffer and the write queue of a nonblocking connection
+typedef struct connbuf {
+	char rbuf[CONNBUF_SIZE];	//received bytes not parsed yet
+	size_t rstart;			//first unparsed byte in rbuf
+	size_t rend;			//end of the received bytes in rbuf
+	wqentry_t* whead;		//first frame to write
+	wqentry_t* wtail;		//last frame to write
+	size_t woff;			//number of bytes of the first frame already written
+	int wqlen;			//number of frames in the write queue
+	int pollout;			//1 if the connection is polled for writability because the write queue is not empty
+	int qlimit;			//max number of frames in the write queue
+	int policy;			//drop policy of the write queue, QUEUE_TAILDROP or QUEUE_RED
+	double avgqlen;			//average write queue length used by the RED drop policy
+	int maxqlen;			//longest write queue seen
+	unsigned long queued;		//number of frames queued
+	unsigned long dropped;		//number of frames dropped by the drop policy
+	unsigned long sent;		//number of frames completely written
+} connbuf_t;
+
+//This function initializes an empty connbuf with the given write queue limit and drop policy.
+//All the queue metrics are reset.
+void connbuf_init(connbuf_t* cb, int qlimit, int policy);
+
+//This function drops all the received bytes and frees all the queued frames of a connbuf.
+//The write queue limit, the drop policy and the queue metrics are kept.
+void connbuf_clear(connbuf_t* cb);
+
+//This function reads all the bytes available on the nonblocking connection conn into the read buffer.
+//Return the number of bytes read (0 if no byte is available or the read buffer is full).
+//Return -1 if the connection is closed by the peer or broken.
+int connbuf_read(int conn, connbuf_t* cb);
+
+//This function parses the next complete frame carrying len bytes of data from the read buffer.
+//The frame is expected as !& data !#. Bytes which are not part of a valid frame are skipped.
+//Return 1 and copy the data into data if a frame is parsed, return 0 if no complete frame is buffered.
+int connbuf_nextframe(connbuf_t* cb, void* data, size_t len);
+
+//This function encodes len bytes of data into a "!& data !#" frame.
+//The frame is returned with a reference count of 1 held by the caller, which must release it with frame_release().
+frame_t* frame_encode(void* data, size_t len);
+
+//This function drops a reference to a frame. The frame is freed when its last reference is dropped.
+void frame_release(frame_t* frame);
+
+//This function appends an encoded frame to the write queue, the write queue takes its own reference to the frame.
+//The drop policy of the write queue decides whether the frame is queued.
+//Return 1 if the frame is queued, -1 if it is dropped.
+int connbuf_queueshared(connbuf_t* cb, frame_t* frame);
+
+//This function encodes len bytes of data into a "!& data !#" frame and appends it to the write queue.
+//The drop policy of the write queue decides whether the frame is queued.
+//Return 1 if the frame is queued, -1 if it is dropped.
+int connbuf_queueframe(connbuf_t* cb, void* data, size_t len);
+
+//This function encodes len bytes of data into a "!& data !#" frame and appends it to the write queue whatever its length.
+//It is used for the control frames which are never sent again, the drop policy does not apply to them.
+void connbuf_queuecontrol(connbuf_t* cb, void* data, size_t len);
+
+//This function prints out the queue metrics of a connbuf.
+void connbuf_printstats(connbuf_t* cb, const char* name);
+
+//This function removes the first frame from the write queue and counts it as sent.
+void connbuf_popframe(connbuf_t* cb);
+
+//This function writes the queued frames to the nonblocking connection conn until the queue is empty or the connection would block.
+//Up to CONNBUF_IOV_MAX frames are written by each writev() call.
+//Return 1 if the write queue is empty, 0 if frames are still pending, -1 if the connection is broken.
+int connbuf_flush(int conn, connbuf_t* cb);
+
+//This function sets the connection conn to nonblocking mode.
+//Return 1 on success, -1 on failure.
+int connbuf_setnonblocking(int conn);
+
+#endif
@@ -7,7 +7,7 @@
 #include "neighbortable.h"
 #include "../topology/topology.h"
 
-//This function first creates a neighbor table dynamically. It then parses the topology/topology.dat file and fill the nodeID and nodeIP fields in all the entries, initialize conn field as -1 .
+//This function first creates a neighbor table dynamically. It then parses the topology/topology.dat file and fill the nodeID and nodeIP fields in all the entries, initialize conn field as -1, the connection buffers as empty and the link state as NBR_DOWN.
 //return the created neighbor table
 nbr_entry_t *nt_create()
 {
@@ -24,6 +24,14 @@ nbr_entry_t *nt_create()
     table[i].nodeID = IParray->arrayID[i];
     table[i].nodeIP = IParray->arrayIP[i];
     table[i].conn = -1;
+    connbuf_init(&table[i].buf, OVERLAY_QUEUE_LIMIT, QUEUE_TAILDROP);
+    table[i].state = NBR_DOWN;
+    table[i].backoff = RECONNECT_MIN_DELAY;
+    table[i].retryTime = 0;
+    table[i].lastRecv = 0;
+    table[i].lastSend = 0;
+    table[i].reportPending = 0;
+    udplink_init(&table[i].link);
   }
 
   free(IParray->arrayIP);
@@ -42,11 +50,12 @@ void nt_destroy(nbr_entry_t *nt)
   for (int i = 0; i < size; i++)
   {
     close(nt[i].conn);
+    connbuf_clear(&nt[i].buf);
   }
   free(nt);
 }
 
-//This function is used to assign a TCP connection to a neighbor table entry for a neighboring node. If the TCP connection is successfully assigned, return 1, otherwise return -1
+//This function is used to assign a TCP connection to a neighbor table entry for a neighboring node. The connection buffers of the entry are emptied. If the TCP connection is successfully assigned, return 1, otherwise return -1
 int nt_addconn(nbr_entry_t *nt, int nodeID, int conn)
 {
   int size;
@@ -59,6 +68,7 @@ int nt_addconn(nbr_entry_t *nt, int nodeID, int conn)
       if (nt[i].nodeID == nodeID)
       {
         nt[i].conn = conn;
+        connbuf_clear(&nt[i].buf);
         return 1;
       }
     }
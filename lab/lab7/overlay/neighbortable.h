@@ -9,6 +9,13 @@
 
 #include <arpa/inet.h>
 #include <unistd.h>
+#include "connbuf.h"
+#include "udplink.h"
+
+//states of the link to a neighbor
+#define NBR_DOWN 0       //no connection, a neighbor with a smaller node ID is reconnected when its retry time comes (a UDP link comes up when a datagram is received)
+#define NBR_CONNECTING 1 //a nonblocking connect to the neighbor is in progress
+#define NBR_UP 2         //the connection is established and packets are exchanged
 
 //neighbor table entry definition
 //a neighbor table contains n entries where n is the number of neighbors
@@ -18,17 +25,25 @@ typedef struct neighborentry
 {
   int nodeID;       //neighbor's node ID
   in_addr_t nodeIP; //neighbor's IP address
-  int conn;         //TCP connection's socket descriptor to the neighbor
+  int conn;         //TCP connection's socket descriptor to the neighbor, -1 on a UDP link
+  connbuf_t buf;    //read buffer and write queue of the connection
+  int state;        //NBR_DOWN, NBR_CONNECTING or NBR_UP
+  int backoff;      //delay before the next reconnection attempt in milliseconds
+  long long retryTime; //time of the next reconnection attempt in milliseconds
+  long long lastRecv;  //time the last bytes were received from the neighbor in milliseconds
+  long long lastSend;  //time the last frame was queued to the neighbor in milliseconds
+  udplink_t link;      //sequence numbers and loss metrics of the UDP link to the neighbor
+  int reportPending;   //1 if the state of the link could not be written into the full shared memory channel to the SNP process yet
 } nbr_entry_t;
 
-//This function first creates a neighbor table dynamically. It then parses the topology/topology.dat file and fill the nodeID and nodeIP fields in all the entries, initialize conn field as -1 .
+//This function first creates a neighbor table dynamically. It then parses the topology/topology.dat file and fill the nodeID and nodeIP fields in all the entries, initialize conn field as -1, the connection buffers as empty and the link state as NBR_DOWN.
 //return the created neighbor table
 nbr_entry_t *nt_create();
 
 //This function destroys a neighbortable. It closes all the connections and frees all the dynamically allocated memory.
 void nt_destroy(nbr_entry_t *nt);
 
-//This function is used to assign a TCP connection to a neighbor table entry for a neighboring node. If the TCP connection is successfully assigned, return 1, otherwise return -1
+//This function is used to assign a TCP connection to a neighbor table entry for a neighboring node. The connection buffers of the entry are emptied. If the TCP connection is successfully assigned, return 1, otherwise return -1
 int nt_addconn(nbr_entry_t *nt, int nodeID, int conn);
 
 #endif
@@ -1,17 +1,30 @@
 //FILE: overlay/overlay.c
 //
 //Description: this file implements a ON process
-//A ON process first connects to all the neighbors and then starts listen_to_neighbor threads each of which keeps receiving the incoming packets from a neighbor and forwarding the received packets to the SNP process. Then ON process waits for the connection from SNP process. After a SNP process is connected, the ON process keeps receiving sendpkt_arg_t structures from the SNP process and sending the received packets out to the overlay network.
+//A ON process is a single threaded event loop built on epoll. The listening socket for the neighbors with larger node IDs, the TCP connections to all the neighbors, the listening socket for the SNP process and the connection to the SNP process are all nonblocking and served by this loop. Every connection has a read buffer from which complete frames are parsed, and a write queue which is flushed whenever the connection is writable. Packets received from the neighbors are queued to the SNP process, and sendpkt_arg_t structures received from the SNP process are queued to the next hop neighbors, so frames are never interleaved on any connection.
+//The links to the neighbors are supervised by a timer: a broken link to a neighbor with a smaller node ID is reconnected with an exponential backoff,
+//idle links carry heartbeats, and a link on which nothing is received for LINK_TIMEOUT is closed. Every link up or down is reported to the SNP process.
+//Every write queue is bounded by OVERLAY_QUEUE_LIMIT frames, so a slow neighbor only loses its own packets and never stalls the loop.
+//With "./overlay udp" the links to the neighbors are UDP instead of TCP (see udplink.h): every packet is one datagram on a socket shared by all the links,
+//a link is up while datagrams are received from the neighbor, and the heartbeats sent to a neighbor which is down probe for it coming back.
+//All the nodes of the overlay must use the same kind of links.
+//A SNP process started with "./network shm" offers a shared memory channel, which then carries the packets between the two processes instead of the TCP connection.
+//The drop policy of the neighbor queues is tail drop by default, "./overlay red" selects RED. The queue metrics are printed on SIGUSR1.
 //
 //Date: April 28,2008
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <string.h>
-#include <pthread.h>
+#include <errno.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <unistd.h>
@@ -24,204 +37,873 @@
 #include "overlay.h"
 #include "../topology/topology.h"
 #include "neighbortable.h"
+#include "connbuf.h"
+#include "udplink.h"
+#include "../common/shmring.h"
 
-//you should start the ON processes on all the overlay hosts within this period of time
-#define OVERLAY_START_DELAY 60
+//max number of events handled by one epoll_wait() call
+#define OVERLAY_MAX_EVENTS 32
+
+//epoll event tags, a tag smaller than these is the index of a neighbor in the neighbor table
+#define TAG_NBR_LISTEN 0xFFFFFFF0u
+#define TAG_NETWORK_LISTEN 0xFFFFFFF1u
+#define TAG_NETWORK 0xFFFFFFF2u
+#define TAG_TIMER 0xFFFFFFF3u
+#define TAG_NETWORK_RING 0xFFFFFFF4u
+#define TAG_SHM_LISTEN 0xFFFFFFF5u
+#define TAG_UDP 0xFFFFFFF6u
+#define TAG_SHM_OFFER 0xFFFFFFF7u
 
 /**************************************************************/
 //declare global variables
 /**************************************************************/
 
 //declare the neighbor table as global variable
-nbr_entry_t *nt;
-int size;
+//the globals are static, so the ON layer can be linked into one process with the SNP and SRT layers (see stack/stack.c)
+static nbr_entry_t *nt;
+static int size;
+static int myNodeID;
 //declare the TCP connection to SNP process as global variable
-int network_conn;
+static int network_conn;
+//read buffer and write queue of the connection to the SNP process
+static connbuf_t network_buf;
+//shared memory channel offered by the SNP process, NULL if the packets go over network_conn
+static shmchannel_t *network_shm;
+//epoll instance of the event loop
+static int epfd;
+//listening sockets for the neighbors and for the SNP process
+static int nbr_listenfd;
+static int network_listenfd;
+//listening unix socket for the shared memory channel offered by the SNP process, -1 if it could not be opened
+static int shm_listenfd;
+//unix connection over which the SNP process is offering a shared memory channel, -1 if none is pending
+static int shm_offerconn;
+//1 if the links to the neighbors are UDP instead of TCP
+static int udp_mode;
+//UDP socket of the links to all the neighbors, the batch of datagrams received from it,
+//and 1 while it is polled for writability because a neighbor's datagrams could not all be sent
+static int udp_sock;
+static udpbatch_t *udp_batch;
+static int udp_pollout;
+//timer driving the reconnections and the heartbeats
+static int timerfd;
+//time the ON process started, and 1 once the links to all the neighbors have been up at the same time
+static long long start_time;
+static int all_up;
+//set by the SIGUSR1 handler, the event loop prints out the queue metrics when it is set
+static volatile sig_atomic_t print_stats;
 
 /**************************************************************/
 //implementation overlay functions
 /**************************************************************/
 
-// This thread opens a TCP port on CONNECTION_PORT and waits for the incoming connection from all the neighbors that have a larger node ID than my nodeID,
-// After all the incoming connections are established, this thread terminates
-void *waitNbrs(void *arg)
+// This function opens a nonblocking TCP port on the given port number for incoming connections.
+// The listening socket descriptor is returned if success, otherwise return -1.
+int openListener(int port)
 {
-  int myID, ID, sfd, new_sfd;
-  nbr_entry_t *entry;
+  int sfd, on = 1;
   struct sockaddr_in addr;
-  socklen_t addrlen = sizeof(struct sockaddr_in);
-
-  if ((myID = topology_getMyNodeID()) == -1)
-  {
-    printf("topology_getMyNodeID failed!\n");
-    return NULL;
-  }
 
   if ((sfd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
   {
-    printf("create waiting socket failed!\n");
-    return NULL;
+    printf("create listening socket failed!\n");
+    return -1;
   }
 
+  setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
   memset(&addr, 0, sizeof(struct sockaddr_in));
-
   addr.sin_family = AF_INET;
   addr.sin_addr.s_addr = htonl(INADDR_ANY);
-  addr.sin_port = htons(CONNECTION_PORT);
+  addr.sin_port = htons(port);
 
   if (bind(sfd, (struct sockaddr *)&addr, sizeof(struct sockaddr_in)) == -1)
   {
     printf("bind address to socket failed!\n");
     close(sfd);
-    return NULL;
+    return -1;
   }
 
-  if (listen(sfd, 10) < 0)
+  if (listen(sfd, 10) < 0 || connbuf_setnonblocking(sfd) == -1)
   {
     printf("Failed to listen on server socket.\n");
     close(sfd);
-    return NULL;
+    return -1;
+  }
+
+  return sfd;
+}
+
+// This function adds the connection conn with the given tag to the epoll instance.
+// The connection is polled for readability.
+void watchConn(int conn, uint32_t tag)
+{
+  struct epoll_event ev;
+
+  ev.events = EPOLLIN;
+  ev.data.u32 = tag;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, conn, &ev);
+}
+
+// This function updates the epoll registration of the connection conn after its write queue changed.
+// The connection is polled for writability only while its write queue is not empty.
+void watchWrite(int conn, uint32_t tag, connbuf_t *cb)
+{
+  struct epoll_event ev;
+  int pollout = cb->wqlen > 0;
+
+  if (pollout == cb->pollout)
+    return;
+
+  ev.events = pollout ? EPOLLIN | EPOLLOUT : EPOLLIN;
+  ev.data.u32 = tag;
+  epoll_ctl(epfd, EPOLL_CTL_MOD, conn, &ev);
+  cb->pollout = pollout;
+}
+
+// This function returns the time of a monotonic clock in milliseconds.
+long long overlay_now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// This function tells the SNP process the state of the link to the neighbor with the given index in the neighbor table.
+// A LINK_UP or LINK_DOWN packet with the neighbor's node ID as src_nodeID is queued to the SNP process.
+// A link event is never sent again, so the drop policy of the queue to the SNP process does not apply to it.
+// If the shared memory channel to the SNP process is full, the state is reported again by overlay_tick().
+void reportLink(int idx)
+{
+  snp_pkt_t pkt;
+
+  nt[idx].reportPending = 0;
+  if (network_conn == -1)
+    return;
+
+  memset(&pkt, 0, sizeof(snp_pkt_t));
+  pkt.header.src_nodeID = nt[idx].nodeID;
+  pkt.header.dest_nodeID = myNodeID;
+  pkt.header.type = nt[idx].state == NBR_UP ? LINK_UP : LINK_DOWN;
+
+  if (network_shm == NULL)
+    connbuf_queuecontrol(&network_buf, &pkt, sizeof(snp_pkt_t));
+  else if (shmtoNetwork(&pkt) == -1)
+    nt[idx].reportPending = 1;
+  flushNetwork();
+}
+
+// This function schedules the next connection attempt to the neighbor with the given index in the neighbor table.
+// The delay doubles after every failed attempt, from RECONNECT_MIN_DELAY up to RECONNECT_MAX_DELAY milliseconds.
+void scheduleRetry(int idx)
+{
+  nbr_entry_t *entry = &nt[idx];
+
+  entry->retryTime = overlay_now() + entry->backoff;
+  printf("Overlay: reconnect to neighbor %d in %d ms\n", entry->nodeID, entry->backoff);
+
+  entry->backoff *= 2;
+  if (entry->backoff > RECONNECT_MAX_DELAY)
+    entry->backoff = RECONNECT_MAX_DELAY;
+}
+
+// This function starts a nonblocking connection to the neighbor with the given index in the neighbor table.
+// The neighbor goes to NBR_CONNECTING and the connection is polled for writability until the connect completes.
+// If the connect fails right away, the next attempt is scheduled.
+void connectNbr(int idx)
+{
+  nbr_entry_t *entry = &nt[idx];
+  struct sockaddr_in node_addr;
+  struct epoll_event ev;
+  int sock;
+
+  if ((sock = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+  {
+    printf("create socket %d failed!\n", entry->nodeID);
+    scheduleRetry(idx);
+    return;
   }
 
+  memset(&node_addr, 0, sizeof(node_addr));
+  node_addr.sin_addr.s_addr = entry->nodeIP;
+  node_addr.sin_family = AF_INET;
+  node_addr.sin_port = htons(CONNECTION_PORT);
+
+  if (connbuf_setnonblocking(sock) == -1 ||
+      (connect(sock, (struct sockaddr *)&node_addr, sizeof(node_addr)) == -1 && errno != EINPROGRESS))
+  {
+    printf("established connect to %d failed!\n", entry->nodeID);
+    close(sock);
+    scheduleRetry(idx);
+    return;
+  }
+
+  entry->conn = sock;
+  entry->state = NBR_CONNECTING;
+  entry->retryTime = overlay_now();
+
+  //a completed connect, successful or not, makes the socket writable
+  ev.events = EPOLLOUT;
+  ev.data.u32 = idx;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &ev);
+}
+
+// This function starts the connections to all the neighbors that have a smaller node ID than my nodeID.
+// The connections complete in the event loop, and the failed ones are retried with an exponential backoff.
+void connectNbrs()
+{
   for (int i = 0; i < size; i++)
   {
-    entry = &nt[i];
+    if (nt[i].nodeID < myNodeID)
+      connectNbr(i);
+  }
+}
+
+// This function brings up the link to the neighbor with the given index in the neighbor table on the established connection conn.
+// The connection is polled for readability and the SNP process is told that the link is up. conn is -1 for a UDP link.
+// The first time the links to all the neighbors are up, the time since the ON process started is printed.
+void linkUp(int idx, int conn)
+{
+  nbr_entry_t *entry = &nt[idx];
+  struct epoll_event ev;
+  int op = entry->state == NBR_CONNECTING ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+  nt_addconn(nt, entry->nodeID, conn);
+  entry->state = NBR_UP;
+  entry->lastRecv = overlay_now();
+  entry->lastSend = entry->lastRecv;
+
+  if (conn != -1)
+  {
+    ev.events = EPOLLIN;
+    ev.data.u32 = idx;
+    epoll_ctl(epfd, op, conn, &ev);
+  }
 
-    if (entry->nodeID > myID)
+  printf("Overlay: link to neighbor %d is up\n", entry->nodeID);
+  reportLink(idx);
+
+  if (!all_up)
+  {
+    for (int i = 0; i < size; i++)
     {
-      new_sfd = accept(sfd, (struct sockaddr *)&addr, &addrlen);
-      ID = topology_getNodeIDfromip(&addr.sin_addr);
+      if (nt[i].state != NBR_UP)
+        return;
+    }
+    all_up = 1;
+    printf("Overlay: links to all %d neighbors up in %lld ms\n", size, overlay_now() - start_time);
+  }
+}
 
-      printf("waitNbrs accept success %d %s\n", ID, inet_ntoa(addr.sin_addr));
+// This function completes the nonblocking connect to the neighbor with the given index in the neighbor table.
+// The link is brought up if the connect succeeded, otherwise the next attempt is scheduled.
+void finishConnect(int idx)
+{
+  nbr_entry_t *entry = &nt[idx];
+  int err = 0;
+  socklen_t len = sizeof(err);
 
-      if (ID < myID)
-      {
-        printf("neighbor has ID less than my ID connect to me!\n");
-        close(new_sfd);
-        break;
-      }
+  if (getsockopt(entry->conn, SOL_SOCKET, SO_ERROR, &err, &len) == -1 || err != 0)
+  {
+    printf("established connect to %d failed!\n", entry->nodeID);
+    closeNbr(idx);
+    return;
+  }
+
+  linkUp(idx, entry->conn);
+}
+
+// This function closes the connection to the neighbor with the given index in the neighbor table.
+// All the frames still queued to the neighbor are dropped, and the SNP process is told that the link is down.
+// A neighbor with a smaller node ID than my nodeID is reconnected after the reconnection backoff.
+// A UDP link has no connection to close, it comes back up with the next datagram from the neighbor.
+void closeNbr(int idx)
+{
+  nbr_entry_t *entry = &nt[idx];
+  int wasUp = entry->state == NBR_UP;
+
+  if (wasUp)
+    printf("Overlay: link to neighbor %d is down\n", entry->nodeID);
+
+  if (entry->conn != -1)
+  {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, entry->conn, NULL);
+    close(entry->conn);
+    entry->conn = -1;
+  }
+  entry->state = NBR_DOWN;
+  connbuf_clear(&entry->buf);
+
+  if (entry->nodeID < myNodeID && !udp_mode)
+    scheduleRetry(idx);
+  if (wasUp)
+    reportLink(idx);
+}
+
+// This function closes the connection to the SNP process.
+// All the frames still queued to the SNP process are dropped.
+void closeNetwork()
+{
+  printf("Overlay: connection to SNP process closed\n");
+  epoll_ctl(epfd, EPOLL_CTL_DEL, network_conn, NULL);
+  close(network_conn);
+  network_conn = -1;
+  connbuf_clear(&network_buf);
+
+  if (network_shm != NULL)
+  {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, network_shm->toserver_fd, NULL);
+    shmchannel_destroy(network_shm);
+    network_shm = NULL;
+  }
+}
+
+// This function accepts an incoming connection from a neighbor that has a larger node ID than my nodeID.
+// The connection is set to nonblocking, assigned to the neighbor's entry in the neighbor table and added to the event loop.
+void acceptNbr()
+{
+  int myID, ID, new_sfd;
+  struct sockaddr_in addr;
+  socklen_t addrlen = sizeof(struct sockaddr_in);
+
+  if ((new_sfd = accept(nbr_listenfd, (struct sockaddr *)&addr, &addrlen)) < 0)
+    return;
+
+  myID = myNodeID;
+  ID = topology_getNodeIDfromip(&addr.sin_addr);
+  printf("acceptNbr accept success %d %s\n", ID, inet_ntoa(addr.sin_addr));
 
-      nt_addconn(nt, ID, new_sfd);
+  if (ID < myID)
+  {
+    printf("neighbor has ID less than my ID connect to me!\n");
+    close(new_sfd);
+    return;
+  }
+
+  for (int i = 0; i < size; i++)
+  {
+    if (nt[i].nodeID == ID)
+    {
+      //a neighbor reconnecting replaces its old connection
+      if (nt[i].conn != -1)
+        closeNbr(i);
+
+      connbuf_setnonblocking(new_sfd);
+      linkUp(i, new_sfd);
+      return;
     }
   }
 
-  printf("waitNbrs thread exit!\n");
-  close(sfd);
-  return NULL;
+  printf("node %d is not my neighbor!\n", ID);
+  close(new_sfd);
 }
 
-// This function connects to all the neighbors that have a smaller node ID than my nodeID
-// After all the outgoing connections are established, return 1, otherwise return -1
-int connectNbrs()
+// This function accepts the incoming connection from the local SNP process.
+// Only one SNP process can be connected at a time. The SNP process is told the state of the links to all the neighbors.
+// Nagle's algorithm is disabled on the connection, so a packet to the SNP process is not held back until the previous one is acknowledged.
+void acceptNetwork()
 {
-  int sock, myID;
-  nbr_entry_t *entry;
-  struct sockaddr_in node_addr;
+  int new_sfd, one = 1;
 
-  if ((myID = topology_getMyNodeID()) == -1)
+  if ((new_sfd = accept(network_listenfd, NULL, NULL)) < 0)
+    return;
+
+  if (network_conn != -1)
   {
-    return -1;
+    printf("Overlay: a SNP process is already connected\n");
+    close(new_sfd);
+    return;
   }
 
+  printf("Overlay: accept connection from SNP process...\n");
+  connbuf_setnonblocking(new_sfd);
+  setsockopt(new_sfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  network_conn = new_sfd;
+  watchConn(network_conn, TAG_NETWORK);
+
   for (int i = 0; i < size; i++)
+    reportLink(i);
+}
+
+// This function queues an encoded packet frame to the neighbor with the given index in the neighbor table.
+// The frame is shared, not copied, so a broadcast packet is encoded only once for all the neighbors.
+// The packet is dropped if the link to the neighbor is not up or if the drop policy of the neighbor's queue rejects it.
+// On a UDP link the packet is sent even if the link is down.
+void sendtoNbr(int idx, frame_t *frame)
+{
+  nbr_entry_t *entry = &nt[idx];
+
+  //a UDP link has no connection, the datagrams to a neighbor which is down are sent anyway and probe for it coming back
+  if (entry->state != NBR_UP && !udp_mode)
+    return;
+
+  if (connbuf_queueshared(&entry->buf, frame) == 1)
+    entry->lastSend = overlay_now();
+}
+
+// This function writes the frames queued to the neighbor with the given index in the neighbor table.
+// If the connection would block, the remaining frames are written when the connection becomes writable.
+// On a UDP link the frames are sent as datagrams, and the UDP socket is polled for writability if it would block.
+void flushNbr(int idx)
+{
+  nbr_entry_t *entry = &nt[idx];
+
+  if (udp_mode)
+  {
+    if (entry->buf.wqlen > 0 && !udp_pollout && udplink_flush(udp_sock, &entry->buf, &entry->link, entry->nodeIP) == 0)
+      watchUdpWrite(1);
+    return;
+  }
+
+  if (entry->state != NBR_UP || entry->buf.wqlen == 0 || entry->buf.pollout)
+    return;
+
+  if (connbuf_flush(entry->conn, &entry->buf) == -1)
+    closeNbr(idx);
+  else
+    watchWrite(entry->conn, idx, &entry->buf);
+}
+
+// This function queues a packet received from a neighbor to the SNP process.
+// If the SNP process attached a shared memory channel, the packet is written into the channel instead.
+// The packet is dropped if no SNP process is connected or if the queue or the channel to the SNP process is full.
+void forwardtoNetwork(snp_pkt_t *pkt)
+{
+  if (network_conn == -1)
+    return;
+
+  if (network_shm == NULL)
+  {
+    connbuf_queueframe(&network_buf, pkt, sizeof(snp_pkt_t));
+    return;
+  }
+
+  shmtoNetwork(pkt);
+}
+
+// This function writes a packet into the shared memory channel to the SNP process.
+// Return 1 if the packet is written, -1 if it is dropped because the channel is full.
+int shmtoNetwork(snp_pkt_t *pkt)
+{
+  void *slot;
+
+  if ((slot = shmring_reserve(network_shm->toclient)) == NULL)
+  {
+    network_buf.dropped++;
+    return -1;
+  }
+  memcpy(slot, pkt, sizeof(snp_pkt_t));
+  shmring_commit(network_shm->toclient, network_shm->toclient_fd);
+  network_buf.queued++;
+  network_buf.sent++;
+  return 1;
+}
+
+// This function writes the frames queued to the SNP process.
+// If the connection would block, the remaining frames are written when the connection becomes writable.
+void flushNetwork()
+{
+  if (network_conn == -1 || network_buf.wqlen == 0 || network_buf.pollout)
+    return;
+
+  if (connbuf_flush(network_conn, &network_buf) == -1)
+    closeNetwork();
+  else
+    watchWrite(network_conn, TAG_NETWORK, &network_buf);
+}
+
+// This function handles the events of the connection to the neighbor with the given index in the neighbor table.
+// A connection in progress is completed when it becomes writable.
+// The pending frames are flushed when the connection is writable. When the connection is readable,
+// all the complete packets received are queued to the SNP process, which is then flushed once for the whole batch.
+// Heartbeats only refresh the liveness of the link and are not forwarded.
+// With a shared memory channel to the SNP process, the packets are parsed straight into the slots of the channel.
+// Receiving from the neighbor resets its reconnection backoff, so a neighbor which accepts and closes right away is retried less and less often.
+void handleNbr(int idx, uint32_t events)
+{
+  nbr_entry_t *entry = &nt[idx];
+  snp_pkt_t pkt;
+  int n;
+
+  if (entry->state == NBR_CONNECTING)
+  {
+    finishConnect(idx);
+    return;
+  }
+
+  if (events & EPOLLOUT)
   {
-    entry = &nt[i];
-    if (entry->nodeID < myID)
+    if (connbuf_flush(entry->conn, &entry->buf) == -1)
     {
-      sock = socket(AF_INET, SOCK_STREAM, 0);
+      closeNbr(idx);
+      return;
+    }
+    watchWrite(entry->conn, idx, &entry->buf);
+  }
 
-      if (sock == -1)
-      {
-        printf("create socket %d failed!\n", entry->nodeID);
-        return -1;
-      }
+  if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+  {
+    n = connbuf_read(entry->conn, &entry->buf);
+    if (n > 0)
+    {
+      entry->lastRecv = overlay_now();
+      entry->backoff = RECONNECT_MIN_DELAY;
+    }
+
+    while (1)
+    {
+      void *slot = network_shm != NULL ? shmring_reserve(network_shm->toclient) : NULL;
+      snp_pkt_t *p = slot != NULL ? slot : &pkt;
 
-      entry->conn = sock;
-      memset(&node_addr, 0, sizeof(node_addr));
-      node_addr.sin_addr.s_addr = entry->nodeIP;
-      node_addr.sin_family = AF_INET;
-      node_addr.sin_port = htons(CONNECTION_PORT);
+      if (connbuf_nextframe(&entry->buf, p, sizeof(snp_pkt_t)) != 1)
+        break;
+      if (p->header.type == HEARTBEAT)
+        continue;
 
-      if (connect(sock, (struct sockaddr *)&node_addr, sizeof(node_addr)) == -1)
+      if (slot != NULL)
       {
-        printf("established connect to %d failed!\n", entry->nodeID);
-        close(sock);
-        return -1;
+        shmring_commit(network_shm->toclient, network_shm->toclient_fd);
+        network_buf.queued++;
+        network_buf.sent++;
       }
+      else
+        forwardtoNetwork(p);
     }
+    flushNetwork();
+
+    if (n == -1)
+      closeNbr(idx);
   }
-  return 1;
 }
 
-//Each listen_to_neighbor thread keeps receiving packets from a neighbor. It handles the received packets by forwarding the packets to the SNP process.
-//all listen_to_neighbor threads are started after all the TCP connections to the neighbors are established
-void *listen_to_neighbor(void *arg)
+// This function updates the epoll registration of the UDP socket.
+// The socket is polled for writability only while some datagrams could not be sent because its buffer is full.
+void watchUdpWrite(int pollout)
 {
-  int i = *(int *)arg;
-  snp_pkt_t pkt;
+  struct epoll_event ev;
 
-  while (recvpkt(&pkt, nt[i].conn) == 1)
-    forwardpktToSNP(&pkt, network_conn);
+  if (pollout == udp_pollout)
+    return;
 
-  close(nt[i].conn);
-  nt[i].conn = -1;
-  printf("listen_to_neighbor %d thread exit\n", i);
-  return NULL;
+  ev.events = pollout ? EPOLLIN | EPOLLOUT : EPOLLIN;
+  ev.data.u32 = TAG_UDP;
+  epoll_ctl(epfd, EPOLL_CTL_MOD, udp_sock, &ev);
+  udp_pollout = pollout;
 }
 
-//This function opens a TCP port on OVERLAY_PORT, and waits for the incoming connection from local SNP process. After the local SNP process is connected, this function keeps getting sendpkt_arg_ts from SNP process, and sends the packets to the next hop in the overlay network. If the next hop's nodeID is BROADCAST_NODEID, the packet should be sent to all the neighboring nodes.
-void waitNetwork()
+// This function handles the events of the UDP socket of the links to the neighbors.
+// When the socket is writable, the datagrams still queued to all the neighbors are sent.
+// When the socket is readable, all the datagrams received are accounted on the links of their senders and
+// their packets are queued to the SNP process, which is then flushed once for the whole batch.
+// A datagram from a neighbor which is down brings its link up, datagrams from other hosts are ignored.
+// Heartbeats only refresh the liveness of the link and are not forwarded.
+void handleUdp(uint32_t events)
 {
-  int sfd, nbNodeID;
-  snp_pkt_t pkt;
-  struct sockaddr_in addr;
-  socklen_t addrlen = sizeof(struct sockaddr_in);
+  snp_pkt_t *pkt;
+  unsigned int seqNum;
+  in_addr_t ip;
+  int n, idx;
 
-  sfd = socket(AF_INET, SOCK_STREAM, 0);
+  if (events & EPOLLOUT)
+  {
+    watchUdpWrite(0);
+    for (int i = 0; i < size; i++)
+      flushNbr(i);
+  }
 
-  if (sfd == -1)
+  if (events & EPOLLIN)
   {
-    printf("waitNetwork create socket failed!\n");
-    exit(-1);
+    do
+    {
+      n = udplink_recv(udp_sock, udp_batch);
+      for (int i = 0; i < n; i++)
+      {
+        if ((pkt = udplink_packet(udp_batch, i, &ip, &seqNum)) == NULL)
+          continue;
+
+        for (idx = 0; idx < size && nt[idx].nodeIP != ip; idx++)
+          ;
+        if (idx == size)
+          continue;
+
+        udplink_account(&nt[idx].link, seqNum, nt[idx].state != NBR_UP);
+        nt[idx].lastRecv = overlay_now();
+        if (nt[idx].state != NBR_UP)
+          linkUp(idx, -1);
+
+        if (pkt->header.type != HEARTBEAT)
+          forwardtoNetwork(pkt);
+      }
+    } while (n == UDPLINK_BATCH);
+    flushNetwork();
   }
+}
 
-  memset(&addr, 0, sizeof(struct sockaddr_in));
-  addr.sin_family = AF_INET;
-  addr.sin_addr.s_addr = htonl(INADDR_ANY);
-  addr.sin_port = htons(OVERLAY_PORT);
+// This function queues a sendpkt_arg_t received from the SNP process to its next hop.
+// If the next hop's nodeID is BROADCAST_NODEID, the packet is queued to all the neighboring nodes.
+// The packet is encoded once and the same frame is queued to all its next hops.
+void routeFromNetwork(sendpkt_arg_t *pkt_arg)
+{
+  frame_t *frame;
 
-  if (bind(sfd, (struct sockaddr *)&addr, sizeof(struct sockaddr_in)) == -1)
+  frame = frame_encode(&pkt_arg->pkt, sizeof(snp_pkt_t));
+  for (int i = 0; i < size; i++)
   {
-    printf("bind address to socket failed!\n");
-    close(sfd);
+    if (nt[i].nodeID == pkt_arg->nextNodeID || pkt_arg->nextNodeID == BROADCAST_NODEID)
+      sendtoNbr(i, frame);
+  }
+  frame_release(frame);
+}
+
+// This function accepts the connection over which the SNP process offers a shared memory channel on shm_listenfd.
+// The offer is received by handleNetworkShmOffer() once the connection is readable, so the event loop never waits for it.
+// A new offer replaces one still pending.
+void acceptNetworkShm()
+{
+  int conn;
+
+  if ((conn = shmchannel_accept(shm_listenfd)) == -1)
     return;
+
+  if (shm_offerconn != -1)
+  {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, shm_offerconn, NULL);
+    close(shm_offerconn);
   }
+  shm_offerconn = conn;
+  watchConn(shm_offerconn, TAG_SHM_OFFER);
+}
+
+// This function receives the shared memory channel offered by the SNP process on shm_offerconn and attaches it.
+// The doorbell of the ring from the SNP process is added to the event loop,
+// and a SHM_ATTACHED packet is sent over network_conn, after which all the packets to the SNP process go through the channel.
+// If the channel can not be attached, the SNP process keeps using network_conn.
+void handleNetworkShmOffer()
+{
+  sendpkt_arg_t offer;
+  shmchannel_t *ch;
+  snp_pkt_t ack;
+  int result;
+
+  if ((result = shmchannel_recvoffer(shm_offerconn, &offer, sizeof(sendpkt_arg_t), &ch)) == 0)
+    return;
 
-  if (listen(sfd, 10) < 0)
+  epoll_ctl(epfd, EPOLL_CTL_DEL, shm_offerconn, NULL);
+  close(shm_offerconn);
+  shm_offerconn = -1;
+  if (result == -1)
+    return;
+
+  //the offer follows the TCP connection of the SNP process, which may be pending in the same batch of events
+  if (network_conn == -1)
+    acceptNetwork();
+
+  if (network_conn == -1 || network_shm != NULL || offer.nextNodeID != SHM_ATTACH_NODEID)
   {
-    printf("Failed to listen on server socket.\n");
-    close(sfd);
+    printf("Overlay: shared memory channel from SNP process not attached\n");
+    shmchannel_destroy(ch);
     return;
   }
+  network_shm = ch;
+
+  memset(&ack, 0, sizeof(snp_pkt_t));
+  ack.header.src_nodeID = myNodeID;
+  ack.header.dest_nodeID = myNodeID;
+  ack.header.type = SHM_ATTACHED;
+  connbuf_queueframe(&network_buf, &ack, sizeof(snp_pkt_t));
+  flushNetwork();
+
+  watchConn(network_shm->toserver_fd, TAG_NETWORK_RING);
+  shmring_arm(network_shm->toserver);
+  printf("Overlay: shared memory channel from SNP process attached\n");
+}
+
+// This function handles the doorbell of the shared memory channel from the SNP process.
+// All the sendpkt_arg_ts in the ring are queued to their next hops in place, and every neighbor is flushed once afterwards.
+void handleNetworkRing()
+{
+  shmring_t *ring = network_shm->toserver;
+  void *slot;
 
-  if ((network_conn = accept(sfd, (struct sockaddr *)&addr, &addrlen)) < 0)
+  shmring_disarm(ring, network_shm->toserver_fd);
+  do
   {
-    printf("Overlay: accept failed\n");
-    close(sfd);
+    while ((slot = shmring_peek(ring)) != NULL)
+    {
+      routeFromNetwork((sendpkt_arg_t *)slot);
+      shmring_release(ring);
+    }
+  } while (!shmring_arm(ring));
+
+  for (int i = 0; i < size; i++)
+    flushNbr(i);
+}
+
+// This function handles the events of the connection to the SNP process.
+// The pending frames are flushed when the connection is writable. When the connection is readable,
+// all the complete sendpkt_arg_t structures received are queued to their next hops.
+// If the next hop's nodeID is BROADCAST_NODEID, the packet is queued to all the neighboring nodes.
+// Every packet is encoded once, and every neighbor is flushed once after the whole batch is queued.
+void handleNetwork(uint32_t events)
+{
+  sendpkt_arg_t pkt_arg;
+  int n;
+
+  if (events & EPOLLOUT)
+  {
+    if (connbuf_flush(network_conn, &network_buf) == -1)
+    {
+      closeNetwork();
+      return;
+    }
+    watchWrite(network_conn, TAG_NETWORK, &network_buf);
+  }
+
+  if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+  {
+    n = connbuf_read(network_conn, &network_buf);
+
+    while (connbuf_nextframe(&network_buf, &pkt_arg, sizeof(sendpkt_arg_t)) == 1)
+      routeFromNetwork(&pkt_arg);
+
+    for (int i = 0; i < size; i++)
+      flushNbr(i);
+
+    if (n == -1)
+      closeNetwork();
+  }
+}
+
+// This function prints out the queue metrics of all the neighbors and of the SNP process.
+void overlay_printstats()
+{
+  char name[32];
+
+  for (int i = 0; i < size; i++)
+  {
+    sprintf(name, "neighbor %d", nt[i].nodeID);
+    connbuf_printstats(&nt[i].buf, name);
+    if (udp_mode)
+      udplink_printstats(&nt[i].link, name);
+  }
+  connbuf_printstats(&network_buf, "SNP");
+}
+
+// This function is the SIGUSR1 handler, it asks the event loop to print out the queue metrics.
+void overlay_requeststats()
+{
+  print_stats = 1;
+}
+
+// This function is called by the event loop every OVERLAY_TICK milliseconds.
+// It starts the reconnections whose retry time has come, gives up the connects in progress for longer than LINK_TIMEOUT,
+// closes the links on which nothing has been received for LINK_TIMEOUT
+// and sends a heartbeat on the links on which nothing has been sent for HEARTBEAT_INTERVAL.
+// The link states which did not fit into the shared memory channel to the SNP process are reported again.
+// UDP links are never reconnected, a heartbeat is sent to a neighbor which is down as well, to probe for it coming back.
+void overlay_tick()
+{
+  uint64_t expirations;
+  long long now = overlay_now();
+  snp_pkt_t heartbeat;
+  frame_t *frame = NULL;
+
+  if (read(timerfd, &expirations, sizeof(expirations)) == -1)
     return;
+
+  for (int i = 0; i < size; i++)
+  {
+    nbr_entry_t *entry = &nt[i];
+
+    if (entry->reportPending)
+      reportLink(i);
+
+    if (entry->state == NBR_DOWN && entry->nodeID < myNodeID && !udp_mode && now >= entry->retryTime)
+      connectNbr(i);
+    else if (entry->state == NBR_CONNECTING && now - entry->retryTime > LINK_TIMEOUT)
+    {
+      printf("Overlay: connect to neighbor %d timed out\n", entry->nodeID);
+      closeNbr(i);
+    }
+    else if (entry->state == NBR_UP && now - entry->lastRecv > LINK_TIMEOUT)
+    {
+      printf("Overlay: neighbor %d timed out\n", entry->nodeID);
+      closeNbr(i);
+    }
+    else if ((entry->state == NBR_UP || udp_mode) && now - entry->lastSend >= HEARTBEAT_INTERVAL)
+    {
+      //the heartbeat is encoded once and shared by all the idle neighbors
+      if (frame == NULL)
+      {
+        memset(&heartbeat, 0, sizeof(snp_pkt_t));
+        heartbeat.header.src_nodeID = myNodeID;
+        heartbeat.header.dest_nodeID = entry->nodeID;
+        heartbeat.header.type = HEARTBEAT;
+        frame = frame_encode(&heartbeat, sizeof(snp_pkt_t));
+      }
+      sendtoNbr(i, frame);
+      flushNbr(i);
+    }
   }
 
-  close(sfd);
+  if (frame != NULL)
+    frame_release(frame);
+}
 
-  printf("Overlay: accept connection from SNP process...\n");
+// This function runs the event loop of the ON process. It waits for the events of all the connections
+// and dispatches them to their handlers. It returns only if epoll_wait() fails.
+void overlay_run()
+{
+  struct epoll_event events[OVERLAY_MAX_EVENTS];
+  int nfds;
 
-  while (getpktToSend(&pkt, &nbNodeID, network_conn) == 1)
+  while (1)
   {
-    printf("Overlay: receive packet from SNP to send!\n");
-    for (int i = 0; i < size; i++)
+    if (print_stats)
+    {
+      print_stats = 0;
+      overlay_printstats();
+    }
+
+    if ((nfds = epoll_wait(epfd, events, OVERLAY_MAX_EVENTS, -1)) == -1)
     {
-      if (nt[i].nodeID == nbNodeID || nbNodeID == BROADCAST_NODEID)
-        sendpkt(&pkt, nt[i].conn);
+      if (errno == EINTR)
+        continue;
+      printf("Overlay: epoll_wait failed!\n");
+      return;
+    }
+
+    for (int i = 0; i < nfds; i++)
+    {
+      uint32_t tag = events[i].data.u32;
+
+      if (tag == TAG_NBR_LISTEN)
+        acceptNbr();
+      else if (tag == TAG_NETWORK_LISTEN)
+        acceptNetwork();
+      else if (tag == TAG_TIMER)
+        overlay_tick();
+      else if (tag == TAG_SHM_LISTEN)
+        acceptNetworkShm();
+      else if (tag == TAG_SHM_OFFER)
+      {
+        if (shm_offerconn != -1)
+          handleNetworkShmOffer();
+      }
+      else if (tag == TAG_UDP)
+        handleUdp(events[i].events);
+      else if (tag == TAG_NETWORK_RING)
+      {
+        if (network_shm != NULL)
+          handleNetworkRing();
+      }
+      else if (tag == TAG_NETWORK)
+      {
+        if (network_conn != -1)
+          handleNetwork(events[i].events);
+      }
+      else if (tag < size && nt[tag].conn != -1)
+        handleNbr(tag, events[i].events);
     }
   }
 }
@@ -231,23 +913,61 @@ void waitNetwork()
 //it is called when receiving a signal SIGINT
 void overlay_stop()
 {
+  overlay_printstats();
   nt_destroy(nt);
   close(network_conn);
+  connbuf_clear(&network_buf);
+  if (nbr_listenfd != -1)
+    close(nbr_listenfd);
+  if (udp_sock != -1)
+  {
+    close(udp_sock);
+    free(udp_batch);
+  }
+  close(network_listenfd);
+  if (shm_listenfd != -1)
+    close(shm_listenfd);
+  if (shm_offerconn != -1)
+    close(shm_offerconn);
+  close(timerfd);
+  close(epfd);
   exit(1);
 }
 
-int main()
+// This function initializes the ON process: it creates the neighbor table, opens the listening sockets and the timer,
+// and starts the connections to the neighbors with smaller node IDs. "red" in argv selects the RED drop policy,
+// "udp" selects UDP links to the neighbors, in which case the UDP socket is opened instead of the listening socket and no connection is started.
+// The connections are served by overlay_run() afterwards. It exits the process if a listening socket can not be opened.
+void overlay_init(int argc, char *argv[])
 {
+  int policy = QUEUE_TAILDROP;
+  struct itimerspec tick;
+
+  udp_mode = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "red") == 0)
+      policy = QUEUE_RED;
+    else if (strcmp(argv[i], "udp") == 0)
+      udp_mode = 1;
+  }
+
   //start overlay initialization
-  printf("Overlay: Node %d initializing...\n", topology_getMyNodeID());
+  start_time = overlay_now();
+  myNodeID = topology_getMyNodeID();
+  printf("Overlay: Node %d initializing...\n", myNodeID);
 
   //create a neighbor table
   nt = nt_create();
   //initialize network_conn to -1, means no SNP process is connected yet
   network_conn = -1;
+  network_shm = NULL;
+  connbuf_init(&network_buf, OVERLAY_QUEUE_LIMIT, QUEUE_TAILDROP);
 
   //register a signal handler which is sued to terminate the process
   signal(SIGINT, overlay_stop);
+  //register a signal handler which is used to print out the queue metrics
+  signal(SIGUSR1, overlay_requeststats);
 
   //print out all the neighbors
   int nbrNum = topology_getNbrNum();
@@ -256,34 +976,74 @@ int main()
   for (i = 0; i < nbrNum; i++)
   {
     printf("Overlay: neighbor %d:%d\n", i + 1, nt[i].nodeID);
+    nt[i].buf.policy = policy;
   }
+  printf("Overlay: neighbor queues use %s drop policy\n", policy == QUEUE_RED ? "RED" : "tail");
+  printf("Overlay: links to the neighbors use %s\n", udp_mode ? "UDP" : "TCP");
 
-  //start the waitNbrs thread to wait for incoming connections from neighbors with larger node IDs
-  pthread_t waitNbrs_thread;
-  pthread_create(&waitNbrs_thread, NULL, waitNbrs, (void *)0);
+  if ((epfd = epoll_create1(0)) == -1)
+  {
+    printf("Overlay: create epoll instance failed!\n");
+    exit(1);
+  }
 
-  //wait for other nodes to start
-  sleep(5);
+  nbr_listenfd = -1;
+  udp_sock = -1;
+  udp_pollout = 0;
+  if (udp_mode)
+  {
+    //the datagrams of all the links are received on one socket, a link comes up with the first datagram from the neighbor
+    if ((udp_sock = udplink_open(CONNECTION_PORT)) == -1)
+      exit(1);
+    udp_batch = udpbatch_create();
+    watchConn(udp_sock, TAG_UDP);
+  }
+  else
+  {
+    //wait for incoming connections from neighbors with larger node IDs, they are accepted by the event loop
+    if ((nbr_listenfd = openListener(CONNECTION_PORT)) == -1)
+      exit(1);
+    watchConn(nbr_listenfd, TAG_NBR_LISTEN);
+  }
 
-  //connect to neighbors with smaller node IDs
-  connectNbrs();
+  //start the timer driving the reconnections and the heartbeats
+  if ((timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)) == -1)
+  {
+    printf("Overlay: create timer failed!\n");
+    exit(1);
+  }
+  tick.it_interval.tv_sec = OVERLAY_TICK / 1000;
+  tick.it_interval.tv_nsec = (OVERLAY_TICK % 1000) * 1000000;
+  tick.it_value = tick.it_interval;
+  timerfd_settime(timerfd, 0, &tick, NULL);
+  watchConn(timerfd, TAG_TIMER);
 
-  //wait for waitNbrs thread to return
-  pthread_join(waitNbrs_thread, NULL);
+  //connect to neighbors with smaller node IDs, the failed connections are retried by the event loop
+  if (!udp_mode)
+    connectNbrs();
 
-  //at this point, all connections to the neighbors are created
+  //wait for the connection from the SNP process, it is accepted by the event loop
+  if ((network_listenfd = openListener(OVERLAY_PORT)) == -1)
+    exit(1);
+  watchConn(network_listenfd, TAG_NETWORK_LISTEN);
+
+  //the shared memory channel is optional, the SNP process falls back to the TCP connection without it
+  shm_offerconn = -1;
+  if ((shm_listenfd = shmchannel_listen(OVERLAY_SHM_NAME)) == -1)
+    printf("Overlay: can't listen for shared memory channels\n");
+  else
+    watchConn(shm_listenfd, TAG_SHM_LISTEN);
 
-  //create threads listening to all the neighbors
-  for (i = 0; i < nbrNum; i++)
-  {
-    int *idx = (int *)malloc(sizeof(int));
-    *idx = i;
-    pthread_t nbr_listen_thread;
-    pthread_create(&nbr_listen_thread, NULL, listen_to_neighbor, (void *)idx);
-  }
   printf("Overlay: node initialized...\n");
   printf("Overlay: waiting for connection from SNP process...\n");
+}
+
+#ifndef EMBEDDED_STACK
+int main(int argc, char *argv[])
+{
+  overlay_init(argc, argv);
 
-  //waiting for connection from  SNP process
-  waitNetwork();
+  //serve all the connections
+  overlay_run();
 }
+#endif
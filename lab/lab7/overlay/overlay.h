@@ -7,24 +7,167 @@
 #ifndef OVERLAY_H
 #define OVERLAY_H
 
+#include <stdint.h>
 #include "../common/constants.h"
 #include "../common/pkt.h"
 #include "neighbortable.h"
 
-// This thread opens a TCP port on CONNECTION_PORT and waits for the incoming connection from all the neighbors that have a larger node ID than my nodeID,
-// After all the incoming connections are established, this thread terminates
-void *waitNbrs();
+// This function opens a nonblocking TCP port on the given port number for incoming connections.
+// The listening socket descriptor is returned if success, otherwise return -1.
+int openListener(int port);
 
-// This function connects to all the neighbors that have a smaller node ID than my nodeID
-// After all the outgoing connections are established, return 1, otherwise return -1
-int connectNbrs();
+// This function adds the connection conn with the given tag to the epoll instance.
+// The connection is polled for readability.
+void watchConn(int conn, uint32_t tag);
 
-//This function opens a TCP port on OVERLAY_PORT, and waits for the incoming connection from local SNP process. After the local SNP process is connected, this function keeps getting send_arg_t structures from SNP process, and sends the packets to the next hop in the overlay network.
-void waitNetwork();
+// This function updates the epoll registration of the connection conn after its write queue changed.
+// The connection is polled for writability only while its write queue is not empty.
+void watchWrite(int conn, uint32_t tag, connbuf_t *cb);
 
-//Each listen_to_neighbor thread keeps receiving packets from a neighbor. It handles the received packets by forwarding the packets to the SNP process.
-//all listen_to_neighbor threads are started after all the TCP connections to the neighbors are established
-void *listen_to_neighbor(void *arg);
+// This function returns the time of a monotonic clock in milliseconds.
+long long overlay_now();
+
+// This function tells the SNP process the state of the link to the neighbor with the given index in the neighbor table.
+// A LINK_UP or LINK_DOWN packet with the neighbor's node ID as src_nodeID is queued to the SNP process.
+// A link event is never sent again, so the drop policy of the queue to the SNP process does not apply to it.
+// If the shared memory channel to the SNP process is full, the state is reported again by overlay_tick().
+void reportLink(int idx);
+
+// This function schedules the next connection attempt to the neighbor with the given index in the neighbor table.
+// The delay doubles after every failed attempt, from RECONNECT_MIN_DELAY up to RECONNECT_MAX_DELAY milliseconds.
+void scheduleRetry(int idx);
+
+// This function starts a nonblocking connection to the neighbor with the given index in the neighbor table.
+// The neighbor goes to NBR_CONNECTING and the connection is polled for writability until the connect completes.
+// If the connect fails right away, the next attempt is scheduled.
+void connectNbr(int idx);
+
+// This function starts the connections to all the neighbors that have a smaller node ID than my nodeID.
+// The connections complete in the event loop, and the failed ones are retried with an exponential backoff.
+void connectNbrs();
+
+// This function brings up the link to the neighbor with the given index in the neighbor table on the established connection conn.
+// The connection is polled for readability and the SNP process is told that the link is up. conn is -1 for a UDP link.
+// The first time the links to all the neighbors are up, the time since the ON process started is printed.
+void linkUp(int idx, int conn);
+
+// This function completes the nonblocking connect to the neighbor with the given index in the neighbor table.
+// The link is brought up if the connect succeeded, otherwise the next attempt is scheduled.
+void finishConnect(int idx);
+
+// This function closes the connection to the neighbor with the given index in the neighbor table.
+// All the frames still queued to the neighbor are dropped, and the SNP process is told that the link is down.
+// A neighbor with a smaller node ID than my nodeID is reconnected after the reconnection backoff.
+// A UDP link has no connection to close, it comes back up with the next datagram from the neighbor.
+void closeNbr(int idx);
+
+// This function closes the connection to the SNP process.
+// All the frames still queued to the SNP process are dropped.
+void closeNetwork();
+
+// This function accepts an incoming connection from a neighbor that has a larger node ID than my nodeID.
+// The connection is set to nonblocking, assigned to the neighbor's entry in the neighbor table and added to the event loop.
+void acceptNbr();
+
+// This function accepts the incoming connection from the local SNP process.
+// Only one SNP process can be connected at a time. The SNP process is told the state of the links to all the neighbors.
+void acceptNetwork();
+
+// This function queues an encoded packet frame to the neighbor with the given index in the neighbor table.
+// The frame is shared, not copied, so a broadcast packet is encoded only once for all the neighbors.
+// The packet is dropped if the link to the neighbor is not up or if the drop policy of the neighbor's queue rejects it.
+// On a UDP link the packet is sent even if the link is down.
+void sendtoNbr(int idx, frame_t *frame);
+
+// This function writes the frames queued to the neighbor with the given index in the neighbor table.
+// If the connection would block, the remaining frames are written when the connection becomes writable.
+// On a UDP link the frames are sent as datagrams, and the UDP socket is polled for writability if it would block.
+void flushNbr(int idx);
+
+// This function queues a packet received from a neighbor to the SNP process.
+// If the SNP process attached a shared memory channel, the packet is written into the channel instead.
+// The packet is dropped if no SNP process is connected or if the queue or the channel to the SNP process is full.
+void forwardtoNetwork(snp_pkt_t *pkt);
+
+// This function writes a packet into the shared memory channel to the SNP process.
+// Return 1 if the packet is written, -1 if it is dropped because the channel is full.
+int shmtoNetwork(snp_pkt_t *pkt);
+
+// This function writes the frames queued to the SNP process.
+// If the connection would block, the remaining frames are written when the connection becomes writable.
+void flushNetwork();
+
+// This function handles the events of the connection to the neighbor with the given index in the neighbor table.
+// A connection in progress is completed when it becomes writable.
+// The pending frames are flushed when the connection is writable. When the connection is readable,
+// all the complete packets received are queued to the SNP process, which is then flushed once for the whole batch.
+// Heartbeats only refresh the liveness of the link and are not forwarded.
+// With a shared memory channel to the SNP process, the packets are parsed straight into the slots of the channel.
+// Receiving from the neighbor resets its reconnection backoff, so a neighbor which accepts and closes right away is retried less and less often.
+void handleNbr(int idx, uint32_t events);
+
+// This function updates the epoll registration of the UDP socket.
+// The socket is polled for writability only while some datagrams could not be sent because its buffer is full.
+void watchUdpWrite(int pollout);
+
+// This function handles the events of the UDP socket of the links to the neighbors.
+// When the socket is writable, the datagrams still queued to all the neighbors are sent.
+// When the socket is readable, all the datagrams received are accounted on the links of their senders and
+// their packets are queued to the SNP process, which is then flushed once for the whole batch.
+// A datagram from a neighbor which is down brings its link up, datagrams from other hosts are ignored.
+// Heartbeats only refresh the liveness of the link and are not forwarded.
+void handleUdp(uint32_t events);
+
+// This function queues a sendpkt_arg_t received from the SNP process to its next hop.
+// If the next hop's nodeID is BROADCAST_NODEID, the packet is queued to all the neighboring nodes.
+// The packet is encoded once and the same frame is queued to all its next hops.
+void routeFromNetwork(sendpkt_arg_t *pkt_arg);
+
+// This function accepts the connection over which the SNP process offers a shared memory channel on shm_listenfd.
+// The offer is received by handleNetworkShmOffer() once the connection is readable, so the event loop never waits for it.
+// A new offer replaces one still pending.
+void acceptNetworkShm();
+
+// This function receives the shared memory channel offered by the SNP process on shm_offerconn and attaches it.
+// The doorbell of the ring from the SNP process is added to the event loop,
+// and a SHM_ATTACHED packet is sent over network_conn, after which all the packets to the SNP process go through the channel.
+// If the channel can not be attached, the SNP process keeps using network_conn.
+void handleNetworkShmOffer();
+
+// This function handles the doorbell of the shared memory channel from the SNP process.
+// All the sendpkt_arg_ts in the ring are queued to their next hops in place, and every neighbor is flushed once afterwards.
+void handleNetworkRing();
+
+// This function handles the events of the connection to the SNP process.
+// The pending frames are flushed when the connection is writable. When the connection is readable,
+// all the complete sendpkt_arg_t structures received are queued to their next hops.
+// If the next hop's nodeID is BROADCAST_NODEID, the packet is queued to all the neighboring nodes.
+// Every packet is encoded once, and every neighbor is flushed once after the whole batch is queued.
+void handleNetwork(uint32_t events);
+
+// This function prints out the queue metrics of all the neighbors and of the SNP process.
+void overlay_printstats();
+
+// This function is the SIGUSR1 handler, it asks the event loop to print out the queue metrics.
+void overlay_requeststats();
+
+// This function is called by the event loop every OVERLAY_TICK milliseconds.
+// It starts the reconnections whose retry time has come, gives up the connects in progress for longer than LINK_TIMEOUT,
+// closes the links on which nothing has been received for LINK_TIMEOUT
+// and sends a heartbeat on the links on which nothing has been sent for HEARTBEAT_INTERVAL.
+// The link states which did not fit into the shared memory channel to the SNP process are reported again.
+// UDP links are never reconnected, a heartbeat is sent to a neighbor which is down as well, to probe for it coming back.
+void overlay_tick();
+
+// This function initializes the ON process: it creates the neighbor table, opens the listening sockets and the timer,
+// and starts the connections to the neighbors with smaller node IDs. "red" in argv selects the RED drop policy,
+// "udp" selects UDP links to the neighbors, in which case the UDP socket is opened instead of the listening socket and no connection is started.
+// The connections are served by overlay_run() afterwards. It exits the process if a listening socket can not be opened.
+void overlay_init(int argc, char *argv[]);
+
+// This function runs the event loop of the ON process. It waits for the events of all the connections
+// and dispatches them to their handlers. It returns only if epoll_wait() fails.
+void overlay_run();
 
 //this function stops the overlay
 //it closes all the connections and frees all the dynamically allocated memory
@@ -0,0 +1,204 @@
+//FILE: overlay/udplink.c
+//
+//Description: this file implements the UDP links between neighboring ON processes.
+//
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "udplink.h"
+
+//a batch of datagrams received by one recvmmsg() call
+struct udpbatch {
+	struct mmsghdr msg[UDPLINK_BATCH];	//received datagrams, msg_len is the length of each
+	struct iovec iov[UDPLINK_BATCH];	//buffers of the datagrams
+	struct sockaddr_in addr[UDPLINK_BATCH];	//senders of the datagrams
+	char buf[UDPLINK_BATCH][UDPLINK_MAX_LEN];	//link headers and packets
+};
+
+//This function initializes the sequence numbers of a UDP link and resets its loss metrics.
+void udplink_init(udplink_t *link)
+{
+  memset(link, 0, sizeof(udplink_t));
+}
+
+//This function opens a nonblocking UDP socket bound to the given port number for the links to all the neighbors.
+//The socket descriptor is returned if success, otherwise return -1.
+int udplink_open(int port)
+{
+  struct sockaddr_in addr;
+  int sock;
+
+  if ((sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)) == -1)
+  {
+    printf("create UDP socket failed!\n");
+    return -1;
+  }
+
+  memset(&addr, 0, sizeof(struct sockaddr_in));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+
+  if (bind(sock, (struct sockaddr *)&addr, sizeof(struct sockaddr_in)) == -1)
+  {
+    printf("bind address to UDP socket failed!\n");
+    close(sock);
+    return -1;
+  }
+
+  return sock;
+}
+
+//This function sends the frames queued in the write queue of cb as datagrams to the neighbor with the IP address ip.
+//Every datagram carries the next sequence number of the link. Up to UDPLINK_BATCH datagrams are sent by each sendmmsg() call.
+//A datagram which can not be sent for any other reason than a full socket buffer is dropped, like a datagram lost on the way.
+//Return 1 if the write queue is empty, 0 if frames are still pending because the socket would block.
+int udplink_flush(int sock, connbuf_t *cb, udplink_t *link, in_addr_t ip)
+{
+  struct mmsghdr msg[UDPLINK_BATCH];
+  struct iovec iov[UDPLINK_BATCH][2];
+  link_hdr_t hdr[UDPLINK_BATCH];
+  struct sockaddr_in addr;
+  snp_hdr_t pkthdr;
+  wqentry_t *entry;
+  int cnt, n;
+
+  memset(&addr, 0, sizeof(struct sockaddr_in));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = ip;
+  addr.sin_port = htons(CONNECTION_PORT);
+
+  while (cb->whead != NULL)
+  {
+    cnt = 0;
+    for (entry = cb->whead; entry != NULL && cnt < UDPLINK_BATCH; entry = entry->next)
+    {
+      //the frame holds "!&" packet "!#", only the packet header and the used part of the data are sent
+      memcpy(&pkthdr, entry->frame->data + 2, sizeof(snp_hdr_t));
+      if (pkthdr.length > MAX_PKT_LEN)
+        pkthdr.length = MAX_PKT_LEN;
+
+      hdr[cnt].seqNum = link->sendSeq + cnt;
+      iov[cnt][0].iov_base = &hdr[cnt];
+      iov[cnt][0].iov_len = sizeof(link_hdr_t);
+      iov[cnt][1].iov_base = entry->frame->data + 2;
+      iov[cnt][1].iov_len = sizeof(snp_hdr_t) + pkthdr.length;
+
+      memset(&msg[cnt], 0, sizeof(struct mmsghdr));
+      msg[cnt].msg_hdr.msg_name = &addr;
+      msg[cnt].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+      msg[cnt].msg_hdr.msg_iov = iov[cnt];
+      msg[cnt].msg_hdr.msg_iovlen = 2;
+      cnt++;
+    }
+
+    n = sendmmsg(sock, msg, cnt, 0);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return 0;
+      //the first datagram can not be sent, it is dropped and the next ones are tried
+      n = 1;
+    }
+
+    link->sendSeq += n;
+    while (n-- > 0)
+      connbuf_popframe(cb);
+  }
+
+  return 1;
+}
+
+//This function creates an empty batch of UDPLINK_BATCH datagram buffers.
+udpbatch_t *udpbatch_create()
+{
+  udpbatch_t *batch = malloc(sizeof(udpbatch_t));
+
+  for (int i = 0; i < UDPLINK_BATCH; i++)
+  {
+    batch->iov[i].iov_base = batch->buf[i];
+    batch->iov[i].iov_len = UDPLINK_MAX_LEN;
+  }
+
+  return batch;
+}
+
+//This function receives up to UDPLINK_BATCH datagrams from the nonblocking socket sock into batch.
+//Return the number of datagrams received, 0 if none is available.
+int udplink_recv(int sock, udpbatch_t *batch)
+{
+  int n;
+
+  for (int i = 0; i < UDPLINK_BATCH; i++)
+  {
+    memset(&batch->msg[i], 0, sizeof(struct mmsghdr));
+    batch->msg[i].msg_hdr.msg_name = &batch->addr[i];
+    batch->msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    batch->msg[i].msg_hdr.msg_iov = &batch->iov[i];
+    batch->msg[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  do
+  {
+    n = recvmmsg(sock, batch->msg, UDPLINK_BATCH, MSG_DONTWAIT, NULL);
+  } while (n < 0 && errno == EINTR);
+
+  return n < 0 ? 0 : n;
+}
+
+//This function returns the packet carried by the i-th datagram of batch, and its sender's IP address and sequence number.
+//NULL is returned if the datagram is malformed.
+snp_pkt_t *udplink_packet(udpbatch_t *batch, int i, in_addr_t *ip, unsigned int *seqNum)
+{
+  snp_pkt_t *pkt = (snp_pkt_t *)(batch->buf[i] + sizeof(link_hdr_t));
+  unsigned int len = batch->msg[i].msg_len;
+
+  if (len < sizeof(link_hdr_t) + sizeof(snp_hdr_t) ||
+      pkt->header.length > MAX_PKT_LEN ||
+      len != sizeof(link_hdr_t) + sizeof(snp_hdr_t) + pkt->header.length)
+    return NULL;
+
+  *ip = batch->addr[i].sin_addr.s_addr;
+  *seqNum = ((link_hdr_t *)batch->buf[i])->seqNum;
+  return pkt;
+}
+
+//This function accounts a sequence number received on a UDP link.
+//A gap counts the skipped datagrams as lost, a smaller sequence number counts a late datagram which is not lost after all.
+//If resync is set (the link was down), the sequence number is taken as is, since the neighbor may have restarted its numbering.
+void udplink_account(udplink_t *link, unsigned int seqNum, int resync)
+{
+  //the difference is signed, so the comparison survives the wrap around of the sequence numbers
+  int gap = (int)(seqNum - link->recvSeq);
+
+  link->received++;
+
+  if (resync || gap >= 0)
+  {
+    if (!resync)
+      link->lost += gap;
+    link->recvSeq = seqNum + 1;
+  }
+  else
+  {
+    link->late++;
+    if (link->lost > 0)
+      link->lost--;
+  }
+}
+
+//This function prints out the loss metrics of a UDP link.
+void udplink_printstats(udplink_t *link, const char *name)
+{
+  printf("%s link: received %lu lost %lu late %lu\n", name, link->received, link->lost, link->late);
+}
@@ -0,0 +1,73 @@
+//FILE: overlay/udplink.h
+//
+//Description: this file defines the UDP links between neighboring ON processes, used instead of the TCP connections when the ON process is started with "./overlay udp".
+//SRT already retransmits lost segments end to end, so a TCP connection under every overlay hop only adds head of line blocking and a second retransmission timer.
+//On a UDP link every packet is one datagram: a link header carrying the sequence number of the link, then the packet header and the packet data.
+//The sequence numbers only count the lost and the late datagrams of every link, a lost datagram is never retransmitted.
+//All the links share one UDP socket bound to CONNECTION_PORT, the datagrams are sent with sendmmsg() and received with recvmmsg() in batches.
+//
+
+#ifndef UDPLINK_H
+#define UDPLINK_H
+
+#include <netinet/in.h>
+#include "../common/constants.h"
+#include "../common/pkt.h"
+#include "connbuf.h"
+
+//max number of datagrams sent by one sendmmsg() call or received by one recvmmsg() call
+#define UDPLINK_BATCH 16
+
+//link header in front of every datagram
+typedef struct linkheader {
+	unsigned int seqNum;		//sequence number of the datagram on the link, counted from 0 by the sender
+} link_hdr_t;
+
+//max length of a datagram, a packet with MAX_PKT_LEN bytes of data does not fit in one ethernet frame and is fragmented by IP
+#define UDPLINK_MAX_LEN (sizeof(link_hdr_t) + sizeof(snp_pkt_t))
+
+//udplink_t keeps the sequence numbers and the loss metrics of the UDP link to a neighbor
+typedef struct udplink {
+	unsigned int sendSeq;		//sequence number of the next datagram sent to the neighbor
+	unsigned int recvSeq;		//sequence number expected next from the neighbor
+	unsigned long received;		//number of datagrams received
+	unsigned long lost;		//number of sequence numbers skipped and not received late
+	unsigned long late;		//number of datagrams received after a larger sequence number
+} udplink_t;
+
+//a batch of datagrams received by one recvmmsg() call, defined in udplink.c
+typedef struct udpbatch udpbatch_t;
+
+//This function initializes the sequence numbers of a UDP link and resets its loss metrics.
+void udplink_init(udplink_t* link);
+
+//This function opens a nonblocking UDP socket bound to the given port number for the links to all the neighbors.
+//The socket descriptor is returned if success, otherwise return -1.
+int udplink_open(int port);
+
+//This function sends the frames queued in the write queue of cb as datagrams to the neighbor with the IP address ip.
+//Every datagram carries the next sequence number of the link. Up to UDPLINK_BATCH datagrams are sent by each sendmmsg() call.
+//A datagram which can not be sent for any other reason than a full socket buffer is dropped, like a datagram lost on the way.
+//Return 1 if the write queue is empty, 0 if frames are still pending because the socket would block.
+int udplink_flush(int sock, connbuf_t* cb, udplink_t* link, in_addr_t ip);
+
+//This function creates an empty batch of UDPLINK_BATCH datagram buffers.
+udpbatch_t* udpbatch_create();
+
+//This function receives up to UDPLINK_BATCH datagrams from the nonblocking socket sock into batch.
+//Return the number of datagrams received, 0 if none is available.
+int udplink_recv(int sock, udpbatch_t* batch);
+
+//This function returns the packet carried by the i-th datagram of batch, and its sender's IP address and sequence number.
+//NULL is returned if the datagram is malformed.
+snp_pkt_t* udplink_packet(udpbatch_t* batch, int i, in_addr_t* ip, unsigned int* seqNum);
+
+//This function accounts a sequence number received on a UDP link.
+//A gap counts the skipped datagrams as lost, a smaller sequence number counts a late datagram which is not lost after all.
+//If resync is set (the link was down), the sequence number is taken as is, since the neighbor may have restarted its numbering.
+void udplink_account(udplink_t* link, unsigned int seqNum, int resync);
+
+//This function prints out the loss metrics of a UDP link.
+void udplink_printstats(udplink_t* link, const char* name);
+
+#endif
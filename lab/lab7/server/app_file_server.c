@@ -0,0 +1,169 @@
+//FILE: server/app_file_server.c
+
+//Description: this is the file transfer server application code. The server first connects to the local SNP process. Then it initializes the SRT server by calling srt_svr_init(). It creates a socket and waits for connections from file transfer clients by calling srt_server_sock() and srt_server_accept(), one connection at a time. It receives the files sent over the connection, see common/filexfer.h, and writes every piece of FILEXFER_CHUNK bytes into the directory as soon as it arrives, so a file of any size is never held in memory whole. A file sent from an offset is written from that offset, the data the server already has before it is kept. The server prints the throughput of every file, and the offset to resume from if a transfer is interrupted. The server runs until it is killed.
+
+//Date: May 6,2008
+
+//Input: [directory], the current directory by default
+
+//Output: SRT server states, received files
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../common/constants.h"
+#include "../common/filexfer.h"
+#include "srt_server.h"
+#ifdef EMBEDDED_STACK
+#include "../stack/stack.h"
+#endif
+
+//This function connects to the local SNP process on port NETWORK_PORT. If the TCP connection fails, return -1. The TCP socket desciptor returned will be used by SRT to send segments.
+int connectToNetwork() {
+	struct sockaddr_in servaddr;
+
+	servaddr.sin_family = AF_INET;
+	servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+	servaddr.sin_port = htons(NETWORK_PORT);
+
+	int network_conn = socket(AF_INET,SOCK_STREAM,0);
+	if(network_conn<0)
+		return -1;
+	if(connect(network_conn, (struct sockaddr*)&servaddr, sizeof(servaddr))!=0)
+		return -1;
+
+	//succefully connected
+	return network_conn;
+}
+
+//This function returns the time in seconds from an arbitrary starting point.
+double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+//This function receives the file announced by hdr: the name and the data from hdr->offset to the end of the file.
+//The data is written into the file in dir as it arrives. A file name which is not a plain name is refused, its data is received and dropped.
+//Return 1 if the whole file is received, -1 if the connection ends before.
+int recvFile(int sockfd, const char* dir, filexfer_hdr_t* hdr, char* buf) {
+	char name[FILEXFER_MAX_NAME+1];
+	if(hdr->nameLen>FILEXFER_MAX_NAME || hdr->offset>hdr->fileSize || srt_server_recv(sockfd,name,hdr->nameLen)<0)
+		return -1;
+	name[hdr->nameLen] = 0;
+
+	int fd = -1;
+	if(strchr(name,'/')!=NULL || strcmp(name,".")==0 || strcmp(name,"..")==0 || hdr->nameLen==0)
+		printf("refused file name %s, the data is dropped\n",name);
+	else {
+		char path[PATH_MAX];
+		snprintf(path,sizeof(path),"%s/%s",dir,name);
+		//a transfer from offset 0 replaces the file, a resumed one writes after the data already received
+		fd = open(path,O_WRONLY|O_CREAT|(hdr->offset==0?O_TRUNC:0),0644);
+		if(fd<0)
+			printf("can not create %s, the data is dropped\n",path);
+		else {
+			struct stat st;
+			if(hdr->offset>0 && fstat(fd,&st)==0 && (unsigned long long)st.st_size<hdr->offset)
+				printf("%s resumed at %llu but only %llu bytes were received before\n",name,hdr->offset,(unsigned long long)st.st_size);
+		}
+	}
+
+	double start = now();
+	unsigned long long pos = hdr->offset;
+	while(pos<hdr->fileSize) {
+		unsigned int len = hdr->fileSize-pos<FILEXFER_CHUNK?hdr->fileSize-pos:FILEXFER_CHUNK;
+		if(srt_server_recv(sockfd,buf,len)<0) {
+			printf("%s interrupted, resume with -C %llu\n",name,pos);
+			if(fd>=0)
+				close(fd);
+			return -1;
+		}
+		if(fd>=0 && pwrite(fd,buf,len,pos)!=len) {
+			printf("can not write %s at offset %llu, the data is dropped\n",name,pos);
+			close(fd);
+			fd = -1;
+		}
+		pos += len;
+	}
+
+	if(fd>=0) {
+		//an older and longer copy of the file is cut to the new size
+		if(ftruncate(fd,hdr->fileSize)<0)
+			printf("can not truncate %s\n",name);
+		close(fd);
+		double elapsed = now()-start;
+		printf("received %s: %llu bytes from offset %llu in %.2f s, %.2f MB/s\n",name,hdr->fileSize-hdr->offset,hdr->offset,elapsed,elapsed>0?(hdr->fileSize-hdr->offset)/elapsed/1e6:0);
+	}
+	return 1;
+}
+
+int main(int argc, char* argv[]) {
+	const char* dir = argc>1?argv[1]:".";
+
+	//random seed for segment loss
+	srand(time(NULL));
+
+#ifdef EMBEDDED_STACK
+	//run the ON and SNP layers in this process, connectToNetwork() then connects to the SNP layer
+	if(stack_start()<0) {
+		printf("fail to start the embedded stack\n");
+		exit(1);
+	}
+#endif
+
+	//connect to SNP process and get the TCP socket descriptor
+	int network_conn = connectToNetwork();
+	if(network_conn<0) {
+		printf("fail to connect to the local SNP process\n");
+		exit(1);
+	}
+
+	//initialize srt server
+	srt_server_init(network_conn);
+
+	//create a srt server sock at port FILEXFER_SVRPORT
+	int sockfd= srt_server_sock(FILEXFER_SVRPORT);
+	if(sockfd<0) {
+		printf("can't create srt server\n");
+		exit(1);
+	}
+
+	char* buf = (char*) malloc(FILEXFER_CHUNK);
+	while(1) {
+		//srt_server_accept() fails until the previous connection leaves CLOSEWAIT
+		while(srt_server_accept(sockfd)<0)
+			sleep(1);
+		printf("receiving files into %s\n",dir);
+
+		filexfer_hdr_t hdr;
+		int ok = 0;
+		while(srt_server_recv(sockfd,&hdr,sizeof(hdr))>0) {
+			if(hdr.magic!=FILEXFER_MAGIC) {
+				printf("bad file header, the rest of the transfer is dropped\n");
+				break;
+			}
+			if(hdr.nameLen==0) {
+				ok = 1;
+				break;
+			}
+			if(recvFile(sockfd,dir,&hdr,buf)<0)
+				break;
+		}
+		printf("%s\n",ok?"transfer finished":"transfer failed");
+
+		//drop whatever the client still sends until it disconnects
+		while(srt_server_recv(sockfd,buf,1)>0);
+	}
+}
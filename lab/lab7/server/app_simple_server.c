@@ -20,6 +20,9 @@
 #include <time.h>
 #include "../common/constants.h"
 #include "srt_server.h"
+#ifdef EMBEDDED_STACK
+#include "../stack/stack.h"
+#endif
 
 //Two connection are created. One uses client port CLIENTPORT1 and server port SVRPORT1. The other uses client port CLIENTPORT2 and server port SVRPORT2.
 #define CLIENTPORT1 87
@@ -57,6 +60,14 @@ int main() {
 	//random seed for segment loss
 	srand(time(NULL));
 
+#ifdef EMBEDDED_STACK
+	//run the ON and SNP layers in this process, connectToNetwork() then connects to the SNP layer
+	if(stack_start()<0) {
+		printf("fail to start the embedded stack\n");
+		exit(1);
+	}
+#endif
+
 	//connect to local SNP process and get the TCP socket descriptor
 	int network_conn = connectToNetwork();
 	if(network_conn<0) {
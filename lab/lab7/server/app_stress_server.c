@@ -21,6 +21,9 @@
 
 #include "../common/constants.h"
 #include "srt_server.h"
+#ifdef EMBEDDED_STACK
+#include "../stack/stack.h"
+#endif
 
 //One SRT connection is created using client port CLIENTPORT1 and server port SVRPORT1. 
 #define CLIENTPORT1 87
@@ -55,6 +58,14 @@ int main() {
 	//random seed for segment loss
 	srand(time(NULL));
 
+#ifdef EMBEDDED_STACK
+	//run the ON and SNP layers in this process, connectToNetwork() then connects to the SNP layer
+	if(stack_start()<0) {
+		printf("fail to start the embedded stack\n");
+		exit(1);
+	}
+#endif
+
 	//start overlay and get the overlay TCP socket descriptor
 	int network_conn = connectToNetwork();
 	if(network_conn<0) {
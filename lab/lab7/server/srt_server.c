@@ -3,9 +3,12 @@
 //Description: this file contains the SRT server interface implementation
 //
 //Date: April 18,2008
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdio.h>
 #include <sys/select.h>
 #include <strings.h>
@@ -17,10 +20,10 @@
 #include "../topology/topology.h"
 #include "../common/constants.h"
 
-//declare tcbtable as global variable
-svr_tcb_t *tcbtable[MAX_TRANSPORT_CONNECTIONS];
+//declare tcbtable as global variable, static so the SRT client can be linked into the same process
+static svr_tcb_t *tcbtable[MAX_TRANSPORT_CONNECTIONS];
 //declare the connection to the SNP process as global variable
-int network_conn;
+static int network_conn;
 
 /*********************************************************************/
 //
@@ -30,7 +33,7 @@ int network_conn;
 
 //get the tcb indexed by sockfd
 //return 0 if no tcb found
-svr_tcb_t *tcbtable_gettcb(int sockfd)
+static svr_tcb_t *tcbtable_gettcb(int sockfd)
 {
   if (tcbtable[sockfd] != NULL)
     return tcbtable[sockfd];
@@ -40,7 +43,7 @@ svr_tcb_t *tcbtable_gettcb(int sockfd)
 
 //get the tcb with given server port
 //return 0 is no tcb found
-svr_tcb_t *tcbtable_gettcbFromPort(unsigned int serverPort)
+static svr_tcb_t *tcbtable_gettcbFromPort(unsigned int serverPort)
 {
   int i;
   for (i = 0; i < MAX_TRANSPORT_CONNECTIONS; i++)
@@ -57,7 +60,7 @@ svr_tcb_t *tcbtable_gettcbFromPort(unsigned int serverPort)
 //assign the server port with the given port number
 //return the index of the new tcb
 //return -1 if the all tcbs in tcbtable are used or the given port number is used
-int tcbtable_newtcb(unsigned int port)
+static int tcbtable_newtcb(unsigned int port)
 {
   int i;
   for (i = 0; i < MAX_TRANSPORT_CONNECTIONS; i++)
@@ -88,20 +91,28 @@ int tcbtable_newtcb(unsigned int port)
 
 // This function initializes the TCB table marking all entries NULL. It also initializes
 // a global variable for the TCP socket descriptor ``conn'' used as input parameter
-// for snp_sendseg and snp_recvseg. Finally, the function starts the seghandler thread to
+// for snp_sendseg and snp_recvseg, and offers a shared memory channel to the SNP process on it
+// with snp_attachshm. Finally, the function starts the seghandler thread to
 // handle the incoming segments. There is only one seghandler for the server side which
 // handles call connections for the client.
 void srt_server_init(int conn)
 {
   //initialize global variables
-  int i;
+  int i, one = 1;
   for (i = 0; i < MAX_TRANSPORT_CONNECTIONS; i++)
     tcbtable[i] = NULL;
   network_conn = conn;
 
+  //without a shared memory channel, a segment must not wait on conn for the acknowledgement of the previous one
+  setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  //segments go through a shared memory channel if the SNP process attaches one, otherwise over conn
+  if (snp_attachshm(conn) == 1)
+    printf("shared memory channel to SNP process attached\n");
+
   //create seghandler thread
   pthread_t seghandler_thread;
-  pthread_create(&seghandler_thread, NULL, seghandler, (void *)0);
+  pthread_create(&seghandler_thread, NULL, srt_server_seghandler, (void *)0);
 }
 
 // This function looks up the client TCB table to find the first NULL entry, and creates
@@ -128,13 +139,23 @@ int srt_server_sock(unsigned int port)
   assert(recvBuf_mutex != NULL);
   pthread_mutex_init(recvBuf_mutex, NULL);
 
+  //create a condition variable to wake up srt_server_recv() when data arrives
+  pthread_cond_t *recvBuf_cond;
+  recvBuf_cond = (pthread_cond_t *)malloc(sizeof(pthread_cond_t));
+  assert(recvBuf_cond != NULL);
+  pthread_cond_init(recvBuf_cond, NULL);
+
   // initialize  server tcb
   svr_tcb_t *my_servertcb = tcbtable_gettcb(sockfd);
   my_servertcb->svr_nodeID = topology_getMyNodeID();
   my_servertcb->state = CLOSED;
   my_servertcb->usedBufLen = 0;
   my_servertcb->bufMutex = recvBuf_mutex;
+  my_servertcb->bufCond = recvBuf_cond;
   my_servertcb->recvBuf = recvBuf;
+
+  //let the SNP process forward the segments for this port to this process
+  snp_registerport(network_conn, port);
   return sockfd;
 }
 
@@ -181,12 +202,15 @@ int srt_server_accept(int sockfd)
 // Receive data from a srt client.
 // This function keeps polling the receive buffer every RECVBUF_POLLING_INTERVAL
 // until the requested data is available, then it stores the data and returns 1
-// If the function fails, return -1
+// It is woken up as soon as data is saved to the receive buffer.
+// The data received before a FIN can still be read in CLOSEWAIT state.
+// If the function fails, return -1, also when the connection is closed before
+// length bytes arrive or length is larger than RECEIVE_BUF_SIZE
 int srt_server_recv(int sockfd, void *buf, unsigned int length)
 {
   svr_tcb_t *servertcb;
   servertcb = tcbtable_gettcb(sockfd);
-  if (!servertcb)
+  if (!servertcb || length > RECEIVE_BUF_SIZE)
     return -1;
 
   switch (servertcb->state)
@@ -196,32 +220,60 @@ int srt_server_recv(int sockfd, void *buf, unsigned int length)
   case LISTENING:
     return -1;
   case CONNECTED:
-    //continuously poll receive buffer to see if there is enough data
-    while (1)
+  case CLOSEWAIT:
+    //wait on the receive buffer until there is enough data, savedata() signals every new segment
+    pthread_mutex_lock(servertcb->bufMutex);
+    while (servertcb->usedBufLen < length && servertcb->state == CONNECTED)
     {
-      if (servertcb->usedBufLen < length)
-      {
-        sleep(RECVBUF_POLLING_INTERVAL);
-      }
-      else
-      {
-        pthread_mutex_lock(servertcb->bufMutex);
-        char *dest = (char *)buf;
-        memcpy(dest, servertcb->recvBuf, length);
-        memcpy(servertcb->recvBuf, servertcb->recvBuf + length, servertcb->usedBufLen - length);
-        servertcb->usedBufLen = servertcb->usedBufLen - length;
-        pthread_mutex_unlock(servertcb->bufMutex);
-        break;
-      }
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += RECVBUF_POLLING_INTERVAL;
+      pthread_cond_timedwait(servertcb->bufCond, servertcb->bufMutex, &deadline);
+    }
+    if (servertcb->usedBufLen < length)
+    {
+      pthread_mutex_unlock(servertcb->bufMutex);
+      return -1;
     }
+    char *dest = (char *)buf;
+    memcpy(dest, servertcb->recvBuf, length);
+    memmove(servertcb->recvBuf, servertcb->recvBuf + length, servertcb->usedBufLen - length);
+    servertcb->usedBufLen = servertcb->usedBufLen - length;
+    pthread_mutex_unlock(servertcb->bufMutex);
     return 1;
-  case CLOSEWAIT:
-    return -1;
   default:
     return -1;
   }
 }
 
+// This function gives up a CONNECTED connection whose client has gone silent.
+// The state transitions to CLOSEWAIT as if a FIN was received, so a srt_server_recv()
+// waiting fails, and the closewait timer moves it to CLOSED after CLOSEWAIT_TIMEOUT.
+// It returns 1 if the connection is given up and -1 if it is not CONNECTED.
+int srt_server_abort(int sockfd)
+{
+  svr_tcb_t *servertcb;
+  servertcb = tcbtable_gettcb(sockfd);
+  if (!servertcb)
+    return -1;
+
+  pthread_mutex_lock(servertcb->bufMutex);
+  if (servertcb->state != CONNECTED)
+  {
+    pthread_mutex_unlock(servertcb->bufMutex);
+    return -1;
+  }
+  servertcb->state = CLOSEWAIT;
+  pthread_cond_broadcast(servertcb->bufCond);
+  pthread_mutex_unlock(servertcb->bufMutex);
+  printf("SERVER: CONNECTION GIVEN UP, CLOSEWAIT\n");
+
+  pthread_t cwtimer;
+  pthread_create(&cwtimer, NULL, closewait, (void *)servertcb);
+  pthread_detach(cwtimer);
+  return 1;
+}
+
 // This function calls free() to free the TCB entry. It marks that entry in TCB as NULL
 // and returns 1 if succeeded (i.e., was in the right state to complete a close) and -1
 // if fails (i.e., in the wrong state).
@@ -236,6 +288,8 @@ int srt_server_close(int sockfd)
   switch (servertcb->state)
   {
   case CLOSED:
+    pthread_cond_destroy(servertcb->bufCond);
+    free(servertcb->bufCond);
     free(servertcb->bufMutex);
     free(servertcb->recvBuf);
     free(tcbtable[sockfd]);
@@ -257,7 +311,7 @@ int srt_server_close(int sockfd)
 // snp_recvseg() fails then the connection to the SNP process is closed and the thread is terminated. Depending
 // on the state of the connection when a segment is received  (based on the incoming segment) various
 // actions are taken. See the client FSM for more details.
-void *seghandler(void *arg)
+void *srt_server_seghandler(void *arg)
 {
   seg_t segBuf;
   svr_tcb_t *my_servertcb;
@@ -315,13 +369,17 @@ void *seghandler(void *arg)
       }
       else if (segBuf.header.type == FIN && my_servertcb->client_portNum == segBuf.header.src_port && my_servertcb->client_nodeID == src_nodeID)
       {
-        //state transition
+        //state transition, a srt_server_recv() waiting for more data fails
         printf("SERVER: FIN RECEIVED\n");
+        pthread_mutex_lock(my_servertcb->bufMutex);
         my_servertcb->state = CLOSEWAIT;
+        pthread_cond_broadcast(my_servertcb->bufCond);
+        pthread_mutex_unlock(my_servertcb->bufMutex);
         printf("SERVER: CLOSEWAIT\n");
         //start a closewait timer
         pthread_t cwtimer;
         pthread_create(&cwtimer, NULL, closewait, (void *)my_servertcb);
+        pthread_detach(cwtimer);
         //send FINACK back
         fin_received(my_servertcb, &segBuf);
       }
@@ -358,8 +416,9 @@ void *closewait(void *servertcb)
   //timerout, state transitions to CLOSED
   pthread_mutex_lock(my_servertcb->bufMutex);
   my_servertcb->usedBufLen = 0;
-  pthread_mutex_unlock(my_servertcb->bufMutex);
   my_servertcb->state = CLOSED;
+  pthread_cond_broadcast(my_servertcb->bufCond);
+  pthread_mutex_unlock(my_servertcb->bufMutex);
   printf("SERVER: CLOSED\n");
   pthread_exit(NULL);
 }
@@ -427,6 +486,7 @@ int savedata(svr_tcb_t *svrtcb, seg_t *segment)
     memcpy(&svrtcb->recvBuf[svrtcb->usedBufLen], segment->data, segment->header.length);
     svrtcb->usedBufLen = svrtcb->usedBufLen + segment->header.length;
     svrtcb->expect_seqNum = segment->header.length + segment->header.seq_num;
+    pthread_cond_signal(svrtcb->bufCond);
     pthread_mutex_unlock(svrtcb->bufMutex);
     return 1;
   }
@@ -34,6 +34,7 @@ typedef struct svr_tcb {
 	char* recvBuf;                  //a pointer pointing to the receive buffer
 	unsigned int  usedBufLen;       //size of the received data in receive buffer
 	pthread_mutex_t* bufMutex;      //a pointer pointing to the mutex which is used for receive buffer access
+	pthread_cond_t* bufCond;        //signaled when data is saved to the receive buffer or the state changes
 } svr_tcb_t;
 
 
@@ -96,7 +97,20 @@ int srt_server_recv(int sockfd, void* buf, unsigned int length);
 // such as SYN, SYNACK, etc.flow in both directions. 
 // This function keeps polling the receive buffer every RECVBUF_POLLING_INTERVAL
 // until the requested data is available, then it stores the data and returns 1
-// If the function fails, return -1 
+// It is woken up as soon as data is saved to the receive buffer.
+// The data received before a FIN can still be read in CLOSEWAIT state.
+// If the function fails, return -1, also when the connection is closed before
+// length bytes arrive or length is larger than RECEIVE_BUF_SIZE 
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int srt_server_abort(int sockfd);
+
+// This function gives up a CONNECTED connection whose client has gone silent, e.g. a client killed
+// without disconnecting. The state transitions to CLOSEWAIT as if a FIN was received: a srt_server_recv()
+// waiting fails once the buffered data is read, and the connection is CLOSED after CLOSEWAIT_TIMEOUT.
+// It returns 1 if the connection is given up and -1 if it is not CONNECTED.
 //
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
@@ -110,7 +124,7 @@ int srt_server_close(int sockfd);
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
 
-void* seghandler(void* arg);
+void* srt_server_seghandler(void* arg);
 
 // This is a thread  started by srt_server_init(). It handles all the incoming 
 // segments from the client. The design of seghanlder is an infinite loop that calls snp_recvseg(). If
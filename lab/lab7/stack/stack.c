@@ -0,0 +1,53 @@
+//FILE: stack/stack.c
+//
+//Description: this file implements the embedded stack mode, in which the ON, SNP and SRT layers run in one process.
+//overlay/overlay.c and network/network.c are compiled with EMBEDDED_STACK, which leaves out their main(), and are linked with the application.
+//
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "stack.h"
+#include "../common/constants.h"
+#include "../common/pkt.h"
+#include "../common/seg.h"
+#include "../overlay/overlay.h"
+#include "../network/network.h"
+
+//This function is the thread running the event loop of the ON layer.
+static void *stack_overlay(void *arg)
+{
+  overlay_run();
+  printf("stack: ON layer stopped\n");
+  return NULL;
+}
+
+//This function is the thread serving the SRT layer in the SNP layer.
+static void *stack_network(void *arg)
+{
+  network_run();
+  printf("stack: SNP layer stopped\n");
+  return NULL;
+}
+
+//This function starts the ON layer and the SNP layer as threads of the calling process.
+//The ON layer uses tail drop, the SNP layer uses distance vector routing and the shared memory channel to the ON layer.
+//It returns once the SNP layer accepts SRT connections on NETWORK_PORT, so the application can connect to it as to a SNP process.
+//Return 1 if the stack is started, otherwise return -1.
+int stack_start()
+{
+  char *overlay_argv[] = {"overlay", NULL};
+  char *network_argv[] = {"network", "shm", NULL};
+  pthread_t overlay_thread, network_thread;
+
+  //the listening sockets of the ON layer are open when overlay_init() returns, so the SNP layer connects to it right away
+  overlay_init(1, overlay_argv);
+  pthread_create(&overlay_thread, NULL, stack_overlay, NULL);
+  pthread_detach(overlay_thread);
+
+  network_init(2, network_argv);
+  pthread_create(&network_thread, NULL, stack_network, NULL);
+  pthread_detach(network_thread);
+
+  return network_waitserving();
+}
@@ -0,0 +1,18 @@
+//FILE: stack/stack.h
+//
+//Description: this file defines the embedded stack mode, in which the ON, SNP and SRT layers run in one process.
+//An application built with EMBEDDED_STACK calls stack_start() before connecting to the SNP layer. The ON and SNP layers then run as threads of the application,
+//and the packets and segments between the layers go through the in-memory rings of the shared memory channels instead of TCP.
+//The multi-process mode is unchanged, the same application sources build both.
+//
+
+#ifndef STACK_H
+#define STACK_H
+
+//This function starts the ON layer and the SNP layer as threads of the calling process.
+//The ON layer uses tail drop, the SNP layer uses distance vector routing and the shared memory channel to the ON layer.
+//It returns once the SNP layer accepts SRT connections on NETWORK_PORT, so the application can connect to it as to a SNP process.
+//Return 1 if the stack is started, otherwise return -1.
+int stack_start();
+
+#endif
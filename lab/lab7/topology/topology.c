@@ -302,15 +302,15 @@ int topology_getNodeArray_Parse(char *firstHost, char *secondHost, int cost, voi
   if (find(a, firstID) == -1)
   {
     a->array = realloc(a->array, (a->size + 1) * sizeof(int));
-    a->size++;
     a->array[a->size] = firstID;
+    a->size++;
   }
 
   if (find(a, secondID) == -1)
   {
     a->array = realloc(a->array, (a->size + 1) * sizeof(int));
-    a->size++;
     a->array[a->size] = secondID;
+    a->size++;
   }
 
   return -1;
@@ -331,8 +331,8 @@ int topology_getNbrArray_Parse(char *firstHost, char *secondHost, int cost, void
     if (find(a, ID) == -1)
     {
       a->array = realloc(a->array, (a->size + 1) * sizeof(int));
-      a->size++;
       a->array[a->size] = ID;
+      a->size++;
     }
   }
 